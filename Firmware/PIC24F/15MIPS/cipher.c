@@ -0,0 +1,120 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        cipher.c Speck64/128 CTR for the Feature reports.
+ *
+ *---------------------------------------------------------------------------*/
+#include "main.h"
+
+#define ROR8(x)                 (((x) >> 8) | ((x) << 24))
+#define ROL3(x)                 (((x) << 3) | ((x) >> 29))
+
+static DWORD RoundKey[CPH_ROUNDS];
+static BYTE Ready;                  /* a key has been expanded             */
+static DWORD Nonce;
+static DWORD Block[2];              /* keystream of the block Counter       */
+static DWORD Counter;
+static BYTE Valid;                  /* Block[] belongs to Nonce, Counter    */
+
+static DWORD CPH_dwLoad(const BYTE *dat)
+{
+    return dat[0] | ((DWORD)dat[1] << 8) |
+        ((DWORD)dat[2] << 16) | ((DWORD)dat[3] << 24);
+}
+
+void CPH_vInit(const BYTE *key)
+{
+    DWORD k, l[3];
+    BYTE i, j;
+
+    /*-------------------------------------------------------------------------
+    ** the key schedule of Speck runs the round function on the key words
+    ** with the round number as its key. it's done once here, so a block
+    ** costs only the 27 rounds of cph.s.
+    **-----------------------------------------------------------------------*/
+    k = CPH_dwLoad(key);
+    for (i=0; i<3; i++)
+    {
+        l[i] = CPH_dwLoad(key+4+4*i);
+    }
+    for (i=0, j=0; i<CPH_ROUNDS; i++)
+    {
+        RoundKey[i] = k;
+        l[j] = (ROR8(l[j]) + k) ^ i;
+        k = ROL3(k) ^ l[j];
+        j = j == 2? 0:j+1;
+    }
+    Ready = 1;
+    Valid = 0;
+}
+
+BYTE CPH_bReady(void)
+{
+    return Ready;
+}
+
+void CPH_vNonce(const BYTE *nonce)
+{
+    DWORD n = CPH_dwLoad(nonce);
+
+    /* the block kept stays good for the same nonce again */
+    if (n != Nonce)
+    {
+        Nonce = n;
+        Valid = 0;
+    }
+}
+
+void CPH_vCrypt(BYTE *dat, WORD pos, BYTE len, DWORD dir)
+{
+    DWORD ctr;
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** XOR the keystream into len bytes of the payload from byte pos, in
+    ** place. the same call encrypts and decrypts. a packet of 8 bytes spans
+    ** two blocks at most, and the last block is kept for the next packet.
+    **-----------------------------------------------------------------------*/
+    for (i=0; i<len; i++, pos++)
+    {
+        ctr = (pos >> 3) | dir;
+        if (!Valid || ctr != Counter)
+        {
+            Block[0] = Nonce;
+            Block[1] = ctr;
+            _cphEncrypt(Block, RoundKey);
+            Counter = ctr;
+            Valid = 1;
+        }
+        dat[i] ^= ((BYTE*)Block)[pos & 7];
+    }
+}
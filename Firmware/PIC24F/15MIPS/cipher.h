@@ -0,0 +1,63 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        cipher.h Header file for cipher.c and cph.s.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _CIPHER_H_ /* this file has been included into main.h */
+#define _CIPHER_H_
+
+/*-----------------------------------------------------------------------------
+** Speck64/128 in CTR mode. the 128-bit key is expanded into CPH_ROUNDS round
+** keys in RAM once, and a block of keystream is Speck of [nonce:4][ctr:4]
+** with ctr = the block of the payload, bit 31 set for the device's reports.
+** the host sends a new nonce in clear with every report, a nonce MUST NOT
+** be used twice with the same key. CTR hides the data but doesn't protect
+** it, a changed bit of the ciphertext flips the same bit of the command.
+**---------------------------------------------------------------------------*/
+#define CPH_ROUNDS              27
+#define CPH_NONCE_SIZE          4
+#define CPH_RX                  0x00000000UL    /* host to device */
+#define CPH_TX                  0x80000000UL    /* device to host */
+
+void CPH_vInit(const BYTE *key);
+
+BYTE CPH_bReady(void);
+
+void CPH_vNonce(const BYTE *nonce);
+
+void CPH_vCrypt(BYTE *dat, WORD pos, BYTE len, DWORD dir);
+
+/* one block in place, blk[0] is x and blk[1] is y, in cph.s */
+extern void _cphEncrypt(DWORD *blk, const DWORD *rk);
+
+#endif
@@ -0,0 +1,124 @@
+;; ----------------------------------------------------------------------------
+;; Copyright (C) 2019-2020 Zach Lee.
+;;
+;; Licensed under the MIT License, you may not use this file except in
+;; compliance with the License.
+;;
+;; MIT License:
+;;
+;; Permission is hereby granted, free of charge, to any person obtaining
+;; a copy of this software and associated documentation files (the "Software"),
+;; to deal in the Software without restriction, including without limitation
+;; the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;; and/or sell copies of the Software, and to permit persons to whom the
+;; Software is furnished to do so, subject to the following conditions:
+;;
+;; The above copyright notice and this permission notice shall be included in
+;; all copies or substantial portions of the Software.
+;;
+;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+;; THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+;; FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+;; IN THE SOFTWARE.
+;;
+;; ----------------------------------------------------------------------------
+;;
+;; $Date:        11. May 2020
+;; $Revision:    V0.0.0
+;;
+;; Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+;; Title:        cph.s One block of Speck64/128 for cipher.c.
+;;
+;;-----------------------------------------------------------------------------
+;;
+;; void _cphEncrypt(DWORD *blk, const DWORD *rk)
+;;
+;; encrypts blk[0] (x) and blk[1] (y) in place with the 27 round keys rk[].
+;; a round is x = (x >>> 8) + y ^ k, y = (y <<< 3) ^ x on the 32-bit words.
+;; x lives in w1:w0 and y in w3:w2. the rotation by 8 is 2 SWAPs and an
+;; exchange of the low bytes, which leaves the high word of x in w0, so the
+;; rounds go in pairs, the second one with w0 and w1 the other way round.
+;; it uses w0..w7 only, which a C function may change. the cycles are for
+;; PIC24F and dsPIC33F alike, see Tools/Cipher/cphsim.py.
+;;
+;;-----------------------------------------------------------------------------
+        .text
+        .global __cphEncrypt
+
+__cphEncrypt:
+        mov     w0, [w15++]             ; 1 (blk for the end)
+        mov     w1, w4                  ; 1 (rk)
+        mov     [w0+2], w1              ; 1 (x high)
+        mov     [w0+4], w2              ; 1 (y low)
+        mov     [w0+6], w3              ; 1 (y high)
+        mov     [w0], w0                ; 1 (x low)
+        mov     #13, w7                 ; 1 (13 pairs of rounds, then one)
+
+__cph_pair:
+        swap    w0                      ; 1 (x >>> 8, w0 is high now)
+        swap    w1                      ; 1
+        mov.b   w0, w5                  ; 1
+        mov.b   w1, w0                  ; 1
+        mov.b   w5, w1                  ; 1
+        add     w1, w2, w1              ; 1 (+ y)
+        addc    w0, w3, w0              ; 1
+        xor     w1, [w4++], w1          ; 1 (^ k)
+        xor     w0, [w4++], w0          ; 1
+        lsr     w2, #13, w5             ; 1 (y <<< 3)
+        lsr     w3, #13, w6             ; 1
+        sl      w2, #3, w2              ; 1
+        sl      w3, #3, w3              ; 1
+        ior     w2, w6, w2              ; 1
+        ior     w3, w5, w3              ; 1
+        xor     w2, w1, w2              ; 1 (^ x)
+        xor     w3, w0, w3              ; 1
+
+        swap    w1                      ; 1 (x >>> 8, w0 is low again)
+        swap    w0                      ; 1
+        mov.b   w1, w5                  ; 1
+        mov.b   w0, w1                  ; 1
+        mov.b   w5, w0                  ; 1
+        add     w0, w2, w0              ; 1 (+ y)
+        addc    w1, w3, w1              ; 1
+        xor     w0, [w4++], w0          ; 1 (^ k)
+        xor     w1, [w4++], w1          ; 1
+        lsr     w2, #13, w5             ; 1 (y <<< 3)
+        lsr     w3, #13, w6             ; 1
+        sl      w2, #3, w2              ; 1
+        sl      w3, #3, w3              ; 1
+        ior     w2, w6, w2              ; 1
+        ior     w3, w5, w3              ; 1
+        xor     w2, w0, w2              ; 1 (^ x)
+        xor     w3, w1, w3              ; 1
+
+        dec     w7, w7                  ; 1
+        bra     nz, __cph_pair          ; 2/1
+
+        swap    w0                      ; 1 (the 27th round)
+        swap    w1                      ; 1
+        mov.b   w0, w5                  ; 1
+        mov.b   w1, w0                  ; 1
+        mov.b   w5, w1                  ; 1
+        add     w1, w2, w1              ; 1 (+ y)
+        addc    w0, w3, w0              ; 1
+        xor     w1, [w4++], w1          ; 1 (^ k)
+        xor     w0, [w4++], w0          ; 1
+        lsr     w2, #13, w5             ; 1 (y <<< 3)
+        lsr     w3, #13, w6             ; 1
+        sl      w2, #3, w2              ; 1
+        sl      w3, #3, w3              ; 1
+        ior     w2, w6, w2              ; 1
+        ior     w3, w5, w3              ; 1
+        xor     w2, w1, w2              ; 1 (^ x)
+        xor     w3, w0, w3              ; 1
+
+        mov     [--w15], w4             ; 1 (blk)
+        mov     w1, [w4]                ; 1 (x low, w0 is high)
+        mov     w0, [w4+2]              ; 1
+        mov     w2, [w4+4]              ; 1
+        mov     w3, [w4+6]              ; 1
+        return                          ; 3
+        .end
@@ -0,0 +1,2 @@
+python ..\..\..\Tools\DescGen\descgen.py ..\..\..\Tools\DescGen\vusb.desc -o desc
+pause
@@ -35,25 +35,177 @@
  *---------------------------------------------------------------------------*/
 #include "main.h"
 
+static WORD Done;
+static DWORD Sunk;                  /* bytes taken by SINK                   */
+static WORD LoadTicks;              /* Timer3 ticks LOAD adds to a command   */
+
+/* Timer3 runs free at Fcy/8, usb.c sets it up */
+#define TICKS_PER_MS    ((WORD)(FCY / 8 / 1000))
+
+/* the processing time LOAD asks for, taken by each benchmark command */
+static void Spin(void)
+{
+    WORD t0 = TMR3;
+
+    while ((WORD)(TMR3 - t0) < LoadTicks)
+    {
+    }
+}
+
+/* [count:2] -> [count:2][done:2] */
+static WORD Delay(const BYTE *req, BYTE *rsp, WORD len)
+{
+    WORD Req;
+
+    Req = req[0] + req[1]*256;
+    rsp[0] = req[0];
+    rsp[1] = req[1];
+    while(Req--)
+    {
+        /* prevent empty loop optimazation of GCC */
+        _RB15 = 1;
+    }
+    /* a count makes each result new */
+    Done++;
+    rsp[2] = Done & 0xFF;
+    rsp[3] = Done >> 8;
+    return 4;
+}
+
+/* any bytes -> the inverted bytes, as HID_wCmdEcho() */
+static WORD Echo(const BYTE *req, BYTE *rsp, WORD len)
+{
+    Spin();
+    return HID_wCmdEcho(req, rsp, len);
+}
+
+/* any bytes -> [bytes:4], what SINK has taken since the start */
+static WORD Sink(const BYTE *req, BYTE *rsp, WORD len)
+{
+    Spin();
+    Sunk += len;
+    rsp[0] = Sunk & 0xFF;
+    rsp[1] = (Sunk >> 8) & 0xFF;
+    rsp[2] = (Sunk >> 16) & 0xFF;
+    rsp[3] = Sunk >> 24;
+    return 4;
+}
+
+/* the bytes of SOURCE, (i*7)^0x5A as hid_bench has them, read from flash */
+static const BYTE Pattern[64] =
+{
+    0x5A, 0x5D, 0x54, 0x4F, 0x46, 0x79, 0x70, 0x6B,
+    0x62, 0x65, 0x1C, 0x17, 0x0E, 0x01, 0x38, 0x33,
+    0x2A, 0x2D, 0x24, 0xDF, 0xD6, 0xC9, 0xC0, 0xFB,
+    0xF2, 0xF5, 0xEC, 0xE7, 0x9E, 0x91, 0x88, 0x83,
+    0xBA, 0xBD, 0xB4, 0xAF, 0xA6, 0x59, 0x50, 0x4B,
+    0x42, 0x45, 0x7C, 0x77, 0x6E, 0x61, 0x18, 0x13,
+    0x0A, 0x0D, 0x04, 0x3F, 0x36, 0x29, 0x20, 0xDB,
+    0xD2, 0xD5, 0xCC, 0xC7, 0xFE, 0xF1, 0xE8, 0xE3,
+};
+
+/* [count:1] -> count bytes of Pattern[], the host reads as many as it asks */
+static WORD Source(const BYTE *req, BYTE *rsp, WORD len)
+{
+    /* one for each response in the queue, and one for EP1 */
+    static HID_SEGMENT Seg[HID_QUEUE_SLOTS+1];
+    HID_SEGMENT *seg = &Seg[HID_bReplySlot()];
+
+    Spin();
+    seg->dat = Pattern;
+    seg->siz = req[0] < sizeof(Pattern)? req[0]:sizeof(Pattern);
+    HID_vReplyFrom(seg, 1);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------
+** [seq:2] -> [seq:2][frame:2][ticks:2][ticks a ms:2]. the time it's handled,
+** the frame of USB_wFrame() and Timer3 ticks since its keep-alive.
+**---------------------------------------------------------------------------*/
+static WORD Ping(const BYTE *req, BYTE *rsp, WORD len)
+{
+    WORD frame, ticks;
+
+    do
+    {
+        /* the ISR may come between the two reads */
+        frame = _frame;
+        ticks = TMR3 - _frametime;
+    } while (frame != _frame);
+    Spin();
+    rsp[0] = req[0];
+    rsp[1] = req[1];
+    rsp[2] = frame & 0xFF;
+    rsp[3] = frame >> 8;
+    rsp[4] = ticks & 0xFF;
+    rsp[5] = ticks >> 8;
+    rsp[6] = TICKS_PER_MS & 0xFF;
+    rsp[7] = TICKS_PER_MS >> 8;
+    return 8;
+}
+
+/* [us:2] -> [us:2] the load each benchmark command takes from now on */
+static WORD Load(const BYTE *req, BYTE *rsp, WORD len)
+{
+    DWORD ticks, us;
+
+    us = req[0] + req[1]*256;
+    ticks = us * TICKS_PER_MS / 1000;
+    LoadTicks = ticks < 0xFFFF? ticks:0xFFFF;
+    us = (DWORD)LoadTicks * 1000 / TICKS_PER_MS;
+    rsp[0] = us & 0xFF;
+    rsp[1] = us >> 8;
+    return 2;
+}
+
+/* indexed by the opcode, the 1st byte of a command */
+const HID_COMMAND HID_Commands[] =
+{
+    {Echo, 0, 0},               /* 0x00 */
+    {Delay, 2, 4},              /* 0x01 */
+    {NULL, 0, 0},               /* 0x02, was PEEK of any RAM */
+    {Sink, 0, 4},               /* 0x03 */
+    {Source, 1, 0},             /* 0x04 */
+    {Ping, 2, 8},               /* 0x05 */
+    {Load, 2, 2},               /* 0x06 */
+#ifdef DSP_SERVICE
+    {DSP_wCmdTaps, 1, 1},       /* 0x07 */
+    {DSP_wCmdFir, 1, 1},        /* 0x08 */
+    {DSP_wCmdDot, 1, 4},        /* 0x09 */
+    {DSP_wCmdFft, 1, 1+4*(DSP_MAX_FFT/2+1)},    /* 0x0A */
+#endif
+};
+const BYTE HID_NumCommands = sizeof(HID_Commands)/sizeof(HID_Commands[0]);
+
+/*-----------------------------------------------------------------------------
+** the key of the ciphered Feature reports. it's no part of the sources, the
+** build gets its 16 bytes as -DCPH_KEY=0x..,0x..,... (usb.bat passes
+** %CPH_KEY%), and HID_Test -e takes the same bytes in hex.
+**---------------------------------------------------------------------------*/
+#ifndef CPH_KEY
+#error "build with -DCPH_KEY=the 16 bytes of the key, comma separated"
+#endif
+static const BYTE Key[] = { CPH_KEY };
+typedef char KEY_MUST_BE_16_BYTES[sizeof(Key) == 16? 1:-1];
+
 void setup(void)
 {
     _TRISB15 = 0; /* drive the LED on RB15 */
+    CPH_vInit(Key);
     HID_vInit(0);
 }
 
 void loop(void)
 {
-    WORD Req;
+    BYTE Buf[8];
 
     _RB15 = 0;
 
-    if (HID_bRxRequest(&Req, sizeof(Req)) == 1)
+    /* take the stream as it comes, the host checks it by its sum */
+    while(STR_wRead(Buf, sizeof(Buf)) != 0)
     {
-        while(Req--)
-        {
-            /* prevent empty loop optimazation of GCC */
-            _RB15 = 1;
-        }
-        HID_bTxResult(&Req, sizeof(Req));
     }
+
+    /* a command is handled in here by HID_Commands[] */
+    HID_bRxRequest();
 }
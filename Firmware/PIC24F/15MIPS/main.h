@@ -42,12 +42,19 @@ typedef unsigned char   BYTE;
 typedef unsigned short  WORD;
 typedef unsigned long   DWORD;
 
+/* the instruction clock sie.s is generated for */
+#define FCY             15000000UL
+
 #ifndef NULL
 #define NULL            ((void*)0)
 #endif
 
+#include "desc.h"
 #include "usb.h"
 #include "hid.h"
+#include "stream.h"
+#include "cipher.h"
+#include "lz.h"
 
 extern void _dbg_led_on(void);
 extern void _dbg_die(void);
@@ -0,0 +1,2 @@
+python ..\..\..\Tools\SIEGen\siegen.py --target PIC24F --fcy 15 -o sie.s
+pause
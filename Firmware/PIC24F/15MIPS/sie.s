@@ -32,6 +32,10 @@
 ;; Project:      Yet Another Firmware Based USB on Microchip dsPIC33
 ;; Title:        sie.s The serial transmission processing code.
 ;;
+;; This file is generated by Tools/SIEGen/siegen.py from sie.s.in for the
+;; PIC24F16KA101 running at 15 MIPS (10 cycles per bit). Please modify the
+;; template or the generator and run sie.bat instead of editing it by hand.
+;;
 ;;-----------------------------------------------------------------------------
 .equ    __24F16KA101, 1
 .include "p24F16KA101.inc"
@@ -46,6 +50,9 @@
         .bss
         .global __uendpt0
         .global __ucontr0
+        .global __eptab
+        .global __frame
+        .global __frametime
 ;;-----------------------------------------------------------------------------
 ; bit defination of __uendpt0:
 ; __uendpt0[15-12] - UNUSED
@@ -64,12 +71,48 @@ __uendpt0:  .space  2
 ; __ucontr0[14] - PID ERROR.
 ; __ucontr0[13] - DEVICE ADDRESS MATCHED. =1 means address of token is matched
 ; __ucontr0[12] - DATA TOGGLE expected. =0/1 means DATA1/DATA0
-; __ucontr0[11-8] - UNUSED
+; __ucontr0[11] - EP0 STALL FLAG. =1 means STALL to IN/OUT until next SETUP
+; __ucontr0[10-8] - UNUSED
 ; __ucontr0[7-4] - BYTES LENGTH to host.
 ; __ucontr0[3-2] - HANDSHAKE for OUT TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
 ; __ucontr0[1-0] - HANDSHAKE for IN TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
 ;;-----------------------------------------------------------------------------
 __ucontr0:  .space  2
+;;-----------------------------------------------------------------------------
+; the frame counter. the host sends a keep-alive (an EOP) at the start of each
+; 1ms frame to a low speed device, __keepAlive of the ISR counts them.
+;;-----------------------------------------------------------------------------
+__frame:    .space  2
+__frametime:.space  2                   ; Timer3 at the last keep-alive
+;;-----------------------------------------------------------------------------
+; the endpoints EP1..EP1 besides EP0, 8 bytes each and indexed by ENDP-1.
+; the ISR dispatches a token on its ENDP field and reaches the endpoint by a
+; pointer into the table, so every endpoint has the same timing.
+; +0 IN word, +2 OUT word, +4 IN buffer (_datai), +6 OUT buffer (_datao)
+;
+; bit defination of the IN word:
+; IN[15] - DATA DONE. =1 means the host has ACKed the armed DATA
+; IN[14-13] - UNUSED
+; IN[12] - DATA TOGGLE expected. =0/1 means DATA1/DATA0
+; IN[11] - HALT FLAG. =1 means STALL to IN until it's cleared
+; IN[10-8] - UNUSED
+; IN[7-4] - BYTES LENGTH to host.
+; IN[3-2] - UNUSED
+; IN[1-0] - HANDSHAKE for IN TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+;
+; bit defination of the OUT word:
+; OUT[15-12] - UNUSED
+; OUT[11] - HALT FLAG. =1 means STALL to OUT until it's cleared
+; OUT[10] - DATA TOGGLE expected. =0/1 means DATA0/DATA1
+; OUT[9] - PACKET DONE. =1 means a packet is in the OUT buffer
+; OUT[8] - UNUSED
+; OUT[7-4] - BYTES LENGTH from host.
+; OUT[3-2] - HANDSHAKE for OUT TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+; OUT[1-0] - UNUSED
+;;-----------------------------------------------------------------------------
+__eptab:    .space  8*1
+_epsent:    .space  2                   ; the entry whose DATA waits for ACK
+_epout:     .space  2                   ; the entry of the last OUT token
 _addr:      .space  1                   ; device address (SET ADDRESS)
 _conf:      .space  1                   ; configuration (SET CONFIGURATION)
 ;;-----------------------------------------------------------------------------
@@ -79,6 +122,8 @@ _packet:    .space  2                   ; a data buffer pointer points to
 _token:     .space  12
 _datax:     .space  12
 _datay:     .space  12
+_datai:     .space  12*1            ; the DATA armed on EP1..EP1
+_datao:     .space  12*1            ; the packet received on EP1..EP1
 
 ;;-----------------------------------------------------------------------------
         .text
@@ -90,14 +135,15 @@ _datay:     .space  12
 ;;-----------------------------------------------------------------------------
 __CNInterrupt:                          ; cycle-counter (5 cycles latency ISR)
         push.s                          ; 6 (w0-w3 could be used now)
-        mov     _PORTU, w0              ; 7 sample D-/D+
-        and     #DPDM, w0               ; 8 (is it a SE0?)
-        bra     z, __SE0                ; 9 (SE0, BUS RESET or RESUME)
+        push    RCOUNT                  ; 7 (a REPEAT broken into goes on later)
+        mov     _PORTU, w0              ; 8 sample D-/D+
+        and     #DPDM, w0               ; 9 (is it a SE0?)
+        bra     z, __SE0                ; 0 (SE0, BUS RESET or RESUME)
 ;;-----------------------------------------------------------------------------
 __waitJ:
         ; last 3 bits (JKK) of SYNC is important
         ; step 1: make sure the current bit is a J (D-/D+ =10)
-        btss    _PORTU, #DM             ; 0 (last cycle of this bit)
+        btss    _PORTU, #DM
         bra     __waitJ
 __waitK:
         ; step 2: capture the edge between J & K
@@ -116,18 +162,16 @@ __SOPError:
         bset    __ucontr0, #15          ; __ucontr0[15] =1 means SOP ERROR
         bra     __IRQExit
 ;;-----------------------------------------------------------------------------
-__SE0:                                  ; 0 (add 1 cycle for 'bra z, __SE0')
-        repeat  #2                      ; 1
-        nop                             ; 2/3/4
+__SE0:                                  ; 1 (add 1 cycle for 'bra z, __SE0')
+        nop                             ; 2
+        nop                             ; 3
+        nop                             ; 4
         mov     _PORTU, w0              ; 5 (sample D-/D+)
         and     #DPDM, w0               ; 6 (is it a SE0 yet?)
         bra     nz, __IRQExit           ; 7 (no, just ignore it)
-        nop                             ; 8 (2nd SE0 detected, if a J-state is
-        nop                             ; 9  following, that would be keep
-        nop                             ; 0  alive signal)
-;;-----------------------------------------------------------------------------
-        repeat  #1                      ; 1
-        nop                             ; 2/3
+        repeat  #4                      ; 8 (2nd SE0 detected, if a J-state is
+        nop                             ; 9/0/1/2/3  following, that would be
+                                        ;  keep alive signal)
         mov     #(1<<DM), w1            ; 4
         mov     _PORTU, w0              ; 5 (sample D-/D+)
         and     #DPDM, w0               ; 6 (is it a SE0 yet?)
@@ -135,6 +179,7 @@ __SE0:                                  ; 0 (add 1 cycle for 'bra z, __SE0')
         cp      w0, w1                  ; 8 (J-state?)
         bra     z, __keepAlive          ; 9
         bra     __IRQExit               ; 0
+                                        ; 1
 ;;-----------------------------------------------------------------------------
 __BUSReset:
         repeat  #8                      ; 10 cycles for 1 bits
@@ -146,14 +191,19 @@ __BUSReset:
         mov     w0, _packet             ; prepare for first SETUP token
         mov     #0, w0                  ; clear some vars
         mov.b   WREG, _addr             ; usb device address must be cleared
+        mov.b   WREG, _conf             ; so must the configuration
         mov     WREG, __uendpt0
         mov     #0x000A, w0             ; __ucontr0[1-0] =10, NAK to IN token
         mov     WREG, __ucontr0         ; __ucontr0[3-2] =10, NAK to OUT token
+        rcall   __EPReset               ; NAK and DATA0 on the other endpoints
         bset    __uendpt0, #11          ; __uendpt0[11] =1 means BUS RESET
         bset    __uendpt0, #10          ; REQUEST FLAG =1, inform the app
         bra     __IRQExit               ; a BUS RESET issued
 ;;-----------------------------------------------------------------------------
-__keepAlive:                            ; nothing should do now
+__keepAlive:                            ; a new frame of 1ms begins
+        mov     TMR3, w0                ; take the time of it, usb.c trims the
+        mov     w0, __frametime         ; FRC by the length of 8 frames
+        inc     __frame                 ; count it
         bra     __IRQExit
 ;;-----------------------------------------------------------------------------
 __firstK:                               ; (4 cycles maximum latency)
@@ -164,8 +214,8 @@ __firstK:                               ; (4 cycles maximum latency)
         bset    w1, #DP                 ; 9 (w1.0 =D+ =1, 1st K)
         bset    w0, #DP                 ; 0 (w0.0 =D+ =1, 2nd K)
 ;;-----------------------------------------------------------------------------
-        push    w4                      ; 1 (second K)
-        push    w5                      ; 2 (we need more registers)
+        push    w4                      ; 1 (we need more registers)
+        push    w5                      ; 2
         setm    w5                      ; 3 (for bit unstuff)
         mov     #0x003f, w3             ; 4
         btsc    _PORTU, #DP             ; 5 (capture the second K)
@@ -265,7 +315,7 @@ __bit5:
         bra     z, __unstuff6           ; 0 (add 1 cycle if 'bra z' is taken)
 ;;-----------------------------------------------------------------------------
 __bit6:
-        xor     w0, w1, w0              ; 1 (if w0.0 =DP, means 'no_switched')
+        xor     w0, w1, w0              ; 1 (if w0.DP =0, means 'no_switched')
         btst.c  w0, #DP                 ; 2 (move w0.DP into SR.C. it's bit6)
         rlc.b   w5, w5                  ; 3 (then shift this bit into w5)
         btst.c  w5, #0                  ; 4 (move this bit into SR.C again)
@@ -395,45 +445,94 @@ __BranchTable0:                         ; 6/7
 __PIDError:                             ; continue 2nd SE0 of EOP
         bset    __ucontr0, #14          ; 8 (__ucontr0[14] =1 means PID ERROR)
         bra     __CNIntEnd              ; 9
-                                        ; 0 (last cycle of 2nd SE0)
+                                        ; 0
 ;;-----------------------------------------------------------------------------
 __isSetup:
         mov     #_token, w0             ; 8 (buffer '_token' will be also used
         mov     WREG, _packet           ; 9  to gather UNRELATED packet)
         com.b   [++w1], w0              ; 0 (fetch the device address byte)
 ;;-----------------------------------------------------------------------------
-        and     #0x7F, w0               ; 1 (first cycle of 1st J-state)
+        and     #0x7F, w0               ; 1
         cp.b    _addr                   ; 2 (device address MUST be matched)
         bra     nz, __CNIntEnd          ; 3 (+1 cycle if address not matched)
         bset    __ucontr0, #13          ; 4 (__ucontr0[13] =1, address matched)
-        mov     #_datax, w0             ; 5 (buffer '_datax' will be used to 
-        mov     WREG, _packet           ; 6  gather SETUP packet)
-        clr.b   __uendpt0               ; 7 (clear the length/toggle/handshake)
-        bclr    __ucontr0, #12          ; 8 (__ucontr0[12] =0,DATA1 for IN/OUT)
-        bra     __CNIntEnd              ; 9 (__uendpt0[1-0] is 00 now. it will
-                                        ; 0  be 01. means a SETUP TOKEN)
+        clr     _epout                  ; 5 (the DATA packet is not for EPn)
+        mov     #_datax, w0             ; 6 (buffer '_datax' will be used to 
+        mov     WREG, _packet           ; 7  gather SETUP packet)
+        clr.b   __uendpt0               ; 8 (clear the length/toggle/handshake)
+        bclr    __ucontr0, #12          ; 9 (__ucontr0[12] =0,DATA1 for IN/OUT)
+        bclr    __ucontr0, #11          ; 0 (a SETUP clears the EP0 STALL FLAG)
+;;-----------------------------------------------------------------------------
+        bra     __CNIntEnd              ; 1 (__uendpt0[1-0] is 00 now. it will
+                                        ; 2  be 01. means a SETUP TOKEN)
 ;;-----------------------------------------------------------------------------
 __isOut:                                ; continue 2nd SE0 of EOP
         mov     #_token, w0             ; 8 (buffer '_token' will be also used
         mov     WREG, _packet           ; 9  to gather UNRELATED packet)
-        com.b   [++w1], w0              ; 0 (fetch the device address byte)
-;;-----------------------------------------------------------------------------
-        and     #0x7F, w0               ; 1 (first cycle of 1st J-state)
-        cp.b    _addr                   ; 2 (device address MUST be matched)
-        bra     nz, __CNIntEnd          ; 3 (+1 cycle if address not matched)
-        bset    __ucontr0, #13          ; 4 (__ucontr0[13] =1, address matched)
-        mov     #_datax, w0             ; 5 (buffer '_datax' is used for DATA0)
-        btss    __uendpt0, #3           ; 6 (buffer '_datay' is used for DATA1)
-        mov     #_datay, w0             ; 7 (use _datay if DATA TOGGLE is 0)
-        mov     w0, _packet             ; 8 (prepare to gather the DATA packet)
-        bra     __CNIntEnd              ; 9 (__uendpt0[1-0] will be switched to
-                                        ; 0  11 when we respond an ACK to the
-                                        ;    host)
+        com.b   [++w1], w0              ; 0 (device address byte, w0.7 =ENDP[0])
+;;-----------------------------------------------------------------------------
+        mov.b   [w1+1], w3              ; 1 (w3[2-0] =~ENDP[3-1])
+        and     w3, #0x07, w3           ; 2
+        btst.c  w0, #7                  ; 3 (SR.C =ENDP[0])
+        rlc     w3, w3                  ; 4 (w3 =index of the endpoint)
+        bra     w3                      ; 5/6
+__EndpointTableOut:                     ; 7/8
+        bra     __CNIntEnd              ; ENDP = 14 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 15 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 12 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 13 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 10 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 11 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 8 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 9 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 6 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 7 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 4 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 5 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 2 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 3 (no such endpoint)
+        bra     __isOut0                ; ENDP = 0
+        bra     __outEP1                ; ENDP = 1
+;;-----------------------------------------------------------------------------
+__isOut0:                               ; 8 (+1 cycle for the entry of the table)
+        cp.b    _addr                   ; 9 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 0 (+1 cycle if address not matched)
+;;-----------------------------------------------------------------------------
+        bset    __ucontr0, #13          ; 1 (__ucontr0[13] =1, address matched)
+        clr     _epout                  ; 2 (the DATA packet is not for EPn)
+        mov     #_datax, w0             ; 3 (buffer '_datax' is used for DATA0)
+        btss    __uendpt0, #3           ; 4 (buffer '_datay' is used for DATA1)
+        mov     #_datay, w0             ; 5 (use _datay if DATA TOGGLE is 0)
+        mov     w0, _packet             ; 6 (prepare to gather the DATA packet)
+        bra     __CNIntEnd              ; 7 (__uendpt0[1-0] will be switched to
+                                        ; 8  11 when we respond an ACK to the
+                                        ;   host)
+;;-----------------------------------------------------------------------------
+__outEP1:                               ; 8 (+1 cycle for the entry of the table)
+        mov     #__eptab+0, w3          ; 9 (w3 points to EP1)
+        bra     __isOutEP               ; 0
+                                        ; 1
+;;-----------------------------------------------------------------------------
+__isOutEP:                              ; 1 (+1 cycle for 'bra __isOutEP')
+        and     #0x7F, w0               ; 2 (discard ENDP[0])
+        cp.b    _addr                   ; 3 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 4 (+1 cycle if address not matched)
+        bclr    __ucontr0, #13          ; 5 (the DATA packet is not for EP0,
+        mov     w3, _epout              ; 6  but for this endpoint)
+        mov     [w3+2], w0              ; 7 (w0 =OUT word of the endpoint)
+        and     #0x0C, w0               ; 8 (fetch OUT word[3-2])
+        cp.b    w0, #0x04               ; 9 (is it an ACK?)
+        mov     [w3+6], w0              ; 0 (its OUT buffer is used if it is
+;;-----------------------------------------------------------------------------
+        btsc    _SR, #Z                 ; 1  armed, or the packet goes to
+        mov     w0, _packet             ; 2  '_token')
+        bra     __CNIntEnd              ; 3
+                                        ; 4
 ;;-----------------------------------------------------------------------------
 __isData1:                              ; continue 2nd SE0 of EOP
         btss    __ucontr0, #13          ; 8 (device address MUST be matched)
-        bra     __CNIntEnd              ; 9 (+1 cycle if address not matched)
-        nop                             ; 0 (last cycle of 2nd SE0)
+        bra     __epData1               ; 9 (+1 cycle if it is not for EP0)
+        nop                             ; 0
 ;;-----------------------------------------------------------------------------
         mov     __ucontr0, w3           ; 1 (continue if dev addr is matched)
         and     #0x0C, w3               ; 2 (fetch __ucontr0[3-2])
@@ -444,12 +543,12 @@ __isData1:                              ; continue 2nd SE0 of EOP
         bset    __uendpt0, #3           ; 7 (__uendpt0[3] =1, DATA1)
         mov     #_token+1, w6           ; 8 (w6 points to the PID byte)
         bra     __HandShake             ; 9 (send handshake to the host)
-                                        ; 0 (last cycle of 1st J-state)
+                                        ; 0
 ;;-----------------------------------------------------------------------------
 __isData0:                              ; data packet for SETUP or OUT ?
         btss    __ucontr0, #13          ; 8 (device address MUST be matched)
-        bra     __CNIntEnd              ; 9 (+1 cycle if address not matched)
-        nop                             ; 0 (last cycle of 2nd SE0)
+        bra     __epData0               ; 9 (+1 cycle if it is not for EP0)
+        nop                             ; 0
 ;;-----------------------------------------------------------------------------
         mov     __ucontr0, w3           ; 1 (continue if dev addr is matched)
         and     #0x0C, w3               ; 2 (fetch __ucontr0[3-2])
@@ -463,7 +562,7 @@ __isData0:                              ; data packet for SETUP or OUT ?
         mov     #_token+1, w6           ; 0 (w6 points to the PID byte)
 ;;-----------------------------------------------------------------------------
 __HandShake:                            ; handshake according to w4[3-2]
-        sub     w2, w1, w2              ; 1 (1st cycle of 2nd J-state)
+        sub     w2, w1, w2              ; 1
         mov     #2, w1                  ; 2 (w1 =2 means 2 bytes will be sent)
         and     w4, #0x0C, w0           ; 3 (w4[3-2] =handshake)
         cp.b    w0, #0x04               ; 4 (is it an ACK? w0[3-0] =0100?)
@@ -473,9 +572,9 @@ __HandShake:                            ; handshake according to w4[3-2]
 __SendBytes:                            ; now w0 =PID, w1 =bytes length
         com     w0, w5                  ; 8 (w5 will be the PID sent to host)
         swap.b  w0                      ; 9 (calclate 4 bits nPID)
-        and     #0x0F, w5               ; 0 (last cycle of 2nd J-state)
+        and     #0x0F, w5               ; 0
 ;;-----------------------------------------------------------------------------
-        ior     w0, w5, w5              ; 1 (first cycle of 3rd J-state)
+        ior     w0, w5, w5              ; 1
         mov.b   w5, [w6--]              ; 2 (w5 is the PID sent to the host)
         setm.b  [w6]                    ; 3 (w6 points to the SYNC byte)
         bclr.b  [w6], #7                ; 4 (clear bit7 of SYNC, so SYNC =7F)
@@ -599,22 +698,26 @@ __bytes:                                ; all bytes are sent completely
         ior.b   __uendpt0               ; 0 (__uendpt0[7-0] has been cleared)
 ;;-----------------------------------------------------------------------------
 __nextSE0:
-        mov     #_token, w1             ; 1 (prepare to receive next TOKEN)
-        mov     w1, _packet             ; 2
-        mov     __ucontr0, w1           ; 3
-        mov     #0xD000, w0             ; 4 (device address NOT matched now)
-        and     w1, w0, w1              ; 5
-        ior     w1, #0xA, w1            ; 6 (NAK to OUT and IN)
+        mov     #0xD800, w0             ; 1 (device address NOT matched now,
+        and     __ucontr0, WREG         ; 2  but keep the EP0 STALL FLAG)
+        ior     w0, #0xA, w1            ; 3 (NAK to OUT and IN)
+        btsc    w1, #11                 ; 4 (STALL to OUT and IN instead if
+        ior     w1, #0xF, w1            ; 5  the EP0 STALL FLAG is set)
+        btss    w4, #8                  ; 6 (keep __ucontr0 if it was EPn)
         mov     w1, __ucontr0           ; 7
-        mov     #DPDM, w0               ; 8 (last cycle of 2nd SE0)
+        mov     #DPDM, w0               ; 8 (the 2nd SE0 ends)
         ior     _TRISU                  ; 9 (D-/D+ are on INPUT mode now)
-        bra     __CNIntEnd              ; 0 (+1 cycle for 'bra __CNIntEnd')
+        mov     #_token, w1             ; 0 (prepare to receive next TOKEN)
+;;-----------------------------------------------------------------------------
+        mov     w1, _packet             ; 1
+        bra     __CNIntEnd              ; 2
+                                        ; 3
 ;;-----------------------------------------------------------------------------
 __dostuff:                              ; 5 (+1 cycle for 'bra z, __dostuff')
         nop                             ; 6 (SR.C MUST NOT be affected)
         nop                             ; 7
-        nop                             ; 8 (insert a 1 at w5.0, that means we
-        bset    w5, #0                  ; 9  will insert a stuff-bit)
+        nop                             ; 8
+        bset    w5, #0                  ; 9 (insert a 1 at w5.0, the stuff-bit)
         mov     #DPDM, w0               ; 0 (w0 is #DPDM, make J-K flipping)
 ;;-----------------------------------------------------------------------------
         xor     _LATU                   ; 1 (generate stuff-bit)
@@ -623,43 +726,169 @@ __dostuff:                              ; 5 (+1 cycle for 'bra z, __dostuff')
 __done:                                 ; branch to '__done + w2 * 2'
 ;;-----------------------------------------------------------------------------
 __isIn:
-        com.b   [++w1], w0              ; 8 (device address byte)
-        and     #0x7F, w0               ; 9
-        cp.b    _addr                   ; 0 (device address MUST be matched)
-;;-----------------------------------------------------------------------------
-        bra     nz, __CNIntEnd          ; 1 (+1 cycle if address not matched)
-        mov     __ucontr0, w0           ; 2 (check __ucontr0[1-0])
-        and     #0x03, w0               ; 3 (w0[1-0] =PID sent to host)
-        sl      w0, #2, w4              ; 4 (w4[3-2] =PID on __uendpt0)
-        cp.b    w0, #0x01               ; 5 (is it ACK?)
-        bra     z, __respond            ; 6 (yes, send DATA packet to host)
+        com.b   [++w1], w0              ; 8 (device address byte, w0.7 =ENDP[0])
+        mov.b   [w1+1], w3              ; 9 (w3[2-0] =~ENDP[3-1])
+        and     w3, #0x07, w3           ; 0
+;;-----------------------------------------------------------------------------
+        btst.c  w0, #7                  ; 1 (SR.C =ENDP[0])
+        rlc     w3, w3                  ; 2 (w3 =index of the endpoint)
+        bra     w3                      ; 3/4
+__EndpointTableIn:                      ; 5/6
+        bra     __CNIntEnd              ; ENDP = 14 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 15 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 12 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 13 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 10 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 11 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 8 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 9 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 6 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 7 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 4 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 5 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 2 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 3 (no such endpoint)
+        bra     __isIn0                 ; ENDP = 0
+        bra     __inEP1                 ; ENDP = 1
+;;-----------------------------------------------------------------------------
+__isIn0:                                ; 6 (+1 cycle for the entry of the table)
+        cp.b    _addr                   ; 7 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 8 (+1 cycle if address not matched)
+        clr     _epsent                 ; 9 (the next ACK is not for EPn)
+        mov     __ucontr0, w0           ; 0 (check __ucontr0[1-0])
+;;-----------------------------------------------------------------------------
+        and     #0x03, w0               ; 1 (w0[1-0] =PID sent to host)
+        sl      w0, #2, w4              ; 2 (w4[3-2] =PID on __uendpt0)
+        cp.b    w0, #0x01               ; 3 (is it ACK?)
+        bra     z, __respond            ; 4 (yes, send DATA packet to host)
+        nop                             ; 5
+        nop                             ; 6
         nop                             ; 7
         mov     #_token+1, w6           ; 8 (w6 points to the PID byte)
         bra     __HandShake             ; 9
-                                        ; 0 (last cycle of 1st J-state)
-;;-----------------------------------------------------------------------------
-__respond:                              ; 7 (+1 cycle for 'bra z, __respond')
-        ior.b   w4, #2, w4              ; 8 (w4[1-0] =TOKEN TYPE, =10, IN)
-        mov.b   #0x03, w0               ; 9 (2nd cycle of 2nd J-state,w0=DATA0)
-        btss    __ucontr0, #12          ; 0 (if __ucontr0[12]==0, then set
-;;-----------------------------------------------------------------------------
-        mov.b   #0x0B, w0               ; 1  w0 =1011, DATA1)
-        mov     __ucontr0, w1           ; 2 (__ucontr0[7-4] =bytes length)
-        lsr     w1, #4, w1              ; 3
-        and     w1, #0xF, w1            ; 4 (w1 =bytes length)
-        add     w1, #4, w1              ; 5 (+SYNC, +PID, +CRC16)
-        dec     w1, w2                  ; 6 (w2 is for '__uendpt0[7-4]')
-        mov     #_datay+1, w6           ; 7 (w6 points to the PID byte)
-        repeat  #6                      ; 8/9/0
-;;-----------------------------------------------------------------------------
-        nop                             ; 1/2/3/4/5
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__respond:                              ; 5 (+1 cycle for 'bra z, __respond')
+        ior.b   w4, #2, w4              ; 6 (w4[1-0] =TOKEN TYPE, =10, IN)
+        mov.b   #0x03, w0               ; 7 (w0 =DATA0)
+        btss    __ucontr0, #12          ; 8 (if __ucontr0[12]==0, then set
+        mov.b   #0x0B, w0               ; 9  w0 =1011, DATA1)
+        mov     __ucontr0, w1           ; 0 (__ucontr0[7-4] =bytes length)
+;;-----------------------------------------------------------------------------
+        lsr     w1, #4, w1              ; 1
+        and     w1, #0xF, w1            ; 2 (w1 =bytes length)
+        add     w1, #4, w1              ; 3 (+SYNC, +PID, +CRC16)
+        dec     w1, w2                  ; 4 (w2 is for '__uendpt0[7-4]')
+        mov     #_datay+1, w6           ; 5 (w6 points to the PID byte)
+        bra     __SendBytes             ; 6
+                                        ; 7
+;;-----------------------------------------------------------------------------
+__inEP1:                                ; 6 (+1 cycle for the entry of the table)
+        mov     #__eptab+0, w3          ; 7 (w3 points to EP1)
+        bra     __isInEP                ; 8
+                                        ; 9
+;;-----------------------------------------------------------------------------
+__isInEP:                               ; 9 (+1 cycle for 'bra __isInEP')
+        and     #0x7F, w0               ; 0 (discard ENDP[0])
+;;-----------------------------------------------------------------------------
+        cp.b    _addr                   ; 1 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 2 (+1 cycle if address not matched)
+        mov     [w3], w0                ; 3 (check IN word[1-0])
+        and     #0x03, w0               ; 4 (w0[1-0] =PID sent to host)
+        sl      w0, #2, w4              ; 5 (w4[3-2] =NAK or STALL)
+        cp.b    w0, #0x01               ; 6 (is it ACK?)
+        bra     z, __respondEP          ; 7 (yes, send the DATA to host)
+        bset    w4, #8                  ; 8 (w4[8] =1, not EP0)
+        repeat  #7                      ; 9
+        nop                             ; 0/1/2/3/4/5/6/7
+        mov     #_token+1, w6           ; 8 (w6 points to the PID byte)
+        bra     __HandShake             ; 9
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__respondEP:                            ; 8 (+1 cycle for 'bra z, __respondEP')
+        mov     #0x0100, w4             ; 9 (w4[8] =1, w4[3-0] =0000)
+        mov     w3, _epsent             ; 0 (the next ACK is for this endpoint)
+;;-----------------------------------------------------------------------------
+        mov.b   #0x03, w0               ; 1 (w0 =DATA0)
+        btss    [w3], #12               ; 2 (if IN word[12]==0, then set
+        mov.b   #0x0B, w0               ; 3  w0 =1011, DATA1)
+        mov     [w3], w1                ; 4 (IN word[7-4] =bytes length)
+        lsr     w1, #4, w1              ; 5
+        and     w1, #0xF, w1            ; 6 (w1 =bytes length)
+        add     w1, #4, w1              ; 7 (+SYNC, +PID, +CRC16)
+        dec     w1, w2                  ; 8
+        mov     [w3+4], w6              ; 9 (w6 points to the IN buffer,
+        inc     w6, w6                  ; 0  then to the PID byte)
+;;-----------------------------------------------------------------------------
+        repeat  #3                      ; 1
+        nop                             ; 2/3/4/5
         bra     __SendBytes             ; 6
                                         ; 7
 ;;-----------------------------------------------------------------------------
+__epData1:                              ; 0 (+1 cycle for 'bra __epData1')
+        mov     _epout, w3              ; 1 (w3 points to the endpoint of the
+        cp0     w3                      ; 2  OUT token, or it is 0)
+        bra     z, __CNIntEnd           ; 3 (no, ignore it)
+        mov     [w3+2], w0              ; 4 (w0 =OUT word of the endpoint)
+        sub     w2, w1, w6              ; 5
+        sub     w6, #3, w6              ; 6 (w6 =bytes length, -PID -CRC16)
+        sl      w6, #4, w6              ; 7
+        mov     #0x060C, w5             ; 8 (set PACKET DONE, switch toggle,
+        xor     w0, w5, w5              ; 9  ACK -> NAK)
+        ior     w5, w6, w5              ; 0 (w5 =OUT word if it is taken)
+;;-----------------------------------------------------------------------------
+        mov     #0x040C, w6             ; 1
+        and     w0, w6, w6              ; 2 (w6 =toggle and handshake)
+        mov     #0x0404, w4             ; 3 (ACK and DATA1 expected?)
+        cp      w6, w4                  ; 4
+        btsc    _SR, #Z                 ; 5 (yes, take the packet)
+        mov     w5, [w3+2]              ; 6
+        mov     #0x0100, w4             ; 7 (w4[8] =1, not EP0)
+        and     w0, #0x0C, w6           ; 8 (send NAK or STALL if it is not
+        btsc    w0, #3                  ; 9  armed. w4[3-2] =00 means ACK)
+        ior     w4, w6, w4              ; 0
+;;-----------------------------------------------------------------------------
+        clr     _epout                  ; 1
+        repeat  #4                      ; 2
+        nop                             ; 3/4/5/6/7
+        mov     #_token+1, w6           ; 8 (w6 points to the PID byte)
+        bra     __HandShake             ; 9
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__epData0:                              ; 0 (+1 cycle for 'bra __epData0')
+        mov     _epout, w3              ; 1 (w3 points to the endpoint of the
+        cp0     w3                      ; 2  OUT token, or it is 0)
+        bra     z, __CNIntEnd           ; 3 (no, ignore it)
+        mov     [w3+2], w0              ; 4 (w0 =OUT word of the endpoint)
+        sub     w2, w1, w6              ; 5
+        sub     w6, #3, w6              ; 6 (w6 =bytes length, -PID -CRC16)
+        sl      w6, #4, w6              ; 7
+        mov     #0x060C, w5             ; 8 (set PACKET DONE, switch toggle,
+        xor     w0, w5, w5              ; 9  ACK -> NAK)
+        ior     w5, w6, w5              ; 0 (w5 =OUT word if it is taken)
+;;-----------------------------------------------------------------------------
+        mov     #0x040C, w6             ; 1
+        and     w0, w6, w6              ; 2 (w6 =toggle and handshake)
+        mov     #0x0004, w4             ; 3 (ACK and DATA0 expected?)
+        cp      w6, w4                  ; 4
+        btsc    _SR, #Z                 ; 5 (yes, take the packet)
+        mov     w5, [w3+2]              ; 6
+        mov     #0x0100, w4             ; 7 (w4[8] =1, not EP0)
+        and     w0, #0x0C, w6           ; 8 (send NAK or STALL if it is not
+        btsc    w0, #3                  ; 9  armed. w4[3-2] =00 means ACK)
+        ior     w4, w6, w4              ; 0
+;;-----------------------------------------------------------------------------
+        clr     _epout                  ; 1
+        repeat  #4                      ; 2
+        nop                             ; 3/4/5/6/7
+        mov     #_token+1, w6           ; 8 (w6 points to the PID byte)
+        bra     __HandShake             ; 9
+                                        ; 0
+;;-----------------------------------------------------------------------------
 __isStall:
         mov     #0x0007, w0             ; 8
         and     __uendpt0, WREG         ; 9 (check __uendpt0[2-0])
-        cp      w0, #6                  ; 0 (it MUST be 110, ACK & IN)
+        cp      w0, #6                  ; 0 (it must be 110, ACK & IN)
 ;;-----------------------------------------------------------------------------
         bra     nz, __CNIntEnd          ; 1 (no, this STALL is not sent to us)
         nop                             ; 2
@@ -668,15 +897,17 @@ __isStall:
                                         ; 5  REQUEST flag)
 ;;-----------------------------------------------------------------------------
 __isAck:
-        mov     #0x0007, w0             ; 8
-        and     __uendpt0, WREG         ; 9 (check __uendpt0[2-0])
-        cp      w0, #6                  ; 0 (it must be 110, ACK & IN)
-;;-----------------------------------------------------------------------------
-        bra     nz, __CNIntEnd          ; 1 (no, this ACK is not sent to us)
-        btg     __ucontr0, #12          ; 2 (switch DATA TOGGLE)
-        mov     #0x0500, w1             ; 3 (REQUEST FLAG & ACK from host)
-        bra     __hostHandShake         ; 4 (w1[9-8] =01, ACK. w1[10] =1, set
-                                        ; 5  REQUEST flag)
+        cp0     _epsent                 ; 8 (is it the ACK of a DATA on EPn?)
+        bra     nz, __isAckEP           ; 9
+        mov     #0x0007, w0             ; 0
+;;-----------------------------------------------------------------------------
+        and     __uendpt0, WREG         ; 1 (check __uendpt0[2-0])
+        cp      w0, #6                  ; 2 (it must be 110, ACK & IN)
+        bra     nz, __CNIntEnd          ; 3 (no, this ACK is not sent to us)
+        btg     __ucontr0, #12          ; 4 (switch DATA TOGGLE)
+        mov     #0x0500, w1             ; 5 (REQUEST FLAG & ACK from host)
+        bra     __hostHandShake         ; 6 (w1[9-8] =01, ACK. w1[10] =1, set
+                                        ; 7  REQUEST flag)
 ;;-----------------------------------------------------------------------------
 __isNak:
         mov     #0x0007, w0             ; 8
@@ -689,30 +920,39 @@ __isNak:
         bclr    __ucontr0, #1           ; 4  DATA packet will be resent)
         mov     #0x0600, w1             ; 5 (REQUEST FLAG & NAK from host)
 ;;-----------------------------------------------------------------------------
-__hostHandShake:                        ; +1 cycle for 'bra __hostHandShake'
-        mov     #0xF8FF, w0             ; 6
-        and     __uendpt0               ; 7
-        mov     w1, w0                  ; 8
-        ior     __uendpt0               ; 9
-;;-----------------------------------------------------------------------------
-__CNIntEnd:                             ; 8 cycles total
+__hostHandShake:                        ; the packet is over, no more timing
+        mov     #0xF8FF, w0
+        and     __uendpt0
+        mov     w1, w0
+        ior     __uendpt0
+        bra     __CNIntEnd
+;;-----------------------------------------------------------------------------
+__isAckEP:                              ; the host has got the DATA
+        mov     _epsent, w1             ; w1 points to the endpoint
+        clr     _epsent
+        mov     #0x1003, w0             ; switch DATA TOGGLE
+        xor     w0, [w1], [w1]          ; IN word[1-0] =01 -> 10, NAK
+        bset    [w1], #15               ; IN word[15] =1, the DATA is done
+;;-----------------------------------------------------------------------------
+__CNIntEnd:                             ; 10 cycles total
         pop     w6                      ;
         pop     w5                      ;
         pop     w4                      ;
-__IRQExit:                              ; 5 cycles total
-        bclr    _IFS1, #CNIF            ;
+__IRQExit:                              ; 7 cycles total
+        clr     TMR2                    ; the bus is alive, restart the
+        bclr    _IFS1, #CNIF            ; SUSPEND timer of usb.c
+        pop     RCOUNT                  ;
         pop.s                           ;
         retfie                          ;
 ;;-----------------------------------------------------------------------------
 __CRC16:                                ; w0 =buffer, w1 =bytes length
-        mov     #0xFFFF, w5             ; initial value
-        mov     #_datay+2, w3           ; copy the data from buffer to _datay
-        cp0.b   w1                      ; zero length?
+        mov     #0xFFFF, w5             ; initial value, w3 =the data field of
+        cp0.b   w1                      ; _datay or _datai. zero length?
         bra     z, __CRCEnd             ; yes, only CRC
         mov     #0xA001, w4
 __CRCbytes:
         mov.b   [w0++], w6              ; fetch a byte
-        com.b   w6, [w3++]              ; copy this byte into _datay
+        com.b   w6, [w3++]              ; copy this byte into w3
         mov     #8, w2                  ; 8 bits
 __CRCbits:
         xor.b   w5, w6, w7              ; lsb (w7.0) is a flag
@@ -733,12 +973,22 @@ __CRCEnd:
 ; APIs for application
 
         .global __usbGetSetup
-        .global __usbLoadData
-        .global __usbReadData
-        .global __usbSendZLP
-        .global __usbWaitZLP
         .global __usbSetAddress
         .global __usbSetConfig
+        .global __usbStallEP0
+        .global __usbArmIn
+        .global __usbArmZLP
+        .global __usbInDone
+        .global __usbArmOut
+        .global __usbOutDone
+        .global __usbBusReset
+        .global __usbArmInEP
+        .global __usbInEPDone
+        .global __usbHaltInEP
+        .global __usbArmOutEP
+        .global __usbOutEPDone
+        .global __usbHaltOutEP
+        .global __usbSendResume
 
 __usbGetSetup:                          ; w0 =output buffer.
         cp0     w0
@@ -764,11 +1014,11 @@ __GetSetupExit:
         mov     #0, w0
         return
 ;;-----------------------------------------------------------------------------
-__usbSendZLP:
+__usbArmZLP:                            ; ACK the next IN with a DATA1 zlp
         bclr    __ucontr0, #12          ; must send a DATA1 packet
         mov     #0, w0
         mov     #0, w1
-__usbLoadData:                          ; w0 =output buffer, w1 =bytes length
+__usbArmIn:                             ; w0 =output buffer, w1 =bytes length
         bclr    __uendpt0, #10          ; clear REQUEST FLAG
         bclr    __uendpt0, #2           ; clear response bit
         mov     __ucontr0, w2           ; __ucontr0[7-4] =bytes length
@@ -778,42 +1028,45 @@ __usbLoadData:                          ; w0 =output buffer, w1 =bytes length
         ior.b   w3, w2, w2
         ior.b   #0x01, w2               ; ACK to IN request
         push    w2
-        rcall   __CRC16                 ; copy data and CRC into datax
+        mov     #_datay+2, w3
+        rcall   __CRC16                 ; copy data and CRC into datay
         pop     __ucontr0
+        return                          ; don't wait for the ACK of host
+;;-----------------------------------------------------------------------------
+__usbInDone:                            ; w0 =1 if the host ACKed the DATA
         mov     #0x0506, w1
-__waitA:
         mov     #0x0707, w0             ; __uendpt0[10-8] & __uendpt0[2-0]
         and     __uendpt0, WREG
         cp      w1, w0
-        bra     nz, __waitA
+        mov     #0, w0                  ; 'mov' doesn't change SR.Z
+        bra     nz, __InDoneExit
 
         mov     #0xF8F8, w0
         and     __uendpt0
+        mov     #1, w0
+__InDoneExit:
         return
 ;;-----------------------------------------------------------------------------
-__usbWaitZLP:
-        mov     #0, w0
-        mov     #0, w1
-__usbReadData:                          ; w0 =input buffer, w1 =bytes length
-        cp0     w0
-        bra     nz, __valid
-        cp0     w1
-        bra     nz, __invalid
-__valid:
-        push    w0
+__usbArmOut:                            ; ACK the next OUT of EP0
         bclr    __uendpt0, #10          ; DO NOT modify '__uendpt0[1-0]' accidentally
         bclr    __uendpt0, #2           ; this 2 bits are useful when we receive 'DATA0'
         mov.b   __ucontr0, WREG
         bclr    w0, #3
         bset    w0, #2                  ; __ucontr0[3-2] =01, means ACK to OUT
         mov.b   WREG, __ucontr0         ; DO NOT modify '__ucontr0[13]' accidentally!!!
+        return                          ; don't wait for the DATA of host
+;;-----------------------------------------------------------------------------
+__usbOutDone:                           ; w0 =input buffer, w1 =bytes length
+        push    w0
         mov     #0x0407, w2             ; __uendpt0[10] =1 & __uendpt0[2-0] =111
-__waitU:
         mov     #0x0407, w0
         and     __uendpt0, WREG
         cp      w0, w2
-        bra     nz, __waitU
-
+        pop     w0
+        bra     z, __OutDone
+        setm    w0                      ; w0 =0xFFFF, nothing received yet
+        return
+__OutDone:
         mov     __uendpt0, w2
         lsr     w2, #4, w2
         and     #0xF, w2                ; bytes length from host
@@ -821,7 +1074,6 @@ __waitU:
         bra     GEU, __unload
         mov     w2, w1
 __unload:
-        pop     w0
         mov     #_datax+2, w2           ; DATA0 or DATA1?
         btsc    __uendpt0, #3           ; __uendpt0[3]==0, means DATA0
         mov     #_datay+2, w2
@@ -835,19 +1087,159 @@ __UnloadLoop:
 __UnloadEnd:
         pop     w0                      ; bytes length return to caller
         return                          ; it can be zero
-__invalid:
-        setm    w0
-        return
 ;;-----------------------------------------------------------------------------
 __usbSetAddress:                        ; w0[7-0] =Device Address
-        push    w0
-        rcall   __usbSendZLP
-        pop     _addr                   ; store the new address
+        mov.b   WREG, _addr             ; call it after the STATUS stage
         return
 ;;-----------------------------------------------------------------------------
 __usbSetConfig:                         ; w0[7-0] =Configuration Value
-        mov.b   WREG, _conf
-        bra     __usbSendZLP
+        mov.b   WREG, _conf             ; NAK, DATA0 first and no HALT on
+        bra     __EPReset               ; EP1..EPn (USB 2.0, 9.4.5)
+;;-----------------------------------------------------------------------------
+__EPReset:                              ; w0-w3 only, the ISR calls it too
+        mov     #__eptab, w1
+        mov     #_datai, w2
+        mov     #_datao, w3
+__EPResetLoop:
+        mov     #0x1002, w0             ; NAK to IN and DATA0 first
+        mov     w0, [w1++]
+        mov     #0x0008, w0             ; NAK to OUT and DATA0 first
+        mov     w0, [w1++]
+        mov     w2, [w1++]              ; the buffers of the endpoint
+        mov     w3, [w1++]
+        add     #12, w2
+        add     #12, w3
+        mov     #__eptab+8*1, w0
+        cp      w1, w0
+        bra     nz, __EPResetLoop
+        clr     _epsent
+        clr     _epout
+        return
+;;-----------------------------------------------------------------------------
+__EPEntry:                              ; w0 =endpoint (1-1), w7 =its entry
+        dec     w0, w7
+        sl      w7, #3, w7
+        mov     #__eptab, w0
+        add     w7, w0, w7
+        return
+;;-----------------------------------------------------------------------------
+__usbArmInEP:                           ; w0 =endpoint, w1 =DATA, w2 =length
+        rcall   __EPEntry               ; call it only if nothing is armed
+        mov     [w7], w3
+        mov     #0x1800, w4             ; keep DATA TOGGLE and HALT FLAG,
+        and     w3, w4, w4              ; clear DATA DONE
+        and     w2, #0xF, w2            ; w2[3-0] =bytes length (0-8)
+        sl      w2, #4, w3
+        ior     w3, w4, w4              ; IN[7-4] =bytes length
+        ior     #0x01, w4               ; ACK to IN request
+        btsc    w4, #11
+        ior     #0x03, w4               ; or STALL if it is halted
+        push    w4
+        push    w7
+        mov     w1, w0
+        mov     w2, w1
+        mov     [w7+4], w3
+        inc2    w3, w3
+        rcall   __CRC16                 ; copy data and CRC into the buffer
+        pop     w7
+        pop     [w7]                    ; the ISR sees it in one write
+        return                          ; don't wait for the ACK of host
+;;-----------------------------------------------------------------------------
+__usbInEPDone:                          ; w0 =1 if the host ACKed the DATA
+        rcall   __EPEntry               ; since the last call
+        mov     #0, w0
+        btst    [w7], #15
+        bra     z, __InEPDoneExit
+        bclr    [w7], #15               ; bclr can't be broken by the IRQ
+        mov     #1, w0
+__InEPDoneExit:
+        return
+;;-----------------------------------------------------------------------------
+__usbHaltInEP:                          ; w1 =1 to halt the endpoint, =0 to
+        rcall   __EPEntry               ; clear it. an armed DATA is dropped
+        cp0.b   w1                      ; either way
+        mov     #0x1002, w0             ; NAK to IN and DATA0 first when the
+        btss    _SR, #Z                 ; halt is cleared (USB 2.0, 9.4.5)
+        mov     #0x0803, w0             ; HALT FLAG and STALL to IN
+        mov     w0, [w7]
+        return
+;;-----------------------------------------------------------------------------
+__usbArmOutEP:                          ; ACK the next OUT of the endpoint
+        rcall   __EPEntry               ; call it only if nothing is armed.
+        mov     [w7+2], w0              ; it's written at once, so the ISR
+        mov     #0x0C00, w1             ; never sees the handshake 00
+        and     w0, w1, w0              ; keep HALT FLAG and DATA TOGGLE
+        bset    w0, #2                  ; OUT[3-2] =01, ACK to OUT
+        btsc    w0, #11
+        bset    w0, #3                  ; or STALL if it is halted
+        mov     w0, [w7+2]
+        return                          ; don't wait for the DATA of host
+;;-----------------------------------------------------------------------------
+__usbOutEPDone:                         ; w0 =endpoint, w1 =input buffer,
+        rcall   __EPEntry               ; w2 =bytes length
+        inc2    w7, w7                  ; w7 points to the OUT word
+        btst    [w7], #9
+        bra     nz, __OutEPDone
+        setm    w0                      ; w0 =0xFFFF, nothing received yet
+        return
+__OutEPDone:
+        mov     [w7], w3                ; the endpoint is NAKed now, the
+        lsr     w3, #4, w3              ; buffer and the length don't change
+        and     #0xF, w3                ; bytes length from host
+        cp      w3, w2
+        bra     GEU, __OutEPUnload
+        mov     w3, w2
+__OutEPUnload:
+        mov     [w7+4], w3              ; the OUT buffer
+        inc2    w3, w3
+        mov     w2, w0                  ; bytes length return to caller
+__OutEPUnloadLoop:
+        cp0     w2
+        bra     z, __OutEPUnloadEnd
+        com.b   [w3++], [w1++]
+        dec     w2, w2
+        bra     __OutEPUnloadLoop
+__OutEPUnloadEnd:
+        bclr    [w7], #9                ; clear PACKET DONE
+        return                          ; it can be zero
+;;-----------------------------------------------------------------------------
+__usbHaltOutEP:                         ; w1 =1 to halt the endpoint, =0 to
+        rcall   __EPEntry               ; clear it. a received packet is
+        cp0.b   w1                      ; dropped either way
+        mov     #0x0008, w0             ; NAK to OUT and DATA0 first when
+        btss    _SR, #Z                 ; the halt is cleared
+        mov     #0x080C, w0             ; HALT FLAG and STALL to OUT
+        mov     w0, [w7+2]
+        return
+;;-----------------------------------------------------------------------------
+__usbSendResume:                        ; w0 =1 drives K-state to wake the
+        cp0.b   w0                      ; host up (REMOTE WAKEUP), =0 ends it
+        mov     #DPDM, w0               ; after the 10ms of usb.c. the CN
+        bra     z, __ResumeEnd          ; interrupt must be masked meanwhile,
+        bset    _LATU, #DP              ; or it would take the K for a SYNC
+        bclr    _LATU, #DM              ; D- =0 and D+ =1, a K-state
+        com     w0, w0                  ; set pins D-/D+ to OUTPUT mode
+        and     _TRISU
+        return
+__ResumeEnd:
+        ior     _TRISU                  ; D-/D+ are on INPUT mode now, the
+        bclr    IFS1, #CNIF             ; host goes on with the K for 20ms
+        return                          ; and ends it by an EOP
+;;-----------------------------------------------------------------------------
+__usbBusReset:                          ; w0 =1 if a BUS RESET has been issued
+        mov     #0, w0                  ; since the last call
+        btst    __uendpt0, #11
+        bra     z, __BusResetExit
+        bclr    __uendpt0, #11          ; bclr can't be broken by the IRQ
+        mov     #1, w0
+__BusResetExit:
+        return
+;;-----------------------------------------------------------------------------
+__usbStallEP0:                          ; STALL the DATA/STATUS stage of EP0
+        bclr    __uendpt0, #10          ; clear REQUEST FLAG
+        mov     #0x080F, w0             ; __ucontr0[11] =1, EP0 STALL FLAG
+        ior     __ucontr0               ; __ucontr0[3-0] =1111, STALL to IN/OUT
+        return                          ; the next SETUP will clear it
 ;;-----------------------------------------------------------------------------
 
         .extern __dbg_init
@@ -919,6 +1311,7 @@ waitJ:  ; waiting until D-(RA1)=1 & D+(RA0)=0
         mov     WREG, __uendpt0
         mov     #0x000A, w0             ; __ucontr0[1-0] =10, NAK to IN token
         mov     WREG, __ucontr0         ; __ucontr0[3-2] =10, NAK to OUT token
+        rcall   __EPReset               ; NAK and DATA0 on EP1..EP1
 
         ; enable interrupt of CN3 (D-/RA1)
         bclr    IFS1, #CNIF
@@ -0,0 +1,79 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        stream.h Header file for stream.c.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _STREAM_H_ /* this file has been included into main.h */
+#define _STREAM_H_
+
+/*-----------------------------------------------------------------------------
+** the stream goes from the host in the Feature reports of STR_REPORT_ID,
+** [seq][len][STR_DATA_SIZE bytes], and the cumulative acknowledgement comes
+** back in the Input report of the same ID on EP1, [ack][credit][bytes:4].
+** GET_FEATURE of the ID gives [ack][credit][bytes:4][sum:2] at any time.
+** the report ID and the sizes MUST match vusb.desc.
+**---------------------------------------------------------------------------*/
+#define STR_REPORT_ID           5
+#define STR_DATA_SIZE           61
+
+/*-----------------------------------------------------------------------------
+** bit7 of len marks a frame packed by lz.c. the packed frames of a stream
+** are one row of tokens cut into frames, STR_wRead() unpacks them through
+** the window of the last LZ_WINDOW bytes. the ack, the bytes and the sum
+** count the bytes of the frames as they have come.
+**---------------------------------------------------------------------------*/
+#define STR_PACKED              0x80
+
+/*-----------------------------------------------------------------------------
+** the frames the device takes ahead of the application, STR_DATA_SIZE+1
+** bytes of RAM each. the host may send up to this count without an ack.
+** main.h may take a smaller window, the host reads it from the credit.
+**---------------------------------------------------------------------------*/
+#ifndef STR_WINDOW
+#define STR_WINDOW              4
+#endif
+
+void STR_vInit(void);
+
+void STR_vTask(void);
+
+WORD STR_wRead(BYTE *dat, WORD siz);
+
+/* callbacks of the control transfer, called by hid.c */
+void STR_vCtrlSource(BYTE *dat, WORD offset, BYTE len);
+
+void STR_vCtrlSink(BYTE *dat, WORD offset, BYTE len);
+
+void STR_vCtrlRxDone(WORD rxl);
+
+#endif
@@ -37,121 +37,447 @@
  #include "main.h"
 
 /*-----------------------------------------------------------------------------
-** HID REPORT descriptor
+** all descriptors are in desc.c, which is generated by descgen.py from
+** Tools/DescGen/vusb.desc. run desc.bat after modifying it.
 **---------------------------------------------------------------------------*/
-const BYTE HID_ReportDescriptor[] =
+static BYTE USB_bFindDesc(BYTE type, BYTE index, WORD langid,
+                          BYTE** desc, WORD* length)
 {
-    /*  ------------------  ||  ---------------------------------------------*/
-    0x06,0x00,0xFF,         /*  Usage Page (vendor defined) ($FF00) global   */
-    0x09,0x01,              /*  Usage (vendor defined) ($01) local           */
-    0xA1,0x01,              /*   Collection (Application)                    */
-    0x75,0x08,              /*    REPORT_SIZE (8)                            */
-    0x95,0x40,              /*    REPORT_COUNT (64 fields, 64 bytes)         */
-
-    /* Feature Report                                                        */
-    0x09,0x01,              /*    USAGE (Vendor Usage 1)                     */
-    0xB1,0x02,              /*    Feature(data,var,absolute)                 */
-    /* Input Report                                                          */
-    0x09,0x01,              /*    USAGE (Vendor Usage 1)                     */
-    0x81,0x02,              /*    Input(data,var,absolute)                   */
-    /* Output Report                                                         */
-    0x09,0x01,              /*    USAGE (Vendor Usage 1)                     */
-    0x91,0x02,              /*    Output(data,var,absolute)                  */
-
-    0xC0                    /*   Application Collection End                  */
-    /*  ------------------  ||  ---------------------------------------------*/
-};
-
-const static BYTE USB_DeviceDescriptor[] =
+    const USB_DESC_TYPE* t = &USB_DescType[USB_DESC_SLOT(type)];
+    BYTE row, i;
+
+    if (t->type != type || index >= t->count)
+    {
+        return 0;
+    }
+
+    row = t->first + index;
+    if (type == 0x03 && index != 0)
+    {
+        /*---------------------------------------------------------------------
+        ** the strings of each language follow the LANGID string (index 0).
+        **-------------------------------------------------------------------*/
+        for (i=0; i<USB_NUM_LANGUAGES; i++)
+        {
+            if (USB_DescLangID[i] == langid)
+            {
+                break;
+            }
+        }
+        if (i == USB_NUM_LANGUAGES)
+        {
+            return 0;
+        }
+        row += i * USB_NUM_STRINGS;
+    }
+
+    *desc = (BYTE*)&USB_DescBlob[USB_DescTable[row].offset];
+    *length = USB_DescTable[row].length;
+    return *length != 0;
+}
+
+/*-----------------------------------------------------------------------------
+** stages of the control transfer on EP0. USB_vTask() moves from one stage
+** to the next one when sie.s has finished a packet, so that loop() never
+** waits for the host.
+**---------------------------------------------------------------------------*/
+#define CTRL_IDLE               0
+#define CTRL_DATA_IN            1   /* DATA stage of control read            */
+#define CTRL_DATA_OUT           2   /* DATA stage of control write           */
+#define CTRL_STATUS_IN          3   /* zlp of control write or no-data ctrl  */
+#define CTRL_STATUS_OUT         4   /* zlp of control read from the host     */
+
+static BYTE  CtrlStage;
+static BYTE* CtrlPtr;               /* NULL streams via hid.c callbacks      */
+static WORD  CtrlLength;            /* bytes left in the DATA stage          */
+static WORD  CtrlCount;             /* bytes moved in the DATA stage         */
+static BYTE  CtrlZLP;               /* a zlp terminates the DATA stage       */
+static BYTE  CtrlClass;             /* report the end of transfer to hid.c   */
+static BYTE  CtrlAddress;           /* applied after the STATUS stage        */
+#define NO_ADDRESS              0x80
+static BYTE  CtrlReply[2];          /* DATA of GET_STATUS and so on          */
+
+/*-----------------------------------------------------------------------------
+** the report on the interrupt IN endpoint EP1. it goes out 8 bytes a poll,
+** the host puts the packets together by the size of the Input report.
+**---------------------------------------------------------------------------*/
+#if USB_MAX_ENDPOINT > 1
+#error "usb.c drives EP1 only, please check the endpoints in vusb.desc"
+#endif
+#define INT_EP                  1   /* EP1 of __eptab in sie.s               */
+static BYTE* IntPtr;                /* the next byte to be armed on EP1      */
+static WORD  IntLength;             /* bytes left of the report              */
+static BYTE  IntArmed;              /* a packet is armed on EP1              */
+#define EP1_IN_HALT             ((WORD)1 << (INT_EP + 8))
+
+/*-----------------------------------------------------------------------------
+** the Output report on the interrupt OUT endpoint EP1. it's passed to hid.c
+** packet by packet, a short packet or the size of the report ends it.
+**---------------------------------------------------------------------------*/
+static WORD  IntRxCount;            /* bytes of the Output report so far     */
+#define EP1_OUT_HALT            ((WORD)1 << INT_EP)
+
+/*-----------------------------------------------------------------------------
+** 3ms of J-state without a keep-alive or a packet is a SUSPEND (USB 2.0,
+** 7.1.7.6). sie.s clears Timer2 on every CN interrupt, so Timer2 reaching
+** PR2 means the bus has been idle that long. D+/D- are RA0/RA1 as in sie.s.
+**---------------------------------------------------------------------------*/
+#define SUSPEND_TICK            ((WORD)(FCY * 3 / 64000) - 1)
+#define WAKEUP_TICK             ((WORD)(FCY * 2 / 64000))
+#define SIGNAL_TICK             ((WORD)(FCY * 10 / 64000) - 1)
+static BYTE  DevSuspended;
+#define SUSP_NONE               0   /* the bus is alive                      */
+#define SUSP_IDLE               1   /* 2ms more awake, the CN masked         */
+#define SUSP_WAKEUP             2   /* and the app has asked for a wakeup    */
+#define SUSP_SLEEP              3   /* asleep, or woken up by the app        */
+#define SUSP_SIGNAL             4   /* the device drives K for 10ms          */
+#define SUSP_RESUME             5   /* the K of a resume, the CN masked      */
+
+/*-----------------------------------------------------------------------------
+** the keep-alives come every 1ms of the host, sie.s takes Timer3 (Fcy/8) at
+** each of them. USB_vTrimTask() measures 8 frames and moves OSCTUN a step
+** when the clock is off by more than 0.2%, half a step of the FRC is less.
+** a measure off by more than 1/16 has missed a keep-alive, it's dropped.
+** with a crystal OSCTUN does nothing and the error is never that large.
+**---------------------------------------------------------------------------*/
+#define TRIM_FRAMES             8
+#define TRIM_TICKS              ((WORD)(FCY / 8 / 1000 * TRIM_FRAMES))
+#define TRIM_DEADBAND           (TRIM_TICKS / 500)
+#define TRIM_LIMIT              (TRIM_TICKS / 16)
+static WORD  TrimFrame;             /* the frame and the time of the last    */
+static WORD  TrimTime;              /* measure                               */
+#define BUS_J_STATE()           (_RA1 == 1 && _RA0 == 0)
+#define BUS_K_STATE()           (_RA1 == 0 && _RA0 == 1)
+
+/*-----------------------------------------------------------------------------
+** state of the device kept for the standard requests. a BUS RESET clears
+** all of them.
+**---------------------------------------------------------------------------*/
+static BYTE  DevConfig;             /* bConfigurationValue, 0 unconfigured   */
+static BYTE  DevRemoteWakeup;       /* DEVICE_REMOTE_WAKEUP feature          */
+static WORD  DevHalt;               /* ENDPOINT_HALT, bit8+n for IN ep n     */
+
+/*-----------------------------------------------------------------------------
+** the standard requests are dispatched on bmRequestType and bRequest
+** together. bmRequestType[4-0] is the recipient, 0 device, 1 interface and
+** 2 endpoint.
+**---------------------------------------------------------------------------*/
+#define REQUEST(t, r)           (((WORD)(t) << 8) | (WORD)(r))
+
+void USB_vInit(void)
 {
-    0x12,                           /* bDescriptorLen                        */
-    0x01,                           /* bDescriptorType                       */
-    0x10,                           /* bcdUSBVersionL                        */
-    0x01,                           /* bcdUSBVersionH                        */
-    0x00,                           /* bDeviceClass                          */
-    0x00,                           /* bDeviceSubclass                       */
-    0x00,                           /* bDeviceProtocol                       */
-    ENDPOINT0_SIZE,                 /* ENDPOINT0_SIZE = 8                    */
-    0x6E,                           /* idVendorL (use your own vid&pid)      */
-    0x09,                           /* idVendorH                             */
-    0x00,                           /* idProductL                            */
-    0x01,                           /* idProductH                            */
-    0x00,                           /* bcdDeviceL                            */
-    0x01,                           /* bcdDeviceH                            */
-    0x01,                           /* ManufacturerStringIndex               */
-    0x02,                           /* ProductStringIndex                    */
-    0x00,                           /* SerialNumberStringIndex               */
-    0x01                            /* bNumConfigs                           */
-};
-
-const static BYTE USB_ConfigureDescriptor[] =
+    /*-------------------------------------------------------------------------
+    ** your own initialization code goes here
+    **-----------------------------------------------------------------------*/
+    CtrlStage = CTRL_IDLE;
+    CtrlAddress = NO_ADDRESS;
+    DevConfig = 0;
+    DevRemoteWakeup = 0;
+    DevHalt = 0;
+    IntLength = 0;
+    IntArmed = 0;
+    IntRxCount = 0;
+    DevSuspended = SUSP_NONE;
+
+    /* Timer2 at Fcy/64, no interrupt */
+    TMR2 = 0;
+    PR2 = SUSPEND_TICK;
+    T2CON = 0x8020;
+    _T2IF = 0;
+
+    /* Timer3 at Fcy/8 runs free, no interrupt */
+    TMR3 = 0;
+    PR3 = 0xFFFF;
+    T3CON = 0x8010;
+    TrimFrame = _frame;
+    TrimTime = _frametime;
+}
+
+static void USB_vTrimTask(void)
 {
-    /* CONFIGURATION descriptor                                              */
-    0x09,                           /* CbLength                              */
-    0x02,                           /* CbDescriptorType                      */
-    0x1B,                           /* CwTotalLengthL                        */
-    0x00,                           /* CwTotalLengthH                        */
-    0x01,                           /* CbNumInterfaces                       */
-    0x01,                           /* CbConfigurationValue                  */
-    0x04,                           /* CiConfiguration                       */
-    0x80,                           /* CbmAttributes                         */
-    0x10,                           /* CMaxPower                             */
-    /* INTERFACE descriptor                                                  */
-    0x09,                           /* IbLength                              */
-    0x04,                           /* IbDescriptorType                      */
-    0x00,                           /* IbInterfaceNumber                     */
-    0x00,                           /* IbAlternateSetting                    */
-    0x00,                           /* IbNumEndpoints                        */
-    0x03,                           /* IbInterfaceClass (HID device)         */
-    0x00,                           /* IbInterfaceSubclass                   */
-    0x00,                           /* IbInterfaceProtocol                   */
-    0x05,                           /* IiInterface                           */
-    /* HID CLASS descriptor                                                  */
-    0x09,                           /* HbLength                              */
-    0x21,                           /* HbDescriptorType                      */
-    0x10,                           /* HbcdHIDVersionL                       */
-    0x01,                           /* HbcdHIDVersionH                       */
-    0x00,                           /* HbCountryCode                         */
-    0x01,                           /* HbNumOfClassDesc                      */
-    0x22,                           /* HbClassDescType (HID REPORT desc)     */
-    sizeof(HID_ReportDescriptor),   /* HwReportDescLengthL                   */
-    0x00                            /* HwReportDescLengthH                   */
-};
-
-const BYTE USB_StringDescriptorI[] =
+    WORD frame, time, ticks;
+    BYTE tun;
+
+    do
+    {
+        /* the ISR may come between the two reads */
+        frame = _frame;
+        time = _frametime;
+    } while (frame != _frame);
+
+    if ((WORD)(frame - TrimFrame) < TRIM_FRAMES)
+    {
+        return;
+    }
+    if ((WORD)(frame - TrimFrame) == TRIM_FRAMES)
+    {
+        /*---------------------------------------------------------------------
+        ** more ticks than TRIM_TICKS, the clock is fast. TUN[5-0] is signed,
+        ** 0x1F the fastest and 0x20 the slowest.
+        **-------------------------------------------------------------------*/
+        ticks = time - TrimTime;
+        tun = OSCTUN & 0x3F;
+        if (ticks > TRIM_TICKS + TRIM_DEADBAND &&
+            ticks < TRIM_TICKS + TRIM_LIMIT && tun != 0x20)
+        {
+            OSCTUN = (tun - 1) & 0x3F;
+        }
+        else if (ticks < TRIM_TICKS - TRIM_DEADBAND &&
+                 ticks > TRIM_TICKS - TRIM_LIMIT && tun != 0x1F)
+        {
+            OSCTUN = (tun + 1) & 0x3F;
+        }
+    }
+    /* a late call takes the next 8 frames from now on */
+    TrimFrame = frame;
+    TrimTime = time;
+}
+
+static void USB_vAwake(void)
 {
-    0x04,
-    0x03,
-    0x09,
-    0x04
-};
+    /*-------------------------------------------------------------------------
+    ** the bus is alive again. an edge in the meantime has left CNIF set, the
+    ** ISR takes it now as the SE0 of a keep-alive or a RESET.
+    **-----------------------------------------------------------------------*/
+    DevSuspended = SUSP_NONE;
+    TMR2 = 0;
+    _T2IF = 0;
+    _CNIE = 1;
+}
 
-const BYTE USB_StringDescriptorV[] =
+static void USB_vSignal(void)
 {
-    0x0C,
-    0x03,
-    'G', 0x00,
-    'e', 0x00,
-    'n', 0x00,
-    'i', 0x00,
-    'e', 0x00
-};
-
-const BYTE USB_StringDescriptorP[] =
+    /*-------------------------------------------------------------------------
+    ** the K of a REMOTE WAKEUP lasts 10ms (USB 2.0, 7.1.7.7). PR2 is that
+    ** long meanwhile, USB_vSuspend() ends the K when Timer2 reaches it and
+    ** loop() goes on in between.
+    **-----------------------------------------------------------------------*/
+    _usbSendResume(1);
+    PR2 = SIGNAL_TICK;
+    TMR2 = 0;
+    _T2IF = 0;
+    DevSuspended = SUSP_SIGNAL;
+}
+
+static void USB_vSuspend(void)
 {
-    0x0A,
-    0x03,
-    'V', 0x00,
-    'U', 0x00,
-    'S', 0x00,
-    'B', 0x00
-};
+    BYTE ipl;
 
-void USB_vInit(void)
+    /*-------------------------------------------------------------------------
+    ** every call returns at once, but the one which puts the CPU to Sleep.
+    ** the CN interrupt stays masked from the 3ms of idle bus to the end of
+    ** the resume, so an edge only sets CNIF and loop() goes on meanwhile.
+    **-----------------------------------------------------------------------*/
+    if (DevSuspended == SUSP_SIGNAL)
+    {
+        /* the host goes on with the K, sie.s doesn't take it for a SYNC */
+        if (_T2IF)
+        {
+            _usbSendResume(0);
+            PR2 = SUSPEND_TICK;
+            DevSuspended = SUSP_RESUME;
+        }
+        return;
+    }
+    if (DevSuspended == SUSP_RESUME)
+    {
+        /* the host drives K for 20ms, the EOP or a RESET follows */
+        if (!BUS_K_STATE())
+        {
+            USB_vAwake();
+        }
+        return;
+    }
+    if (DevSuspended == SUSP_NONE)
+    {
+        /*---------------------------------------------------------------------
+        ** a REMOTE WAKEUP may be sent after 5ms of idle bus (USB 2.0,
+        ** 7.1.7.7), so the device stays awake 2ms more before Sleep. Timer2
+        ** counts them, the ISR doesn't clear it with the CN masked.
+        **-------------------------------------------------------------------*/
+        _CNIE = 0;
+        TMR2 = 0;
+        _T2IF = 0;
+        DevSuspended = SUSP_IDLE;
+    }
+    if (!BUS_J_STATE() || _CNIF)
+    {
+        /* a long SE0 is a BUS RESET, or the bus has just woken up */
+        USB_vAwake();
+        return;
+    }
+    if (DevSuspended != SUSP_SLEEP)
+    {
+        if (TMR2 < WAKEUP_TICK && !_T2IF)
+        {
+            return;
+        }
+        if (DevSuspended == SUSP_WAKEUP)
+        {
+            /* asked for by USB_bRemoteWakeup() within the 2ms */
+            USB_vSignal();
+            return;
+        }
+        DevSuspended = SUSP_SLEEP;
+    }
+
+    /*-------------------------------------------------------------------------
+    ** the CN interrupt wakes the CPU up from Sleep, but with IPL 7 it isn't
+    ** taken. the oscillator and the PLL stop in Sleep.
+    **-----------------------------------------------------------------------*/
+    ipl = SRbits.IPL;
+    SRbits.IPL = 7;
+    _CNIE = 1;
+    Sleep();
+
+    /*-------------------------------------------------------------------------
+    ** the CPU doesn't run until the oscillator has started. the PLL may take
+    ** a little longer to lock, with the crystal (PRIPLL, COSC 3) or the FRC
+    ** (FRCPLL, COSC 1) alike. it's the only wait, the K of the resume goes
+    ** on as loop() runs.
+    **-----------------------------------------------------------------------*/
+    if (OSCCONbits.COSC == 1 || OSCCONbits.COSC == 3)
+    {
+        while (!OSCCONbits.LOCK);
+    }
+    _CNIE = 0;
+    SRbits.IPL = ipl;
+    if (BUS_K_STATE())
+    {
+        DevSuspended = SUSP_RESUME;
+    }
+    else
+    if (!BUS_J_STATE())
+    {
+        USB_vAwake();
+    }
+
+    /*-------------------------------------------------------------------------
+    ** if the bus is still idle, an interrupt of the application has woken
+    ** the CPU up. it's taken now, loop() runs once and may call
+    ** USB_bRemoteWakeup() before the next USB_vTask() puts the CPU to Sleep
+    ** again.
+    **-----------------------------------------------------------------------*/
+}
+
+BYTE USB_bRemoteWakeup(void)
 {
     /*-------------------------------------------------------------------------
-    ** your own initialization code goes here
+    ** wakes the host up if the bus is suspended and the host has enabled
+    ** DEVICE_REMOTE_WAKEUP. it returns 1 at once if the resume has begun, or
+    ** will at 5ms of idle bus. USB_vTask() ends the K 10ms later, the host
+    ** resumes the bus within 20ms then.
+    **-----------------------------------------------------------------------*/
+    if (DevSuspended == SUSP_NONE || DevSuspended >= SUSP_SIGNAL ||
+        !DevRemoteWakeup)
+    {
+        return 0;
+    }
+    if (DevSuspended != SUSP_SLEEP)
+    {
+        DevSuspended = SUSP_WAKEUP;
+        return 1;
+    }
+    USB_vSignal();
+    return 1;
+}
+
+WORD USB_wFrame(void)
+{
+    /*-------------------------------------------------------------------------
+    ** the frames of 1ms counted by sie.s from the keep-alives of the host.
+    ** it's a clock in step with the host, but it stops in SUSPEND.
+    **-----------------------------------------------------------------------*/
+    return _frame;
+}
+
+void USB_vWaitFrame(void)
+{
+    WORD frame = _frame;
+
+    /*-------------------------------------------------------------------------
+    ** returns at the start of the next frame, right after its keep-alive, or
+    ** when the bus is suspended and there is no next frame.
+    **-----------------------------------------------------------------------*/
+    while (_frame == frame && !_T2IF);
+}
+
+BYTE USB_bFrameElapsed(WORD* last, WORD frames)
+{
+    WORD now = _frame;
+
+    /*-------------------------------------------------------------------------
+    ** returns 1 once every 'frames' frames, 'last' keeps the frame of the
+    ** last time. a period missed by a late call is dropped rather than
+    ** returned twice in a row.
+    **-----------------------------------------------------------------------*/
+    if ((WORD)(now - *last) < frames)
+    {
+        return 0;
+    }
+    *last = (WORD)(now - *last) < 2 * frames? *last + frames:now;
+    return 1;
+}
+
+static BYTE USB_bValidInterface(BYTE* setup)
+{
+    /* interfaces exist in the Configured state only */
+    return DevConfig != 0 && setup[4] < USB_NUM_INTERFACES;
+}
+
+static WORD USB_wHaltBit(BYTE* setup)
+{
+    BYTE ep = setup[4];
+
+    /*-------------------------------------------------------------------------
+    ** returns the bit of the endpoint in wIndex in DevHalt, or 0 if there
+    ** isn't such an endpoint. EP0 is always there but it has no bit.
+    **-----------------------------------------------------------------------*/
+    if ((ep & 0x70) != 0 || (ep & 0x0F) > USB_MAX_ENDPOINT ||
+        ((ep & 0x0F) != 0 && DevConfig == 0))
+    {
+        return 0;
+    }
+    return (WORD)1 << ((ep & 0x0F) + (ep & 0x80? 8:0));
+}
+
+static void USB_vLoadNext(void)
+{
+    BYTE len, chunk[ENDPOINT0_SIZE];
+
+    /*-------------------------------------------------------------------------
+    ** load the next DATA packet of control read, or wait for the STATUS stage
+    ** if all of them have been sent.
     **-----------------------------------------------------------------------*/
+    if (CtrlLength > 0 || CtrlZLP)
+    {
+        len = CtrlLength >= ENDPOINT0_SIZE? ENDPOINT0_SIZE:(BYTE)CtrlLength;
+        if (len < ENDPOINT0_SIZE)
+        {
+            CtrlZLP = 0;
+        }
+        if (CtrlPtr == NULL)
+        {
+            /*-----------------------------------------------------------------
+            ** _usbArmIn() copies the packet at once, so hid.c fills a chunk
+            ** on the stack instead of keeping the whole report.
+            **---------------------------------------------------------------*/
+            HID_vCtrlSource(chunk, CtrlCount, len);
+            _usbArmIn(chunk, len);
+        }
+        else
+        {
+            _usbArmIn(CtrlPtr, len);
+            CtrlPtr += len;
+        }
+        CtrlLength -= len; CtrlCount += len;
+        CtrlStage = CTRL_DATA_IN;
+    }
+    else
+    {
+        _usbArmOut();
+        CtrlStage = CTRL_STATUS_OUT;
+    }
 }
 
 BYTE USB_bRxRequest(void* Request)
@@ -164,78 +490,207 @@ BYTE USB_bRxRequest(void* Request)
     /* invoke API func in sie.s */
     if (_usbGetSetup(setup) == ENDPOINT0_SIZE)
     {
-        switch(setup[1])
+        /*---------------------------------------------------------------------
+        ** a new SETUP aborts the unfinished control transfer.
+        **-------------------------------------------------------------------*/
+        CtrlStage = CTRL_IDLE;
+        CtrlClass = 0;
+        CtrlAddress = NO_ADDRESS;
+
+        /*---------------------------------------------------------------------
+        ** data length in the SETUP packet.
+        **-------------------------------------------------------------------*/
+        exLength = (((WORD)setup[7] << 8) | (WORD)setup[6]);
+
+        if ((setup[0] & 0x60) != 0x00)
         {
-        case 0x06:  /* Get Descriptor */
             /*-----------------------------------------------------------------
-            ** data length in the SETUP packet.
+            ** class or vendor request, such as HID GET_REPORT. hid.c handles
+            ** it and STALLs the ones it doesn't know.
             **---------------------------------------------------------------*/
-            exLength = (((WORD)setup[7] << 8) | (WORD)setup[6]);
-
-            if (setup[3]==0x01) /* Devcie Descriptor */
+            ret = USB_REQ_SETUP;
+            CtrlClass = 1;
+        }
+        else
+        switch(REQUEST(setup[0], setup[1]))
+        {
+        case REQUEST(0x80, 0x00):   /* GET_STATUS of device */
+            CtrlReply[0] = (USB_CONFIG_ATTRIBUTES & 0x40? 0x01:0x00) |
+                           (DevRemoteWakeup? 0x02:0x00);
+            CtrlReply[1] = 0;
+            USB_wSendCtrlData(CtrlReply, 2, exLength);
+            break;
+        case REQUEST(0x81, 0x00):   /* GET_STATUS of interface */
+            if (USB_bValidInterface(setup))
             {
-                desc = (BYTE*)USB_DeviceDescriptor;
-                txLength = sizeof(USB_DeviceDescriptor);
+                CtrlReply[0] = 0;
+                CtrlReply[1] = 0;
+                USB_wSendCtrlData(CtrlReply, 2, exLength);
             }
             else
-            if (setup[3]==0x02) /* Configure Descriptor */
             {
-                desc = (BYTE*)USB_ConfigureDescriptor;
-                txLength = sizeof(USB_ConfigureDescriptor);
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x82, 0x00):   /* GET_STATUS of endpoint */
+            if ((setup[4] & 0x0F) == 0 || USB_wHaltBit(setup) != 0)
+            {
+                CtrlReply[0] = (DevHalt & USB_wHaltBit(setup))? 0x01:0x00;
+                CtrlReply[1] = 0;
+                USB_wSendCtrlData(CtrlReply, 2, exLength);
+            }
+            else
+            {
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x00, 0x01):   /* CLEAR_FEATURE of device */
+        case REQUEST(0x00, 0x03):   /* SET_FEATURE of device */
+            /*-----------------------------------------------------------------
+            ** DEVICE_REMOTE_WAKEUP only if bmAttributes allows it. TEST_MODE
+            ** doesn't exist on a low speed device.
+            **---------------------------------------------------------------*/
+            if (setup[2] == 0x01 && (USB_CONFIG_ATTRIBUTES & 0x20))
+            {
+                DevRemoteWakeup = setup[1] == 0x03? 1:0;
+                USB_wSendCtrlData(NULL, 0, 0);
             }
             else
-            if (setup[3]==0x03) /* String Descriptor */
             {
-                if (setup[2]==USB_DeviceDescriptor[14])
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x02, 0x01):   /* CLEAR_FEATURE of endpoint */
+        case REQUEST(0x02, 0x03):   /* SET_FEATURE of endpoint */
+            /*-----------------------------------------------------------------
+            ** ENDPOINT_HALT only. EP0 can't be halted, clearing it is fine.
+            **---------------------------------------------------------------*/
+            if (setup[2] == 0x00 && USB_wHaltBit(setup) != 0 &&
+                ((setup[4] & 0x0F) != 0 || setup[1] == 0x01))
+            {
+                if (setup[1] == 0x03)
                 {
-                    desc = (BYTE*)USB_StringDescriptorV;
-                    txLength = sizeof(USB_StringDescriptorV);
+                    DevHalt |= USB_wHaltBit(setup);
                 }
                 else
-                if (setup[2]==USB_DeviceDescriptor[15])
                 {
-                    desc = (BYTE*)USB_StringDescriptorP;
-                    txLength = sizeof(USB_StringDescriptorP);
+                    DevHalt &= ~USB_wHaltBit(setup);
                 }
-                else
+                if (USB_wHaltBit(setup) == EP1_IN_HALT)
                 {
-                    desc = (BYTE*)USB_StringDescriptorI;
-                    txLength = sizeof(USB_StringDescriptorI);
+                    /* the report in progress is dropped */
+                    _usbHaltInEP(INT_EP, setup[1] == 0x03);
+                    IntLength = 0;
+                    IntArmed = 0;
                 }
+                if (USB_wHaltBit(setup) == EP1_OUT_HALT)
+                {
+                    /* so is the Output report, and DATA0 comes next */
+                    _usbHaltOutEP(INT_EP, setup[1] == 0x03);
+                    IntRxCount = 0;
+                    if (setup[1] == 0x01)
+                    {
+                        _usbArmOutEP(INT_EP);
+                    }
+                }
+                USB_wSendCtrlData(NULL, 0, 0);
             }
             else
-            if (setup[3]==0x22) /* HID Report Descriptor */
             {
-                desc = (BYTE*)HID_ReportDescriptor;
-                txLength = sizeof(HID_ReportDescriptor);
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x00, 0x05):   /* SET_ADDRESS */
+            if (setup[2] <= 0x7F)
+            {
+                /* the new address is used after the STATUS stage */
+                CtrlAddress = setup[2];
+                USB_wSendCtrlData(NULL, 0, 0);
             }
             else
             {
-                desc = NULL; txLength = 0;
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x80, 0x06):   /* GET_DESCRIPTOR */
+        case REQUEST(0x81, 0x06):   /* GET_DESCRIPTOR of HID interface */
+            /*-----------------------------------------------------------------
+            ** HID and HID REPORT descriptors are selected by the interface
+            ** number in wIndex, the others by the index in wValue.
+            **---------------------------------------------------------------*/
+            if (USB_bFindDesc(setup[3],
+                              setup[3] >= 0x21? setup[4]:setup[2],
+                              ((WORD)setup[5] << 8) | (WORD)setup[4],
+                              &desc, &txLength))
+            {
+                USB_wSendCtrlData(desc, txLength, exLength);
+            }
+            else
+            {
+                /* no such descriptor, don't let the host time out */
+                USB_vStallCtrl();
             }
-
-            USB_bSendCtrlData(desc, txLength, exLength);
             break;
-        case 0x05:  /* Set Address */
-            _usbSetAddress(setup[2]);
+        case REQUEST(0x80, 0x08):   /* GET_CONFIGURATION */
+            CtrlReply[0] = DevConfig;
+            USB_wSendCtrlData(CtrlReply, 1, exLength);
             break;
-        case 0x09:  /* Set Configuration or HID Set Report */
-            if (setup[0] == 0)
+        case REQUEST(0x00, 0x09):   /* SET_CONFIGURATION */
+            if (setup[2] <= USB_NUM_CONFIGS)
             {
+                /* it clears ENDPOINT_HALT of every endpoint */
+                DevConfig = setup[2];
+                DevHalt = 0;
+                IntLength = 0;
+                IntArmed = 0;
+                IntRxCount = 0;
                 _usbSetConfig(setup[2]);
+                if (setup[2] != 0)
+                {
+                    _usbArmOutEP(INT_EP);
+                }
+                USB_wSendCtrlData(NULL, 0, 0);
             }
             else
             {
-                /* 21 09 00 00 00 00 40 00 */
-                ret = USB_REQ_SETUP;
+                USB_vStallCtrl();
             }
             break;
-        case 0x0A:  /* HID Set Idle: 21 0A 00 00 00 00 00 00 */
-        case 0x01:  /* Clear Feature or HID Get Report */
-            /* A1 01 00 00 00 00 40 00 */
-            ret = USB_REQ_SETUP;
+        case REQUEST(0x81, 0x0A):   /* GET_INTERFACE */
+            if (USB_bValidInterface(setup))
+            {
+                CtrlReply[0] = 0;   /* no alternate setting */
+                USB_wSendCtrlData(CtrlReply, 1, exLength);
+            }
+            else
+            {
+                USB_vStallCtrl();
+            }
+            break;
+        case REQUEST(0x01, 0x0B):   /* SET_INTERFACE */
+            if (USB_bValidInterface(setup) && setup[2] == 0)
+            {
+                DevHalt = 0;
+                IntLength = 0;
+                IntArmed = 0;
+                IntRxCount = 0;
+                _usbHaltInEP(INT_EP, 0);
+                _usbHaltOutEP(INT_EP, 0);
+                _usbArmOutEP(INT_EP);
+                USB_wSendCtrlData(NULL, 0, 0);
+            }
+            else
+            {
+                USB_vStallCtrl();
+            }
             break;
         default:
+            /*-----------------------------------------------------------------
+            ** unsupported request, such as SET_DESCRIPTOR, SYNCH_FRAME or a
+            ** feature of interface. STALL the DATA/STATUS stage so that the
+            ** host gives up at once instead of waiting for a timeout.
+            **---------------------------------------------------------------*/
+            USB_vStallCtrl();
             ret = USB_REQ_DEBUG;  /* Just for debugging */
             break;
         }
@@ -245,53 +700,48 @@ BYTE USB_bRxRequest(void* Request)
     return ret;
 }
 
-BYTE USB_bGetCtrlData(BYTE * dat, WORD siz, WORD exLength)
+WORD USB_wGetCtrlData(BYTE * dat, WORD siz, WORD exLength)
 {
-    BYTE* ptr = dat, total = 0, rlen;
-    WORD rxLength;
-
     /*-------------------------------------------------------------------------
     ** 'exLength' is the data length in the SETUP packet. 'siz' is the length
-    ** of 'dat'.
+    ** of 'dat'. it returns at once, 'dat' is filled by USB_vTask() and
+    ** HID_vCtrlRxDone() is called with the bytes received. if 'dat' is NULL,
+    ** each packet is passed to HID_vCtrlSink() instead. it returns the bytes
+    ** expected from the host.
     **-----------------------------------------------------------------------*/
-    rxLength = siz <= exLength? siz:exLength;
+    CtrlPtr = dat;
+    CtrlLength = siz <= exLength? siz:exLength;
+    CtrlCount = 0;
 
-    while(rxLength >= ENDPOINT0_SIZE)
+    if (CtrlLength == 0)
     {
-        rlen = _usbReadData(ptr, ENDPOINT0_SIZE);
-        if (rlen < ENDPOINT0_SIZE)
-        {
-            /* send a zlp via 'DATA1'. STATUS stage of control write */
-            _usbSendZLP();
-            total += rlen;
-            return total;
-        }
-        ptr += ENDPOINT0_SIZE; rxLength -= ENDPOINT0_SIZE;
-        total += ENDPOINT0_SIZE;
+        /* send a zlp via 'DATA1'. STATUS stage of control write */
+        _usbArmZLP();
+        CtrlStage = CTRL_STATUS_IN;
     }
-    if (rxLength > 0)
+    else
     {
-        rlen = _usbReadData(ptr, rxLength);
-        total += rlen <= rxLength? rlen:rxLength;
+        _usbArmOut();
+        CtrlStage = CTRL_DATA_OUT;
     }
 
-    _usbSendZLP();
-
-    return total;
+    return CtrlLength;
 }
 
-BYTE USB_bSendCtrlData(BYTE* dat, WORD siz, WORD exLength)
+WORD USB_wSendCtrlData(BYTE* dat, WORD siz, WORD exLength)
 {
-    BYTE* ptr = dat, zlp;
     WORD txLength;
 
     /*-------------------------------------------------------------------------
     ** 'exLength' is the data length in the SETUP packet. 'siz' is the length
-    ** of data stored in 'dat'.
+    ** of data stored in 'dat'. it returns at once, so 'dat' MUST NOT be
+    ** changed until HID_vCtrlTxDone() is called. if 'dat' is NULL, each
+    ** packet is fetched by HID_vCtrlSource() just before it's sent.
     **-----------------------------------------------------------------------*/
     if (siz == 0 && exLength == 0)
     {
-        _usbSendZLP();
+        _usbArmZLP();
+        CtrlStage = CTRL_STATUS_IN;
         return 0;
     }
 
@@ -302,31 +752,195 @@ BYTE USB_bSendCtrlData(BYTE* dat, WORD siz, WORD exLength)
         ** to terminate current transmission. it doesn't mean the STATUS stage
         ** of control write.
         **-------------------------------------------------------------------*/
-        zlp = (siz&(ENDPOINT0_SIZE-1))==0? 1:0;
+        CtrlZLP = (siz&(ENDPOINT0_SIZE-1))==0? 1:0;
         txLength = siz;
     }
     else
     {
-        zlp = 0;
+        CtrlZLP = 0;
         txLength = exLength;
     }
 
-    while(txLength >= ENDPOINT0_SIZE)
+    CtrlPtr = dat;
+    CtrlLength = txLength;
+    CtrlCount = 0;
+    USB_vLoadNext();
+
+    return txLength;
+}
+
+static void USB_vLoadNextInt(void)
+{
+    BYTE len;
+
+    len = IntLength >= ENDPOINT1_SIZE? ENDPOINT1_SIZE:(BYTE)IntLength;
+    _usbArmInEP(INT_EP, IntPtr, len);
+    IntPtr += len; IntLength -= len;
+    IntArmed = 1;
+}
+
+BYTE USB_bSendIntData(BYTE* dat, WORD siz)
+{
+    /*-------------------------------------------------------------------------
+    ** queue a report of 'siz' bytes on EP1. it returns at once, so 'dat' MUST
+    ** NOT be changed until USB_bIntBusy() returns 0. it returns 0 if the
+    ** report can't be queued: EP1 is busy or halted, or the device isn't
+    ** configured yet.
+    **-----------------------------------------------------------------------*/
+    if (USB_bIntBusy() || DevConfig == 0 || (DevHalt & EP1_IN_HALT) ||
+        siz == 0)
     {
-        _usbLoadData(ptr, ENDPOINT0_SIZE);
-        ptr += ENDPOINT0_SIZE; txLength -= ENDPOINT0_SIZE;
+        return 0;
     }
-    if (txLength > 0)
+
+    IntPtr = dat;
+    IntLength = siz;
+    USB_vLoadNextInt();
+
+    return 1;
+}
+
+BYTE USB_bIntBusy(void)
+{
+    return IntArmed || IntLength != 0;
+}
+
+void USB_vStallCtrl(void)
+{
+    /*-------------------------------------------------------------------------
+    ** STALL every IN/OUT token on EP0 until the host issues the next SETUP.
+    ** it's used for unsupported or malformed requests.
+    **-----------------------------------------------------------------------*/
+    CtrlStage = CTRL_IDLE;
+    _usbStallEP0();
+}
+
+void USB_vTask(void)
+{
+    BYTE len, chunk[ENDPOINT0_SIZE];
+
+    /*-------------------------------------------------------------------------
+    ** call it as often as possible. every call returns at once, but the one
+    ** which puts the CPU to Sleep in a SUSPEND of the bus. it returns when
+    ** the host resumes the device or an interrupt of the application wakes
+    ** the CPU up.
+    **-----------------------------------------------------------------------*/
+    if (_T2IF || DevSuspended)
     {
-        _usbLoadData(ptr, txLength);
+        USB_vSuspend();
     }
-    if (zlp)
+    USB_vTrimTask();
+
+    if (_usbBusReset())
     {
-        _usbLoadData(NULL, 0);
+        /* the device is in the Default state again */
+        CtrlStage = CTRL_IDLE;
+        CtrlAddress = NO_ADDRESS;
+        DevConfig = 0;
+        DevRemoteWakeup = 0;
+        DevHalt = 0;
+        IntLength = 0;
+        IntArmed = 0;
+        IntRxCount = 0;
     }
 
-    /* STATUS stage of control read */
-    _usbWaitZLP();
+    if (IntArmed && _usbInEPDone(INT_EP))
+    {
+        /* the host has got a packet of the report, arm the next one */
+        IntArmed = 0;
+        if (IntLength != 0)
+        {
+            USB_vLoadNextInt();
+        }
+    }
 
-    return (BYTE)txLength;
+    /* chunk[] takes a packet of EP1 as well, ENDPOINT1_SIZE is 8 too */
+    len = _usbOutEPDone(INT_EP, chunk, ENDPOINT1_SIZE);
+    if (len != 0xFF)
+    {
+        /*---------------------------------------------------------------------
+        ** EP1 NAKs the host until it's armed again, so hid.c gets the packet
+        ** before the next one comes.
+        **-------------------------------------------------------------------*/
+        HID_vIntSink(chunk, IntRxCount, len);
+        IntRxCount += len;
+        if (len < ENDPOINT1_SIZE || IntRxCount >= USB_OUTPUT_REPORT_SIZE)
+        {
+            HID_vIntRxDone(IntRxCount);
+            IntRxCount = 0;
+        }
+        _usbArmOutEP(INT_EP);
+    }
+
+    switch(CtrlStage)
+    {
+    case CTRL_DATA_IN:
+        if (_usbInDone())
+        {
+            USB_vLoadNext();
+        }
+        break;
+
+    case CTRL_DATA_OUT:
+        len = CtrlLength >= ENDPOINT0_SIZE? ENDPOINT0_SIZE:(BYTE)CtrlLength;
+        len = _usbOutDone(CtrlPtr == NULL? chunk:CtrlPtr, len);
+        if (len != 0xFF)
+        {
+            if (CtrlPtr == NULL)
+            {
+                HID_vCtrlSink(chunk, CtrlCount, len);
+            }
+            else
+            {
+                CtrlPtr += len;
+            }
+            CtrlLength -= len; CtrlCount += len;
+            if (len < ENDPOINT0_SIZE || CtrlLength == 0)
+            {
+                /*-------------------------------------------------------------
+                ** hid.c may STALL the STATUS stage if the data is wrong.
+                **-----------------------------------------------------------*/
+                CtrlStage = CTRL_STATUS_IN;
+                if (CtrlClass)
+                {
+                    HID_vCtrlRxDone(CtrlCount);
+                }
+                if (CtrlStage == CTRL_STATUS_IN)
+                {
+                    _usbArmZLP();
+                }
+            }
+            else
+            {
+                _usbArmOut();
+            }
+        }
+        break;
+
+    case CTRL_STATUS_IN:
+        if (_usbInDone())
+        {
+            CtrlStage = CTRL_IDLE;
+            if (CtrlAddress != NO_ADDRESS)
+            {
+                _usbSetAddress(CtrlAddress);
+                CtrlAddress = NO_ADDRESS;
+            }
+        }
+        break;
+
+    case CTRL_STATUS_OUT:
+        if (_usbOutDone(NULL, 0) != 0xFF)
+        {
+            CtrlStage = CTRL_IDLE;
+            if (CtrlClass)
+            {
+                HID_vCtrlTxDone();
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
 }
@@ -0,0 +1,196 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        desc.c Descriptors generated by descgen.py.
+ *
+ * THIS FILE IS GENERATED. Please modify Tools/DescGen/vusb.desc and run
+ * desc.bat instead of editing it.
+ *
+ *---------------------------------------------------------------------------*/
+#include "main.h"
+
+/*-----------------------------------------------------------------------------
+** all descriptors, 149 bytes
+**---------------------------------------------------------------------------*/
+const BYTE USB_DescBlob[USB_DESC_BLOB_SIZE] =
+{
+    /* DEVICE descriptor                                                     */
+    0x12,                           /* bLength                               */
+    0x01,                           /* bDescriptorType                       */
+    0x10,0x01,                      /* bcdUSB                                */
+    0x00,                           /* bDeviceClass                          */
+    0x00,                           /* bDeviceSubClass                       */
+    0x00,                           /* bDeviceProtocol                       */
+    0x08,                           /* bMaxPacketSize0                       */
+    0x6E,0x09,                      /* idVendor                              */
+    0x00,0x01,                      /* idProduct                             */
+    0x00,0x01,                      /* bcdDevice                             */
+    0x01,                           /* iManufacturer (string 1)              */
+    0x02,                           /* iProduct (string 2)                   */
+    0x00,                           /* iSerialNumber (no string)             */
+    0x01,                           /* bNumConfigurations                    */
+    /* CONFIGURATION descriptor 0                                            */
+    0x09,                           /* bLength                               */
+    0x02,                           /* bDescriptorType                       */
+    0x29,0x00,                      /* wTotalLength                          */
+    0x01,                           /* bNumInterfaces                        */
+    0x01,                           /* bConfigurationValue                   */
+    0x00,                           /* iConfiguration (no string)            */
+    0xA0,                           /* bmAttributes                          */
+    0x10,                           /* bMaxPower                             */
+    /* INTERFACE descriptor 0.0                                              */
+    0x09,                           /* bLength                               */
+    0x04,                           /* bDescriptorType                       */
+    0x00,                           /* bInterfaceNumber                      */
+    0x00,                           /* bAlternateSetting                     */
+    0x02,                           /* bNumEndpoints                         */
+    0x03,                           /* bInterfaceClass                       */
+    0x00,                           /* bInterfaceSubClass                    */
+    0x00,                           /* bInterfaceProtocol                    */
+    0x00,                           /* iInterface (no string)                */
+    /* HID CLASS descriptor                                                  */
+    0x09,                           /* bLength                               */
+    0x21,                           /* bDescriptorType                       */
+    0x10,0x01,                      /* bcdHID                                */
+    0x00,                           /* bCountryCode                          */
+    0x01,                           /* bNumDescriptors                       */
+    0x22,                           /* bDescriptorType (HID REPORT)          */
+    0x40,0x00,                      /* wDescriptorLength                     */
+    /* ENDPOINT descriptor 0x81                                              */
+    0x07,                           /* bLength                               */
+    0x05,                           /* bDescriptorType                       */
+    0x81,                           /* bEndpointAddress                      */
+    0x03,                           /* bmAttributes                          */
+    0x08,0x00,                      /* wMaxPacketSize                        */
+    0x0A,                           /* bInterval                             */
+    /* ENDPOINT descriptor 0x01                                              */
+    0x07,                           /* bLength                               */
+    0x05,                           /* bDescriptorType                       */
+    0x01,                           /* bEndpointAddress                      */
+    0x03,                           /* bmAttributes                          */
+    0x08,0x00,                      /* wMaxPacketSize                        */
+    0x0A,                           /* bInterval                             */
+    /* HID REPORT descriptor of interface 0                                  */
+    0x06,0x00,0xFF,                 /*  Usage Page (0xFF00)                  */
+    0x09,0x01,                      /*  Usage (1)                            */
+    0xA1,0x01,                      /*  Collection (1)                       */
+    0x75,0x08,                      /*   Report Size (8)                     */
+    0x85,0x01,                      /*   Report ID (1)                       */
+    0x95,0x07,                      /*   Report Count (7)                    */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0xB1,0x02,                      /*   Feature (2)                         */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0x81,0x02,                      /*   Input (2)                           */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0x91,0x02,                      /*   Output (2)                          */
+    0x85,0x02,                      /*   Report ID (2)                       */
+    0x95,0x0F,                      /*   Report Count (0xF)                  */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0xB1,0x02,                      /*   Feature (2)                         */
+    0x85,0x03,                      /*   Report ID (3)                       */
+    0x95,0x1F,                      /*   Report Count (0x1F)                 */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0xB1,0x02,                      /*   Feature (2)                         */
+    0x85,0x04,                      /*   Report ID (4)                       */
+    0x95,0x3F,                      /*   Report Count (0x3F)                 */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0xB1,0x02,                      /*   Feature (2)                         */
+    0x85,0x05,                      /*   Report ID (5)                       */
+    0x95,0x3F,                      /*   Report Count (0x3F)                 */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0xB1,0x02,                      /*   Feature (2)                         */
+    0x95,0x07,                      /*   Report Count (7)                    */
+    0x09,0x01,                      /*   Usage (1)                           */
+    0x81,0x02,                      /*   Input (2)                           */
+    0xC0,                           /*  End Collection                       */
+    /* STRING descriptor 0 (LANGID)                                          */
+    0x04,                           /* bLength                               */
+    0x03,                           /* bDescriptorType                       */
+    0x09,0x04,                      /* wLANGID                               */
+    /* STRING descriptor 1 (0x0409) "Genie"                                  */
+    0x0C,                           /* bLength                               */
+    0x03,                           /* bDescriptorType                       */
+    'G', 0x00,
+    'e', 0x00,
+    'n', 0x00,
+    'i', 0x00,
+    'e', 0x00,
+    /* STRING descriptor 2 (0x0409) "VUSB"                                   */
+    0x0A,                           /* bLength                               */
+    0x03,                           /* bDescriptorType                       */
+    'V', 0x00,
+    'U', 0x00,
+    'S', 0x00,
+    'B', 0x00
+};
+
+/*-----------------------------------------------------------------------------
+** (type, index, langid) of each row, the rows of a type are ordered by
+** langid and index. HID and HID REPORT descriptors are indexed by the
+** interface number.
+**---------------------------------------------------------------------------*/
+const USB_DESC USB_DescTable[] =
+{
+    {0x0000,  18},                  /* DEVICE         0  0x0000              */
+    {0x0012,  41},                  /* CONFIGURATION  0  0x0000              */
+    {0x007B,   4},                  /* STRING         0  0x0000              */
+    {0x007F,  12},                  /* STRING         1  0x0409              */
+    {0x008B,  10},                  /* STRING         2  0x0409              */
+    {0x0024,   9},                  /* HID            0  0x0000              */
+    {0x003B,  64}                   /* HID REPORT     0  0x0000              */
+};
+
+const USB_DESC_TYPE USB_DescType[8] =
+{
+    {0x00,   0,   0},               /* slot 0                                */
+    {0x01,   0,   1},               /* slot 1 DEVICE                         */
+    {0x02,   1,   1},               /* slot 2 CONFIGURATION                  */
+    {0x03,   2,   3},               /* slot 3 STRING                         */
+    {0x00,   0,   0},               /* slot 4                                */
+    {0x21,   5,   1},               /* slot 5 HID                            */
+    {0x22,   6,   1},               /* slot 6 HID REPORT                     */
+    {0x00,   0,   0}                /* slot 7                                */
+};
+
+const WORD USB_DescLangID[USB_NUM_LANGUAGES] =
+{
+    0x0409                          /* language 0                            */
+};
+
+/*-----------------------------------------------------------------------------
+** bytes of the Input, Output and Feature report of each REPORT ID, 0 if
+** there isn't such a report. the row is the report type of GET_REPORT
+** and SET_REPORT less 1.
+**---------------------------------------------------------------------------*/
+const WORD USB_ReportSize[3][USB_NUM_REPORT_ID] =
+{
+    {0, 8, 0, 0, 0, 8},             /* Input                                 */
+    {0, 8, 0, 0, 0, 0},             /* Output                                */
+    {0, 8, 16, 32, 64, 64}          /* Feature                               */
+};
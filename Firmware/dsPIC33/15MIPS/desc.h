@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        desc.h Descriptors generated by descgen.py.
+ *
+ * THIS FILE IS GENERATED. Please modify Tools/DescGen/vusb.desc and run
+ * desc.bat instead of editing it.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _DESC_H_
+#define _DESC_H_
+
+#define USB_DESC_BLOB_SIZE      149
+#define USB_NUM_CONFIGS         1
+#define USB_NUM_LANGUAGES       1
+#define USB_NUM_STRINGS         2
+
+/* of the 1st configuration, used by the standard requests */
+#define USB_CONFIG_ATTRIBUTES   0xA0
+#define USB_NUM_INTERFACES      1
+#define USB_MAX_ENDPOINT        1
+
+/* bytes of the largest reports of the 1st HID interface, with the
+   ID byte if the report descriptor has REPORT IDs */
+#define USB_INPUT_REPORT_SIZE   8
+#define USB_OUTPUT_REPORT_SIZE  8
+#define USB_FEATURE_REPORT_SIZE 64
+#define USB_NUM_REPORT_ID       6
+
+/*-----------------------------------------------------------------------------
+** USB_DescType[USB_DESC_SLOT(type)] is the row of a descriptor type.
+**---------------------------------------------------------------------------*/
+#define USB_DESC_SLOT(t)        ((((t) >> 3) ^ (t)) & 7)
+
+typedef struct
+{
+    WORD offset;                    /* offset in USB_DescBlob[]              */
+    WORD length;                    /* 0 if there isn't such a descriptor    */
+} USB_DESC;
+
+typedef struct
+{
+    BYTE type;                      /* 0 for an unused slot                  */
+    BYTE first;                     /* first row in USB_DescTable[]          */
+    BYTE count;                     /* count of indexes of the type          */
+} USB_DESC_TYPE;
+
+extern const BYTE USB_DescBlob[];
+extern const USB_DESC USB_DescTable[];
+extern const USB_DESC_TYPE USB_DescType[];
+extern const WORD USB_DescLangID[];
+extern const WORD USB_ReportSize[3][USB_NUM_REPORT_ID];
+
+#endif
@@ -0,0 +1,206 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        dsp.c The jobs of the DSP commands for the kernels of dsp.s.
+ *
+ *---------------------------------------------------------------------------*/
+#include "main.h"
+
+#ifdef DSP_SERVICE /* main.h */
+
+#if 2*DSP_MAX_FFT < DSP_MAX_BLOCK || DSP_MAX_FFT != (1 << DSP_MAX_LOG2)
+#error "the FFT takes the block of Samples[], DSP_MAX_FFT is 2^DSP_MAX_LOG2"
+#endif
+
+/*-----------------------------------------------------------------------------
+** the MACs walk Samples[] by w8 in X space and Taps[] and Scratch[] by w10
+** in Y space. Samples[] keeps the last DSP_MAX_TAPS-1 samples of the FIR in
+** front of the block of the report, which is the buffer of the FFT as well.
+**---------------------------------------------------------------------------*/
+#define BLOCK                   (DSP_MAX_TAPS-1)
+
+static int Samples[BLOCK+2*DSP_MAX_FFT] __attribute__((space(xmemory)));
+static int Taps[DSP_MAX_TAPS] __attribute__((space(ymemory)));
+static int Scratch[DSP_MAX_BLOCK] __attribute__((space(ymemory)));
+static BYTE NumTaps;
+
+/* cos and sin of 2*pi*k/DSP_MAX_FFT in Q15, read by _dspFft() through PSV */
+static const int Twiddle[DSP_MAX_FFT] =
+{
+    0x7FFF, 0x0000, 0x7642, 0x30FC, 0x5A82, 0x5A82, 0x30FC, 0x7642,
+    0x0000, 0x7FFF, 0xCF04, 0x7642, 0xA57E, 0x5A82, 0x89BE, 0x30FC,
+};
+
+/* the reports are bytes, a Q15 may be at an odd address */
+static int DSP_iLoad(const BYTE *dat)
+{
+    return (int)(dat[0] | (dat[1] << 8));
+}
+
+static void DSP_vStore(BYTE *dat, int v)
+{
+    dat[0] = v & 0xFF;
+    dat[1] = (v >> 8) & 0xFF;
+}
+
+WORD DSP_wCmdTaps(const BYTE *req, BYTE *rsp, WORD len)
+{
+    BYTE n = req[0], i;
+
+    if (n < 2 || n > DSP_MAX_TAPS || 1+2*n > len)
+    {
+        n = 0;
+    }
+    /* the last one first, as _dspFir() takes them */
+    for (i=0; i<n; i++)
+    {
+        Taps[n-1-i] = DSP_iLoad(req+1+2*i);
+    }
+    /* the new filter starts from silence */
+    for (i=0; i<BLOCK; i++)
+    {
+        Samples[i] = 0;
+    }
+    NumTaps = n;
+    rsp[0] = n;
+    return 1;
+}
+
+WORD DSP_wCmdFir(const BYTE *req, BYTE *rsp, WORD len)
+{
+    BYTE n = req[0], i;
+    int *x;
+
+    if (n > DSP_MAX_BLOCK)
+    {
+        n = DSP_MAX_BLOCK;
+    }
+    if (1+2*n > len)
+    {
+        n = (len-1)/2;
+    }
+    if (NumTaps == 0)
+    {
+        n = 0;
+    }
+    for (i=0; i<n; i++)
+    {
+        Samples[BLOCK+i] = DSP_iLoad(req+1+2*i);
+    }
+    /* the window of the first output starts NumTaps-1 samples back */
+    x = Samples+BLOCK-(NumTaps-1);
+    if (n != 0)
+    {
+        _dspFir(Scratch, x, Taps, NumTaps, n);
+    }
+
+    /* the response is written over the request, which has been taken */
+    rsp[0] = n;
+    for (i=0; i<n; i++)
+    {
+        DSP_vStore(rsp+1+2*i, Scratch[i]);
+    }
+    /* the last NumTaps-1 samples go in front of the next block */
+    for (i=0; n!=0 && i<NumTaps-1; i++)
+    {
+        x[i] = x[n+i];
+    }
+    return 1+2*n;
+}
+
+WORD DSP_wCmdDot(const BYTE *req, BYTE *rsp, WORD len)
+{
+    BYTE n = req[0], i;
+    long dot = 0;
+
+    if (n > DSP_MAX_DOT)
+    {
+        n = DSP_MAX_DOT;
+    }
+    if (1+4*n > len)
+    {
+        n = (len-1)/4;
+    }
+    for (i=0; i<n; i++)
+    {
+        Samples[BLOCK+i] = DSP_iLoad(req+1+2*i);
+        Scratch[i] = DSP_iLoad(req+1+2*(n+i));
+    }
+    if (n != 0)
+    {
+        dot = _dspDot(Samples+BLOCK, Scratch, n);
+    }
+    DSP_vStore(rsp, (int)dot);
+    DSP_vStore(rsp+2, (int)(dot >> 16));
+    return 4;
+}
+
+WORD DSP_wCmdFft(const BYTE *req, BYTE *rsp, WORD len)
+{
+    BYTE bits = req[0], n, i, j, k;
+    int *buf = Samples+BLOCK;
+
+    /* bits is the host's, it's checked before it makes a shift */
+    if (bits < 1 || bits > DSP_MAX_LOG2)
+    {
+        rsp[0] = 0;
+        return 1;
+    }
+    n = 1 << bits;
+    if (1+2*n > len)
+    {
+        rsp[0] = 0;
+        return 1;
+    }
+    /* the real samples go in bit-reversed order, with no imaginary part */
+    for (i=0; i<n; i++)
+    {
+        for (j=0, k=0; j<bits; j++)
+        {
+            k = (k << 1) | ((i >> j) & 1);
+        }
+        buf[2*k] = DSP_iLoad(req+1+2*i);
+        buf[2*k+1] = 0;
+    }
+    _dspFft(buf, bits, Twiddle);
+
+    /* a real signal has a symmetric spectrum, the bins 0..n/2 tell it all */
+    rsp[0] = bits;
+    for (i=0; i<=n/2; i++)
+    {
+        DSP_vStore(rsp+1+4*i, buf[2*i]);
+        DSP_vStore(rsp+3+4*i, buf[2*i+1]);
+    }
+    return 1+4*(n/2+1);
+}
+
+#endif
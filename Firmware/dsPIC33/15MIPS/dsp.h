@@ -0,0 +1,68 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        dsp.h Header file for dsp.c and dsp.s.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _DSP_H_ /* this file has been included into main.h */
+#define _DSP_H_
+
+/*-----------------------------------------------------------------------------
+** the commands of the DSP engine, in Q15 (-1 to 1-2^-15, little-endian).
+** each job fits a Feature report of 64 bytes, and its result comes back in
+** the same report. the taps of the FIR and its last samples stay in RAM
+** from a report to the next, so the host filters a signal of any length.
+**---------------------------------------------------------------------------*/
+#define DSP_MAX_TAPS            16
+#define DSP_MAX_BLOCK           30      /* samples of a FIR report */
+#define DSP_MAX_DOT             15      /* pairs of a DOT report */
+#define DSP_MAX_FFT             16      /* points of an FFT report */
+#define DSP_MAX_LOG2            4
+
+/* [taps:1][h: taps] -> [taps:1], 0 if it's not 2..DSP_MAX_TAPS */
+WORD DSP_wCmdTaps(const BYTE *req, BYTE *rsp, WORD len);
+
+/* [n:1][x: n] -> [n:1][y: n], the FIR of the last TAPS */
+WORD DSP_wCmdFir(const BYTE *req, BYTE *rsp, WORD len);
+
+/* [n:1][x: n][y: n] -> [dot:4], the sum of x*y in Q1.31 */
+WORD DSP_wCmdDot(const BYTE *req, BYTE *rsp, WORD len);
+
+/* [log2n:1][x: n real] -> [log2n:1][X: n/2+1 complex], the DFT / n */
+WORD DSP_wCmdFft(const BYTE *req, BYTE *rsp, WORD len);
+
+/* the kernels in dsp.s */
+extern long _dspDot(const int *x, const int *y, WORD n);
+extern void _dspFir(int *y, const int *x, const int *h, WORD taps, WORD n);
+extern void _dspFft(int *buf, WORD log2n, const int *tw);
+
+#endif
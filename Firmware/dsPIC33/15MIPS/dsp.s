@@ -0,0 +1,230 @@
+;; ----------------------------------------------------------------------------
+;; Copyright (C) 2019-2020 Zach Lee.
+;;
+;; Licensed under the MIT License, you may not use this file except in
+;; compliance with the License.
+;;
+;; MIT License:
+;;
+;; Permission is hereby granted, free of charge, to any person obtaining
+;; a copy of this software and associated documentation files (the "Software"),
+;; to deal in the Software without restriction, including without limitation
+;; the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;; and/or sell copies of the Software, and to permit persons to whom the
+;; Software is furnished to do so, subject to the following conditions:
+;;
+;; The above copyright notice and this permission notice shall be included in
+;; all copies or substantial portions of the Software.
+;;
+;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+;; THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+;; FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+;; IN THE SOFTWARE.
+;;
+;; ----------------------------------------------------------------------------
+;;
+;; $Date:        11. May 2020
+;; $Revision:    V0.0.0
+;;
+;; Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+;; Title:        dsp.s The Q15 kernels of dsp.c on the DSP engine.
+;;
+;;-----------------------------------------------------------------------------
+;;
+;; each kernel sets CORCON for signed fractional math with saturation of
+;; both accumulators at 1.31 and of the writes from them, and conventional
+;; rounding, then gives the caller its CORCON back. the MACs fetch their
+;; next operands from X space by w8 and from Y space by w10 while they
+;; multiply, so the arrays they walk must be in xmemory and ymemory. w8..w14
+;; belong to the caller and are saved. the cycles are for dsPIC33F, see
+;; Tools/DSP/dspsim.py.
+;;
+;; the loops of MACs are DO loops. the CN interrupt of sie.s runs REPEATs
+;; of its own but saves RCOUNT around them, and it never runs a DO, so a
+;; keep-alive cuts neither kind of loop short.
+;;
+;;-----------------------------------------------------------------------------
+        .text
+        .global __dspDot
+        .global __dspFir
+        .global __dspFft
+
+;; signed fractional, SATA, SATB, SATDW, 1.31, RND. PSV and IPL3 are kept
+.equ    DSP_CORCON, 0x00E2
+
+;;-----------------------------------------------------------------------------
+;;
+;; long _dspDot(const int *x, const int *y, WORD n)
+;;
+;; the sum of x[i]*y[i] for n >= 1, in Q1.31. x is in X space, y in Y space.
+;; one MAC a pair.
+;;
+;;-----------------------------------------------------------------------------
+__dspDot:
+        mov     w8, [w15++]             ; 1
+        mov     w10, [w15++]            ; 1
+        mov     CORCON, w3              ; 1
+        mov     w3, [w15++]             ; 1
+        and     w3, #0x0C, w3           ; 1 (PSV and IPL3)
+        mov     #DSP_CORCON, w4         ; 1
+        ior     w3, w4, w3              ; 1
+        mov     w3, CORCON              ; 1
+
+        mov     w0, w8                  ; 1
+        mov     w1, w10                 ; 1
+        clr     A, [w8]+=2, w4, [w10]+=2, w6    ; 1 (x[0], y[0])
+        sub     w2, #2, w2              ; 1
+        bra     n, __dsp_dot_last       ; 2/1 (n == 1)
+        do      w2, __dsp_dot_pair      ; 2
+__dsp_dot_pair:
+        mac     w4*w6, A, [w8]+=2, w4, [w10]+=2, w6 ; n-1
+__dsp_dot_last:
+        mac     w4*w6, A                ; 1
+        mov     ACCAL, w0               ; 1
+        mov     ACCAH, w1               ; 1
+
+        mov     [--w15], w3             ; 1
+        mov     w3, CORCON              ; 1
+        mov     [--w15], w10            ; 1
+        mov     [--w15], w8             ; 1
+        return                          ; 3
+
+;;-----------------------------------------------------------------------------
+;;
+;; void _dspFir(int *y, const int *x, const int *h, WORD taps, WORD n)
+;;
+;; n >= 1 outputs of a FIR of taps >= 2. x holds the taps-1 samples before
+;; the block and then the n samples of it, in X space. h holds the taps
+;; from the last one to h[0], in Y space, so y[i] is the sum of x[i+j]*h[j]
+;; for j of 0..taps-1, rounded to Q15. taps+10 cycles an output.
+;;
+;;-----------------------------------------------------------------------------
+__dspFir:
+        mov     w8, [w15++]             ; 1
+        mov     w10, [w15++]            ; 1
+        mov     CORCON, w5              ; 1
+        mov     w5, [w15++]             ; 1
+        and     w5, #0x0C, w5           ; 1
+        mov     #DSP_CORCON, w6         ; 1
+        ior     w5, w6, w5              ; 1
+        mov     w5, CORCON              ; 1
+
+        sub     w3, #2, w3              ; 1 (the MACs with a fetch, -1)
+        mov     w4, w5                  ; 1 (n outputs)
+
+__dsp_fir_next:
+        mov     w1, w8                  ; 1 (x[i])
+        mov     w2, w10                 ; 1 (h[0])
+        clr     A, [w8]+=2, w4, [w10]+=2, w6    ; 1
+        do      w3, __dsp_fir_tap       ; 2
+__dsp_fir_tap:
+        mac     w4*w6, A, [w8]+=2, w4, [w10]+=2, w6 ; taps-1
+        mac     w4*w6, A                ; 1
+        sac.r   A, [w0++]               ; 1 (y[i])
+        inc2    w1, w1                  ; 1
+        dec     w5, w5                  ; 1
+        bra     nz, __dsp_fir_next      ; 2/1
+
+        mov     [--w15], w5             ; 1
+        mov     w5, CORCON              ; 1
+        mov     [--w15], w10            ; 1
+        mov     [--w15], w8             ; 1
+        return                          ; 3
+
+;;-----------------------------------------------------------------------------
+;;
+;; void _dspFft(int *buf, WORD log2n, const int *tw)
+;;
+;; the FFT of n = 2^log2n complex points, 2 <= n <= 16, in place in buf
+;; [re, im, re, im...], which holds them in bit-reversed order and then the
+;; spectrum in order, each stage scaled by 1/2, so it's the DFT / n. tw[2k]
+;; and tw[2k+1] are cos and sin of 2*pi*k/16 for k of 0..7, the twiddle of
+;; k is cos - j*sin. radix 2, decimation in time. a stage goes over the
+;; twiddles, and a twiddle over the groups of the stage in a DO loop:
+;;
+;;   t = b*W, a = a/2 + t/2, b = a/2 - t/2
+;;
+;; the /2 keeps every point within the unit circle of the input.
+;;
+;;-----------------------------------------------------------------------------
+__dspFft:
+        mov     w8, [w15++]             ; 1
+        mov     w9, [w15++]             ; 1
+        mov     w10, [w15++]            ; 1
+        mov     w11, [w15++]            ; 1
+        mov     w12, [w15++]            ; 1
+        mov     w13, [w15++]            ; 1
+        mov     w14, [w15++]            ; 1
+        mov     CORCON, w5              ; 1
+        mov     w5, [w15++]             ; 1
+        and     w5, #0x0C, w5           ; 1
+        mov     #DSP_CORCON, w6         ; 1
+        ior     w5, w6, w5              ; 1
+        mov     w5, CORCON              ; 1
+
+        mov     #4, w3                  ; 1 (b - a, 1 point in bytes)
+        mov     #32, w11                ; 1 (8 twiddles a step)
+        dec     w1, w1                  ; 1
+        mov     #1, w12                 ; 1
+        sl      w12, w1, w12            ; 1 (n/2 groups)
+
+__dsp_fft_stage:
+        sl      w3, #1, w1              ; 1 (a group in bytes)
+        mov     w2, w10                 ; 1 (tw[0])
+        mov     w0, w13                 ; 1 (a of the twiddle)
+        lsr     w3, #2, w14             ; 1 (twiddles of the stage)
+
+__dsp_fft_twiddle:
+        mov     [w10], w6               ; 1 (cos)
+        mov     [w10+2], w7             ; 1 (sin)
+        add     w10, w11, w10           ; 1
+        mov     w13, w8                 ; 1 (a)
+        add     w13, w3, w9             ; 1 (b)
+        dec     w12, w5                 ; 1
+        do      w5, __dsp_fft_end       ; 2
+        mov     [w9], w4                ; 1 (b.re)
+        mov     [w9+2], w5              ; 1 (b.im)
+        mpy     w4*w6, A                ; 1
+        mac     w5*w7, A                ; 1 (t.re = b.re*cos + b.im*sin)
+        mpy     w5*w6, B                ; 1
+        msc     w4*w7, B                ; 1 (t.im = b.im*cos - b.re*sin)
+        sac.r   A, #1, w4               ; 1 (t.re/2)
+        sac.r   B, #1, w5               ; 1 (t.im/2)
+        lac     [w8++], #1, A           ; 1 (a.re/2)
+        lac     [w8--], #1, B           ; 1 (a.im/2)
+        add     w4, #0, A               ; 1
+        add     w5, #0, B               ; 1
+        sac.r   A, [w8++]               ; 1 (a.re)
+        sac.r   B, [w8--]               ; 1 (a.im)
+        neg     w4, w4                  ; 1
+        neg     w5, w5                  ; 1
+        add     w4, #-1, A              ; 1 (a.re/2 - t.re/2)
+        add     w5, #-1, B              ; 1
+        sac.r   A, [w9++]               ; 1 (b.re)
+        sac.r   B, [w9--]               ; 1 (b.im)
+        add     w8, w1, w8              ; 1 (the next group)
+__dsp_fft_end:
+        add     w9, w1, w9              ; 1
+
+        add     w13, #4, w13            ; 1 (the next twiddle)
+        dec     w14, w14                ; 1
+        bra     nz, __dsp_fft_twiddle   ; 2/1
+        sl      w3, #1, w3              ; 1 (b twice as far)
+        lsr     w11, #1, w11            ; 1 (twiddles twice as dense)
+        lsr     w12, #1, w12            ; 1 (half the groups)
+        bra     nz, __dsp_fft_stage     ; 2/1
+
+        mov     [--w15], w5             ; 1
+        mov     w5, CORCON              ; 1
+        mov     [--w15], w14            ; 1
+        mov     [--w15], w13            ; 1
+        mov     [--w15], w12            ; 1
+        mov     [--w15], w11            ; 1
+        mov     [--w15], w10            ; 1
+        mov     [--w15], w9             ; 1
+        mov     [--w15], w8             ; 1
+        return                          ; 3
+        .end
@@ -35,39 +35,455 @@
  *---------------------------------------------------------------------------*/
 #include "main.h"
 
-static BYTE State;
-#define RESPONSE			0
-#define COMMAND				1
+#if USB_FEATURE_REPORT_SIZE > HID_MAX_FEATURE
+#error "the Feature report in vusb.desc is larger than HID_MAX_FEATURE"
+#endif
+#if USB_INPUT_REPORT_SIZE > USB_FEATURE_REPORT_SIZE || \
+    USB_OUTPUT_REPORT_SIZE > USB_FEATURE_REPORT_SIZE
+#error "Input and Output reports share FeatureRpt, they can't be larger"
+#endif
+#if HID_QUEUE_SLOTS < 1 || HID_QUEUE_SLOTS > 128 || \
+    (HID_QUEUE_SLOTS & (HID_QUEUE_SLOTS-1)) != 0
+#error "HID_QUEUE_SLOTS must be a power of 2 up to 128"
+#endif
 
-static BYTE RequestPkt[64];
-static BYTE FeatureRpt[64];
+static BYTE Whiten;
+#define WHITEN_OFF			0
+#define WHITEN_PN9			1
+#define WHITEN_SPECK		2       /* Speck64/128 CTR of cipher.c     */
 
-void HID_vInit(BYTE Mode)
+static BYTE Pending;                /* report type of the control transfer */
+static BYTE PendingId;              /* report ID of the control transfer   */
+static WORD PendingLen;             /* data length of SET_REPORT           */
+static BYTE Command;                /* an Output report waits on EP1       */
+#define CMD_NONE            0
+#define CMD_FEATURE         1       /* SET_FEATURE, in a slot of FeatureRpt*/
+#define CMD_OUTPUT          2       /* an Output report on EP1, OutputRpt  */
+static WORD CommandLen;             /* bytes of the Output report with ID  */
+static WORD Lfsr;                   /* PN9 state of the streamed report    */
+
+/*-----------------------------------------------------------------------------
+** the reports are streamed into and out of the slots of FeatureRpt by
+** HID_vCtrlSink() and HID_vCtrlSource() 8 bytes at a time, there isn't any
+** other copy of them. the slots are a queue: SET_FEATURE takes one
+** (QueueIn), its command is handled in place (QueueRun) and GET_FEATURE
+** gives it back (QueueOut), so the host may send the next command before
+** it has read the last response. each index has one writer, USB_vTask()
+** moves QueueIn and QueueOut and HID_vDispatch() moves QueueRun, so they
+** need no lock. they wrap at 256, the slot is the index modulo the slots.
+**---------------------------------------------------------------------------*/
+static BYTE RequestPkt[8];
+static BYTE FeatureRpt[HID_QUEUE_SLOTS][USB_FEATURE_REPORT_SIZE];
+static WORD SlotLen[HID_QUEUE_SLOTS];       /* bytes of the command     */
+static BYTE SlotOff[HID_QUEUE_SLOTS];       /* bytes before its opcode  */
+static const HID_SEGMENT *SlotReply[HID_QUEUE_SLOTS];
+static BYTE SlotReplyNum[HID_QUEUE_SLOTS];  /* 0 if the slot holds it all */
+static BYTE QueueIn, QueueRun, QueueOut;
+static BYTE QueueHead;              /* heads sent on EP1 up to here        */
+static BYTE RxSlot;                 /* the slot of SET_FEATURE             */
+static BYTE TxSlot;                 /* the slot of GET_REPORT              */
+#define SLOT(n)             ((n) & (HID_QUEUE_SLOTS-1))
+static BYTE InputRpt[USB_INPUT_REPORT_SIZE];    /* the result on EP1 */
+static BYTE OutputRpt[USB_OUTPUT_REPORT_SIZE];  /* the command on EP1 */
+static BYTE EchoRpt[USB_OUTPUT_REPORT_SIZE];    /* SET_OUTPUT_REPORT */
+static BYTE InputId;                /* the ID of the Input report on EP1 */
+static WORD InputLen;               /* and its bytes with the ID byte    */
+
+/* HID_vReplyFrom() of the handler running, kept in its slot after it */
+static const HID_SEGMENT *Reply;
+static BYTE ReplyNum;
+static BYTE ReplySlot;              /* of HID_bReplySlot()                 */
+
+/*-----------------------------------------------------------------------------
+** the idle rate of SET_IDLE in 4ms units. an Input report which hasn't
+** changed is sent again only after the idle duration, never if it's 0.
+** the 4ms tick is taken from the frames of the host, 4 keep-alives. only
+** a result of HID_bTxResult() is repeated, a response of a command in
+** InputRpt clears InputSent and goes out once.
+**---------------------------------------------------------------------------*/
+static BYTE IdleRate[HID_NUM_REPORT_ID];
+static BYTE IdleCount;              /* 4ms ticks since the last Input report */
+static WORD IdleFrame;              /* the frame of the last tick            */
+static BYTE InputSent;              /* InputRpt holds a result, gone out     */
+#define IDLE_FRAMES             4
+
+/*-----------------------------------------------------------------------------
+** PN9 (x^9+x^5+1) whitening of a Feature report. a report of all 0x00 or all
+** 0xFF makes a stuff-bit every 6 bits on the wire, the whitened report has
+** a few of them only. the LFSR starts from 0x1FF for every report, so that
+** a lost report never puts the host and the device out of step. whitening
+** the data twice gives the original data back. it returns the LFSR for the
+** next packet of the same report.
+**---------------------------------------------------------------------------*/
+static WORD HID_wWhiten(BYTE *dat, BYTE siz, WORD lfsr)
 {
     BYTE i;
 
+    while(siz--)
+    {
+        *dat++ ^= (BYTE)lfsr;
+        for (i=0; i<8; i++)
+        {
+            lfsr = (lfsr >> 1) | (((lfsr ^ (lfsr >> 5)) & 1) << 8);
+        }
+    }
+    return lfsr;
+}
+
+/*-----------------------------------------------------------------------------
+** Speck64/128 CTR of a packet of the Feature report rpt at offset. the ID
+** byte and the nonce after it go in clear, the payload behind them is
+** ciphered from its first byte on with the nonce of rpt, whichever report
+** of the queue has been ciphered last.
+**---------------------------------------------------------------------------*/
+static void HID_vCipher(const BYTE *rpt, BYTE *dat, WORD offset, BYTE len,
+                        DWORD dir)
+{
+    WORD head = HID_ID_BYTES+CPH_NONCE_SIZE;
+
+    if (offset < head)
+    {
+        if (offset+len <= head)
+        {
+            return;
+        }
+        dat += head-offset;
+        len -= head-offset;
+        offset = head;
+    }
+    CPH_vNonce(rpt+HID_ID_BYTES);
+    CPH_vCrypt(dat, offset-head, len, dir);
+}
+
+/*-----------------------------------------------------------------------------
+** bytes of the report of a type (wValue 1..3) and ID on the bus, 0 if the
+** report descriptor hasn't got it. the ID is below HID_NUM_REPORT_ID.
+**---------------------------------------------------------------------------*/
+static WORD HID_wReportSize(BYTE type, BYTE id)
+{
+    if (type < 0x01 || type > 0x03)
+    {
+        return 0;
+    }
+    return USB_ReportSize[type-1][id];
+}
+
+void HID_vInit(BYTE Mode)
+{
+    WORD i;
+
     /* driver initialization */
     USB_vInit();
 
     /* vars initialization */
-    State = COMMAND;
-    for (i=0; i<sizeof(FeatureRpt); i++)
+    Whiten = WHITEN_OFF;
+    Pending = 0;
+    Command = CMD_NONE;
+    ReplyNum = 0;
+    QueueIn = QueueRun = QueueOut = QueueHead = 0;
+    RxSlot = TxSlot = 0;
+    for (i=0; i<HID_QUEUE_SLOTS*USB_FEATURE_REPORT_SIZE; i++)
     {
-        FeatureRpt[i] = 0;
+        FeatureRpt[i/USB_FEATURE_REPORT_SIZE][i%USB_FEATURE_REPORT_SIZE] = 0;
     }
+    for (i=0; i<HID_QUEUE_SLOTS; i++)
+    {
+        SlotReplyNum[i] = 0;
+    }
+    for (i=0; i<HID_NUM_REPORT_ID; i++)
+    {
+        IdleRate[i] = 0;
+    }
+    IdleCount = 0;
+    IdleFrame = USB_wFrame();
+    InputSent = 0;
+
+    /* the Input report of the lowest ID is the one sent on EP1 */
+    InputId = 0;
+    while (InputId < HID_NUM_REPORT_ID-1 && USB_ReportSize[0][InputId] == 0)
+    {
+        InputId++;
+    }
+    InputLen = USB_ReportSize[0][InputId];
+
+    STR_vInit();
 }
 
-BYTE HID_bRxRequest(void *Req, WORD siz)
+static void HID_vIdleTask(void)
 {
-    BYTE ret;
-    WORD len,rxl;
-    DWORD adr;
+    /*-------------------------------------------------------------------------
+    ** repeat the last Input report when the idle duration is over. a tick
+    ** missed while USB_vTask() was busy only makes the repeat a bit late.
+    **-----------------------------------------------------------------------*/
+    if (!USB_bFrameElapsed(&IdleFrame, IDLE_FRAMES))
+    {
+        return;
+    }
+    if (IdleCount != 0xFF)
+    {
+        IdleCount++;
+    }
+    if (InputSent && IdleRate[InputId] != 0 &&
+        IdleCount >= IdleRate[InputId] &&
+        !USB_bIntBusy() && USB_bSendIntData(InputRpt, InputLen))
+    {
+        IdleCount = 0;
+    }
+}
+
+/*-----------------------------------------------------------------------------
+** len bytes of num segments of HID_vReplyFrom() from pos on, 0x00 after
+** the last one. the list is short, it's walked from its head every time.
+**---------------------------------------------------------------------------*/
+static void HID_vGather(const HID_SEGMENT *seg, BYTE num, BYTE *dat,
+                        WORD pos, BYTE len)
+{
+    while (len)
+    {
+        if (num == 0)
+        {
+            *dat++ = 0;
+            len--;
+        }
+        else
+        if (pos >= seg->siz)
+        {
+            pos -= seg->siz;
+            seg++; num--;
+        }
+        else
+        {
+            *dat++ = seg->dat[pos++];
+            len--;
+        }
+    }
+}
 
-    if (Req != NULL && siz == 2)
+/* len bytes of the response in slot k at offset, as GET_FEATURE has it */
+static void HID_vReplySource(BYTE k, BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+
+    for (i=0; i<len && (SlotReplyNum[k] == 0 || offset+i <= SlotOff[k]); i++)
+    {
+        dat[i] = FeatureRpt[k][offset+i];
+    }
+    if (i < len)
     {
-        *((BYTE*)Req+0) = 0;
-        *((BYTE*)Req+1) = 0;
+        HID_vGather(SlotReply[k], SlotReplyNum[k], dat+i,
+                    offset+i-SlotOff[k]-1, len-i);
     }
+}
+
+/*-----------------------------------------------------------------------------
+** RxSlot for SET_FEATURE. if every slot is taken, the oldest response which
+** the host hasn't read gives its slot up. it returns 0 if all of them hold
+** commands still waiting for their handlers.
+**---------------------------------------------------------------------------*/
+static BYTE HID_bFreeSlot(void)
+{
+    if ((BYTE)(QueueIn-QueueOut) >= HID_QUEUE_SLOTS)
+    {
+        if (QueueOut == QueueRun)
+        {
+            return 0;
+        }
+        QueueOut++;
+    }
+    RxSlot = SLOT(QueueIn);
+    SlotReplyNum[RxSlot] = 0;
+    return 1;
+}
+
+/*-----------------------------------------------------------------------------
+** [opcode][siz bytes of response] in room bytes becomes [opcode|HID_CMD_PACK]
+** [bytes][packed response]. the window of lz.c is the response itself, so
+** it's moved to the back of the report first and packed into the front. it
+** stays as it is if it's longer than the half of the report or packing
+** doesn't make it shorter.
+**---------------------------------------------------------------------------*/
+static void HID_vPack(BYTE *rsp, WORD siz, WORD room)
+{
+    WORD i, n, back;
+
+    if (2+2*siz > room)
+    {
+        return;
+    }
+    back = room-siz;
+    for (i=siz; i>0; i--)
+    {
+        rsp[back+i-1] = rsp[i];
+    }
+    n = LZ_wPack(rsp+back, siz, rsp+2, back-2);
+    if (n != 0 && n+1 < siz)
+    {
+        rsp[0] |= HID_CMD_PACK;
+        rsp[1] = (BYTE)n;
+        return;
+    }
+    for (i=0; i<siz; i++)
+    {
+        rsp[1+i] = rsp[back+i];
+    }
+}
+
+/*-----------------------------------------------------------------------------
+** a command is [opcode][request] after the ID byte (and after the nonce if
+** the Feature reports are ciphered), and the opcode indexes
+** HID_Commands[] of the application. the handler reads the request where
+** it has been received and writes the response over it in its slot for
+** SET_FEATURE, or into InputRpt for an Output report on EP1, after the
+** opcode which is sent back.
+**---------------------------------------------------------------------------*/
+static void HID_vDispatch(BYTE from)
+{
+    const HID_COMMAND *cmd;
+    BYTE *req, *rsp, op, k = 0;
+    WORD len, room, i;
+
+    if (from == CMD_FEATURE)
+    {
+        k = SLOT(QueueRun);
+        req = FeatureRpt[k]+SlotOff[k];
+        rsp = req;
+        len = SlotLen[k]-SlotOff[k];
+        room = len;
+    }
+    else
+    {
+        req = OutputRpt+HID_ID_BYTES;
+        rsp = InputRpt+HID_ID_BYTES;
+        len = CommandLen-HID_ID_BYTES;
+        room = InputLen-HID_ID_BYTES;
+    }
+    len = len-1 < room-1? len-1:room-1;
+
+    op = req[0];
+    i = op & ~HID_CMD_PACK;
+    ReplyNum = 0;
+    cmd = i < HID_NumCommands? &HID_Commands[i]:NULL;
+    /* EP1 isn't ciphered, so it takes no command while the reports are */
+    if (from == CMD_OUTPUT && Whiten == WHITEN_SPECK)
+    {
+        cmd = NULL;
+    }
+    if (cmd == NULL || cmd->handler == NULL ||
+        len < cmd->reqlen || room-1 < cmd->rsplen)
+    {
+        rsp[0] = HID_CMD_ERROR;
+    }
+    else
+    {
+        rsp[0] = (BYTE)i;
+        ReplySlot = from == CMD_FEATURE? k:HID_QUEUE_SLOTS;
+        i = cmd->handler(req+1, rsp+1, len);
+        if (ReplyNum != 0 && from == CMD_OUTPUT)
+        {
+            /* the Input report is the only copy on EP1 */
+            HID_vGather(Reply, ReplyNum, rsp+1, 0, room-1);
+            ReplyNum = 0;
+        }
+        else
+        if ((op & HID_CMD_PACK) && ReplyNum == 0 && from == CMD_FEATURE)
+        {
+            HID_vPack(rsp, i < room-1? i:room-1, room);
+        }
+    }
+
+    if (from == CMD_FEATURE)
+    {
+        SlotReply[k] = Reply;
+        SlotReplyNum[k] = ReplyNum;
+        QueueRun++;
+        return;
+    }
+    if (HID_ID_BYTES)
+    {
+        InputRpt[0] = InputId;
+    }
+    Command = CMD_NONE;
+    USB_bSendIntData(InputRpt, InputLen);
+    InputSent = 0;
+    IdleCount = 0;
+}
+
+/*-----------------------------------------------------------------------------
+** the head of each response in a slot goes on EP1 as well, in the order of
+** the queue, so the host may wait for it there instead of asking for it
+** with GET_FEATURE. the commands don't wait for EP1, which the host polls
+** every 10ms only. a response the host has read already is skipped, its
+** slot may hold the next command by now.
+**---------------------------------------------------------------------------*/
+static void HID_vHeadTask(void)
+{
+    BYTE k;
+
+    if ((BYTE)(QueueRun-QueueHead) > (BYTE)(QueueRun-QueueOut))
+    {
+        QueueHead = QueueOut;
+    }
+    if (QueueHead == QueueRun || USB_bIntBusy())
+    {
+        return;
+    }
+    k = SLOT(QueueHead);
+    if (HID_ID_BYTES)
+    {
+        InputRpt[0] = InputId;
+    }
+    HID_vReplySource(k, InputRpt+HID_ID_BYTES, SlotOff[k],
+                     InputLen-HID_ID_BYTES);
+    /* the same ciphertext as the head of GET_FEATURE */
+    if (Whiten == WHITEN_SPECK)
+    {
+        CPH_vNonce(FeatureRpt[k]+HID_ID_BYTES);
+        CPH_vCrypt(InputRpt+HID_ID_BYTES, 0, InputLen-HID_ID_BYTES, CPH_TX);
+    }
+    USB_bSendIntData(InputRpt, InputLen);
+    InputSent = 0;
+    IdleCount = 0;
+    QueueHead++;
+}
+
+WORD HID_wCmdEcho(const BYTE *req, BYTE *rsp, WORD len)
+{
+    WORD i;
+
+    /* the inverted request, HID_Test checks it */
+    for (i=0; i<len; i++)
+    {
+        rsp[i] = req[i] ^ 0xFF;
+    }
+    return len;
+}
+
+BYTE HID_bRxRequest(void)
+{
+    BYTE ret, id, done = 0;
+    WORD len, rpt;
+
+    /* move the control transfer on EP0 one step on, it never waits */
+    USB_vTask();
+    HID_vIdleTask();
+    STR_vTask();
+
+    /*-------------------------------------------------------------------------
+    ** one command a call, the queue of Feature reports first. an Output
+    ** report waits until EP1 is free for its response.
+    **-----------------------------------------------------------------------*/
+    if (QueueRun != QueueIn)
+    {
+        HID_vDispatch(CMD_FEATURE);
+        done = 1;
+    }
+    else
+    if (Command == CMD_OUTPUT && !USB_bIntBusy())
+    {
+        HID_vDispatch(CMD_OUTPUT);
+        done = 1;
+    }
+    HID_vHeadTask();
 
     /* get 8 bytes of SETUP */
     ret = USB_bRxRequest(RequestPkt);
@@ -79,101 +495,128 @@ BYTE HID_bRxRequest(void *Req, WORD siz)
         ** data length in the SETUP packet.
         **-------------------------------------------------------------------*/
         len = RequestPkt[7]*256+RequestPkt[6];
+        Pending = 0;
+        PendingId = RequestPkt[2];
 
+        if (RequestPkt[2] >= HID_NUM_REPORT_ID)
+        {
+            /*-----------------------------------------------------------------
+            ** there isn't such a REPORT ID in the report descriptor.
+            **---------------------------------------------------------------*/
+            USB_vStallCtrl();
+        }
+        else
         if (RequestPkt[0] == 0xA1 && RequestPkt[1] == 0x01)
         {
-            if (RequestPkt[3] == 0x03)	/* HidD_GetFeature() */
+            /*-----------------------------------------------------------------
+            ** Pending MUST be set first, HID_vCtrlSource() is called for the
+            ** 1st packet before USB_wSendCtrlData() returns.
+            **---------------------------------------------------------------*/
+            rpt = HID_wReportSize(RequestPkt[3], RequestPkt[2]);
+            if (rpt != 0 && RequestPkt[3] == 0x03)	/* HidD_GetFeature() */
             {
-                if (State != RESPONSE)
+                /* QueueOut is moved on by HID_vCtrlTxDone() */
+                Pending = 0x03;
+                TxSlot = SLOT(QueueOut);
+                if (QueueOut == QueueRun && PendingId != STR_REPORT_ID)
                 {
                     /*---------------------------------------------------------
                     ** there isn't any data to be sent to the host.
                     ** here we just send a zero length packet to the host.
                     ** a simple protocol could be defined here instead of zlp.
                     **-------------------------------------------------------*/
-                    USB_bSendCtrlData(FeatureRpt, 0, len);
+                    Pending = 0;
+                    USB_wSendCtrlData(NULL, 0, len);
                 }
                 else
                 {
-                    USB_bSendCtrlData(FeatureRpt, 64, len);
+                    USB_wSendCtrlData(NULL, rpt, len);
                 }
-
-                State = COMMAND;
             }
             else
-            if (RequestPkt[3] == 0x01)	/* HidD_GetInputReport() */
+            if (rpt != 0 && RequestPkt[3] == 0x01)	/* HidD_GetInputReport() */
             {
-                USB_bSendCtrlData(FeatureRpt, 64, len);
+                /* the last Output report of SET_REPORT, echoed from EchoRpt */
+                Pending = 0x01;
+                USB_wSendCtrlData(NULL, rpt, len);
             }
             else
             {
                 /*-------------------------------------------------------------
-                ** DEBUG Code if needed
+                ** there isn't such a report type or ID for GET_REPORT.
                 **-----------------------------------------------------------*/
+                USB_vStallCtrl();
             }
             break;
         }
         else
         if (RequestPkt[0] == 0x21 && RequestPkt[1] == 0x09)
         {
-            if (RequestPkt[3] == 0x03)	// HidD_SetFeature
+            /*-----------------------------------------------------------------
+            ** the host sends the report of the ID as it is, or the shorter
+            ** part of it which holds the data.
+            **---------------------------------------------------------------*/
+            rpt = HID_wReportSize(RequestPkt[3], RequestPkt[2]);
+            if (len == 0 || len > rpt)
             {
-                State = COMMAND;
-                if ((rxl=USB_bGetCtrlData(RequestPkt, 64, len)) == len)
-                {
-                    /*---------------------------------------------------------
-                    ** if you transmit secret data, decipher it here.
-                    **-------------------------------------------------------*/
-                    while(rxl)
-                    {
-                        rxl--;
-                        FeatureRpt[rxl] = RequestPkt[rxl] ^ 0xFF;
-                    }
-                    if (Req != NULL && siz == 2)
-                    {
-                        *((BYTE*)Req+0) = RequestPkt[0];
-                        *((BYTE*)Req+1) = RequestPkt[1];
-                        return 1;
-                    }
-                    State = RESPONSE;
-                }
-                else
-                {
-                    /*---------------------------------------------------------
-                    ** DEBUG Code if needed
-                    **-------------------------------------------------------*/
-                }
+                /*-------------------------------------------------------------
+                ** malformed SET_REPORT. STALL it before the DATA stage.
+                **-----------------------------------------------------------*/
+                USB_vStallCtrl();
             }
             else
-            if (RequestPkt[3] == 0x02)	/* HidD_SetOutputReport() */
+            if ((RequestPkt[3] == 0x03 &&	// HidD_SetFeature
+                 (PendingId == STR_REPORT_ID || HID_bFreeSlot())) ||
+                RequestPkt[3] == 0x02)		/* HidD_SetOutputReport() */
             {
-                if ((rxl=USB_bGetCtrlData(FeatureRpt, 64, len)) == len)
-                {
-                    State = RESPONSE;
-                }
+                /*-------------------------------------------------------------
+                ** the DATA stage goes on in USB_vTask(), each packet is passed
+                ** to HID_vCtrlSink() and HID_vCtrlRxDone() is called at last.
+                **-----------------------------------------------------------*/
+                Pending = RequestPkt[3];
+                PendingLen = len;
+                USB_wGetCtrlData(NULL, len, len);
             }
             else
             {
                 /*-------------------------------------------------------------
-                ** DEBUG Code if needed
+                ** there isn't such a report type for SET_REPORT, or every
+                ** slot holds a command which hasn't been handled yet.
                 **-----------------------------------------------------------*/
+                USB_vStallCtrl();
             }
             break;
         }
         else
-        if (RequestPkt[0] == 0x21 && RequestPkt[1] == 0x0A)
+        if (RequestPkt[0] == 0x21 && RequestPkt[1] == 0x0A)	/* SET_IDLE */
         {
             /*-----------------------------------------------------------------
-            ** just send a STATUS packet
+            ** wValue is the duration and the report ID, ID 0 sets all of
+            ** them. a shorter duration applies at once, IdleCount goes on.
             **---------------------------------------------------------------*/
-            USB_bSendCtrlData(NULL, 0, 0);
+            for (id=0; id<HID_NUM_REPORT_ID; id++)
+            {
+                if (RequestPkt[2] == 0 || RequestPkt[2] == id)
+                {
+                    IdleRate[id] = RequestPkt[3];
+                }
+            }
+            USB_wSendCtrlData(NULL, 0, 0);
+            break;
+        }
+        else
+        if (RequestPkt[0] == 0xA1 && RequestPkt[1] == 0x02)	/* GET_IDLE */
+        {
+            USB_wSendCtrlData(&IdleRate[RequestPkt[2]], 1, len);
             break;
         }
         else
         {
             /*-----------------------------------------------------------------
-            ** DEBUG Code if needed
+            ** unsupported class request, such as SET_PROTOCOL.
+            ** STALL it so that the host doesn't wait for a timeout.
             **---------------------------------------------------------------*/
+            USB_vStallCtrl();
         }
         break;
 
@@ -187,11 +630,271 @@ BYTE HID_bRxRequest(void *Req, WORD siz)
         break;
     }
 
-    return 0;
+    return done;
+}
+
+void HID_vCtrlSource(BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() for each packet of GET_REPORT. the report goes
+    ** with the ID asked for, whichever ID the command has come with.
+    **-----------------------------------------------------------------------*/
+    if (Pending == 0x03 && PendingId == STR_REPORT_ID)
+    {
+        /* the status of the stream after its ID byte, never whitened */
+        if (offset == 0 && len != 0)
+        {
+            dat[0] = PendingId;
+            STR_vCtrlSource(dat+1, 0, len-1);
+        }
+        else
+        {
+            STR_vCtrlSource(dat, offset-1, len);
+        }
+        return;
+    }
+    if (Pending == 0x01)	/* HidD_GetInputReport() */
+    {
+        for (i=0; i<len; i++)
+        {
+            dat[i] = offset+i < sizeof(EchoRpt)? EchoRpt[offset+i]:0;
+        }
+    }
+    else
+    {
+        HID_vReplySource(TxSlot, dat, offset, len);
+    }
+    if (offset == 0)
+    {
+        Lfsr = 0x1FF;
+        if (HID_ID_BYTES && len != 0)
+        {
+            dat[0] = PendingId;
+            dat += HID_ID_BYTES;
+            len -= HID_ID_BYTES;
+            offset += HID_ID_BYTES;
+        }
+    }
+    if (Pending == 0x03 && Whiten == WHITEN_PN9)
+    {
+        Lfsr = HID_wWhiten(dat, len, Lfsr);
+    }
+    else
+    if (Pending == 0x03 && Whiten == WHITEN_SPECK)
+    {
+        HID_vCipher(FeatureRpt[TxSlot], dat, offset, len, CPH_TX);
+    }
+}
+
+void HID_vCtrlSink(BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() for each packet of SET_REPORT. the ID byte is
+    ** kept as it is.
+    **-----------------------------------------------------------------------*/
+    if (Pending == 0x03 && PendingId == STR_REPORT_ID)
+    {
+        /* a frame of the stream, neither inverted nor whitened */
+        if (offset == 0 && len != 0)
+        {
+            STR_vCtrlSink(dat+1, 0, len-1);
+        }
+        else
+        if (offset != 0)
+        {
+            STR_vCtrlSink(dat, offset-1, len);
+        }
+        return;
+    }
+    if (Pending == 0x02)	/* HidD_SetOutputReport() */
+    {
+        /* it takes no slot, a full queue keeps its responses */
+        for (i=0; i<len && offset+i<sizeof(EchoRpt); i++)
+        {
+            EchoRpt[offset+i] = dat[i];
+        }
+        return;
+    }
+    if (offset == 0)
+    {
+        Lfsr = 0x1FF;
+        if (HID_ID_BYTES && len != 0)
+        {
+            FeatureRpt[RxSlot][0] = dat[0];
+            dat += HID_ID_BYTES;
+            len -= HID_ID_BYTES;
+            offset += HID_ID_BYTES;
+        }
+    }
+    if (Whiten == WHITEN_PN9)
+    {
+        Lfsr = HID_wWhiten(dat, len, Lfsr);
+    }
+    for (i=0; i<len; i++)
+    {
+        FeatureRpt[RxSlot][offset+i] = dat[i];
+    }
+    if (Whiten == WHITEN_SPECK)
+    {
+        /*---------------------------------------------------------------------
+        ** secret data is deciphered in place in its slot, with the nonce
+        ** of the 1st packet.
+        **-------------------------------------------------------------------*/
+        HID_vCipher(FeatureRpt[RxSlot], FeatureRpt[RxSlot]+offset, offset,
+                    len, CPH_RX);
+    }
+}
+
+void HID_vCtrlRxDone(WORD rxl)
+{
+    WORD off;
+
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() when the DATA stage of SET_REPORT is over.
+    **-----------------------------------------------------------------------*/
+    off = HID_ID_BYTES + (Whiten == WHITEN_SPECK? CPH_NONCE_SIZE:0);
+    if (rxl != PendingLen)
+    {
+        /*---------------------------------------------------------------------
+        ** DEBUG Code if needed
+        **-------------------------------------------------------------------*/
+    }
+    else
+    if (Pending == 0x03 && PendingId == STR_REPORT_ID)
+    {
+        STR_vCtrlRxDone(rxl-1);
+    }
+    else
+    if (Pending == 0x03 && rxl > off)	// HidD_SetFeature
+    {
+        SlotLen[RxSlot] = rxl;
+        SlotOff[RxSlot] = (BYTE)off;
+        QueueIn++;
+    }
+    else
+    if (Pending == 0x02)	/* HidD_SetOutputReport() */
+    {
+        /*---------------------------------------------------------------------
+        ** an Output report "PN9" + mode switches the whitening of Feature
+        ** reports, or their cipher with mode 2 once the application has
+        ** given cipher.c a key. the mode is echoed with bit7 set in the Input
+        ** report, an old firmware echoes it unchanged. any other Output
+        ** report is echoed as before.
+        **-------------------------------------------------------------------*/
+        BYTE *pn9 = EchoRpt + HID_ID_BYTES;
+
+        if (rxl >= HID_ID_BYTES+4 &&
+            pn9[0] == 'P' && pn9[1] == 'N' && pn9[2] == '9')
+        {
+            Whiten = pn9[3] == WHITEN_PN9 ||
+                (pn9[3] == WHITEN_SPECK && CPH_bReady())? pn9[3]:WHITEN_OFF;
+            pn9[3] = Whiten | 0x80;
+        }
+    }
+    Pending = 0;
+}
+
+void HID_vCtrlTxDone(void)
+{
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() when the host has got the whole report.
+    **-----------------------------------------------------------------------*/
+    if (Pending == 0x03 && PendingId != STR_REPORT_ID)	/* HidD_GetFeature() */
+    {
+        QueueOut++;
+    }
+    Pending = 0;
+}
+
+void HID_vIntSink(BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() for each packet of an Output report on EP1. it's
+    ** dropped while the last command waits for its response.
+    **-----------------------------------------------------------------------*/
+    for (i=0; Command != CMD_OUTPUT && i<len && offset+i<sizeof(OutputRpt); i++)
+    {
+        OutputRpt[offset+i] = dat[i];
+    }
+}
+
+void HID_vIntRxDone(WORD rxl)
+{
+    /*-------------------------------------------------------------------------
+    ** called by USB_vTask() when an Output report has come on EP1, that is
+    ** WriteFile() on the host. it's a command just like HidD_SetFeature(),
+    ** but it's never whitened and no SETUP is needed for it. while the
+    ** Feature reports are ciphered it only gets HID_CMD_ERROR.
+    **-----------------------------------------------------------------------*/
+    if (Command == CMD_NONE && rxl > HID_ID_BYTES)
+    {
+        Command = CMD_OUTPUT;
+        CommandLen = rxl;
+    }
+}
+
+void HID_vReplyFrom(const HID_SEGMENT *seg, BYTE num)
+{
+    /*-------------------------------------------------------------------------
+    ** called by a handler of HID_Commands[] only, the response of any other
+    ** command is in its slot of FeatureRpt again.
+    **-----------------------------------------------------------------------*/
+    Reply = seg;
+    ReplyNum = num;
+}
+
+BYTE HID_bReplySlot(void)
+{
+    /*-------------------------------------------------------------------------
+    ** the slot of the command running, HID_QUEUE_SLOTS for an Output report
+    ** on EP1, whose response is gathered before the handler returns.
+    **-----------------------------------------------------------------------*/
+    return ReplySlot;
 }
 
 BYTE HID_bTxResult(void *dat, WORD siz)
 {
-    State = RESPONSE;
-    return 1;
+    WORD i;
+
+    BYTE b, changed;
+
+    /*-------------------------------------------------------------------------
+    ** a result of the application which no command has asked for goes to
+    ** the host as an Input report on EP1 at the next poll. it returns 0 if
+    ** the previous result is still on its way. the same result again is
+    ** dropped until the idle duration is over, the host has got it already.
+    ** a new result wakes the host up if the bus is suspended.
+    **-----------------------------------------------------------------------*/
+    if (USB_bIntBusy())
+    {
+        return 0;
+    }
+    changed = !InputSent;
+    if (HID_ID_BYTES)
+    {
+        InputRpt[0] = InputId;
+    }
+    for (i=0; i+HID_ID_BYTES<InputLen; i++)
+    {
+        b = i < siz? *((BYTE*)dat+i):0;
+        changed |= InputRpt[HID_ID_BYTES+i] != b;
+        InputRpt[HID_ID_BYTES+i] = b;
+    }
+    if (!changed && (IdleRate[InputId] == 0 || IdleCount < IdleRate[InputId]))
+    {
+        return 1;
+    }
+    if (changed)
+    {
+        USB_bRemoteWakeup();
+    }
+    InputSent = USB_bSendIntData(InputRpt, InputLen);
+    IdleCount = 0;
+    return InputSent;
 }
@@ -36,10 +36,96 @@
 #ifndef _HID_H_ /* this file has been included into main.h */
 #define _HID_H_
 
+/*-----------------------------------------------------------------------------
+** the largest Feature report hid.c takes. a slot of FeatureRpt[] is the
+** only copy of a report, so it's bounded by the RAM only (1KB on
+** dsPIC33FJ12MC201), HID_QUEUE_SLOTS times over.
+**---------------------------------------------------------------------------*/
+#define HID_MAX_FEATURE         512
+
+/*-----------------------------------------------------------------------------
+** the slots of the queue of Feature reports, a power of 2. the host may
+** send up to HID_QUEUE_SLOTS commands before it reads their responses, in
+** the same order. 1 is stop-and-wait, as HID_Test does it.
+**---------------------------------------------------------------------------*/
+#define HID_QUEUE_SLOTS         2
+
+/*-----------------------------------------------------------------------------
+** the report IDs 0..HID_NUM_REPORT_ID-1 have an idle rate each (SET_IDLE).
+** with more than ID 0 every report starts with its ID byte, which is never
+** inverted or whitened, and the command follows it.
+**---------------------------------------------------------------------------*/
+#define HID_NUM_REPORT_ID       USB_NUM_REPORT_ID
+#define HID_ID_BYTES            (HID_NUM_REPORT_ID > 1)
+
+/*-----------------------------------------------------------------------------
+** a command is [opcode][request] after the ID byte and its response is
+** [opcode][response], or HID_CMD_ERROR for an opcode without a handler or
+** too short a request. the application defines HID_Commands[], indexed by
+** the opcode. a handler gets len bytes of request, at least reqlen of them,
+** writes up to rsplen bytes of response and returns how many, rsp may be
+** the same buffer as req. the host sets HID_CMD_PACK in the opcode of a
+** Feature report to ask for [opcode|HID_CMD_PACK][bytes][packed response]
+** by lz.c, it gets the response as it is if packing doesn't make it shorter
+** or it takes more than half of the report.
+**---------------------------------------------------------------------------*/
+#define HID_CMD_ERROR           0xFF
+#define HID_CMD_PACK            0x40
+
+typedef WORD (*HID_HANDLER)(const BYTE *req, BYTE *rsp, WORD len);
+
+typedef struct
+{
+    HID_HANDLER handler;
+    BYTE reqlen;
+    BYTE rsplen;
+} HID_COMMAND;
+
+/*-----------------------------------------------------------------------------
+** a response may stay where the application keeps it. a handler passes a
+** list of segments to HID_vReplyFrom() and returns 0, the response is then
+** [opcode][the segments one after the other], and GET_FEATURE reads them 8
+** bytes at a time as the packets go, with no copy in FeatureRpt. the list
+** and the bytes MUST NOT change until the host has read the report. such a
+** response is never packed, and on EP1 it's as long as the Input report.
+** the command may run again before that, with a response in each slot of
+** the queue, so a list which changes is kept for each HID_bReplySlot().
+**---------------------------------------------------------------------------*/
+typedef struct
+{
+    const BYTE *dat;
+    WORD siz;
+} HID_SEGMENT;
+
+void HID_vReplyFrom(const HID_SEGMENT *seg, BYTE num);
+
+/* 0..HID_QUEUE_SLOTS, the slot of the response of the handler running */
+BYTE HID_bReplySlot(void);
+
+extern const HID_COMMAND HID_Commands[];
+extern const BYTE HID_NumCommands;
+
+/* the inverted request as its response, any length */
+WORD HID_wCmdEcho(const BYTE *req, BYTE *rsp, WORD len);
+
 void HID_vInit(BYTE Mode);
 
-BYTE HID_bRxRequest(void *Req, WORD siz);
+BYTE HID_bRxRequest(void);
 
 BYTE HID_bTxResult(void *dat, WORD siz);
 
+/* callbacks of the control transfer, called by USB_vTask() */
+void HID_vCtrlSource(BYTE *dat, WORD offset, BYTE len);
+
+void HID_vCtrlSink(BYTE *dat, WORD offset, BYTE len);
+
+void HID_vCtrlRxDone(WORD rxl);
+
+void HID_vCtrlTxDone(void);
+
+/* callbacks of the interrupt OUT endpoint, called by USB_vTask() */
+void HID_vIntSink(BYTE *dat, WORD offset, BYTE len);
+
+void HID_vIntRxDone(WORD rxl);
+
 #endif
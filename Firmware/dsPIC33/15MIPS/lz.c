@@ -0,0 +1,193 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        lz.c A small LZ77 for the reports.
+ *
+ *---------------------------------------------------------------------------*/
+#include "main.h"
+
+#if LZ_WINDOW > 256 || (LZ_WINDOW & (LZ_WINDOW-1)) != 0
+#error "the window must be a power of 2 up to the 256 of a distance byte"
+#endif
+
+#define OP_TOKEN                0
+#define OP_LITERAL              1
+#define OP_DISTANCE             2
+#define OP_MATCH                3
+
+/*-----------------------------------------------------------------------------
+** the literals src[from..to-1] as tokens of up to 128 bytes at dst[*o], 0 if
+** they don't fit into room.
+**---------------------------------------------------------------------------*/
+static BYTE LZ_bLiterals(const BYTE *src, WORD from, WORD to,
+                         BYTE *dst, WORD *o, WORD room)
+{
+    WORD n;
+
+    while (from < to)
+    {
+        n = to-from < LZ_MAX_LITERAL? to-from:LZ_MAX_LITERAL;
+        if (*o+1+n > room)
+        {
+            return 0;
+        }
+        dst[(*o)++] = (BYTE)(n-1);
+        while (n--)
+        {
+            dst[(*o)++] = src[from++];
+        }
+    }
+    return 1;
+}
+
+WORD LZ_wPack(const BYTE *src, WORD siz, BYTE *dst, WORD room)
+{
+    WORD i, lit, o, d, l, best, dist;
+
+    /*-------------------------------------------------------------------------
+    ** greedy, the longest match in the window at each byte. it returns the
+    ** packed bytes, or 0 if they don't fit into room. the window is src
+    ** itself, so dst MUST NOT overlap it.
+    **-----------------------------------------------------------------------*/
+    i = 0;
+    lit = 0;
+    o = 0;
+    while (i < siz)
+    {
+        best = 0;
+        dist = 0;
+        for (d=1; d<=LZ_WINDOW && d<=i; d++)
+        {
+            for (l=0; i+l<siz && l<LZ_MAX_MATCH && src[i+l-d]==src[i+l]; l++)
+            {
+            }
+            if (l > best)
+            {
+                best = l;
+                dist = d;
+            }
+        }
+        if (best >= LZ_MIN_MATCH)
+        {
+            if (!LZ_bLiterals(src, lit, i, dst, &o, room) || o+2 > room)
+            {
+                return 0;
+            }
+            dst[o++] = (BYTE)(0x80 | (best-LZ_MIN_MATCH));
+            dst[o++] = (BYTE)(dist-1);
+            i += best;
+            lit = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if (!LZ_bLiterals(src, lit, siz, dst, &o, room))
+    {
+        return 0;
+    }
+    return o;
+}
+
+void LZ_vInit(LZ_STATE *lz)
+{
+    BYTE i;
+
+    for (i=0; i<LZ_WINDOW; i++)
+    {
+        lz->Hist[i] = 0;
+    }
+    lz->Pos = 0;
+    lz->Op = OP_TOKEN;
+    lz->Count = 0;
+    lz->Dist = 0;
+}
+
+WORD LZ_wUnpack(LZ_STATE *lz, const BYTE *src, WORD siz, WORD *used,
+                BYTE *dst, WORD room)
+{
+    WORD i = 0, o = 0;
+    BYTE b, t;
+
+    /*-------------------------------------------------------------------------
+    ** up to room bytes from siz bytes of packed data, it returns the bytes
+    ** written and sets *used to the bytes taken. it stops when room is full
+    ** or the packed data runs out, and goes on from there the next time.
+    **-----------------------------------------------------------------------*/
+    while (o < room)
+    {
+        if (lz->Op == OP_MATCH)
+        {
+            b = lz->Hist[(BYTE)(lz->Pos - lz->Dist) & (LZ_WINDOW-1)];
+        }
+        else
+        if (i >= siz)
+        {
+            break;
+        }
+        else
+        if (lz->Op == OP_LITERAL)
+        {
+            b = src[i++];
+        }
+        else
+        if (lz->Op == OP_DISTANCE)
+        {
+            lz->Dist = src[i++]+1;
+            lz->Op = OP_MATCH;
+            continue;
+        }
+        else
+        {
+            t = src[i++];
+            lz->Op = t & 0x80? OP_DISTANCE:OP_LITERAL;
+            lz->Count = t & 0x80? (t & 0x7F)+LZ_MIN_MATCH:t+1;
+            continue;
+        }
+        dst[o++] = b;
+        lz->Hist[lz->Pos] = b;
+        lz->Pos = (lz->Pos+1) & (LZ_WINDOW-1);
+        if (--lz->Count == 0)
+        {
+            lz->Op = OP_TOKEN;
+        }
+    }
+    *used = i;
+    return o;
+}
+
+BYTE LZ_bBusy(const LZ_STATE *lz)
+{
+    /* a match has more output without any more input */
+    return lz->Op == OP_MATCH;
+}
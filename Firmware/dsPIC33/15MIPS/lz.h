@@ -0,0 +1,75 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        lz.h Header file for lz.c.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _LZ_H_ /* this file has been included into main.h */
+#define _LZ_H_
+
+/*-----------------------------------------------------------------------------
+** a byte oriented LZ77 with a window of LZ_WINDOW bytes. the packed data is
+** a row of tokens:
+**   0x00..0x7F  n+1 literal bytes follow (1..128)
+**   0x80..0xFF  a match of (t & 0x7F)+3 bytes (3..130), the next byte is its
+**               distance-1 (1..LZ_WINDOW) back in the output
+** a match may overlap its output, distance 1 is a run of one byte. the host
+** packs the same way, see Tools/Linux/HID_Stream/lz.c.
+**---------------------------------------------------------------------------*/
+#define LZ_WINDOW               64
+#define LZ_MIN_MATCH            3
+#define LZ_MAX_MATCH            130
+#define LZ_MAX_LITERAL          128
+
+/*-----------------------------------------------------------------------------
+** the state of an unpacked stream, the last LZ_WINDOW bytes of its output
+** and the token on its way. a token may be split anywhere between calls.
+**---------------------------------------------------------------------------*/
+typedef struct
+{
+    BYTE Hist[LZ_WINDOW];
+    BYTE Pos;                       /* the next byte of Hist[]             */
+    BYTE Op;                        /* the token on its way                */
+    BYTE Count;                     /* its bytes still to come             */
+    BYTE Dist;
+} LZ_STATE;
+
+WORD LZ_wPack(const BYTE *src, WORD siz, BYTE *dst, WORD room);
+
+void LZ_vInit(LZ_STATE *lz);
+
+WORD LZ_wUnpack(LZ_STATE *lz, const BYTE *src, WORD siz, WORD *used,
+                BYTE *dst, WORD room);
+
+BYTE LZ_bBusy(const LZ_STATE *lz);
+
+#endif
@@ -42,12 +42,30 @@ typedef unsigned char   BYTE;
 typedef unsigned short  WORD;
 typedef unsigned long   DWORD;
 
+/* the instruction clock sie.s is generated for, usb.bat of 40MIPS builds
+   these sources with its own */
+#ifndef FCY
+#define FCY             15000000UL
+#endif
+
+/* the DSP commands 0x07..0x0A of dsp.c. their arrays take 188 of the 1024
+   bytes of RAM, so the stream gives up 2 frames of its window for them */
+/* #define DSP_SERVICE */
+#ifdef DSP_SERVICE
+#define STR_WINDOW      2
+#endif
+
 #ifndef NULL
 #define NULL            ((void*)0)
 #endif
 
+#include "desc.h"
 #include "usb.h"
 #include "hid.h"
+#include "stream.h"
+#include "cipher.h"
+#include "lz.h"
+#include "dsp.h"
 
 extern void _dbg_led_on(void);
 extern void _dbg_die(void);
@@ -0,0 +1,231 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * $Date:        11. May 2020
+ * $Revision:    V0.0.0
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        stream.c Windowed stream over HID Feature reports.
+ *
+ *---------------------------------------------------------------------------*/
+#include "main.h"
+
+#if STR_REPORT_ID >= USB_NUM_REPORT_ID
+#error "vusb.desc hasn't got the report ID of the stream"
+#endif
+#if STR_WINDOW < 1 || STR_WINDOW > 127
+#error "the window of the stream must be 1..127 frames for 8-bit seq"
+#endif
+
+/*-----------------------------------------------------------------------------
+** the frames of the window, a ring of STR_WINDOW slots. the host sends
+** frame 'seq' while the application still reads an older one, so a frame
+** is acknowledged as soon as it's in a slot, and its slot is given back to
+** the window (credit) when it has been read.
+**---------------------------------------------------------------------------*/
+static BYTE Slot[STR_WINDOW][STR_DATA_SIZE];
+static BYTE SlotLen[STR_WINDOW];    /* and STR_PACKED                       */
+static BYTE Head;                   /* the slot of the next frame           */
+static BYTE Tail;                   /* the slot the application reads       */
+static BYTE Used;                   /* slots holding a frame                */
+static BYTE ReadPos;                /* bytes of Slot[Tail] already read     */
+
+static BYTE Expected;               /* seq of the next frame, the ack       */
+static BYTE RxSeq;                  /* header of the frame on its way       */
+static BYTE RxLen;
+static BYTE RxOk;                   /* the frame on its way goes to Head    */
+static DWORD Bytes;                 /* bytes taken since STR_vInit()        */
+static WORD Sum;                    /* and their sum, checked by the host   */
+
+static LZ_STATE Unpack;             /* the packed frames read so far        */
+
+static BYTE AckPending;             /* the ack or the credit has changed    */
+static BYTE AckRpt[8];              /* the Input report of STR_REPORT_ID    */
+
+void STR_vInit(void)
+{
+    Head = 0;
+    Tail = 0;
+    Used = 0;
+    ReadPos = 0;
+    Expected = 0;
+    RxOk = 0;
+    Bytes = 0;
+    Sum = 0;
+    AckPending = 0;
+    LZ_vInit(&Unpack);
+}
+
+/*-----------------------------------------------------------------------------
+** [ack][credit][bytes:4][sum:2], the status of the stream.
+**---------------------------------------------------------------------------*/
+static BYTE STR_bStatus(BYTE i)
+{
+    switch(i)
+    {
+    case 0:
+        return Expected;
+    case 1:
+        return STR_WINDOW - Used;
+    case 2: case 3: case 4: case 5:
+        return (BYTE)(Bytes >> (8*(i-2)));
+    case 6: case 7:
+        return (BYTE)(Sum >> (8*(i-6)));
+    default:
+        return 0;
+    }
+}
+
+void STR_vTask(void)
+{
+    BYTE i;
+    WORD siz;
+
+    /*-------------------------------------------------------------------------
+    ** the ack goes on EP1 when nothing else is on its way. the acks are
+    ** cumulative, so a later one takes the place of any that couldn't go.
+    **-----------------------------------------------------------------------*/
+    siz = USB_ReportSize[0][STR_REPORT_ID];
+    if (!AckPending || siz == 0 || siz > sizeof(AckRpt) || USB_bIntBusy())
+    {
+        return;
+    }
+    AckRpt[0] = STR_REPORT_ID;
+    for (i=1; i<siz; i++)
+    {
+        AckRpt[i] = STR_bStatus(i-1);
+    }
+    if (USB_bSendIntData(AckRpt, siz))
+    {
+        AckPending = 0;
+    }
+}
+
+WORD STR_wRead(BYTE *dat, WORD siz)
+{
+    WORD n = 0, used;
+    BYTE len;
+
+    /*-------------------------------------------------------------------------
+    ** copy up to 'siz' bytes of the stream, it returns at once with the
+    ** bytes there are. each slot read through widens the window again. a
+    ** packed slot is kept until the match at its end has been read.
+    **-----------------------------------------------------------------------*/
+    while (n < siz && Used != 0)
+    {
+        len = SlotLen[Tail] & ~STR_PACKED;
+        if (SlotLen[Tail] & STR_PACKED)
+        {
+            n += LZ_wUnpack(&Unpack, &Slot[Tail][ReadPos], len-ReadPos, &used,
+                            dat+n, siz-n);
+            ReadPos += used;
+        }
+        else
+        if (ReadPos < len)
+        {
+            dat[n++] = Slot[Tail][ReadPos++];
+        }
+        if (ReadPos >= len && !LZ_bBusy(&Unpack))
+        {
+            ReadPos = 0;
+            Tail = Tail+1 < STR_WINDOW? Tail+1:0;
+            Used--;
+            AckPending = 1;
+        }
+    }
+    return n;
+}
+
+void STR_vCtrlSource(BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** GET_FEATURE of the stream, the host resynchronizes with it.
+    **-----------------------------------------------------------------------*/
+    for (i=0; i<len; i++)
+    {
+        dat[i] = offset+i < 8? STR_bStatus(offset+i):0;
+    }
+}
+
+void STR_vCtrlSink(BYTE *dat, WORD offset, BYTE len)
+{
+    BYTE i;
+    WORD pos;
+
+    /*-------------------------------------------------------------------------
+    ** each packet of a frame goes straight into its slot. a frame out of
+    ** order or without a free slot is dropped, the host sends it again.
+    **-----------------------------------------------------------------------*/
+    for (i=0; i<len; i++)
+    {
+        pos = offset+i;
+        if (pos == 0)
+        {
+            RxSeq = dat[i];
+        }
+        else
+        if (pos == 1)
+        {
+            RxLen = dat[i];
+            RxOk = RxSeq == Expected && Used < STR_WINDOW &&
+                   (RxLen & ~STR_PACKED) <= STR_DATA_SIZE;
+        }
+        else
+        if (RxOk && pos-2 < STR_DATA_SIZE)
+        {
+            Slot[Head][pos-2] = dat[i];
+        }
+    }
+}
+
+void STR_vCtrlRxDone(WORD rxl)
+{
+    BYTE i;
+
+    /*-------------------------------------------------------------------------
+    ** a whole frame has come, the ack goes back even if it's dropped, so
+    ** that the host learns where to go on from.
+    **-----------------------------------------------------------------------*/
+    if (RxOk && rxl >= 2+(WORD)(RxLen & ~STR_PACKED))
+    {
+        SlotLen[Head] = RxLen;
+        RxLen &= ~STR_PACKED;
+        for (i=0; i<RxLen; i++)
+        {
+            Sum += Slot[Head][i];
+        }
+        Bytes += RxLen;
+        Head = Head+1 < STR_WINDOW? Head+1:0;
+        Used++;
+        Expected++;
+    }
+    RxOk = 0;
+    AckPending = 1;
+}
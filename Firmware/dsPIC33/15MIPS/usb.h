@@ -47,23 +47,55 @@
 **---------------------------------------------------------------------------*/
 extern volatile WORD _uendpt0;
 extern volatile WORD _ucontr0;
+extern volatile WORD _eptab[];     /* IN/OUT words of EP1..EPn, 4 a piece */
+extern volatile WORD _frame;       /* +1 at each keep-alive, every 1ms    */
+extern volatile WORD _frametime;   /* Timer3 at the last keep-alive       */
 /* API functions in sie.s */
 extern BYTE _usbGetSetup(BYTE * setup);
-extern void _usbLoadData(BYTE * _data, BYTE length);
-extern BYTE _usbReadData(BYTE * _data, BYTE length);
-extern void _usbSendZLP(void);
-extern void _usbWaitZLP(void);
 extern void _usbSetAddress(BYTE a);
 extern void _usbSetConfig(BYTE c);
+extern void _usbStallEP0(void);
+/* non-blocking API functions in sie.s, used by USB_vTask() */
+extern void _usbArmIn(BYTE * _data, BYTE length);
+extern void _usbArmZLP(void);
+extern BYTE _usbInDone(void);
+extern void _usbArmOut(void);
+extern BYTE _usbOutDone(BYTE * _data, BYTE length);
+extern BYTE _usbBusReset(void);
+/* endpoints EP1..EPn in sie.s, 'ep' is the endpoint number */
+extern void _usbArmInEP(BYTE ep, BYTE * _data, BYTE length);
+extern BYTE _usbInEPDone(BYTE ep);
+extern void _usbHaltInEP(BYTE ep, BYTE halt);
+extern void _usbArmOutEP(BYTE ep);
+extern BYTE _usbOutEPDone(BYTE ep, BYTE * _data, BYTE length);
+extern void _usbHaltOutEP(BYTE ep, BYTE halt);
+extern void _usbSendResume(BYTE on);
 
 #define ENDPOINT0_SIZE          8
+#define ENDPOINT1_SIZE          8
 
 void USB_vInit(void);
 
+void USB_vTask(void);
+
 BYTE USB_bRxRequest(void* Request);
 
-BYTE USB_bGetCtrlData(BYTE * dat, WORD siz, WORD exLength);
+WORD USB_wGetCtrlData(BYTE * dat, WORD siz, WORD exLength);
+
+WORD USB_wSendCtrlData(BYTE* dat, WORD siz, WORD exLength);
+
+void USB_vStallCtrl(void);
+
+BYTE USB_bSendIntData(BYTE* dat, WORD siz);
+
+BYTE USB_bIntBusy(void);
+
+BYTE USB_bRemoteWakeup(void);
+
+WORD USB_wFrame(void);
+
+void USB_vWaitFrame(void);
 
-BYTE USB_bSendCtrlData(BYTE* dat, WORD siz, WORD exLength);
+BYTE USB_bFrameElapsed(WORD* last, WORD frames);
 
 #endif
@@ -0,0 +1,4 @@
+del main.elf
+del main.hex
+del main.map
+del main.txt
@@ -0,0 +1,2 @@
+python ..\..\..\Tools\SIEGen\siegen.py --target dsPIC33 --fcy 40 --crc -o sie.s
+pause
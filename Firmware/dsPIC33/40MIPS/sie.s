@@ -0,0 +1,1502 @@
+;; ----------------------------------------------------------------------------
+;; Copyright (C) 2019-2020 Zach Lee.
+;;
+;; Licensed under the MIT License, you may not use this file except in
+;; compliance with the License.
+;;
+;; MIT License:
+;;
+;; Permission is hereby granted, free of charge, to any person obtaining
+;; a copy of this software and associated documentation files (the "Software"),
+;; to deal in the Software without restriction, including without limitation
+;; the rights to use, copy, modify, merge, publish, distribute, sublicense,
+;; and/or sell copies of the Software, and to permit persons to whom the
+;; Software is furnished to do so, subject to the following conditions:
+;;
+;; The above copyright notice and this permission notice shall be included in
+;; all copies or substantial portions of the Software.
+;;
+;; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+;; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+;; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+;; THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+;; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+;; FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+;; IN THE SOFTWARE.
+;;
+;; ----------------------------------------------------------------------------
+;;
+;; $Date:        11. May 2020
+;; $Revision:    V0.0.0
+;;
+;; Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+;; Title:        sie.s The serial transmission processing code.
+;;
+;; This file is generated by Tools/SIEGen/siegen.py from sie.s.in for the
+;; dsPIC33FJ12MC201 running at 40 MIPS (26.67 cycles per bit). Please modify the
+;; template or the generator and run sie.bat instead of editing it by hand.
+;;
+;;-----------------------------------------------------------------------------
+.equ    __33FJ12MC201, 1
+.include "p33FJ12MC201.inc"
+
+.equ    _PORTU, PORTA
+.equ    _TRISU, TRISA
+.equ    _LATU,  LATA
+.equ    DP,     0                     ; RA0 pin
+.equ    DM,     1                     ; RA1 pin
+.equ    DPDM,   ((1<<DP)|(1<<DM))
+
+        .bss
+        .global __uendpt0
+        .global __ucontr0
+        .global __eptab
+        .global __frame
+        .global __frametime
+;;-----------------------------------------------------------------------------
+; bit defination of __uendpt0:
+; __uendpt0[15-12] - UNUSED
+; __uendpt0[11] - BUS RESET from host. =1 means BUS RESET issued
+; __uendpt0[10] - REQUEST FLAG. =1 means a request needs to be handled.
+; __uendpt0[9-8] - HANDSHAKE (to IN) from host. 00:undef/01:ACK/10:NAK/11:STALL
+; __uendpt0[7-4] - BYTES LENGTH from/to host.
+; __uendpt0[3] - DATA TOGGLE from host. =0/1 means DATA0/DATA1
+; __uendpt0[2] - HANDSHAKE to host. 1:ACK|0:NAK/STALL
+; __uendpt0[1-0] - TOKEN TYPE from/to host. 00:undef/01:SETUP/10:IN/11:OUT
+;;-----------------------------------------------------------------------------
+__uendpt0:  .space  2
+;;-----------------------------------------------------------------------------
+; bit defination of __ucontr0:
+; __ucontr0[15] - SOP ERROR.
+; __ucontr0[14] - PID ERROR.
+; __ucontr0[13] - DEVICE ADDRESS MATCHED. =1 means address of token is matched
+; __ucontr0[12] - DATA TOGGLE expected. =0/1 means DATA1/DATA0
+; __ucontr0[11] - EP0 STALL FLAG. =1 means STALL to IN/OUT until next SETUP
+; __ucontr0[10-8] - UNUSED
+; __ucontr0[7-4] - BYTES LENGTH to host.
+; __ucontr0[3-2] - HANDSHAKE for OUT TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+; __ucontr0[1-0] - HANDSHAKE for IN TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+;;-----------------------------------------------------------------------------
+__ucontr0:  .space  2
+;;-----------------------------------------------------------------------------
+; the frame counter. the host sends a keep-alive (an EOP) at the start of each
+; 1ms frame to a low speed device, __keepAlive of the ISR counts them.
+;;-----------------------------------------------------------------------------
+__frame:    .space  2
+__frametime:.space  2                   ; Timer3 at the last keep-alive
+;;-----------------------------------------------------------------------------
+; the endpoints EP1..EP1 besides EP0, 8 bytes each and indexed by ENDP-1.
+; the ISR dispatches a token on its ENDP field and reaches the endpoint by a
+; pointer into the table, so every endpoint has the same timing.
+; +0 IN word, +2 OUT word, +4 IN buffer (_datai), +6 OUT buffer (_datao)
+;
+; bit defination of the IN word:
+; IN[15] - DATA DONE. =1 means the host has ACKed the armed DATA
+; IN[14-13] - UNUSED
+; IN[12] - DATA TOGGLE expected. =0/1 means DATA1/DATA0
+; IN[11] - HALT FLAG. =1 means STALL to IN until it's cleared
+; IN[10-8] - UNUSED
+; IN[7-4] - BYTES LENGTH to host.
+; IN[3-2] - UNUSED
+; IN[1-0] - HANDSHAKE for IN TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+;
+; bit defination of the OUT word:
+; OUT[15-12] - UNUSED
+; OUT[11] - HALT FLAG. =1 means STALL to OUT until it's cleared
+; OUT[10] - DATA TOGGLE expected. =0/1 means DATA0/DATA1
+; OUT[9] - PACKET DONE. =1 means a packet is in the OUT buffer
+; OUT[8] - UNUSED
+; OUT[7-4] - BYTES LENGTH from host.
+; OUT[3-2] - HANDSHAKE for OUT TOKEN. 00:undef/01:ACK/10:NAK/11:STALL
+; OUT[1-0] - UNUSED
+;;-----------------------------------------------------------------------------
+__eptab:    .space  8*1
+_epsent:    .space  2                   ; the entry whose DATA waits for ACK
+_epout:     .space  2                   ; the entry of the last OUT token
+_addr:      .space  1                   ; device address (SET ADDRESS)
+_conf:      .space  1                   ; configuration (SET CONFIGURATION)
+;;-----------------------------------------------------------------------------
+; internal varibles
+_packet:    .space  2                   ; a data buffer pointer points to
+                                        ; _token or _datax or _datay
+_token:     .space  12
+_datax:     .space  12
+_datay:     .space  12
+_datai:     .space  12*1            ; the DATA armed on EP1..EP1
+_datao:     .space  12*1            ; the packet received on EP1..EP1
+
+;;-----------------------------------------------------------------------------
+        .text
+        .extern __dbg_die
+        .extern __dbg_send_bytes
+        .extern __dbg_led_on
+
+        .global __CNInterrupt
+;;-----------------------------------------------------------------------------
+__CNInterrupt:                          ; cycle-counter (5 cycles latency ISR)
+        push.s                          ; 6 (w0-w3 could be used now)
+        push    RCOUNT                  ; 7 (a REPEAT broken into goes on later)
+        mov     _PORTU, w0              ; 8 sample D-/D+
+        and     #DPDM, w0               ; 9 (is it a SE0?)
+        bra     z, __SE0                ; 10 (SE0, BUS RESET or RESUME)
+;;-----------------------------------------------------------------------------
+__waitJ:
+        ; last 3 bits (JKK) of SYNC is important
+        ; step 1: make sure the current bit is a J (D-/D+ =10)
+        btss    _PORTU, #DM
+        bra     __waitJ
+__waitK:
+        ; step 2: capture the edge between J & K
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+        btsc    _PORTU, #DP
+        bra     __firstK
+;;-----------------------------------------------------------------------------
+__SOPError:
+        bset    __ucontr0, #15          ; __ucontr0[15] =1 means SOP ERROR
+        bra     __IRQExit
+;;-----------------------------------------------------------------------------
+__SE0:                                  ; 11 (add 1 cycle for 'bra z, __SE0')
+        repeat  #26                     ; 12
+        nop                             ; 13..12
+        mov     _PORTU, w0              ; 13 (sample D-/D+)
+        and     #DPDM, w0               ; 14 (is it a SE0 yet?)
+        bra     nz, __IRQExit           ; 15 (no, just ignore it)
+        repeat  #21                     ; 16 (2nd SE0 detected, if a J-state is
+        nop                             ; 17/18/19/20/21/22/23/24/25/26/0/1/2/3/4/5/6/7/8/9/10/11  following,
+                                        ;  that would be keep alive signal)
+        mov     #(1<<DM), w1            ; 12
+        mov     _PORTU, w0              ; 13 (sample D-/D+)
+        and     #DPDM, w0               ; 14 (is it a SE0 yet?)
+        bra     z, __BUSReset           ; 15 (3rd SE0 detected, a BUS RESET)
+        cp      w0, w1                  ; 16 (J-state?)
+        bra     z, __keepAlive          ; 17
+        bra     __IRQExit               ; 18
+                                        ; 19
+;;-----------------------------------------------------------------------------
+__BUSReset:
+        repeat  #25                     ; 27 cycles for 1 bits
+        nop
+        mov     _PORTU, w0              ; resample D-/D+ after 97 cycles(2.4uS)
+        and     #DPDM, w0               ; is it still a SE0?
+        bra     nz, __IRQExit           ; not a SE0, just exit
+        mov     #_token, w0             ; vars reinitializing for BUS RESET
+        mov     w0, _packet             ; prepare for first SETUP token
+        mov     #0, w0                  ; clear some vars
+        mov.b   WREG, _addr             ; usb device address must be cleared
+        mov.b   WREG, _conf             ; so must the configuration
+        mov     WREG, __uendpt0
+        mov     #0x000A, w0             ; __ucontr0[1-0] =10, NAK to IN token
+        mov     WREG, __ucontr0         ; __ucontr0[3-2] =10, NAK to OUT token
+        rcall   __EPReset               ; NAK and DATA0 on the other endpoints
+        bset    __uendpt0, #11          ; __uendpt0[11] =1 means BUS RESET
+        bset    __uendpt0, #10          ; REQUEST FLAG =1, inform the app
+        bra     __IRQExit               ; a BUS RESET issued
+;;-----------------------------------------------------------------------------
+__keepAlive:                            ; a new frame of 1ms begins
+        mov     TMR3, w0                ; take the time of it, usb.c trims the
+        mov     w0, __frametime         ; FRC by the length of 8 frames
+        inc     __frame                 ; count it
+        bra     __IRQExit
+;;-----------------------------------------------------------------------------
+__firstK:                               ; (4 cycles maximum latency)
+        repeat  #25                     ; 5
+        nop                             ; 6/7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0/1/2/3/4
+        mov     _packet, w2             ; 5 (w2 points to the rx buffer)
+        setm.b  [w2]                    ; 6 (the SYNC byte will be 0x7F)
+        bset    w1, #DP                 ; 7 (w1.0 =D+ =1, 1st K)
+        bset    w0, #DP                 ; 8 (w0.0 =D+ =1, 2nd K)
+        push    w4                      ; 9 (we need more registers)
+        push    w5                      ; 10
+        setm    w5                      ; 11 (for bit unstuff)
+        mov     #0x003f, w3             ; 12
+        btsc    _PORTU, #DP             ; 13 (capture the second K)
+        bra     __SyncEnd               ; 14 (add 1 cycle if 'bra' is taken)
+        pop     w5                      ; 15 (current bit is J, not 2nd K)
+        pop     w4                      ; 16
+        bra     __waitK                 ; 17
+                                        ; 18
+;;-----------------------------------------------------------------------------
+__SyncEnd:                              ; 15 (add 1 cycle for 'bra __SyncEnd')
+        push    w6                      ; 16 (more register)
+        push    w7                      ; 17 (CRC16 of DATA0/DATA1)
+        push    w8                      ; 18 (CRC5 of tokens)
+        push    w9                      ; 19
+        mov     #0xA001, w9             ; 20 (the polynomial of CRC16)
+        add     w2, #2, w6              ; 21 (w6 points to the byte after PID)
+        repeat  #4                      ; 22 (maximum 12 bytes received, last
+        nop                             ; 23/24/25/26/0  bit of SYNC will be
+                                        ;  processed)
+;;-----------------------------------------------------------------------------
+__bit7:                                 ; w1.DP & w0.DP capture the level of DP
+        xor     w0, w1, w1              ; 1 (if w1.DP =0, means 'no_switched')
+        btst.c  w1, #DP                 ; 2 (move w1.DP into SR.C. it's bit7)
+        rlc.b   w5, w5                  ; 3 (then shift this bit into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (move this bit into SR.C again)
+        mov     _PORTU, w1              ; 13 (bit0 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2++]            ; 14 (gather bit7, w2 =the next byte)
+        and.b   w1, #DPDM, w4           ; 15 (terminate the RX loop if this bit
+        bra     z, __EOPHit             ; 16  is the 1st SE0 of EOP)
+        cp      w2, w6                  ; 17 (is the PID byte gathered now?)
+        btsc    _SR, #Z                 ; 18 (yes, CRC16 and CRC5 start from the
+        setm    w7                      ; 19  next bit, the 1st bit after PID)
+        btsc    _SR, #Z                 ; 20
+        mov     #0x1F, w8               ; 21
+        repeat  #2                      ; 22
+        nop                             ; 23/24/25
+        and.b   w3, w5, w4              ; 26 (is there a 6-b-1 in lsb of w5?)
+        bra     z, __unstuff0           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit0:                                 ; now w0.DP is prev sample of DP
+        xor     w0, w1, w0              ; 1 (if w0.DP =0, means 'no_switched')
+        btst.c  w0, #DP                 ; 2 (move w0.DP into SR.C. it's bit0)
+        rlc.b   w5, w5                  ; 3 (then shift this bit into w5)
+        btst.c  w5, #0                  ; 4 (move this bit into SR.C again)
+        repeat  #6                      ; 5
+        nop                             ; 6/7/8/9/10/11/12
+        mov     _PORTU, w0              ; 13 (bit1 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14 (gather this bit)
+        and.b   w0, #DPDM, w4           ; 15 (terminate the RX loop if this bit
+        bra     z, __EOPHit             ; 16  is the 1st SE0 of EOP)
+        xor     w7, w5, w4              ; 17 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 18  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 19  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 20
+        xor     w8, w5, w4              ; 21 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 22
+        btss    w4, #0                  ; 23
+        xor     #0x14, w8               ; 24 (0x14 is the polynomial of CRC5)
+        nop                             ; 25
+        and.b   w3, w5, w4              ; 26 (is there a 6-b-1 in lsb of w5?)
+        bra     z, __unstuff1           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit1:                                 ; now w1.DP is prev sample of DP
+        xor     w0, w1, w1              ; 1 (if w1.DP =0, means 'no_switched')
+        btst.c  w1, #DP                 ; 2 (move w1.DP into SR.C)
+        rlc.b   w5, w5                  ; 3 (shift bit1 into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (gather this bit if it is not a
+        mov     _PORTU, w1              ; 13 (bit2 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14  stuff-bit)
+        repeat  #8                      ; 15
+        nop                             ; 16/17/18/19/20/21/22/23/24
+        and.b   w3, w5, w4              ; 25 (prev D-/D+ is in w0)
+        bra     z, __unstuff2           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit2:
+        xor     w0, w1, w0              ; 1 (if w0.DP =0, means 'no_switched')
+        btst.c  w0, #DP                 ; 2 (move w0.DP into SR.C)
+        rlc.b   w5, w5                  ; 3 (shift bit2 into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (gather this bit if it is not a
+        mov     _PORTU, w0              ; 13 (bit3 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14  stuff-bit)
+        repeat  #9                      ; 15
+        nop                             ; 16/17/18/19/20/21/22/23/24/25
+        and.b   w3, w5, w4              ; 26 (prev D-/D+ is in w1)
+        bra     z, __unstuff3           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit3:
+        xor     w0, w1, w1              ; 1 (if w1.DP =0, means 'no_switched')
+        btst.c  w1, #DP                 ; 2 (move w1.DP into SR.C)
+        rlc.b   w5, w5                  ; 3 (shift bit3 into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (gather this bit if it is not a
+        mov     _PORTU, w1              ; 13 (bit4 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14  stuff-bit)
+        repeat  #9                      ; 15
+        nop                             ; 16/17/18/19/20/21/22/23/24/25
+        and.b   w3, w5, w4              ; 26 (prev D-/D+ is in w0)
+        bra     z, __unstuff4           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit4:
+        xor     w0, w1, w0              ; 1 (if w0.DP =0, means 'no_switched')
+        btst.c  w0, #DP                 ; 2 (move w0.DP into SR.C)
+        rlc.b   w5, w5                  ; 3 (shift bit4 into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (gather this bit if it is not a
+        mov     _PORTU, w0              ; 13 (bit5 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14  stuff-bit)
+        repeat  #8                      ; 15
+        nop                             ; 16/17/18/19/20/21/22/23/24
+        and.b   w3, w5, w4              ; 25 (prev D-/D+ is in w1)
+        bra     z, __unstuff5           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit5:
+        xor     w0, w1, w1              ; 1 (if w1.DP =0, means 'no_switched')
+        btst.c  w1, #DP                 ; 2 (move w1.DP into SR.C)
+        rlc.b   w5, w5                  ; 3 (shift bit5 into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (gather this bit if it is not a
+        mov     _PORTU, w1              ; 13 (bit6 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14  stuff-bit)
+        repeat  #9                      ; 15
+        nop                             ; 16/17/18/19/20/21/22/23/24/25
+        and.b   w3, w5, w4              ; 26 (prev D-/D+ is in w0)
+        bra     z, __unstuff6           ; 0 (add 1 cycle if 'bra z' is taken)
+;;-----------------------------------------------------------------------------
+__bit6:
+        xor     w0, w1, w0              ; 1 (if w0.DP =0, means 'no_switched')
+        btst.c  w0, #DP                 ; 2 (move w0.DP into SR.C. it's bit6)
+        rlc.b   w5, w5                  ; 3 (then shift this bit into w5)
+        xor     w7, w5, w4              ; 4 (w7 =CRC16 of the bits after PID,
+        lsr     w7, w7                  ; 5  w4.0 =0 if the polynomial is
+        btss    w4, #0                  ; 6  applied, w9 =0xA001)
+        xor     w7, w9, w7              ; 7
+        xor     w8, w5, w4              ; 8 (w8 =CRC5 of the same bits)
+        lsr     w8, w8                  ; 9
+        btss    w4, #0                  ; 10
+        xor     #0x14, w8               ; 11 (0x14 is the polynomial of CRC5)
+        btst.c  w5, #0                  ; 12 (move this bit into SR.C again)
+        mov     _PORTU, w0              ; 13 (bit7 or a stuff-bit is sampled)
+        rrc.b   [w2], [w2]              ; 14 (gather this bit)
+        repeat  #6                      ; 15
+        nop                             ; 16/17/18/19/20/21/22
+        and.b   w3, w5, w4              ; 23 (is there a 6-b-1 in lsb of w5?)
+        bra     z, __unstuff7           ; 24 (add 1 cycle if 'bra z' is taken)
+        bra     __bit7                  ; 25
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff0:                             ; 1 (+1 cycle for 'bra z,__unstuff0')
+        xor     w0, w1, w0              ; 2 (27 cycles of the next-bit)
+        btst.c  w0, #DP                 ; 3 (w0.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w1, w0                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w1              ; 13 (sample the next bit)
+        nop                             ; 14
+        and.b   w1, #DPDM, w4           ; 15 (terminate the RX loop if this bit
+        bra     z, __EOPHit             ; 16  is the 1st SE0 of EOP)
+        repeat  #7                      ; 17
+        nop                             ; 18/19/20/21/22/23/24/25
+        bra     __bit0                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff1:                             ; 1 (+1 cycle for 'bra z,__unstuff1')
+        xor     w0, w1, w1              ; 2 (27 cycles of the next-bit)
+        btst.c  w1, #DP                 ; 3 (w1.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w0, w1                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w0              ; 13 (sample the next bit)
+        nop                             ; 14
+        and.b   w0, #DPDM, w4           ; 15 (terminate the RX loop if this bit
+        bra     z, __EOPHit             ; 16  is the 1st SE0 of EOP)
+        repeat  #7                      ; 17
+        nop                             ; 18/19/20/21/22/23/24/25
+        bra     __bit1                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff2:                             ; 1 (+1 cycle for 'bra z,__unstuff2')
+        xor     w0, w1, w0              ; 2 (27 cycles of the next-bit)
+        btst.c  w0, #DP                 ; 3 (w0.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w1, w0                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w1              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit2                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff3:                             ; 1 (+1 cycle for 'bra z,__unstuff3')
+        xor     w0, w1, w1              ; 2 (27 cycles of the next-bit)
+        btst.c  w1, #DP                 ; 3 (w1.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w0, w1                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w0              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit3                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff4:                             ; 1 (+1 cycle for 'bra z,__unstuff4')
+        xor     w0, w1, w0              ; 2 (27 cycles of the next-bit)
+        btst.c  w0, #DP                 ; 3 (w0.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w1, w0                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w1              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit4                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff5:                             ; 1 (+1 cycle for 'bra z,__unstuff5')
+        xor     w0, w1, w1              ; 2 (27 cycles of the next-bit)
+        btst.c  w1, #DP                 ; 3 (w1.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w0, w1                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w0              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit5                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff6:                             ; 1 (+1 cycle for 'bra z,__unstuff6')
+        xor     w0, w1, w0              ; 2 (27 cycles of the next-bit)
+        btst.c  w0, #DP                 ; 3 (w0.DP should be 1)
+        rlc.b   w5, w5                  ; 4 (shift this 1 into w5)
+        mov     w1, w0                  ; 5 (discard sample of the stuff-bit)
+        repeat  #5                      ; 6
+        nop                             ; 7/8/9/10/11/12
+        mov     _PORTU, w1              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit6                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__unstuff7:                             ; 26 (+1 cycle for 'bra z,__unstuff7')
+        nop                             ; 0 (stuff-bit cycle ends here)
+;;-----------------------------------------------------------------------------
+        xor     w0, w1, w1              ; 1 (27 cycles of the next-bit)
+        btst.c  w1, #DP                 ; 2 (w1.DP should be 1)
+        rlc.b   w5, w5                  ; 3 (shift this 1 into w5)
+        mov     w0, w1                  ; 4 (discard sample of the stuff-bit)
+        repeat  #6                      ; 5
+        nop                             ; 6/7/8/9/10/11/12
+        mov     _PORTU, w0              ; 13 (sample the next bit)
+        repeat  #10                     ; 14
+        nop                             ; 15/16/17/18/19/20/21/22/23/24/25
+        bra     __bit7                  ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__EOPHit:                               ; 17 (+1 cycle for 'bra    z, __EOPHit')
+        mov     _packet, w1             ; 18
+        nop                             ; 19
+        com.b   [++w1], w0              ; 20 (we need to check the PID byte)
+        and     w0, #0xF, w0            ; 21 (discard nPID at high nibble)
+        bra     w0                      ; 22/23
+__BranchTable0:                         ; 24/25
+        bra     __PIDError              ; (undefined PID)
+        bra     __isOut                 ; PID = 0001 (OUT)
+        bra     __isAck                 ; PID = 0010 (ACK)
+        bra     __isData0               ; PID = 0011 (DATA0)
+        bra     __PIDError              ; (undefined PID)
+        bra     __PIDError              ; PID = 0101 (SOF) not supported
+        bra     __PIDError              ; (undefined PID)
+        bra     __PIDError              ; (undefined PID)
+        bra     __PIDError              ; (undefined PID)
+        bra     __isIn                  ; PID = 1001 (IN)
+        bra     __isNak                 ; PID = 1010 (NAK)
+        bra     __isData1               ; PID = 1011 (DATA1)
+        bra     __PIDError              ; PID = 1100 (PRE) not supported
+        bra     __isSetup               ; PID = 1101 (SETUP)
+        bra     __isStall               ; PID = 1110 (STALL)
+        bra     __PIDError              ; (undefined  PID)
+;;-----------------------------------------------------------------------------
+__PIDError:                             ; continue 2nd SE0 of EOP
+        bset    __ucontr0, #14          ; 26 (__ucontr0[14] =1 means PID ERROR)
+        bra     __CNIntEnd              ; 0
+                                        ; 1
+;;-----------------------------------------------------------------------------
+__isSetup:
+        mov     #_token, w0             ; 26 (buffer '_token' will be also used
+        mov     WREG, _packet           ; 0  to gather UNRELATED packet)
+;;-----------------------------------------------------------------------------
+        com.b   [++w1], w0              ; 1 (fetch the device address byte)
+        and     #0x7F, w0               ; 2
+        cp.b    _addr                   ; 3 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 4 (+1 cycle if address not matched)
+        cp      w8, #0x06               ; 5 (CRC5 of the token MUST be correct)
+        bra     nz, __CNIntEnd          ; 6 (a bad token, just ignore it)
+        bset    __ucontr0, #13          ; 7 (__ucontr0[13] =1, address matched)
+        clr     _epout                  ; 8 (the DATA packet is not for EPn)
+        mov     #_datax, w0             ; 9 (buffer '_datax' will be used to 
+        mov     WREG, _packet           ; 10  gather SETUP packet)
+        clr.b   __uendpt0               ; 11 (clear the length/toggle/handshake)
+        bclr    __ucontr0, #12          ; 12 (__ucontr0[12] =0,DATA1 for IN/OUT)
+        bclr    __ucontr0, #11          ; 13 (a SETUP clears the EP0 STALL FLAG)
+        bra     __CNIntEnd              ; 14 (__uendpt0[1-0] is 00 now. it will
+                                        ; 15  be 01. means a SETUP TOKEN)
+;;-----------------------------------------------------------------------------
+__isOut:                                ; continue 2nd SE0 of EOP
+        mov     #_token, w0             ; 26 (buffer '_token' will be also used
+        mov     WREG, _packet           ; 0  to gather UNRELATED packet)
+;;-----------------------------------------------------------------------------
+        com.b   [++w1], w0              ; 1 (device address byte, w0.7 =ENDP[0])
+        mov.b   [w1+1], w3              ; 2 (w3[2-0] =~ENDP[3-1])
+        and     w3, #0x07, w3           ; 3
+        btst.c  w0, #7                  ; 4 (SR.C =ENDP[0])
+        rlc     w3, w3                  ; 5 (w3 =index of the endpoint)
+        bra     w3                      ; 6/7
+__EndpointTableOut:                     ; 8/9
+        bra     __CNIntEnd              ; ENDP = 14 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 15 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 12 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 13 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 10 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 11 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 8 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 9 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 6 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 7 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 4 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 5 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 2 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 3 (no such endpoint)
+        bra     __isOut0                ; ENDP = 0
+        bra     __outEP1                ; ENDP = 1
+;;-----------------------------------------------------------------------------
+__isOut0:                               ; 9 (+1 cycle for the entry of the table)
+        cp.b    _addr                   ; 10 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 11 (+1 cycle if address not matched)
+        cp      w8, #0x06               ; 12 (CRC5 of the token MUST be correct)
+        bra     nz, __CNIntEnd          ; 13 (a bad token, just ignore it)
+        bset    __ucontr0, #13          ; 14 (__ucontr0[13] =1, address matched)
+        clr     _epout                  ; 15 (the DATA packet is not for EPn)
+        mov     #_datax, w0             ; 16 (buffer '_datax' is used for DATA0)
+        btss    __uendpt0, #3           ; 17 (buffer '_datay' is used for DATA1)
+        mov     #_datay, w0             ; 18 (use _datay if DATA TOGGLE is 0)
+        mov     w0, _packet             ; 19 (prepare to gather the DATA packet)
+        bra     __CNIntEnd              ; 20 (__uendpt0[1-0] will be switched to
+                                        ; 21  11 when we respond an ACK to the
+                                        ;   host)
+;;-----------------------------------------------------------------------------
+__outEP1:                               ; 9 (+1 cycle for the entry of the table)
+        mov     #__eptab+0, w3          ; 10 (w3 points to EP1)
+        bra     __isOutEP               ; 11
+                                        ; 12
+;;-----------------------------------------------------------------------------
+__isOutEP:                              ; 12 (+1 cycle for 'bra __isOutEP')
+        and     #0x7F, w0               ; 13 (discard ENDP[0])
+        cp.b    _addr                   ; 14 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 15 (+1 cycle if address not matched)
+        cp      w8, #0x06               ; 16 (CRC5 of the token MUST be correct)
+        bra     nz, __CNIntEnd          ; 17 (a bad token, just ignore it)
+        bclr    __ucontr0, #13          ; 18 (the DATA packet is not for EP0,
+        mov     w3, _epout              ; 19  but for this endpoint)
+        mov     [w3+2], w0              ; 20 (w0 =OUT word of the endpoint)
+        and     #0x0C, w0               ; 21 (fetch OUT word[3-2])
+        cp.b    w0, #0x04               ; 22 (is it an ACK?)
+        mov     [w3+6], w0              ; 23 (its OUT buffer is used if it is
+        btsc    _SR, #Z                 ; 24  armed, or the packet goes to
+        mov     w0, _packet             ; 25  '_token')
+        bra     __CNIntEnd              ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__isData1:                              ; continue 2nd SE0 of EOP
+        btss    __ucontr0, #13          ; 26 (device address MUST be matched)
+        bra     __epData1               ; 0 (+1 cycle if it is not for EP0)
+;;-----------------------------------------------------------------------------
+        mov     #0xB001, w0             ; 1 (CRC16 of the data MUST be correct,
+        cp      w7, w0                  ; 2  or no handshake is sent and the
+        bra     nz, __CNIntEnd          ; 3  host will send it again)
+        repeat  #39                     ; 4
+        nop                             ; 5..17
+        mov     __ucontr0, w3           ; 18 (continue if dev addr is matched)
+        and     #0x0C, w3               ; 19 (fetch __ucontr0[3-2])
+        mov     #0x03, w0               ; 20 (TOKEN TYPE =11, it is OUT)
+        ior     w0, w3, w4              ; 21 (response and TOKEN TYPE in w4)
+        cp.b    w3, #0x04               ; 22 (is it an ACK?)
+        btsc    _SR, #Z                 ; 23 (not an ACK, skip toggle bit)
+        bset    __uendpt0, #3           ; 24 (__uendpt0[3] =1, DATA1)
+        mov     #_token+1, w6           ; 25 (w6 points to the PID byte)
+        bra     __HandShake             ; 26 (send handshake to the host)
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__isData0:                              ; data packet for SETUP or OUT ?
+        btss    __ucontr0, #13          ; 26 (device address MUST be matched)
+        bra     __epData0               ; 0 (+1 cycle if it is not for EP0)
+;;-----------------------------------------------------------------------------
+        mov     #0xB001, w0             ; 1 (CRC16 of the data MUST be correct,
+        cp      w7, w0                  ; 2  or no handshake is sent and the
+        bra     nz, __CNIntEnd          ; 3  host will send it again)
+        repeat  #39                     ; 4
+        nop                             ; 5..17
+        mov     __ucontr0, w3           ; 18 (continue if dev addr is matched)
+        and     #0x0C, w3               ; 19 (fetch __ucontr0[3-2])
+        mov     #0x03, w0               ; 20 (TOKEN TYPE =11, it is OUT)
+        ior     w0, w3, w4              ; 21 (response and TOKEN TYPE in w4)
+        btss    __uendpt0, #0           ; 22 (change response and TOKEN TYPE
+        mov     #0x05, w4               ; 23  if current token is SETUP)
+        cp.b    w3, #0x04               ; 24 (is it an ACK for OUT?)
+        btsc    _SR, #Z                 ; 25 (not ACK, skip 'bclr __uendpt0, #3)
+        bclr    __uendpt0, #3           ; 26 (clear toggle bit)
+        mov     #_token+1, w6           ; 0 (w6 points to the PID byte)
+;;-----------------------------------------------------------------------------
+__HandShake:                            ; handshake according to w4[3-2]
+        sub     w2, w1, w2              ; 1
+        mov     #2, w1                  ; 2 (w1 =2 means 2 bytes will be sent)
+        and     w4, #0x0C, w0           ; 3 (w4[3-2] =handshake)
+        cp.b    w0, #0x04               ; 4 (is it an ACK? w0[3-0] =0100?)
+        btsc    _SR, #Z                 ; 5 (not ACK, skip 'bclr w0, #2')
+        bclr    w0, #2                  ; 6 (w0[3-0] =0000 now)
+        bset    w0, #1                  ; 7 (this bit is always 1)
+__SendBytes:                            ; now w0 =PID, w1 =bytes length
+        com     w0, w5                  ; 8 (w5 will be the PID sent to host)
+        swap.b  w0                      ; 9 (calclate 4 bits nPID)
+        and     #0x0F, w5               ; 10
+        ior     w0, w5, w5              ; 11
+        mov.b   w5, [w6--]              ; 12 (w5 is the PID sent to the host)
+        setm.b  [w6]                    ; 13 (w6 points to the SYNC byte)
+        bclr.b  [w6], #7                ; 14 (clear bit7 of SYNC, so SYNC =7F)
+        dec     w2, [w15++]             ; 15 (w2 -PID, then push into stack)
+        bclr    _LATU, #DP              ; 16 (D- =0 and D+ =0, a SE0)
+        bclr    _LATU, #DM              ; 17 (they are not sent, _TRISU =1 now)
+        push    _LATU                   ; 18 (push a SE0 on the top of stack)
+        bset    _LATU, #DM              ; 19 (D- =1 and D+ =0, a J-state)
+        repeat  #5                      ; 20
+        nop                             ; 21/22/23/24/25/26
+        mov     #~DPDM, w0              ; 0 (set pins D-/D+ to OUTPUT mode)
+;;-----------------------------------------------------------------------------
+__Sending:                              ; start to output all signals
+        and     _TRISU                  ; 1 (now output a J-state first)
+        and     w4, #0x0C, w0           ; 2 (is it an ACK sent to host?)
+        cp.b    w0, #0x04               ; 3 (yes, we need to clear the low
+        mov     #0xFF08, w0             ; 4  byte of __uendpt0 except bit3)
+        btsc    _SR, #Z                 ; 5 (now w6 points to the SYNC byte)
+        and     __uendpt0               ; 6 (clear __uendpt0[7-4,2-0])
+        mov     #0xFFFF, w5             ; 7 (w5 is initialized for bit-stuff)
+        mov     #DPDM, w0               ; 8 (D-/D+ xor w0, make J-K flipping)
+        repeat  #15                     ; 9
+        nop                             ; 10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25
+        rrc.b   [w6++], w3              ; 26 (fetch the first byte to be sent,
+        rlc.b   w5, w5                  ; 0  bit0 is in SR.C, shift it into w5)
+;;-----------------------------------------------------------------------------
+__bit0_:xor     _LATU                   ; 1 (send bit0, lsb sent first)
+        mov     #(__bit1s-__done27)/2, w2 ; 2 (return here when __dostuff done)
+        and     #0x3F, w5               ; 3 (bit-stuff checking)
+        bra     z, __dostuff27          ; 4 (w5[5-0] =000000, need a stuff-bit
+__bit1s:mov     #DPDM, w0               ; 5
+        btss    w3, #0                  ; 6 (if next bit is 1, D-/D+ will not
+        mov     #0x0000, w0             ; 7  be switched)
+        rrc.b   w3, w3                  ; 8
+        rlc.b   w5, w5                  ; 9 (w5[5-0] is for bit-stuff checking)
+        mov     #(__bit2s-__done27)/2, w2 ; 10 (return here when __dostuff done)
+        repeat  #15                     ; 11
+        nop                             ; 12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0
+;;-----------------------------------------------------------------------------
+__bit1_:xor     _LATU                   ; 1 (send bit1)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff26          ; 4
+__bit2s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7
+        rlc.b   w5, w5                  ; 8
+        mov     #(__bit3s-__done26)/2, w2 ; 9 (return here when __dostuff done)
+        repeat  #15                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/0
+;;-----------------------------------------------------------------------------
+__bit2_:xor     _LATU                   ; 1 (send bit2)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff27          ; 4
+__bit3s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7
+        rlc.b   w5, w5                  ; 8
+        mov     #(__bit4s-__done27)/2, w2 ; 9 (return here when __dostuff done)
+        repeat  #16                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0
+;;-----------------------------------------------------------------------------
+__bit3_:xor     _LATU                   ; 1 (send bit3)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff27          ; 4
+__bit4s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7
+        rlc.b   w5, w5                  ; 8
+        mov     #(__bit5s-__done27)/2, w2 ; 9 (return here when __dostuff done)
+        repeat  #16                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0
+;;-----------------------------------------------------------------------------
+__bit4_:xor     _LATU                   ; 1 (send bit4)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff26          ; 4
+__bit5s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7
+        rlc.b   w5, w5                  ; 8
+        mov     #(__bit6s-__done26)/2, w2 ; 9 (return here when __dostuff done)
+        repeat  #15                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/0
+;;-----------------------------------------------------------------------------
+__bit5_:xor     _LATU                   ; 1 (send bit5)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff27          ; 4
+__bit6s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7
+        rlc.b   w5, w5                  ; 8
+        mov     #(__bit7s-__done27)/2, w2 ; 9 (return here when __dostuff done)
+        repeat  #16                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0
+;;-----------------------------------------------------------------------------
+__bit6_:xor     _LATU                   ; 1 (send bit6)
+        mov     #DPDM, w0               ; 2
+        and     #0x3F, w5               ; 3
+        bra     z, __dostuff26          ; 4
+__bit7s:btss    w3, #0                  ; 5
+        mov     #0x0000, w0             ; 6
+        rrc.b   w3, w3                  ; 7 (shift last bit of w3 into w5.
+        rlc.b   w5, w5                  ; 8  now w3 is empty. we can load next
+        mov     #(__bit0s-__done27)/2, w2 ; 9
+        repeat  #14                     ; 10
+        nop                             ; 11/12/13/14/15/16/17/18/19/20/21/22/23/24/25
+        rrc.b   [w6++], w3              ; 0  byte into w3 and bit0 into SR.C)
+;;-----------------------------------------------------------------------------
+__bit7_:xor     _LATU                   ; 1 (SR.C will not be affected)
+        mov     #DPDM, w0               ; 2 (SR.C will not be affected)
+        and     #0x3F, w5               ; 3 (SR.C will not be affected)
+        bra     z, __dostuff27          ; 4 (SR.C MUST NOT be affected when
+__bit0s:btss    SR, #C                  ; 5  __dostuff is executed)
+        mov     #0x0000, w0             ; 6 (SR.C will not be affected)
+        rlc.b   w5, w5                  ; 7 (shift bit0 of next byte into w5)
+        repeat  #15                     ; 8
+        nop                             ; 9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24
+        dec     w1, w1                  ; 25 (are all bytes sent?)
+        bra     nz, __bit0_             ; 26 (+1 cycle if 'bra nz' is taken)
+        and     w4, #0x0C, w0           ; 0 (get the HANDSHAKE to host)
+;;-----------------------------------------------------------------------------
+__bytes:                                ; all bytes are sent completely
+        pop     _LATU                   ; 1 (generate first SE0 on the BUS)
+        dec2    [--w15], w2             ; 2 (w2 -CRC, clac real bytes length)
+        sl      w2, #4, w2              ; 3 (w2[7-4] =real bytes length)
+        ior     w4, w2, w4              ; 4 (w4[1-0] =TOKEN TYPE)
+        cp.b    w0, #0x04               ; 5 (w0[3-2] =HANDSHAKE. is it a ACK?)
+        mov     w4, w0                  ; 6 (w4[7-4] =real bytes length)
+        btsc    _SR, #Z                 ; 7 (not ACK, skip 'bset __uendpt0,#10)
+        bset    __uendpt0, #10          ; 8 (set REQUEST flag)
+        btsc    _SR, #Z                 ; 9 (not ACK, skip 'ior.b __uendpt0')
+        ior.b   __uendpt0               ; 10 (__uendpt0[7-0] has been cleared)
+__nextSE0:
+        mov     #0xD800, w0             ; 11 (device address NOT matched now,
+        and     __ucontr0, WREG         ; 12  but keep the EP0 STALL FLAG)
+        ior     w0, #0xA, w1            ; 13 (NAK to OUT and IN)
+        btsc    w1, #11                 ; 14 (STALL to OUT and IN instead if
+        ior     w1, #0xF, w1            ; 15  the EP0 STALL FLAG is set)
+        btss    w4, #8                  ; 16 (keep __ucontr0 if it was EPn)
+        mov     w1, __ucontr0           ; 17
+        repeat  #32                     ; 18
+        nop                             ; 19..24
+        mov     #DPDM, w0               ; 25 (the 2nd SE0 ends)
+        ior     _TRISU                  ; 26 (D-/D+ are on INPUT mode now)
+        mov     #_token, w1             ; 0 (prepare to receive next TOKEN)
+;;-----------------------------------------------------------------------------
+        mov     w1, _packet             ; 1
+        bra     __CNIntEnd              ; 2
+                                        ; 3
+;;-----------------------------------------------------------------------------
+__dostuff26:                            ; 5 (+1 cycle for 'bra z, __dostuff26')
+        repeat  #17                     ; 6 (SR.C MUST NOT be affected)
+        nop                             ; 7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24
+        bset    w5, #0                  ; 25 (insert a 1 at w5.0, the stuff-bit)
+        mov     #DPDM, w0               ; 0 (w0 is #DPDM, make J-K flipping)
+;;-----------------------------------------------------------------------------
+        xor     _LATU                   ; 1 (generate stuff-bit)
+        nop                             ; 2
+        bra     w2                      ; 3/4
+__done26:                               ; branch to '__done26 + w2 * 2'
+;;-----------------------------------------------------------------------------
+__dostuff27:                            ; 5 (+1 cycle for 'bra z, __dostuff27')
+        repeat  #18                     ; 6 (SR.C MUST NOT be affected)
+        nop                             ; 7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25
+        bset    w5, #0                  ; 26 (insert a 1 at w5.0, the stuff-bit)
+        mov     #DPDM, w0               ; 0 (w0 is #DPDM, make J-K flipping)
+;;-----------------------------------------------------------------------------
+        xor     _LATU                   ; 1 (generate stuff-bit)
+        nop                             ; 2
+        bra     w2                      ; 3/4
+__done27:                               ; branch to '__done27 + w2 * 2'
+;;-----------------------------------------------------------------------------
+__isIn:
+        com.b   [++w1], w0              ; 26 (device address byte, w0.7 =ENDP[0])
+        mov.b   [w1+1], w3              ; 0 (w3[2-0] =~ENDP[3-1])
+;;-----------------------------------------------------------------------------
+        and     w3, #0x07, w3           ; 1
+        btst.c  w0, #7                  ; 2 (SR.C =ENDP[0])
+        rlc     w3, w3                  ; 3 (w3 =index of the endpoint)
+        bra     w3                      ; 4/5
+__EndpointTableIn:                      ; 6/7
+        bra     __CNIntEnd              ; ENDP = 14 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 15 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 12 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 13 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 10 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 11 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 8 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 9 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 6 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 7 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 4 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 5 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 2 (no such endpoint)
+        bra     __CNIntEnd              ; ENDP = 3 (no such endpoint)
+        bra     __isIn0                 ; ENDP = 0
+        bra     __inEP1                 ; ENDP = 1
+;;-----------------------------------------------------------------------------
+__isIn0:                                ; 7 (+1 cycle for the entry of the table)
+        cp.b    _addr                   ; 8 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 9 (+1 cycle if address not matched)
+        cp      w8, #0x06               ; 10 (CRC5 of the token MUST be correct)
+        bra     nz, __CNIntEnd          ; 11 (a bad token, just ignore it)
+        clr     _epsent                 ; 12 (the next ACK is not for EPn)
+        mov     __ucontr0, w0           ; 13 (check __ucontr0[1-0])
+        and     #0x03, w0               ; 14 (w0[1-0] =PID sent to host)
+        sl      w0, #2, w4              ; 15 (w4[3-2] =PID on __uendpt0)
+        cp.b    w0, #0x01               ; 16 (is it ACK?)
+        bra     z, __respond            ; 17 (yes, send DATA packet to host)
+        repeat  #32                     ; 18
+        nop                             ; 19..24
+        mov     #_token+1, w6           ; 25 (w6 points to the PID byte)
+        bra     __HandShake             ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__respond:                              ; 18 (+1 cycle for 'bra z, __respond')
+        ior.b   w4, #2, w4              ; 19 (w4[1-0] =TOKEN TYPE, =10, IN)
+        mov.b   #0x03, w0               ; 20 (w0 =DATA0)
+        btss    __ucontr0, #12          ; 21 (if __ucontr0[12]==0, then set
+        mov.b   #0x0B, w0               ; 22  w0 =1011, DATA1)
+        mov     __ucontr0, w1           ; 23 (__ucontr0[7-4] =bytes length)
+        lsr     w1, #4, w1              ; 24
+        and     w1, #0xF, w1            ; 25 (w1 =bytes length)
+        add     w1, #4, w1              ; 26 (+SYNC, +PID, +CRC16)
+        dec     w1, w2                  ; 0 (w2 is for '__uendpt0[7-4]')
+;;-----------------------------------------------------------------------------
+        mov     #_datay+1, w6           ; 1 (w6 points to the PID byte)
+        repeat  #29                     ; 2
+        nop                             ; 3..5
+        bra     __SendBytes             ; 6
+                                        ; 7
+;;-----------------------------------------------------------------------------
+__inEP1:                                ; 7 (+1 cycle for the entry of the table)
+        mov     #__eptab+0, w3          ; 8 (w3 points to EP1)
+        bra     __isInEP                ; 9
+                                        ; 10
+;;-----------------------------------------------------------------------------
+__isInEP:                               ; 10 (+1 cycle for 'bra __isInEP')
+        and     #0x7F, w0               ; 11 (discard ENDP[0])
+        cp.b    _addr                   ; 12 (device address MUST be matched)
+        bra     nz, __CNIntEnd          ; 13 (+1 cycle if address not matched)
+        cp      w8, #0x06               ; 14 (CRC5 of the token MUST be correct)
+        bra     nz, __CNIntEnd          ; 15 (a bad token, just ignore it)
+        mov     [w3], w0                ; 16 (check IN word[1-0])
+        and     #0x03, w0               ; 17 (w0[1-0] =PID sent to host)
+        sl      w0, #2, w4              ; 18 (w4[3-2] =NAK or STALL)
+        cp.b    w0, #0x01               ; 19 (is it ACK?)
+        bra     z, __respondEP          ; 20 (yes, send the DATA to host)
+        bset    w4, #8                  ; 21 (w4[8] =1, not EP0)
+        repeat  #28                     ; 22
+        nop                             ; 23..24
+        mov     #_token+1, w6           ; 25 (w6 points to the PID byte)
+        bra     __HandShake             ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__respondEP:                            ; 21 (+1 cycle for 'bra z, __respondEP')
+        mov     #0x0100, w4             ; 22 (w4[8] =1, w4[3-0] =0000)
+        mov     w3, _epsent             ; 23 (the next ACK is for this endpoint)
+        mov.b   #0x03, w0               ; 24 (w0 =DATA0)
+        btss    [w3], #12               ; 25 (if IN word[12]==0, then set
+        mov.b   #0x0B, w0               ; 26  w0 =1011, DATA1)
+        mov     [w3], w1                ; 0 (IN word[7-4] =bytes length)
+;;-----------------------------------------------------------------------------
+        lsr     w1, #4, w1              ; 1
+        and     w1, #0xF, w1            ; 2 (w1 =bytes length)
+        add     w1, #4, w1              ; 3 (+SYNC, +PID, +CRC16)
+        dec     w1, w2                  ; 4
+        mov     [w3+4], w6              ; 5 (w6 points to the IN buffer,
+        inc     w6, w6                  ; 6  then to the PID byte)
+        repeat  #24                     ; 7
+        nop                             ; 8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24/25/26/0/1/2/3/4/5
+        bra     __SendBytes             ; 6
+                                        ; 7
+;;-----------------------------------------------------------------------------
+__epData1:                              ; 1 (+1 cycle for 'bra __epData1')
+        mov     _epout, w3              ; 2 (w3 points to the endpoint of the
+        cp0     w3                      ; 3  OUT token, or it is 0)
+        bra     z, __CNIntEnd           ; 4 (no, ignore it)
+        mov     #0xB001, w0             ; 5 (CRC16 of the data MUST be correct,
+        cp      w7, w0                  ; 6  or no handshake is sent and the
+        bra     nz, __CNIntEnd          ; 7  host will send it again)
+        mov     [w3+2], w0              ; 8 (w0 =OUT word of the endpoint)
+        sub     w2, w1, w6              ; 9
+        sub     w6, #3, w6              ; 10 (w6 =bytes length, -PID -CRC16)
+        sl      w6, #4, w6              ; 11
+        mov     #0x060C, w5             ; 12 (set PACKET DONE, switch toggle,
+        xor     w0, w5, w5              ; 13  ACK -> NAK)
+        ior     w5, w6, w5              ; 14 (w5 =OUT word if it is taken)
+        mov     #0x040C, w6             ; 15
+        and     w0, w6, w6              ; 16 (w6 =toggle and handshake)
+        mov     #0x0404, w4             ; 17 (ACK and DATA1 expected?)
+        cp      w6, w4                  ; 18
+        btsc    _SR, #Z                 ; 19 (yes, take the packet)
+        mov     w5, [w3+2]              ; 20
+        mov     #0x0100, w4             ; 21 (w4[8] =1, not EP0)
+        and     w0, #0x0C, w6           ; 22 (send NAK or STALL if it is not
+        btsc    w0, #3                  ; 23  armed. w4[3-2] =00 means ACK)
+        ior     w4, w6, w4              ; 24
+        clr     _epout                  ; 25
+        repeat  #24                     ; 26
+        nop                             ; 0/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24
+        mov     #_token+1, w6           ; 25 (w6 points to the PID byte)
+        bra     __HandShake             ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__epData0:                              ; 1 (+1 cycle for 'bra __epData0')
+        mov     _epout, w3              ; 2 (w3 points to the endpoint of the
+        cp0     w3                      ; 3  OUT token, or it is 0)
+        bra     z, __CNIntEnd           ; 4 (no, ignore it)
+        mov     #0xB001, w0             ; 5 (CRC16 of the data MUST be correct,
+        cp      w7, w0                  ; 6  or no handshake is sent and the
+        bra     nz, __CNIntEnd          ; 7  host will send it again)
+        mov     [w3+2], w0              ; 8 (w0 =OUT word of the endpoint)
+        sub     w2, w1, w6              ; 9
+        sub     w6, #3, w6              ; 10 (w6 =bytes length, -PID -CRC16)
+        sl      w6, #4, w6              ; 11
+        mov     #0x060C, w5             ; 12 (set PACKET DONE, switch toggle,
+        xor     w0, w5, w5              ; 13  ACK -> NAK)
+        ior     w5, w6, w5              ; 14 (w5 =OUT word if it is taken)
+        mov     #0x040C, w6             ; 15
+        and     w0, w6, w6              ; 16 (w6 =toggle and handshake)
+        mov     #0x0004, w4             ; 17 (ACK and DATA0 expected?)
+        cp      w6, w4                  ; 18
+        btsc    _SR, #Z                 ; 19 (yes, take the packet)
+        mov     w5, [w3+2]              ; 20
+        mov     #0x0100, w4             ; 21 (w4[8] =1, not EP0)
+        and     w0, #0x0C, w6           ; 22 (send NAK or STALL if it is not
+        btsc    w0, #3                  ; 23  armed. w4[3-2] =00 means ACK)
+        ior     w4, w6, w4              ; 24
+        clr     _epout                  ; 25
+        repeat  #24                     ; 26
+        nop                             ; 0/1/2/3/4/5/6/7/8/9/10/11/12/13/14/15/16/17/18/19/20/21/22/23/24
+        mov     #_token+1, w6           ; 25 (w6 points to the PID byte)
+        bra     __HandShake             ; 26
+                                        ; 0
+;;-----------------------------------------------------------------------------
+__isStall:
+        mov     #0x0007, w0             ; 26
+        and     __uendpt0, WREG         ; 0 (check __uendpt0[2-0])
+;;-----------------------------------------------------------------------------
+        cp      w0, #6                  ; 1 (it must be 110, ACK & IN)
+        bra     nz, __CNIntEnd          ; 2 (no, this STALL is not sent to us)
+        nop                             ; 3
+        mov     #0x0700, w1             ; 4 (REQUEST FLAG & STALL from host)
+        bra     __hostHandShake         ; 5 (w1[9-8] =11, STALL. w1[10] =1, set
+                                        ; 6  REQUEST flag)
+;;-----------------------------------------------------------------------------
+__isAck:
+        cp0     _epsent                 ; 26 (is it the ACK of a DATA on EPn?)
+        bra     nz, __isAckEP           ; 0
+;;-----------------------------------------------------------------------------
+        mov     #0x0007, w0             ; 1
+        and     __uendpt0, WREG         ; 2 (check __uendpt0[2-0])
+        cp      w0, #6                  ; 3 (it must be 110, ACK & IN)
+        bra     nz, __CNIntEnd          ; 4 (no, this ACK is not sent to us)
+        btg     __ucontr0, #12          ; 5 (switch DATA TOGGLE)
+        mov     #0x0500, w1             ; 6 (REQUEST FLAG & ACK from host)
+        bra     __hostHandShake         ; 7 (w1[9-8] =01, ACK. w1[10] =1, set
+                                        ; 8  REQUEST flag)
+;;-----------------------------------------------------------------------------
+__isNak:
+        mov     #0x0007, w0             ; 26
+        and     __uendpt0, WREG         ; 0 (check __uendpt0[2-0])
+;;-----------------------------------------------------------------------------
+        cp      w0, #6                  ; 1 (it must be 110, ACK & IN)
+        bra     nz, __CNIntEnd          ; 2 (no, this NAK is not sent to us)
+        nop                             ; 3
+        bset    __ucontr0, #0           ; 4 (set an ACK to next IN token, then
+        bclr    __ucontr0, #1           ; 5  DATA packet will be resent)
+        mov     #0x0600, w1             ; 6 (REQUEST FLAG & NAK from host)
+;;-----------------------------------------------------------------------------
+__hostHandShake:                        ; the packet is over, no more timing
+        mov     #0xF8FF, w0
+        and     __uendpt0
+        mov     w1, w0
+        ior     __uendpt0
+        bra     __CNIntEnd
+;;-----------------------------------------------------------------------------
+__isAckEP:                              ; the host has got the DATA
+        mov     _epsent, w1             ; w1 points to the endpoint
+        clr     _epsent
+        mov     #0x1003, w0             ; switch DATA TOGGLE
+        xor     w0, [w1], [w1]          ; IN word[1-0] =01 -> 10, NAK
+        bset    [w1], #15               ; IN word[15] =1, the DATA is done
+;;-----------------------------------------------------------------------------
+__CNIntEnd:                             ; 13 cycles total
+        pop     w9                      ;
+        pop     w8                      ;
+        pop     w7                      ;
+        pop     w6                      ;
+        pop     w5                      ;
+        pop     w4                      ;
+__IRQExit:                              ; 7 cycles total
+        clr     TMR2                    ; the bus is alive, restart the
+        bclr    _IFS1, #CNIF            ; SUSPEND timer of usb.c
+        pop     RCOUNT                  ;
+        pop.s                           ;
+        retfie                          ;
+;;-----------------------------------------------------------------------------
+__CRC16:                                ; w0 =buffer, w1 =bytes length
+        mov     #0xFFFF, w5             ; initial value, w3 =the data field of
+        cp0.b   w1                      ; _datay or _datai. zero length?
+        bra     z, __CRCEnd             ; yes, only CRC
+        mov     #0xA001, w4
+__CRCbytes:
+        mov.b   [w0++], w6              ; fetch a byte
+        com.b   w6, [w3++]              ; copy this byte into w3
+        mov     #8, w2                  ; 8 bits
+__CRCbits:
+        xor.b   w5, w6, w7              ; lsb (w7.0) is a flag
+        lsr     w5, w5
+        btsc    w7, #0
+        xor     w5, w4, w5
+        rrnc.b  w6, w6
+        dec     w2, w2
+        bra     nz, __CRCbits
+        dec     w1, w1
+        bra     nz, __CRCbytes
+__CRCEnd:
+        mov.b   w5, [w3++]
+        swap    w5
+        mov.b   w5, [w3++]
+        return
+;;-----------------------------------------------------------------------------
+; APIs for application
+
+        .global __usbGetSetup
+        .global __usbSetAddress
+        .global __usbSetConfig
+        .global __usbStallEP0
+        .global __usbArmIn
+        .global __usbArmZLP
+        .global __usbInDone
+        .global __usbArmOut
+        .global __usbOutDone
+        .global __usbBusReset
+        .global __usbArmInEP
+        .global __usbInEPDone
+        .global __usbHaltInEP
+        .global __usbArmOutEP
+        .global __usbOutEPDone
+        .global __usbHaltOutEP
+        .global __usbSendResume
+
+__usbGetSetup:                          ; w0 =output buffer.
+        cp0     w0
+        bra     z, __GetSetupExit
+        push    w0
+        mov     #0x04FF, w0
+        and     __uendpt0, WREG
+        mov     #0x0485, w1
+        cp      w0, w1
+        pop     w0
+        bra     nz, __GetSetupExit
+        mov     #_datax+2, w1
+        mov     #8, w2
+__GetSetupLoop:
+        com.b   [w1++], [w0++]          ; w0 is allowed to point to odd address
+        dec     w2, w2
+        bra     nz, __GetSetupLoop
+        mov     #0xF808, w0             ; clear '__uendpt0[1-0]', next 'OUT'+
+        and     __uendpt0               ; 'DATA1' will set it to '11'
+        mov     #8, w0
+        return
+__GetSetupExit:
+        mov     #0, w0
+        return
+;;-----------------------------------------------------------------------------
+__usbArmZLP:                            ; ACK the next IN with a DATA1 zlp
+        bclr    __ucontr0, #12          ; must send a DATA1 packet
+        mov     #0, w0
+        mov     #0, w1
+__usbArmIn:                             ; w0 =output buffer, w1 =bytes length
+        bclr    __uendpt0, #10          ; clear REQUEST FLAG
+        bclr    __uendpt0, #2           ; clear response bit
+        mov     __ucontr0, w2           ; __ucontr0[7-4] =bytes length
+        and.b   #0xC, w2                ; clear bytes length and NAK
+        and     w1, #0xF, w1            ; w1[3-0] =bytes length
+        sl      w1, #4, w3
+        ior.b   w3, w2, w2
+        ior.b   #0x01, w2               ; ACK to IN request
+        push    w2
+        mov     #_datay+2, w3
+        rcall   __CRC16                 ; copy data and CRC into datay
+        pop     __ucontr0
+        return                          ; don't wait for the ACK of host
+;;-----------------------------------------------------------------------------
+__usbInDone:                            ; w0 =1 if the host ACKed the DATA
+        mov     #0x0506, w1
+        mov     #0x0707, w0             ; __uendpt0[10-8] & __uendpt0[2-0]
+        and     __uendpt0, WREG
+        cp      w1, w0
+        mov     #0, w0                  ; 'mov' doesn't change SR.Z
+        bra     nz, __InDoneExit
+
+        mov     #0xF8F8, w0
+        and     __uendpt0
+        mov     #1, w0
+__InDoneExit:
+        return
+;;-----------------------------------------------------------------------------
+__usbArmOut:                            ; ACK the next OUT of EP0
+        bclr    __uendpt0, #10          ; DO NOT modify '__uendpt0[1-0]' accidentally
+        bclr    __uendpt0, #2           ; this 2 bits are useful when we receive 'DATA0'
+        mov.b   __ucontr0, WREG
+        bclr    w0, #3
+        bset    w0, #2                  ; __ucontr0[3-2] =01, means ACK to OUT
+        mov.b   WREG, __ucontr0         ; DO NOT modify '__ucontr0[13]' accidentally!!!
+        return                          ; don't wait for the DATA of host
+;;-----------------------------------------------------------------------------
+__usbOutDone:                           ; w0 =input buffer, w1 =bytes length
+        push    w0
+        mov     #0x0407, w2             ; __uendpt0[10] =1 & __uendpt0[2-0] =111
+        mov     #0x0407, w0
+        and     __uendpt0, WREG
+        cp      w0, w2
+        pop     w0
+        bra     z, __OutDone
+        setm    w0                      ; w0 =0xFFFF, nothing received yet
+        return
+__OutDone:
+        mov     __uendpt0, w2
+        lsr     w2, #4, w2
+        and     #0xF, w2                ; bytes length from host
+        cp      w2, w1
+        bra     GEU, __unload
+        mov     w2, w1
+__unload:
+        mov     #_datax+2, w2           ; DATA0 or DATA1?
+        btsc    __uendpt0, #3           ; __uendpt0[3]==0, means DATA0
+        mov     #_datay+2, w2
+        push    w1
+__UnloadLoop:
+        cp0     w1
+        bra     z, __UnloadEnd
+        com.b   [w2++], [w0++]
+        dec     w1, w1
+        bra     __UnloadLoop
+__UnloadEnd:
+        pop     w0                      ; bytes length return to caller
+        return                          ; it can be zero
+;;-----------------------------------------------------------------------------
+__usbSetAddress:                        ; w0[7-0] =Device Address
+        mov.b   WREG, _addr             ; call it after the STATUS stage
+        return
+;;-----------------------------------------------------------------------------
+__usbSetConfig:                         ; w0[7-0] =Configuration Value
+        mov.b   WREG, _conf             ; NAK, DATA0 first and no HALT on
+        bra     __EPReset               ; EP1..EPn (USB 2.0, 9.4.5)
+;;-----------------------------------------------------------------------------
+__EPReset:                              ; w0-w3 only, the ISR calls it too
+        mov     #__eptab, w1
+        mov     #_datai, w2
+        mov     #_datao, w3
+__EPResetLoop:
+        mov     #0x1002, w0             ; NAK to IN and DATA0 first
+        mov     w0, [w1++]
+        mov     #0x0008, w0             ; NAK to OUT and DATA0 first
+        mov     w0, [w1++]
+        mov     w2, [w1++]              ; the buffers of the endpoint
+        mov     w3, [w1++]
+        add     #12, w2
+        add     #12, w3
+        mov     #__eptab+8*1, w0
+        cp      w1, w0
+        bra     nz, __EPResetLoop
+        clr     _epsent
+        clr     _epout
+        return
+;;-----------------------------------------------------------------------------
+__EPEntry:                              ; w0 =endpoint (1-1), w7 =its entry
+        dec     w0, w7
+        sl      w7, #3, w7
+        mov     #__eptab, w0
+        add     w7, w0, w7
+        return
+;;-----------------------------------------------------------------------------
+__usbArmInEP:                           ; w0 =endpoint, w1 =DATA, w2 =length
+        rcall   __EPEntry               ; call it only if nothing is armed
+        mov     [w7], w3
+        mov     #0x1800, w4             ; keep DATA TOGGLE and HALT FLAG,
+        and     w3, w4, w4              ; clear DATA DONE
+        and     w2, #0xF, w2            ; w2[3-0] =bytes length (0-8)
+        sl      w2, #4, w3
+        ior     w3, w4, w4              ; IN[7-4] =bytes length
+        ior     #0x01, w4               ; ACK to IN request
+        btsc    w4, #11
+        ior     #0x03, w4               ; or STALL if it is halted
+        push    w4
+        push    w7
+        mov     w1, w0
+        mov     w2, w1
+        mov     [w7+4], w3
+        inc2    w3, w3
+        rcall   __CRC16                 ; copy data and CRC into the buffer
+        pop     w7
+        pop     [w7]                    ; the ISR sees it in one write
+        return                          ; don't wait for the ACK of host
+;;-----------------------------------------------------------------------------
+__usbInEPDone:                          ; w0 =1 if the host ACKed the DATA
+        rcall   __EPEntry               ; since the last call
+        mov     #0, w0
+        btst    [w7], #15
+        bra     z, __InEPDoneExit
+        bclr    [w7], #15               ; bclr can't be broken by the IRQ
+        mov     #1, w0
+__InEPDoneExit:
+        return
+;;-----------------------------------------------------------------------------
+__usbHaltInEP:                          ; w1 =1 to halt the endpoint, =0 to
+        rcall   __EPEntry               ; clear it. an armed DATA is dropped
+        cp0.b   w1                      ; either way
+        mov     #0x1002, w0             ; NAK to IN and DATA0 first when the
+        btss    _SR, #Z                 ; halt is cleared (USB 2.0, 9.4.5)
+        mov     #0x0803, w0             ; HALT FLAG and STALL to IN
+        mov     w0, [w7]
+        return
+;;-----------------------------------------------------------------------------
+__usbArmOutEP:                          ; ACK the next OUT of the endpoint
+        rcall   __EPEntry               ; call it only if nothing is armed.
+        mov     [w7+2], w0              ; it's written at once, so the ISR
+        mov     #0x0C00, w1             ; never sees the handshake 00
+        and     w0, w1, w0              ; keep HALT FLAG and DATA TOGGLE
+        bset    w0, #2                  ; OUT[3-2] =01, ACK to OUT
+        btsc    w0, #11
+        bset    w0, #3                  ; or STALL if it is halted
+        mov     w0, [w7+2]
+        return                          ; don't wait for the DATA of host
+;;-----------------------------------------------------------------------------
+__usbOutEPDone:                         ; w0 =endpoint, w1 =input buffer,
+        rcall   __EPEntry               ; w2 =bytes length
+        inc2    w7, w7                  ; w7 points to the OUT word
+        btst    [w7], #9
+        bra     nz, __OutEPDone
+        setm    w0                      ; w0 =0xFFFF, nothing received yet
+        return
+__OutEPDone:
+        mov     [w7], w3                ; the endpoint is NAKed now, the
+        lsr     w3, #4, w3              ; buffer and the length don't change
+        and     #0xF, w3                ; bytes length from host
+        cp      w3, w2
+        bra     GEU, __OutEPUnload
+        mov     w3, w2
+__OutEPUnload:
+        mov     [w7+4], w3              ; the OUT buffer
+        inc2    w3, w3
+        mov     w2, w0                  ; bytes length return to caller
+__OutEPUnloadLoop:
+        cp0     w2
+        bra     z, __OutEPUnloadEnd
+        com.b   [w3++], [w1++]
+        dec     w2, w2
+        bra     __OutEPUnloadLoop
+__OutEPUnloadEnd:
+        bclr    [w7], #9                ; clear PACKET DONE
+        return                          ; it can be zero
+;;-----------------------------------------------------------------------------
+__usbHaltOutEP:                         ; w1 =1 to halt the endpoint, =0 to
+        rcall   __EPEntry               ; clear it. a received packet is
+        cp0.b   w1                      ; dropped either way
+        mov     #0x0008, w0             ; NAK to OUT and DATA0 first when
+        btss    _SR, #Z                 ; the halt is cleared
+        mov     #0x080C, w0             ; HALT FLAG and STALL to OUT
+        mov     w0, [w7+2]
+        return
+;;-----------------------------------------------------------------------------
+__usbSendResume:                        ; w0 =1 drives K-state to wake the
+        cp0.b   w0                      ; host up (REMOTE WAKEUP), =0 ends it
+        mov     #DPDM, w0               ; after the 10ms of usb.c. the CN
+        bra     z, __ResumeEnd          ; interrupt must be masked meanwhile,
+        bset    _LATU, #DP              ; or it would take the K for a SYNC
+        bclr    _LATU, #DM              ; D- =0 and D+ =1, a K-state
+        com     w0, w0                  ; set pins D-/D+ to OUTPUT mode
+        and     _TRISU
+        return
+__ResumeEnd:
+        ior     _TRISU                  ; D-/D+ are on INPUT mode now, the
+        bclr    IFS1, #CNIF             ; host goes on with the K for 20ms
+        return                          ; and ends it by an EOP
+;;-----------------------------------------------------------------------------
+__usbBusReset:                          ; w0 =1 if a BUS RESET has been issued
+        mov     #0, w0                  ; since the last call
+        btst    __uendpt0, #11
+        bra     z, __BusResetExit
+        bclr    __uendpt0, #11          ; bclr can't be broken by the IRQ
+        mov     #1, w0
+__BusResetExit:
+        return
+;;-----------------------------------------------------------------------------
+__usbStallEP0:                          ; STALL the DATA/STATUS stage of EP0
+        bclr    __uendpt0, #10          ; clear REQUEST FLAG
+        mov     #0x080F, w0             ; __ucontr0[11] =1, EP0 STALL FLAG
+        ior     __ucontr0               ; __ucontr0[3-0] =1111, STALL to IN/OUT
+        return                          ; the next SETUP will clear it
+;;-----------------------------------------------------------------------------
+
+        .extern __dbg_init
+        .global __user_init
+
+__user_init:
+        ; initialize PLL, Fpllout = 80MHz, Fcy = 40MHz
+        mov     #38, w0                 ; PLLDIV=40 for 8MHz crystal
+        mov     w0, PLLFBD              ; please refer to DS70186A-page-7-12
+        mov     #0x00, w0               ; PLLPRE=2, PLLPOST=2
+        mov     w0, CLKDIV              ; please refer to DS70186A-page-7-11
+
+        ; initialize OSCCON for clock switching. please refer to
+        ; DS70186A-page-7-27 and DS70186A-page-7-9.
+        mov     #3, w2                  ; set OSCCON<NOSC> to 011
+        mov     #120, w1                ; unlock sequence. DS70186A-page-7-29
+        mov     #154, w0                ; we don't use __builtin_write_OSCCONH
+        mov     #OSCCONH, w3
+        mov.b   w1, [w3]
+        mov.b   w0, [w3]
+        mov.b   w2, [w3]
+
+        mov     #1, w2                  ; set OSCCON<OSWEN>, start switching
+        mov     #70, w1                 ; unlock sequence
+        mov     #87, w0
+        mov     #OSCCONL, w3
+        mov.b   w1, [w3]
+        mov.b   w0, [w3]
+        mov.b   w2, [w3]
+
+wait_lock:                              ; waiting for the PLL locked
+        btst    OSCCON, #LOCK
+        bra     z, wait_lock
+
+wait_switching:                         ; waiting for clock switching done
+        btst    OSCCON, #OSWEN
+        bra     nz, wait_switching
+
+        ; disable all analog input and OD output
+        ; please refer to DS70265E-page-120
+        mov     #0x000f, w0
+        mov     w0, AD1PCFGL
+        mov     #0, w0
+        mov     w0, ODCB
+
+wait_attached:
+        mov.b   _PORTU, WREG
+        and     #DPDM, w0               ; usb host D+/D- was pulled down by
+        bra     nz, wait_attached       ; two 15k resistors
+
+        ; enable 1.5k pullup resistor on D-.
+        ; if you connect 1.5k pullup resistor to 3.3V directly, please
+        ; omit next 2 instructions (bclr/bset).
+        bclr    TRISB, #4
+        bset    PORTB, #4
+
+        mov     #(1<<DM), w1
+waitJ:  ; waiting until D-(RA1)=1 & D+(RA0)=0
+        mov     _PORTU, w0
+        and     #DPDM, w0
+        cp      w0, w1
+        bra     nz, waitJ
+
+        ; initialize some global varibles
+        mov     #_token, w0
+        mov     w0, _packet             ; prepare to receive first token
+        mov     #0, w0
+        mov.b   WREG, _addr             ; usb device address is zero
+        mov     WREG, __uendpt0
+        mov     #0x000A, w0             ; __ucontr0[1-0] =10, NAK to IN token
+        mov     WREG, __ucontr0         ; __ucontr0[3-2] =10, NAK to OUT token
+        rcall   __EPReset               ; NAK and DATA0 on EP1..EP1
+
+        ; enable interrupt of CN3 (D-/RA1)
+        bclr    IFS1, #CNIF
+        bset    CNEN1, #CN3IE
+        bset    IEC1, #CNIE
+
+        ; initialize DEBUG func
+        rcall   __dbg_init
+        rcall   __dbg_led_on
+
+        return
+
+;;-----------------------------------------------------------------------------
+; main task
+
+        .extern _setup
+        .extern _loop
+        .global _main
+
+_main:
+        rcall   _setup
+
+_taskloop:
+        rcall   _loop
+        bra     _taskloop
+
+        .end
@@ -0,0 +1,5 @@
+set SRC=..\15MIPS
+xc16-gcc -mcpu=33FJ12MC201 -O1 -DFCY=40000000UL %SRC%\main.c %SRC%\hid.c %SRC%\stream.c %SRC%\cipher.c %SRC%\lz.c %SRC%\dsp.c %SRC%\usb.c %SRC%\desc.c sie.s dbg.s %SRC%\cph.s %SRC%\dsp.s -DCPH_KEY=%CPH_KEY% -o main.elf -T p33FJ12MC201.gld -Wl,--stack=128,--defsym,__has_user_init=1,-Map=main.map
+xc16-bin2hex main.elf
+xc16-objdump -D main.elf >main.txt
+pause
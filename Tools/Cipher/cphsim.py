@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright (C) 2019-2020 Zach Lee.
+#
+# Licensed under the MIT License, you may not use this file except in
+# compliance with the License.
+#
+# MIT License:
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# ----------------------------------------------------------------------------
+#
+# Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+# Title:        cphsim.py Runs cph.s on a model of the PIC24 core.
+#
+# cph.s encrypts one block of Speck64/128 for the CTR mode of cipher.c. This
+# script runs its instructions on a model of the W registers, the stack and
+# the C/Z flags, checks the result against the test vector of the Speck
+# paper and against speck() below for random blocks, and counts the cycles
+# from the call to the return. cipher.c needs one block for each 8 bytes of
+# a Feature report, so the cycles per byte follow from it.
+#
+# usage: cphsim.py [--asm ../../Firmware/dsPIC33/15MIPS/cph.s]
+#
+# ----------------------------------------------------------------------------
+import argparse
+import os
+import random
+import re
+import sys
+
+ROUNDS = 27
+M32 = 0xFFFFFFFF
+
+# Speck64/128, 'Simon and Speck Families of Lightweight Block Ciphers', C.2
+VECTOR_KEY = (0x03020100, 0x0b0a0908, 0x13121110, 0x1b1a1918)
+VECTOR_PT = (0x3b726574, 0x7475432d)
+VECTOR_CT = (0x8c6fa548, 0x454e028b)
+
+
+def ror(x, n):
+    return ((x >> n) | (x << (32 - n))) & M32
+
+
+def rol(x, n):
+    return ((x << n) | (x >> (32 - n))) & M32
+
+
+def schedule(key):
+    """the round keys of CPH_vInit(), key is (k0, l0, l1, l2)."""
+    k, l = key[0], list(key[1:])
+    rk = []
+    for i in range(ROUNDS):
+        rk.append(k)
+        l[i % 3] = ((ror(l[i % 3], 8) + k) & M32) ^ i
+        k = rol(k, 3) ^ l[i % 3]
+    return rk
+
+
+def speck(rk, x, y):
+    for k in rk:
+        x = ((ror(x, 8) + y) & M32) ^ k
+        y = rol(y, 3) ^ x
+    return x, y
+
+
+class Core(object):
+    """the W registers, the data memory and the flags of the instructions
+    cph.s uses, with their cycles on PIC24F and dsPIC33F."""
+    def __init__(self, lines):
+        self.code, self.labels = [], {}
+        for line in lines:
+            line = line.split(';')[0].strip()
+            if not line or line.startswith('.'):
+                continue
+            m = re.match(r'(\w+):$', line)
+            if m:
+                self.labels[m.group(1)] = len(self.code)
+                continue
+            op, _, args = line.partition(' ')
+            self.code.append((op, [a.strip() for a in args.split(',')]
+                              if args.strip() else []))
+        self.w = [0] * 16
+        self.mem = {}
+        self.c = self.z = 0
+        self.cycles = 0
+
+    def rd(self, a):
+        return self.mem.get(a, 0) | (self.mem.get(a + 1, 0) << 8)
+
+    def wr(self, a, v):
+        self.mem[a], self.mem[a + 1] = v & 0xFF, (v >> 8) & 0xFF
+
+    def ea(self, s):
+        """the address of an indirect operand, with its side effect."""
+        m = re.match(r'\[(--)?w(\d+)(\+\+)?(?:\+(\d+))?\]$', s)
+        pre, n, post, off = m.groups()
+        if pre:
+            self.w[int(n)] -= 2
+        a = self.w[int(n)] + int(off or 0)
+        if post:
+            self.w[int(n)] += 2
+        return a
+
+    def get(self, s):
+        if s.startswith('#'):
+            return int(s[1:], 0)
+        if s.startswith('['):
+            return self.rd(self.ea(s))
+        return self.w[int(s[1:])]
+
+    def put(self, s, v, byte=False):
+        v &= 0xFFFF
+        if s.startswith('['):
+            self.wr(self.ea(s), v)
+        elif byte:
+            n = int(s[1:])
+            self.w[n] = (self.w[n] & 0xFF00) | (v & 0xFF)
+        else:
+            self.w[int(s[1:])] = v
+
+    def flags(self, v):
+        self.z = int(v & 0xFFFF == 0)
+
+    def call(self, label, args, sp=0x800):
+        for i, a in enumerate(args):
+            self.w[i] = a
+        self.w[15] = sp + 4             # the return address of CALL
+        self.cycles = 2
+        pc = self.labels[label]
+        while True:
+            op, a = self.code[pc]
+            pc += 1
+            self.cycles += 1
+            if op == 'mov':
+                self.put(a[1], self.get(a[0]))
+            elif op == 'mov.b':
+                v = self.get(a[0]) & 0xFF
+                self.put(a[1], v, byte=True)
+                self.flags(v)
+            elif op in ('add', 'addc'):
+                v = self.get(a[0]) + self.get(a[1])
+                v += self.c if op == 'addc' else 0
+                self.c = v >> 16
+                self.put(a[2], v)
+                self.flags(v)
+            elif op in ('xor', 'ior'):
+                b = self.get(a[0])
+                v = b ^ self.get(a[1]) if op == 'xor' else b | self.get(a[1])
+                self.put(a[2], v)
+                self.flags(v)
+            elif op == 'sl':
+                v = (self.get(a[0]) << self.get(a[1])) & 0xFFFF
+                self.put(a[2], v)
+                self.flags(v)
+            elif op == 'lsr':
+                v = self.get(a[0]) >> self.get(a[1])
+                self.put(a[2], v)
+                self.flags(v)
+            elif op == 'swap':
+                v = self.get(a[0])
+                self.put(a[0], (v >> 8) | (v << 8))
+            elif op == 'dec':
+                v = (self.get(a[0]) - 1) & 0xFFFF
+                self.put(a[1], v)
+                self.flags(v)
+            elif op == 'bra':
+                if a[0] == 'nz' and not self.z:
+                    pc = self.labels[a[1]]
+                    self.cycles += 1
+            elif op == 'return':
+                self.cycles += 2
+                return self.cycles
+            else:
+                raise ValueError('cph.s: %s is not modelled' % op)
+
+
+def run(core, rk, x, y):
+    blk, base = 0x900, 0xA00
+    for i, v in enumerate((x & 0xFFFF, x >> 16, y & 0xFFFF, y >> 16)):
+        core.wr(blk + 2 * i, v)
+    for i, k in enumerate(rk):
+        core.wr(base + 4 * i, k & 0xFFFF)
+        core.wr(base + 4 * i + 2, k >> 16)
+    cycles = core.call('__cphEncrypt', [blk, base])
+    w = [core.rd(blk + 2 * i) for i in range(4)]
+    return w[0] | (w[1] << 16), w[2] | (w[3] << 16), cycles
+
+
+def main(argv=None):
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description='run cph.s on a model')
+    ap.add_argument('--asm', default=os.path.join(
+        here, '..', '..', 'Firmware', 'dsPIC33', '15MIPS', 'cph.s'))
+    ap.add_argument('--blocks', type=int, default=1000)
+    args = ap.parse_args(argv)
+    with open(args.asm) as f:
+        core = Core(f.readlines())
+
+    rk = schedule(VECTOR_KEY)
+    if speck(rk, *VECTOR_PT) != VECTOR_CT:
+        print('speck() fails the test vector')
+        return 1
+    x, y, cycles = run(core, rk, *VECTOR_PT)
+    if (x, y) != VECTOR_CT:
+        print('cph.s: %08x %08x, the test vector is %08x %08x' %
+              (x, y, VECTOR_CT[0], VECTOR_CT[1]))
+        return 1
+    rnd = random.Random(1)
+    for _ in range(args.blocks):
+        key = [rnd.getrandbits(32) for _ in range(4)]
+        pt = rnd.getrandbits(32), rnd.getrandbits(32)
+        rk = schedule(key)
+        if run(core, rk, *pt)[:2] != speck(rk, *pt):
+            print('cph.s fails key %s block %08x %08x' % (key, pt[0], pt[1]))
+            return 1
+
+    print('cph.s: the test vector and %d random blocks pass' % args.blocks)
+    print('  %d cycles a block of 8 bytes, %.1f cycles a byte' %
+          (cycles, cycles / 8.0))
+    for mips in (15, 40):
+        print('  64-byte report, 8 blocks: %d cycles, %.0f us at %d MIPS' %
+              (8 * cycles, 8 * cycles / float(mips), mips))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
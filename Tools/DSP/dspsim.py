@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright (C) 2019-2020 Zach Lee.
+#
+# Licensed under the MIT License, you may not use this file except in
+# compliance with the License.
+#
+# MIT License:
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# ----------------------------------------------------------------------------
+#
+# Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+# Title:        dspsim.py Runs dsp.s on a model of the dsPIC33 DSP engine.
+#
+# dsp.s has the FIR, dot product and FFT kernels of the DSP commands of
+# dsp.c. This script runs them on a model of the W registers, the
+# accumulators A and B, CORCON, REPEAT and DO, checks every result against
+# the same Q15 arithmetic written in Python, the FFT also against a DFT in
+# floating point, and counts the cycles from the call to the return. The
+# reads of the twiddles of the FFT come through PSV from the flash and take
+# a cycle more. Each run goes once more with the CN interrupt of sie.s
+# breaking in after a random instruction, which runs REPEATs of its own and
+# gives RCOUNT back, and must give the same result.
+#
+# usage: dspsim.py [--asm ../../Firmware/dsPIC33/15MIPS/dsp.s]
+#
+# ----------------------------------------------------------------------------
+import argparse
+import cmath
+import math
+import os
+import random
+import re
+import sys
+
+# as dsp.h
+MAX_TAPS = 16
+MAX_BLOCK = 30
+MAX_DOT = 15
+MAX_FFT = 16
+
+PSV = 0x8000
+Q31 = (-1 << 31, (1 << 31) - 1)
+
+
+def sext(v, bits=16):
+    v &= (1 << bits) - 1
+    return v - (1 << bits) if v >> (bits - 1) else v
+
+
+def shift(v, n):
+    """the shifter of the DSP engine, n > 0 is to the right."""
+    return v >> n if n >= 0 else v << -n
+
+
+def sat31(v):
+    return min(max(v, Q31[0]), Q31[1])
+
+
+def round16(acc, n=0):
+    """SAC.R with conventional rounding and SATDW."""
+    v = (shift(acc, n) + 0x8000) >> 16
+    return min(max(v, -0x8000), 0x7FFF)
+
+
+class Core(object):
+    """the instructions of dsp.s, with their cycles on dsPIC33F."""
+    def __init__(self, lines):
+        self.code, self.labels, self.equ = [], {}, {}
+        for line in lines:
+            line = line.split(';')[0].strip()
+            if not line or line.startswith('.'):
+                m = re.match(r'\.equ\s+(\w+),\s*(\w+)', line)
+                if m:
+                    self.equ[m.group(1)] = int(m.group(2), 0)
+                continue
+            m = re.match(r'(\w+):$', line)
+            if m:
+                self.labels[m.group(1)] = len(self.code)
+                continue
+            op, _, args = line.partition(' ')
+            self.code.append((op, [a.strip() for a in args.split(',')]
+                              if args.strip() else []))
+        self.w = [0] * 16
+        self.mem = {}
+        self.acc = {'A': 0, 'B': 0}
+        self.corcon = 0x0004            # PSV on, as the C start-up leaves it
+        self.z = self.n = 0
+        self.cycles = 0
+
+    def rd(self, a):
+        if a >= PSV:
+            self.cycles += 1
+        return self.mem.get(a, 0) | (self.mem.get(a + 1, 0) << 8)
+
+    def wr(self, a, v):
+        self.mem[a], self.mem[a + 1] = v & 0xFF, (v >> 8) & 0xFF
+
+    def ea(self, s):
+        """the address of an indirect operand, with its side effect."""
+        m = re.match(r'\[(--)?w(\d+)(\+\+|--)?(?:\+(\d+))?\]$', s)
+        pre, n, post, off = m.groups()
+        if pre:
+            self.w[int(n)] -= 2
+        a = self.w[int(n)] + int(off or 0)
+        if post:
+            self.w[int(n)] += 2 if post == '++' else -2
+        return a
+
+    def get(self, s):
+        if s.startswith('#'):
+            v = s[1:]
+            return self.equ[v] if v in self.equ else int(v, 0) & 0xFFFF
+        if s.startswith('['):
+            return self.rd(self.ea(s))
+        if s == 'CORCON':
+            return self.corcon
+        if s == 'ACCAL':
+            return self.acc['A'] & 0xFFFF
+        if s == 'ACCAH':
+            return (self.acc['A'] >> 16) & 0xFFFF
+        return self.w[int(s[1:])]
+
+    def put(self, s, v):
+        v &= 0xFFFF
+        if s.startswith('['):
+            self.wr(self.ea(s), v)
+        elif s == 'CORCON':
+            self.corcon = v
+        else:
+            self.w[int(s[1:])] = v
+
+    def flags(self, v):
+        self.z = int(v & 0xFFFF == 0)
+        self.n = (v >> 15) & 1
+
+    def setacc(self, a, v):
+        # SATA and SATB at 1.31, the only mode dsp.s uses
+        assert self.corcon & 0x00F0 == 0x00E0
+        self.acc[a] = sat31(v)
+
+    def mul(self, s):
+        x, y = s.split('*')
+        assert self.corcon & 1 == 0     # fractional
+        return sext(self.get(x)) * sext(self.get(y)) * 2
+
+    def fetch(self, a):
+        """the operand fetches of CLR/MAC: [wN]+=2, wM."""
+        for i in range(0, len(a), 2):
+            m = re.match(r'\[w(\d+)\]\+=(\d)$', a[i])
+            n = int(m.group(1))
+            v = self.rd(self.w[n])
+            self.w[n] += int(m.group(2))
+            self.put(a[i + 1], v)
+
+    def step(self, op, a):
+        if op == 'mov':
+            self.put(a[1], self.get(a[0]))
+        elif op in ('add', 'sub', 'and', 'ior') and a[-1] in ('A', 'B'):
+            # ADD Wso,#Slit4,Acc
+            v = sext(self.get(a[0])) << 16
+            v = shift(v, sext(self.get(a[1]), 4))
+            self.setacc(a[2], self.acc[a[2]] + v)
+        elif op in ('add', 'sub', 'and', 'ior'):
+            b, c = self.get(a[0]), self.get(a[1])
+            v = {'add': b + c, 'sub': b - c, 'and': b & c, 'ior': b | c}[op]
+            self.put(a[2], v)
+            self.flags(v)
+        elif op in ('dec', 'inc2', 'neg'):
+            b = self.get(a[0])
+            v = {'dec': b - 1, 'inc2': b + 2, 'neg': -b}[op]
+            self.put(a[1], v)
+            self.flags(v)
+        elif op in ('sl', 'lsr'):
+            b, c = self.get(a[0]), self.get(a[1]) & 0xF
+            v = (b << c) if op == 'sl' else b >> c
+            self.put(a[2], v)
+            self.flags(v)
+        elif op == 'clr':
+            self.setacc(a[0], 0)
+            self.fetch(a[1:])
+        elif op in ('mpy', 'mac', 'msc'):
+            p = self.mul(a[0])
+            v = {'mpy': p, 'mac': self.acc[a[1]] + p,
+                 'msc': self.acc[a[1]] - p}[op]
+            self.setacc(a[1], v)
+            self.fetch(a[2:])
+        elif op == 'lac':
+            v = sext(self.get(a[0])) << 16
+            self.setacc(a[2], shift(v, sext(self.get(a[1]), 4)))
+        elif op == 'sac.r':
+            n = sext(self.get(a[1]), 4) if len(a) == 3 else 0
+            assert self.corcon & 0x0022 == 0x0022     # SATDW, RND
+            self.put(a[-1], round16(self.acc[a[0]], n))
+        else:
+            raise ValueError('dsp.s: %s is not modelled' % op)
+
+    def isr(self):
+        """the CN interrupt of sie.s saves what it uses, RCOUNT too, around
+        its own REPEATs. DCOUNT it never touches, so the kernel sees no
+        change."""
+        pass
+
+    def call(self, label, args, irq=None, sp=0x800):
+        """runs label and returns its cycles. the interrupt comes in after
+        the irq-th instruction or repeated instruction, if it's given."""
+        for i, a in enumerate(args):
+            self.w[i] = a & 0xFFFF
+        self.w[15] = sp + 4             # the return address of CALL
+        self.cycles = 2
+        self.steps = 0
+        self.rcount = 0
+
+        def tick():
+            self.steps += 1
+            if self.steps == irq:
+                self.isr()
+
+        pc = self.labels[label]
+        loop = None                     # the DO: its start, its end, count
+        while True:
+            op, a = self.code[pc]
+            pc += 1
+            self.cycles += 1
+            if op == 'repeat':
+                self.rcount = self.get(a[0])
+                tick()
+                op, a = self.code[pc]
+                pc += 1
+                while True:
+                    self.step(op, a)
+                    self.cycles += 1
+                    tick()
+                    if self.rcount == 0:
+                        break
+                    self.rcount -= 1
+                continue
+            elif op == 'do':
+                assert loop is None
+                loop = [pc, self.labels[a[1]], self.get(a[0])]
+                self.cycles += 1
+                tick()
+                continue
+            elif op == 'bra':
+                if len(a) == 1 or (a[0] == 'nz' and not self.z) or \
+                        (a[0] == 'n' and self.n):
+                    pc = self.labels[a[-1]]
+                    self.cycles += 1
+            elif op == 'return':
+                assert self.w[15] == sp + 4, 'the stack is off'
+                self.cycles += 2
+                return self.cycles
+            else:
+                self.step(op, a)
+            tick()
+            if loop is not None and pc == loop[1] + 1:
+                if loop[2]:
+                    loop[2] -= 1
+                    pc = loop[0]
+                else:
+                    loop = None
+
+
+# the RAM of the arrays, and the flash of the twiddles seen through PSV
+X, Y, OUT, TW = 0x0900, 0x0A00, 0x0B00, PSV + 0x100
+
+
+def load(core, base, vals):
+    for i, v in enumerate(vals):
+        core.wr(base + 2 * i, v)
+
+
+def fetch(core, base, n):
+    return [sext(core.rd(base + 2 * i)) for i in range(n)]
+
+
+def dot(x, y):
+    acc = 0
+    for a, b in zip(x, y):
+        acc = sat31(acc + a * b * 2)
+    return acc
+
+
+def fir(x, h):
+    """the outputs of _dspFir() of the samples x and the taps h[0..]."""
+    t = len(h)
+    y = []
+    for i in range(len(x) - t + 1):
+        acc = 0
+        for j in range(t):
+            acc = sat31(acc + x[i + j] * h[t - 1 - j] * 2)
+        y.append(round16(acc))
+    return y
+
+
+def twiddles():
+    tw = []
+    for k in range(MAX_FFT // 2):
+        for v in (math.cos(2 * math.pi * k / MAX_FFT),
+                  math.sin(2 * math.pi * k / MAX_FFT)):
+            tw.append(min(int(round(v * 32768)), 0x7FFF))
+    return tw
+
+
+def bitrev(i, bits):
+    return int(format(i, '0%db' % bits)[::-1], 2) if bits else 0
+
+
+def fft(x, tw):
+    """_dspFft() in Python, x is [(re, im)] in order."""
+    n = len(x)
+    bits = n.bit_length() - 1
+    p = [list(x[bitrev(i, bits)]) for i in range(n)]
+    half = 1
+    while half < n:
+        step = MAX_FFT // (2 * half)
+        for j in range(half):
+            c, s = tw[2 * j * step], tw[2 * j * step + 1]
+            for g in range(0, n, 2 * half):
+                a, b = p[g + j], p[g + j + half]
+                tr = round16(sat31(b[0] * c * 2 + b[1] * s * 2), 1)
+                ti = round16(sat31(b[1] * c * 2 - b[0] * s * 2), 1)
+                ar, ai = sat31(shift(a[0] << 16, 1) + (tr << 16)), \
+                    sat31(shift(a[1] << 16, 1) + (ti << 16))
+                p[g + j] = [round16(ar), round16(ai)]
+                ar, ai = sat31(ar - (tr << 17)), sat31(ai - (ti << 17))
+                p[g + j + half] = [round16(ar), round16(ai)]
+        half *= 2
+    return p
+
+
+def main(argv=None):
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description='run dsp.s on a model')
+    ap.add_argument('--asm', default=os.path.join(
+        here, '..', '..', 'Firmware', 'dsPIC33', '15MIPS', 'dsp.s'))
+    ap.add_argument('--runs', type=int, default=300)
+    args = ap.parse_args(argv)
+    with open(args.asm) as f:
+        core = Core(f.readlines())
+    rnd = random.Random(1)
+
+    def q15(full=False):
+        if full or rnd.random() < 0.1:
+            return rnd.choice((-0x8000, 0x7FFF, rnd.randint(-0x8000, 0x7FFF)))
+        return rnd.randint(-0x8000, 0x7FFF)
+
+    def run(label, args, setup, result):
+        """the kernel as it is, then with the interrupt in the middle."""
+        setup()
+        c = core.call(label, args)
+        got = result()
+        setup()
+        core.call(label, args, irq=rnd.randint(1, core.steps))
+        return c, got, result()
+
+    cycles = {}
+    for r in range(args.runs):
+        n = rnd.randint(1, MAX_DOT) if r else MAX_DOT
+        x, y = [q15() for _ in range(n)], [q15() for _ in range(n)]
+        if r == 1:
+            x = y = [-0x8000] * MAX_DOT         # saturates at 1.31
+        c, got, irq = run('__dspDot', [X, Y, len(x)],
+                          lambda: (load(core, X, x), load(core, Y, y)),
+                          lambda: sext(core.w[0] | core.w[1] << 16, 32))
+        if got != dot(x, y) or irq != got:
+            print('_dspDot fails %s . %s: %08x, %08x with the interrupt' %
+                  (x, y, got & 0xFFFFFFFF, irq & 0xFFFFFFFF))
+            return 1
+        cycles.setdefault(('dot', len(x)), c)
+
+        t = rnd.randint(2, MAX_TAPS) if r else MAX_TAPS
+        n = rnd.randint(1, MAX_BLOCK) if r else MAX_BLOCK
+        h, x = [q15() for _ in range(t)], [q15() for _ in range(t - 1 + n)]
+        c, got, irq = run('__dspFir', [OUT, X, Y, t, n],
+                          lambda: (load(core, X, x), load(core, Y, h[::-1])),
+                          lambda: fetch(core, OUT, n))
+        if got != fir(x, h) or irq != got:
+            print('_dspFir fails taps %s samples %s%s' %
+                  (h, x, ' with the interrupt' if irq != got else ''))
+            return 1
+        cycles.setdefault(('fir', t, n), c)
+
+        tw = twiddles()
+        load(core, TW, tw)
+        bits = rnd.randint(1, 4) if r > 3 else 4 - r
+        n = 1 << bits
+        x = [(q15(), 0) for _ in range(n)]
+        p = [x[bitrev(i, bits)] for i in range(n)]
+        c, got, irq = run('__dspFft', [X, bits, TW],
+                          lambda: load(core, X, [v for pt in p for v in pt]),
+                          lambda: fetch(core, X, 2 * n))
+        if irq != got:
+            print('_dspFft fails %s with the interrupt' % x)
+            return 1
+        got = [(got[2 * i], got[2 * i + 1]) for i in range(n)]
+        if got != [tuple(v) for v in fft(x, tw)]:
+            print('_dspFft fails %s: %s' % (x, got))
+            return 1
+        # the DFT / n, within an LSB of rounding a stage
+        for k in range(n):
+            f = sum(complex(*x[i]) * cmath.exp(-2j * math.pi * i * k / n)
+                    for i in range(n)) / n
+            if abs(complex(*got[k]) - f) > bits + 1:
+                print('_dspFft is %s at %d, the DFT is %s' % (got[k], k, f))
+                return 1
+        cycles.setdefault(('fft', n), c)
+
+    print('dsp.s: %d runs of each kernel pass, with an interrupt too' %
+          args.runs)
+    rows = [('dot product of %d pairs' % MAX_DOT, cycles[('dot', MAX_DOT)])]
+    rows.append(('dot product of 1 pair', cycles[('dot', 1)]))
+    t, n = MAX_TAPS, MAX_BLOCK
+    rows.append(('FIR, %d taps, %d samples' % (t, n), cycles[('fir', t, n)]))
+    for n in (16, 8, 4, 2):
+        rows.append(('FFT of %d points' % n, cycles[('fft', n)]))
+    for name, c in rows:
+        print('  %-28s %5d cycles, %4.0f us at 15 MIPS, %4.0f us at 40 MIPS'
+              % (name, c, c / 15.0, c / 40.0))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,595 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright (C) 2019-2020 Zach Lee.
+#
+# Licensed under the MIT License, you may not use this file except in
+# compliance with the License.
+#
+# MIT License:
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# ----------------------------------------------------------------------------
+#
+# Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+# Title:        descgen.py Generates desc.c/desc.h from a descriptor spec.
+#
+# All descriptors are packed into one const blob. Every descriptor which can
+# be asked for by GET_DESCRIPTOR gets a row (offset, length) in a table, the
+# rows of a type are consecutive and ordered by index, strings of the 2nd
+# language follow the ones of the 1st language. A small table indexed by a
+# hash of the type gives the first row and the count of each type, so that
+# USB_bFindDesc() of usb.c needs no search at all. Every length, count and
+# string index is computed here.
+#
+# usage: descgen.py vusb.desc -o desc
+#
+# ----------------------------------------------------------------------------
+import argparse
+import ast
+import os
+import sys
+
+DEVICE = 0x01
+CONFIGURATION = 0x02
+STRING = 0x03
+INTERFACE = 0x04
+ENDPOINT = 0x05
+HID = 0x21
+REPORT = 0x22
+
+TYPE_NAMES = {
+    DEVICE: 'DEVICE', CONFIGURATION: 'CONFIGURATION', STRING: 'STRING',
+    HID: 'HID', REPORT: 'HID REPORT',
+}
+
+# HID short items: prefix without the size bits, signed value or not
+ITEMS = {
+    'Input':            (0x80, False),
+    'Output':           (0x90, False),
+    'Feature':          (0xB0, False),
+    'Collection':       (0xA0, False),
+    'End Collection':   (0xC0, False),
+    'Usage Page':       (0x04, False),
+    'Logical Minimum':  (0x14, True),
+    'Logical Maximum':  (0x24, True),
+    'Physical Minimum': (0x34, True),
+    'Physical Maximum': (0x44, True),
+    'Unit Exponent':    (0x54, True),
+    'Unit':             (0x64, False),
+    'Report Size':      (0x74, False),
+    'Report ID':        (0x84, False),
+    'Report Count':     (0x94, False),
+    'Push':             (0xA4, False),
+    'Pop':              (0xB4, False),
+    'Usage':            (0x08, False),
+    'Usage Minimum':    (0x18, False),
+    'Usage Maximum':    (0x28, False),
+}
+
+SLOTS = 8                           # rows of USB_DescType[]
+
+
+class DescError(Exception):
+    pass
+
+
+class Blob:
+    """The packed bytes with a comment for each line of desc.c."""
+
+    def __init__(self):
+        self.data = []
+        self.lines = []             # (offset, count, comment) or header str
+
+    def header(self, text):
+        self.lines.append(text)
+
+    def put(self, values, comment=''):
+        self.lines.append((len(self.data), len(values), comment))
+        self.data.extend(values)
+
+    def field(self, name, size, value):
+        if value < 0 or value >= 1 << (8 * size):
+            raise DescError('%s =%d doesn\'t fit into %d byte(s)'
+                            % (name, value, size))
+        self.put([(value >> (8 * i)) & 0xFF for i in range(size)], name)
+
+    def patch(self, offset, size, value):
+        for i in range(size):
+            self.data[offset + i] = (value >> (8 * i)) & 0xFF
+
+
+def item_bytes(name, value):
+    if name not in ITEMS:
+        raise DescError('unknown HID item \'%s\'' % name)
+    prefix, signed = ITEMS[name]
+    if value is None:
+        return [prefix]
+    for size, code in ((1, 1), (2, 2), (4, 3)):
+        lo, hi = (-(1 << (8 * size - 1)), (1 << (8 * size - 1)) - 1) \
+            if signed else (0, (1 << (8 * size)) - 1)
+        if lo <= value <= hi:
+            v = value & ((1 << (8 * size)) - 1)
+            return [prefix | code] + [(v >> (8 * i)) & 0xFF
+                                      for i in range(size)]
+    raise DescError('HID item \'%s\' =%d is out of range' % (name, value))
+
+
+REPORT_TYPES = ('Input', 'Output', 'Feature')     # wValue 1, 2 and 3
+
+
+def report_sizes(items):
+    """Bytes of the Input, Output and Feature reports of a report desc, as
+    {type: {report ID: bytes}}. The bytes of a report with an ID take the ID
+    byte in front of it, as it goes over the bus."""
+    state = {'Report Size': 0, 'Report Count': 0, 'Report ID': 0}
+    stack = []
+    bits = dict((t, {}) for t in REPORT_TYPES)
+    for name, value in items:
+        if name == 'Report ID' and not 0 < value < 256:
+            raise DescError('Report ID %d is out of 1..255' % value)
+        if name in state:
+            state[name] = value
+        elif name == 'Push':
+            stack.append(dict(state))
+        elif name == 'Pop':
+            state = stack.pop()
+        elif name in bits:
+            rid = state['Report ID']
+            bits[name][rid] = bits[name].get(rid, 0) + \
+                state['Report Size'] * state['Report Count']
+    ids = set(i for b in bits.values() for i in b)
+    if 0 in ids and len(ids) > 1:
+        raise DescError('a report without Report ID among reports with one')
+    return dict((t, dict((i, (v + 7) // 8 + (i != 0))
+                         for i, v in b.items())) for t, b in bits.items())
+
+
+class Strings:
+    """Numbers the strings in the order they appear, index 0 is LANGID."""
+
+    def __init__(self, languages):
+        self.languages = languages
+        self.texts = []
+
+    def index(self, s):
+        if s is None:
+            return 0
+        if isinstance(s, str):
+            s = dict((l, s) for l in self.languages)
+        if sorted(s) != sorted(self.languages):
+            raise DescError('string %r must have a text for each language'
+                            % (s,))
+        if s not in self.texts:
+            self.texts.append(s)
+        return self.texts.index(s) + 1
+
+
+def build(spec):
+    languages = spec.get('languages', [0x0409])
+    strings = Strings(languages)
+    blob = Blob()
+    rows = {}                       # type -> list of (index, langid, off, len)
+
+    def row(t, index, langid, offset, length):
+        rows.setdefault(t, []).append((index, langid, offset, length))
+
+    # DEVICE descriptor
+    d = spec['device']
+    confs = spec['configurations']
+    start = len(blob.data)
+    blob.header('DEVICE descriptor')
+    blob.field('bLength', 1, 18)
+    blob.field('bDescriptorType', 1, DEVICE)
+    blob.field('bcdUSB', 2, d['bcdUSB'])
+    blob.field('bDeviceClass', 1, d['bDeviceClass'])
+    blob.field('bDeviceSubClass', 1, d['bDeviceSubClass'])
+    blob.field('bDeviceProtocol', 1, d['bDeviceProtocol'])
+    blob.field('bMaxPacketSize0', 1, d['bMaxPacketSize0'])
+    blob.field('idVendor', 2, d['idVendor'])
+    blob.field('idProduct', 2, d['idProduct'])
+    blob.field('bcdDevice', 2, d['bcdDevice'])
+    for name in ('iManufacturer', 'iProduct', 'iSerialNumber'):
+        i = strings.index(d.get(name))
+        blob.field('%s (%s)' % (name, 'string %d' % i if i else 'no string'),
+                   1, i)
+    blob.field('bNumConfigurations', 1, len(confs))
+    row(DEVICE, 0, 0, start, 18)
+
+    # CONFIGURATION descriptors with their INTERFACE/HID/ENDPOINT ones
+    reports = []                    # (interface number, report items)
+    hids = {}                       # interface number -> offset
+    for ci, c in enumerate(confs):
+        start = len(blob.data)
+        numbers = sorted(set(i['bInterfaceNumber'] for i in c['interfaces']))
+        if numbers != list(range(len(numbers))):
+            raise DescError('interfaces must be numbered from 0')
+        blob.header('CONFIGURATION descriptor %d' % ci)
+        blob.field('bLength', 1, 9)
+        blob.field('bDescriptorType', 1, CONFIGURATION)
+        total = len(blob.data)
+        blob.field('wTotalLength', 2, 0)
+        blob.field('bNumInterfaces', 1, len(numbers))
+        blob.field('bConfigurationValue', 1, c['bConfigurationValue'])
+        i = strings.index(c.get('iConfiguration'))
+        blob.field('iConfiguration (%s)' % ('string %d' % i if i else
+                                             'no string'), 1, i)
+        blob.field('bmAttributes', 1, c['bmAttributes'])
+        blob.field('bMaxPower', 1, c['bMaxPower'])
+        for f in c['interfaces']:
+            eps = f.get('endpoints', [])
+            blob.header('INTERFACE descriptor %d.%d'
+                        % (f['bInterfaceNumber'], f['bAlternateSetting']))
+            blob.field('bLength', 1, 9)
+            blob.field('bDescriptorType', 1, INTERFACE)
+            blob.field('bInterfaceNumber', 1, f['bInterfaceNumber'])
+            blob.field('bAlternateSetting', 1, f['bAlternateSetting'])
+            blob.field('bNumEndpoints', 1, len(eps))
+            blob.field('bInterfaceClass', 1, f['bInterfaceClass'])
+            blob.field('bInterfaceSubClass', 1, f['bInterfaceSubClass'])
+            blob.field('bInterfaceProtocol', 1, f['bInterfaceProtocol'])
+            i = strings.index(f.get('iInterface'))
+            blob.field('iInterface (%s)' % ('string %d' % i if i else
+                                             'no string'), 1, i)
+            h = f.get('hid')
+            if h is not None:
+                report = []
+                for name, value in h['report']:
+                    report += item_bytes(name, value)
+                blob.header('HID CLASS descriptor')
+                if ci == 0 and f['bAlternateSetting'] == 0:
+                    hids[f['bInterfaceNumber']] = len(blob.data)
+                    reports.append((f['bInterfaceNumber'], h['report']))
+                blob.field('bLength', 1, 9)
+                blob.field('bDescriptorType', 1, HID)
+                blob.field('bcdHID', 2, h['bcdHID'])
+                blob.field('bCountryCode', 1, h['bCountryCode'])
+                blob.field('bNumDescriptors', 1, 1)
+                blob.field('bDescriptorType (HID REPORT)', 1, REPORT)
+                blob.field('wDescriptorLength', 2, len(report))
+            for e in eps:
+                # a low speed device has interrupt endpoints only, of 8
+                # bytes at most and polled every 10ms or slower
+                if (e['bmAttributes'] & 0x03) != 0x03 or \
+                        e['wMaxPacketSize'] > 8 or e['bInterval'] < 10:
+                    raise DescError('endpoint 0x%02X is not a low speed '
+                                    'interrupt endpoint'
+                                    % e['bEndpointAddress'])
+                blob.header('ENDPOINT descriptor 0x%02X'
+                            % e['bEndpointAddress'])
+                blob.field('bLength', 1, 7)
+                blob.field('bDescriptorType', 1, ENDPOINT)
+                blob.field('bEndpointAddress', 1, e['bEndpointAddress'])
+                blob.field('bmAttributes', 1, e['bmAttributes'])
+                blob.field('wMaxPacketSize', 2, e['wMaxPacketSize'])
+                blob.field('bInterval', 1, e['bInterval'])
+        length = len(blob.data) - start
+        blob.patch(total, 2, length)
+        row(CONFIGURATION, ci, 0, start, length)
+
+    # HID and HID REPORT descriptors are asked for by the interface number
+    # in wIndex. a row of length 0 stands for an interface without HID.
+    interfaces = len(set(i['bInterfaceNumber']
+                         for i in confs[0]['interfaces'])) if confs else 0
+    for n in range(interfaces):
+        if n in hids:
+            row(HID, n, 0, hids[n], 9)
+        else:
+            row(HID, n, 0, 0, 0)
+    offsets = {}
+    for n, items in reports:
+        start = len(blob.data)
+        blob.header('HID REPORT descriptor of interface %d' % n)
+        depth = 0
+        for name, value in items:
+            if name == 'End Collection':
+                depth -= 1
+            text = name if value is None else \
+                '%s (0x%X)' % (name, value) if value > 9 else \
+                '%s (%d)' % (name, value)
+            blob.put(item_bytes(name, value), ' ' * (depth + 1) + text)
+            if name == 'Collection':
+                depth += 1
+        offsets[n] = (start, len(blob.data) - start)
+    for n in range(interfaces):
+        start, length = offsets.get(n, (0, 0))
+        row(REPORT, n, 0, start, length)
+
+    # STRING descriptors. index 0 is the LANGID table for any langid
+    start = len(blob.data)
+    blob.header('STRING descriptor 0 (LANGID)')
+    blob.field('bLength', 1, 2 + 2 * len(languages))
+    blob.field('bDescriptorType', 1, STRING)
+    for l in languages:
+        blob.field('wLANGID', 2, l)
+    row(STRING, 0, 0, start, len(blob.data) - start)
+    for l in languages:
+        for i, s in enumerate(strings.texts):
+            text = s[l]
+            start = len(blob.data)
+            blob.header('STRING descriptor %d (0x%04X) "%s"' % (i + 1, l, text))
+            blob.field('bLength', 1, 2 + 2 * len(text))
+            blob.field('bDescriptorType', 1, STRING)
+            for ch in text:
+                blob.put([ord(ch) & 0xFF, ord(ch) >> 8], '')
+            row(STRING, i + 1, l, start, len(blob.data) - start)
+
+    c = confs[0] if confs else {'bmAttributes': 0x80, 'interfaces': []}
+    eps = [e['bEndpointAddress'] & 0x0F for f in c['interfaces']
+           for e in f.get('endpoints', [])]
+    sizes = report_sizes(reports[0][1]) if reports else \
+        dict((t, {}) for t in REPORT_TYPES)
+    ids = max([0] + [i for b in sizes.values() for i in b]) + 1
+    info = {
+        'USB_INPUT_REPORT_SIZE': max([0] + list(sizes['Input'].values())),
+        'USB_OUTPUT_REPORT_SIZE': max([0] + list(sizes['Output'].values())),
+        'USB_FEATURE_REPORT_SIZE': max([0] + list(sizes['Feature'].values())),
+        'USB_NUM_REPORT_ID': ids,
+        'report_sizes': [[sizes[t].get(i, 0) for i in range(ids)]
+                         for t in REPORT_TYPES],
+        'USB_CONFIG_ATTRIBUTES': '0x%02X' % c['bmAttributes'],
+        'USB_NUM_INTERFACES': interfaces,
+        'USB_MAX_ENDPOINT': max(eps + [0]),
+    }
+    return blob, rows, languages, len(strings.texts), len(confs), info
+
+
+def slot_hash(types):
+    """((t >> s) ^ t) & (SLOTS-1) must be unique for the types present."""
+    for s in range(1, 8):
+        slots = [((t >> s) ^ t) & (SLOTS - 1) for t in types]
+        if len(set(slots)) == len(slots):
+            return s
+    raise DescError('no hash for descriptor types %s' % types)
+
+
+def cbyte(v):
+    return '0x%02X' % v
+
+
+def text_line(code, comment):
+    if not comment:
+        return '    %s' % code
+    return '    %-32s/* %-37s */' % (code, comment)
+
+
+def banner(*lines):
+    return '\n'.join(['/*' + '-' * 77] + ['** ' + l for l in lines] +
+                     ['**' + '-' * 75 + '*/'])
+
+
+def generate(spec, base):
+    blob, rows, languages, nstrings, nconfs, info = build(spec)
+    types = sorted(rows)
+    shift = slot_hash(types)
+    table = []
+    slots = [(0, 0, 0)] * SLOTS
+    for t in types:
+        r = sorted(rows[t], key=lambda x: (languages.index(x[1])
+                                           if x[1] in languages else -1, x[0]))
+        slot = ((t >> shift) ^ t) & (SLOTS - 1)
+        count = len(r) if t != STRING else nstrings + 1
+        slots[slot] = (t, len(table), count)
+        table += [(t, i, l, o, n) for i, l, o, n in r]
+    if len(table) > 255:
+        raise DescError('too many descriptors')
+
+    name = os.path.basename(base)
+    guard = '_%s_H_' % name.upper()
+    head = HEADER % {'title': '%s.h Descriptors generated by descgen.py.'
+                     % name}
+    h = [head,
+         '#ifndef %s' % guard,
+         '#define %s' % guard,
+         '',
+         '#define USB_DESC_BLOB_SIZE      %d' % len(blob.data),
+         '#define USB_NUM_CONFIGS         %d' % nconfs,
+         '#define USB_NUM_LANGUAGES       %d' % len(languages),
+         '#define USB_NUM_STRINGS         %d' % nstrings,
+         '',
+         '/* of the 1st configuration, used by the standard requests */',
+         '#define USB_CONFIG_ATTRIBUTES   %s' % info['USB_CONFIG_ATTRIBUTES'],
+         '#define USB_NUM_INTERFACES      %d' % info['USB_NUM_INTERFACES'],
+         '#define USB_MAX_ENDPOINT        %d' % info['USB_MAX_ENDPOINT'],
+         '',
+         '/* bytes of the largest reports of the 1st HID interface, with the',
+         '   ID byte if the report descriptor has REPORT IDs */',
+         '#define USB_INPUT_REPORT_SIZE   %d' % info['USB_INPUT_REPORT_SIZE'],
+         '#define USB_OUTPUT_REPORT_SIZE  %d' % info['USB_OUTPUT_REPORT_SIZE'],
+         '#define USB_FEATURE_REPORT_SIZE %d'
+         % info['USB_FEATURE_REPORT_SIZE'],
+         '#define USB_NUM_REPORT_ID       %d' % info['USB_NUM_REPORT_ID'],
+         '',
+         banner('USB_DescType[USB_DESC_SLOT(type)] is the row of a descriptor '
+                'type.'),
+         '#define USB_DESC_SLOT(t)        ((((t) >> %d) ^ (t)) & %d)'
+         % (shift, SLOTS - 1),
+         '',
+         'typedef struct',
+         '{',
+         '    WORD offset;                    /* offset in USB_DescBlob[]   '
+         '           */',
+         '    WORD length;                    /* 0 if there isn\'t such a '
+         'descriptor    */',
+         '} USB_DESC;',
+         '',
+         'typedef struct',
+         '{',
+         '    BYTE type;                      /* 0 for an unused slot       '
+         '           */',
+         '    BYTE first;                     /* first row in USB_DescTable[]'
+         '          */',
+         '    BYTE count;                     /* count of indexes of the type'
+         '          */',
+         '} USB_DESC_TYPE;',
+         '',
+         'extern const BYTE USB_DescBlob[];',
+         'extern const USB_DESC USB_DescTable[];',
+         'extern const USB_DESC_TYPE USB_DescType[];',
+         'extern const WORD USB_DescLangID[];',
+         'extern const WORD USB_ReportSize[3][USB_NUM_REPORT_ID];',
+         '',
+         '#endif',
+         '']
+
+    c = [HEADER % {'title': '%s.c Descriptors generated by descgen.py.'
+                   % name},
+         '#include "main.h"',
+         '',
+         banner('all descriptors, %d bytes' % len(blob.data)),
+         'const BYTE USB_DescBlob[USB_DESC_BLOB_SIZE] =',
+         '{']
+    lines = []
+    for ln in blob.lines:
+        if isinstance(ln, str):
+            lines.append('    /* %-69s */' % ln)
+            continue
+        offset, count, comment = ln
+        vals = blob.data[offset:offset + count]
+        if not comment and count == 2 and 0x20 <= vals[0] < 0x7F \
+                and vals[1] == 0:
+            code = "'%s', 0x00," % chr(vals[0]).replace("'", "\\'")
+        else:
+            code = ','.join(cbyte(v) for v in vals) + ','
+        lines.append(text_line(code, comment))
+    last = max(i for i, l in enumerate(lines) if not l.startswith('    /*'))
+    lines[last] = lines[last].replace(',', ' ', 1) \
+        if lines[last].count(',') == 1 else \
+        lines[last][:lines[last].rindex(',')] + ' ' + \
+        lines[last][lines[last].rindex(',') + 1:]
+    c += lines
+    c += ['};',
+          '',
+          banner('(type, index, langid) of each row, the rows of a type are '
+                 'ordered by',
+                 'langid and index. HID and HID REPORT descriptors are '
+                 'indexed by the',
+                 'interface number.'),
+          'const USB_DESC USB_DescTable[] =',
+          '{']
+    for k, (t, i, l, o, n) in enumerate(table):
+        code = '{0x%04X, %3d}%s' % (o, n, ',' if k < len(table) - 1 else ' ')
+        c.append(text_line(code, '%-13s %2d  0x%04X'
+                           % (TYPE_NAMES[t], i, l)))
+    c += ['};',
+          '',
+          'const USB_DESC_TYPE USB_DescType[%d] =' % SLOTS,
+          '{']
+    for k, (t, first, count) in enumerate(slots):
+        code = '{0x%02X, %3d, %3d}%s' % (t, first, count,
+                                        ',' if k < SLOTS - 1 else ' ')
+        c.append(text_line(code, 'slot %d %s' % (k, TYPE_NAMES.get(t, ''))))
+    c += ['};',
+          '',
+          'const WORD USB_DescLangID[USB_NUM_LANGUAGES] =',
+          '{']
+    for k, l in enumerate(languages):
+        c.append(text_line('0x%04X%s' % (l, ',' if k < len(languages) - 1
+                                          else ' '), 'language %d' % k))
+    c += ['};',
+          '',
+          banner('bytes of the Input, Output and Feature report of each '
+                 'REPORT ID, 0 if',
+                 'there isn\'t such a report. the row is the report type of '
+                 'GET_REPORT',
+                 'and SET_REPORT less 1.'),
+          'const WORD USB_ReportSize[3][USB_NUM_REPORT_ID] =',
+          '{']
+    for k, (t, row) in enumerate(zip(REPORT_TYPES, info['report_sizes'])):
+        code = '{%s}%s' % (', '.join('%d' % v for v in row),
+                           ',' if k < 2 else ' ')
+        c.append(text_line(code, t))
+    c += ['};', '']
+    c = [l.rstrip() for l in c]
+
+    # each 2 bytes of const data take a 24-bit program word through PSV
+    consts = len(blob.data) + 4 * len(table) + 3 * SLOTS + \
+        2 * len(languages) + 6 * info['USB_NUM_REPORT_ID']
+    report = [
+        '%d descriptors in %d bytes, index %d bytes, %d bytes of const data '
+        '(%d program words)' % (len(table), len(blob.data),
+                                4 * len(table) + 3 * SLOTS,
+                                consts, (consts + 1) // 2),
+        'lookup: 1 hash, 1 USB_DescType[] read, 1 USB_DescTable[] read '
+        '(+%d langid compare(s) for strings)' % len(languages),
+    ]
+    return '\n'.join(c), '\n'.join(h), report
+
+
+HEADER = '''/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        %(title)s
+ *
+ * THIS FILE IS GENERATED. Please modify Tools/DescGen/vusb.desc and run
+ * desc.bat instead of editing it.
+ *
+ *---------------------------------------------------------------------------*/'''
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description='generate desc.c/desc.h')
+    ap.add_argument('spec', help='descriptor spec, such as vusb.desc')
+    ap.add_argument('-o', '--output', default='desc',
+                    help='base name of the .c/.h files')
+    args = ap.parse_args(argv)
+    try:
+        with open(args.spec) as f:
+            spec = ast.literal_eval(f.read())
+        c, h, report = generate(spec, args.output)
+    except (DescError, KeyError, ValueError, SyntaxError) as e:
+        sys.stderr.write('descgen: %s\n' % e)
+        return 1
+    with open(args.output + '.c', 'w', newline='\n') as f:
+        f.write(c)
+    with open(args.output + '.h', 'w', newline='\n') as f:
+        f.write(h)
+    for r in report:
+        sys.stderr.write(r + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
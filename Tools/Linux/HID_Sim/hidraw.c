@@ -0,0 +1,133 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        hidraw.c The calls of hidstream.c turned to the bus of sie.c.
+ *
+ *---------------------------------------------------------------------------*/
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#include "sim.h"
+
+/*-----------------------------------------------------------------------------
+** the Makefile links hidstream.c with --wrap, so its open(), ioctl() and
+** the rest land here. there is one device, its time is the clock of the
+** bus, and a request of the host takes the time of its packets.
+**---------------------------------------------------------------------------*/
+int __wrap_open(const char *path, int flags)
+{
+  (void)path; (void)flags;
+  return 3;
+}
+
+int __wrap_close(int fd)
+{
+  (void)fd;
+  return 0;
+}
+
+int __wrap_ioctl(int fd, unsigned long req, void *arg)
+{
+  BYTE *rpt = arg, setup[8];
+  int len = _IOC_SIZE(req), n;
+
+  (void)fd;
+  setup[2] = rpt[0];                    /* report ID */
+  setup[3] = 3;                         /* Feature */
+  setup[4] = setup[5] = 0;
+  setup[6] = len & 0xFF;
+  setup[7] = len >> 8;
+  if (req == HIDIOCSFEATURE(len))
+  {
+    /* lost on the way, or sent while the caller is told it failed */
+    if (SimLose(SimDropSet))
+    {
+      errno = EPIPE;
+      return -1;
+    }
+    setup[0] = 0x21;
+    setup[1] = 0x09;                    /* SET_REPORT */
+    n = SimControl(setup,rpt);
+    if (n < 0 || SimLose(SimLostSet))
+    {
+      errno = EPIPE;
+      return -1;
+    }
+    return len;
+  }
+  if (req == HIDIOCGFEATURE(len))
+  {
+    setup[0] = 0xA1;
+    setup[1] = 0x01;                    /* GET_REPORT */
+    n = SimControl(setup,rpt);
+    if (n < 0)
+    {
+      errno = EPIPE;
+      return -1;
+    }
+    return n;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int ms)
+{
+  long end = SimNow+ms*1000L;
+
+  (void)nfds;
+  while (!SimInput(NULL) && SimNow < end)
+  {
+    SimStep(SIM_LOOP);
+  }
+  fds[0].revents = SimInput(NULL)? POLLIN:0;
+  return fds[0].revents != 0;
+}
+
+long __wrap_read(int fd, void *buf, unsigned long siz)
+{
+  (void)fd;
+  if (siz < ENDPOINT1_SIZE || !SimInput(buf))
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+  return ENDPOINT1_SIZE;
+}
+
+int __wrap_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+  (void)clk;
+  ts->tv_sec = SimNow/1000000L;
+  ts->tv_nsec = SimNow%1000000L*1000L;
+  return 0;
+}
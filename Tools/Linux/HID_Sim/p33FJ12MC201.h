@@ -0,0 +1,54 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        p33FJ12MC201.h The SFRs of the firmware as host variables.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _P33FJ12MC201_H_
+#define _P33FJ12MC201_H_
+
+/* main.h of the firmware includes this before anything else, -I. of the
+   Makefile puts it in front of the header of the compiler. sie.c keeps the
+   registers, and only those the C modules of hid_sim touch are here */
+extern volatile unsigned int TMR2, PR2, T2CON, PR3, T3CON, OSCTUN;
+extern volatile unsigned int _T2IF, _CNIF, _CNIE, _RA0, _RA1, _RB15, _TRISB15;
+
+/* Timer3 at Fcy/8 on the clock of the bus, each read takes 1us of it */
+extern volatile unsigned int *SimTimer3(void);
+#define TMR3                    (*SimTimer3())
+
+typedef struct { unsigned COSC:3; unsigned LOCK:1; } OSCCONBITS;
+extern volatile OSCCONBITS OSCCONbits;
+typedef struct { unsigned IPL:3; } SRBITS;
+extern volatile SRBITS SRbits;
+
+/* the bus of hid_sim is never suspended */
+#define Sleep()
+
+#endif
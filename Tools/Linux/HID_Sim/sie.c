@@ -0,0 +1,350 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        sie.c The API of sie.s on a clocked model of the bus.
+ *
+ *---------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "sim.h"
+
+volatile unsigned int TMR2, PR2, T2CON, PR3, T3CON, OSCTUN;
+volatile unsigned int _T2IF, _CNIF, _CNIE, _RA0, _RA1, _RB15, _TRISB15;
+volatile OSCCONBITS OSCCONbits;
+volatile SRBITS SRbits;
+
+volatile WORD _uendpt0;
+volatile WORD _ucontr0;
+volatile WORD _eptab[4*USB_MAX_ENDPOINT];
+volatile WORD _frame;
+volatile WORD _frametime;
+
+long SimNow;
+int SimDropAck;
+int SimDropSet;
+int SimLostSet;
+BYTE SimAddress;
+BYTE SimConfig;
+
+static long NextFrame, NextPoll;
+
+/* the transfer on EP0 */
+static BYTE Setup[8];
+static int SetupReady;
+static int InArmed;                     /* a DATA/STATUS packet to the host  */
+static int OutArmed;                    /* ready for one from the host       */
+static int Done, Stalled;
+static BYTE *HostDat;
+static int HostLen, HostPos;
+
+/* EP1 IN, and the reports the host has got from it */
+static BYTE Ep1[ENDPOINT1_SIZE];
+static int Ep1Len, Ep1Done;
+static BYTE Queue[4096][ENDPOINT1_SIZE];
+static unsigned QueueHead, QueueTail;
+
+/*-----------------------------------------------------------------------------
+** sie.s. the ISR of the bus is the host itself here: a packet armed by
+** usb.c goes at the next SimStep(), and the handshakes never fail.
+**---------------------------------------------------------------------------*/
+BYTE _usbGetSetup(BYTE *setup)
+{
+  if (!SetupReady)
+  {
+    return 0;
+  }
+  SetupReady = 0;
+  memcpy(setup,Setup,8);
+  return 8;
+}
+
+void _usbSetAddress(BYTE a)
+{
+  /* 0xFF if it's applied before the STATUS stage is over */
+  SimAddress = Done && !InArmed? a:0xFF;
+}
+
+void _usbSetConfig(BYTE c)
+{
+  SimConfig = c;
+}
+
+void _usbStallEP0(void)
+{
+  InArmed = OutArmed = 0;
+  Stalled = Done = 1;
+}
+
+void _usbArmIn(BYTE *dat, BYTE len)
+{
+  if (HostDat != NULL && HostPos+len <= HostLen)
+  {
+    memcpy(HostDat+HostPos,dat,len);
+  }
+  HostPos += len;
+  InArmed = 1;
+}
+
+void _usbArmZLP(void)
+{
+  InArmed = 1;
+  /* the STATUS stage of an OUT transfer or of one with no DATA */
+  if (!(Setup[0] & 0x80))
+  {
+    Done = 1;
+  }
+}
+
+BYTE _usbInDone(void)
+{
+  if (!InArmed)
+  {
+    return 0;
+  }
+  InArmed = 0;
+  return 1;
+}
+
+void _usbArmOut(void)
+{
+  OutArmed = 1;
+  /* the STATUS stage of an IN transfer */
+  if (Setup[0] & 0x80)
+  {
+    Done = 1;
+  }
+}
+
+BYTE _usbOutDone(BYTE *dat, BYTE len)
+{
+  int n;
+
+  if (!OutArmed)
+  {
+    return 0xFF;
+  }
+  OutArmed = 0;
+  if (Setup[0] & 0x80)
+  {
+    return 0;
+  }
+  n = HostLen-HostPos;
+  if (n > ENDPOINT0_SIZE) n = ENDPOINT0_SIZE;
+  if (n > len) n = len;
+  if (dat != NULL)
+  {
+    memcpy(dat,HostDat+HostPos,n);
+  }
+  HostPos += n;
+  return n;
+}
+
+BYTE _usbBusReset(void)
+{
+  return 0;
+}
+
+void _usbArmInEP(BYTE ep, BYTE *dat, BYTE len)
+{
+  (void)ep;
+  memcpy(Ep1,dat,len);
+  Ep1Len = len;
+}
+
+BYTE _usbInEPDone(BYTE ep)
+{
+  (void)ep;
+  if (!Ep1Done)
+  {
+    return 0;
+  }
+  Ep1Done = 0;
+  return 1;
+}
+
+void _usbHaltInEP(BYTE ep, BYTE halt)
+{
+  (void)ep; (void)halt;
+  Ep1Len = -1;
+}
+
+void _usbArmOutEP(BYTE ep)
+{
+  (void)ep;
+}
+
+BYTE _usbOutEPDone(BYTE ep, BYTE *dat, BYTE len)
+{
+  (void)ep; (void)dat; (void)len;
+  return 0xFF;
+}
+
+void _usbHaltOutEP(BYTE ep, BYTE halt)
+{
+  (void)ep; (void)halt;
+}
+
+void _usbSendResume(BYTE on)
+{
+  (void)on;
+}
+
+/* cph.s has Tools/Cipher/cphsim.py, and DWORD is no 32 bits on the host */
+void _cphEncrypt(DWORD *blk, const DWORD *rk)
+{
+  (void)blk; (void)rk;
+}
+
+void _dbg_led_on(void)
+{
+}
+
+void _dbg_die(void)
+{
+}
+
+void _dbg_send_bytes(WORD c)
+{
+  (void)c;
+}
+
+/*-----------------------------------------------------------------------------
+** the bus. a keep-alive at the start of each frame, Timer3 at Fcy/8, and
+** the host polls EP1 every SIM_POLL. hidraw drops SimDropAck % of what it
+** gets, as when its buffer is full.
+**---------------------------------------------------------------------------*/
+static unsigned Seed;
+
+int SimLose(int pct)
+{
+  Seed = Seed*1103515245+12345;
+  return (int)((Seed>>16)%100) < pct;
+}
+
+static WORD Ticks(long us)
+{
+  return (WORD)(us*(long)(FCY/1000000UL)/8);
+}
+
+volatile unsigned int *SimTimer3(void)
+{
+  static volatile unsigned int tmr3;
+
+  /* the firmware writes it too, but the bus keeps the time */
+  SimNow++;
+  tmr3 = Ticks(SimNow);
+  return &tmr3;
+}
+
+void SimStep(long us)
+{
+  SimNow += us;
+  while (SimNow >= NextFrame)
+  {
+    NextFrame += SIM_FRAME;
+    _frame++;
+    _frametime = Ticks(NextFrame-SIM_FRAME);
+  }
+
+  loop();
+
+  while (SimNow >= NextPoll)
+  {
+    NextPoll += SIM_POLL;
+    if (Ep1Len >= 0)
+    {
+      if (!SimLose(SimDropAck))
+      {
+        memcpy(Queue[QueueHead++%4096],Ep1,ENDPOINT1_SIZE);
+      }
+      Ep1Len = -1;
+      Ep1Done = 1;
+    }
+  }
+}
+
+int SimInput(BYTE *rpt)
+{
+  if (QueueTail == QueueHead)
+  {
+    return 0;
+  }
+  if (rpt != NULL)
+  {
+    memcpy(rpt,Queue[QueueTail++%4096],ENDPOINT1_SIZE);
+  }
+  return ENDPOINT1_SIZE;
+}
+
+int SimControl(const BYTE *setup, BYTE *dat)
+{
+  long start = (SimNow+SIM_TURN+SIM_FRAME-1)/SIM_FRAME*SIM_FRAME;
+  int n;
+
+  while (SimNow < start)
+  {
+    SimStep(SIM_LOOP);
+  }
+
+  memcpy(Setup,setup,8);
+  HostDat = dat;
+  HostLen = setup[6] | (setup[7] << 8);
+  HostPos = 0;
+  InArmed = OutArmed = Done = Stalled = 0;
+  SetupReady = 1;
+  for (n=0; !Done && n<2000; n++)
+  {
+    SimStep(SIM_PACKET);
+  }
+  /* the handshake of the STATUS stage */
+  SimStep(SIM_LOOP);
+  SimStep(SIM_LOOP);
+  HostDat = NULL;
+  if (!Done)
+  {
+    return -2;
+  }
+  return Stalled? -1:HostPos;
+}
+
+void SimInit(void)
+{
+  SimNow = 0;
+  NextFrame = SIM_FRAME;
+  NextPoll = SIM_POLL;
+  Seed = 1;
+  SetupReady = InArmed = OutArmed = 0;
+  Ep1Len = -1;
+  Ep1Done = 0;
+  QueueHead = QueueTail = 0;
+  SimAddress = SimConfig = 0;
+  _RA1 = 1;                             /* J-state */
+  _RA0 = 0;
+  setup();
+}
@@ -0,0 +1,323 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        sim.c The firmware against hidstream.c on a model of the bus.
+ *
+ *---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "hidstream.h"
+
+#define ECHO_BYTES              6100
+
+/* lz.c of HID_Stream. its lz.h has the guard of lz.h of the firmware */
+size_t LzPack(const void *src, size_t siz, void *dst, size_t room);
+
+static int Failed;
+
+/* the bytes loop() has read from the stream */
+static BYTE Out[65536];
+static unsigned OutLen;
+
+static void Check(int ok, const char *what)
+{
+  printf("%-56s %s\n",what,ok? "ok":"FAILED");
+  if (!ok)
+  {
+    Failed++;
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** loop() of main.c reads the stream and drops it, the Makefile links its
+** STR_wRead() here with --wrap so the bytes are kept.
+**---------------------------------------------------------------------------*/
+WORD __real_STR_wRead(BYTE *dat, WORD siz);
+
+WORD __wrap_STR_wRead(BYTE *dat, WORD siz)
+{
+  WORD n = __real_STR_wRead(dat,siz);
+
+  if (OutLen+n <= sizeof(Out))
+  {
+    memcpy(Out+OutLen,dat,n);
+  }
+  OutLen += n;
+  return n;
+}
+
+static int Request(BYTE type, BYTE req, WORD val, WORD idx, WORD len, BYTE *dat)
+{
+  BYTE setup[8] = {type, req, val & 0xFF, val >> 8, idx & 0xFF, idx >> 8,
+                   len & 0xFF, len >> 8};
+
+  return SimControl(setup,dat);
+}
+
+static void Configure(void)
+{
+  SimInit();
+  Request(0x00,0x05,1,0,0,NULL);
+  Request(0x00,0x09,1,0,0,NULL);
+}
+
+/*-----------------------------------------------------------------------------
+** the standard requests of usb.c
+**---------------------------------------------------------------------------*/
+static void Chapter9(void)
+{
+  BYTE d[512];
+  int n, total;
+
+  SimInit();
+  n = Request(0x80,0x06,0x0100,0,64,d);
+  Check(n == 18 && d[0] == 18 && d[1] == 1,"GET_DESCRIPTOR device, 18 of 64 bytes");
+  n = Request(0x80,0x06,0x0200,0,9,d);
+  total = d[2] | (d[3] << 8);
+  Check(n == 9 && d[1] == 2 && Request(0x80,0x06,0x0200,0,total,d) == total,
+        "GET_DESCRIPTOR configuration, 9 bytes then all");
+  n = Request(0x00,0x05,7,0,0,NULL);
+  Check(n == 0 && SimAddress == 7,"SET_ADDRESS after its STATUS stage");
+  n = Request(0x80,0x08,0,0,1,d);
+  Check(n == 1 && d[0] == 0,"GET_CONFIGURATION in the Address state");
+  Check(Request(0x81,0x00,0,0,2,d) == -1,"GET_STATUS of the interface STALLs");
+  n = Request(0x00,0x09,1,0,0,NULL);
+  Check(n == 0 && SimConfig == 1 && Request(0x80,0x08,0,0,1,d) == 1 && d[0] == 1,
+        "SET_CONFIGURATION 1");
+  Check(Request(0x00,0x09,2,0,0,NULL) == -1,"SET_CONFIGURATION 2 STALLs");
+  n = Request(0x80,0x00,0,0,2,d);
+  Check(n == 2 && d[0] == 0 && d[1] == 0,"GET_STATUS of the device, bus powered");
+  Request(0x00,0x03,1,0,0,NULL);
+  n = Request(0x80,0x00,0,0,2,d);
+  Check(n == 2 && d[0] == 2,"SET_FEATURE DEVICE_REMOTE_WAKEUP");
+  Request(0x00,0x01,1,0,0,NULL);
+  n = Request(0x80,0x00,0,0,2,d);
+  Check(n == 2 && d[0] == 0,"CLEAR_FEATURE DEVICE_REMOTE_WAKEUP");
+  Request(0x02,0x03,0,0x81,0,NULL);
+  n = Request(0x82,0x00,0,0x81,2,d);
+  Check(n == 2 && d[0] == 1,"SET_FEATURE ENDPOINT_HALT of EP1 IN");
+  Request(0x02,0x01,0,0x81,0,NULL);
+  n = Request(0x82,0x00,0,0x81,2,d);
+  Check(n == 2 && d[0] == 0,"CLEAR_FEATURE ENDPOINT_HALT of EP1 IN");
+  Check(Request(0x02,0x03,0,0x82,0,NULL) == -1,"SET_FEATURE ENDPOINT_HALT of EP2 STALLs");
+  n = Request(0x81,0x0A,0,0,1,d);
+  Check(n == 1 && d[0] == 0 && Request(0x01,0x0B,0,0,0,NULL) == 0,
+        "GET_INTERFACE, SET_INTERFACE 0");
+  Check(Request(0x01,0x0B,1,0,0,NULL) == -1,"SET_INTERFACE 1 STALLs");
+  Check(Request(0x00,0x07,0x0100,0,18,d) == -1,"SET_DESCRIPTOR STALLs");
+  Check(Request(0x82,0x0C,0,0x81,2,d) == -1,"SYNCH_FRAME STALLs");
+  Check(Request(0xA1,0x01,0x0102,0,8,d) == -1,"GET_REPORT of an Input ID there isn't STALLs");
+}
+
+/*-----------------------------------------------------------------------------
+** the queue of hid.c: Feature commands, and an Output report beside them
+**---------------------------------------------------------------------------*/
+static int Echoed(const BYTE *rsp, int n, BYTE fill)
+{
+  int i;
+
+  if (n != 64 || rsp[0] != 4 || rsp[1] != 0)
+  {
+    return 0;
+  }
+  for (i=3; i<64; i++)
+  {
+    if ((rsp[i] ^ fill) != 0xFF)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* two SOURCE commands of main.c in the queue, then their responses */
+static int Source(int first, int second)
+{
+  BYTE a[64] = {4, 0x04, first}, b[64] = {4, 0x04, second}, d[64];
+  int i, k, n, count[2] = {first, second};
+
+  Request(0x21,0x09,0x0304,0,64,a);
+  Request(0x21,0x09,0x0304,0,64,b);
+  for (k=0; k<2; k++)
+  {
+    n = Request(0xA1,0x01,0x0304,0,64,d);
+    if (n != 64 || d[1] != 0x04)
+    {
+      return 0;
+    }
+    for (i=0; i<61; i++)
+    {
+      if (d[2+i] != (i < count[k]? ((i*7) & 0xFF) ^ 0x5A:0))
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static void Queue(void)
+{
+  BYTE a[64], b[64], d[64];
+  BYTE pn9[8] = {1, 'P', 'N', '9', 0};
+
+  Configure();
+  memset(a,0x11,sizeof(a));
+  memset(b,0x22,sizeof(b));
+  a[0] = b[0] = 4;
+  a[1] = b[1] = 0;
+  Check(Request(0x21,0x09,0x0304,0,64,a) == 64,"SET_FEATURE of ECHO");
+  Check(Echoed(d,Request(0xA1,0x01,0x0304,0,64,d),0x11),"GET_FEATURE of its response");
+  Check(Request(0xA1,0x01,0x0304,0,64,d) == 0,"GET_FEATURE with none is a ZLP");
+
+  Request(0x21,0x09,0x0304,0,64,a);
+  Request(0x21,0x09,0x0304,0,64,b);
+  Check(Request(0x21,0x09,0x0201,0,8,pn9) == 8,"SET_OUTPUT_REPORT with both slots full");
+  Check(Request(0xA1,0x01,0x0101,0,8,d) == 8 && !memcmp(d,"\1PN9\x80",5),
+        "GET_INPUT_REPORT echoes it");
+  Check(Echoed(d,Request(0xA1,0x01,0x0304,0,64,d),0x11) &&
+        Echoed(d,Request(0xA1,0x01,0x0304,0,64,d),0x22),
+        "both responses are kept, in order");
+
+  Check(Source(10,40),"SOURCE of 10 bytes queued before one of 40");
+  Check(Source(40,10),"SOURCE of 40 bytes queued before one of 10");
+}
+
+/*-----------------------------------------------------------------------------
+** EchoWrite() of hidstream.c with 1 and 2 commands queued, for handlers
+** of 0 to 2ms by LOAD of main.c. the table of README.
+**---------------------------------------------------------------------------*/
+static void Timing(void)
+{
+  static BYTE d[ECHO_BYTES];
+  BYTE load[64] = {4, 0x06};
+  hid_stream s;
+  long t0, us;
+  int i, q, rv;
+
+  for (i=0; i<ECHO_BYTES; i++)
+  {
+    d[i] = rand();
+  }
+  printf("\n| Handler | 1 queued | 2 queued |\n| ------- | -------- | -------- |\n");
+  for (us=0; us<=2000; us+=1000)
+  {
+    printf("| %ldms |",us/1000);
+    for (q=1; q<=2; q++)
+    {
+      Configure();
+      load[2] = us & 0xFF;
+      load[3] = us >> 8;
+      Request(0x21,0x09,0x0304,0,64,load);
+      Request(0xA1,0x01,0x0304,0,64,load);
+      StreamOpen(&s,"sim",0,0);
+      t0 = SimNow;
+      rv = EchoWrite(&s,d,ECHO_BYTES,q);
+      printf(" %.0fms, %.1fKB/s |",
+             (SimNow-t0)/1000.0/((ECHO_BYTES+STREAM_DATA_SIZE-1)/STREAM_DATA_SIZE),
+             ECHO_BYTES/1.024/(SimNow-t0)*1000);
+      if (rv != 0)
+      {
+        printf(" EchoWrite() %d",rv);
+        Failed++;
+      }
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+/*-----------------------------------------------------------------------------
+** StreamWrite() with lost acks and SET_FEATUREs, raw and packed. the bytes
+** loop() reads, and the count and the sum of the device, must match.
+**---------------------------------------------------------------------------*/
+static void Telemetry(BYTE *d, size_t siz)
+{
+  char line[64];
+  int t = 2350, mv = 3300, n;
+  unsigned long ms = 0;
+  size_t i;
+
+  for (i=0; i<siz; i+=n)
+  {
+    t += rand()%3-1;
+    mv += rand()%5-2;
+    n = snprintf(line,sizeof(line),"%lu,%d.%02d,%d,%s\n",ms,t/100,t%100,mv,
+                 rand()%50? "OK":"WARN");
+    memcpy(d+i,line,(size_t)n < siz-i? (size_t)n:siz-i);
+    ms += 100;
+  }
+}
+
+static void Stream(int packed, int drop)
+{
+  static BYTE d[20000], p[20000+20000/128+1];
+  stream_status a, b;
+  hid_stream s;
+  const BYTE *dat = d;
+  size_t siz = sizeof(d);
+  char what[80];
+  int rv;
+
+  Configure();
+  SimDropAck = SimDropSet = SimLostSet = drop;
+  Telemetry(d,sizeof(d));
+  if (packed)
+  {
+    siz = LzPack(d,sizeof(d),p,sizeof(p));
+    dat = p;
+  }
+  StreamOpen(&s,"sim",0,0);
+  StreamStatus(&s,&a);
+  OutLen = 0;
+  rv = StreamWrite(&s,dat,siz,STR_WINDOW,packed);
+  SimDropAck = SimDropSet = SimLostSet = 0;
+  StreamStatus(&s,&b);
+  snprintf(what,sizeof(what),"StreamWrite() %s, %d%% lost, %lu frames, %lu syncs",
+           packed? "packed":"raw",drop,s.sent,s.syncs);
+  Check(rv == 0 && b.bytes-a.bytes == siz && b.sum == StreamSum(dat,siz,a.sum) &&
+        OutLen == sizeof(d) && !memcmp(Out,d,sizeof(d)),what);
+}
+
+int main(void)
+{
+  srand(1);
+  Chapter9();
+  Queue();
+  Timing();
+  Stream(0,0);
+  Stream(0,20);
+  Stream(1,0);
+  Stream(1,20);
+  printf("%s\n",Failed? "FAILED":"PASSED");
+  return Failed? 1:0;
+}
@@ -0,0 +1,73 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        sim.h The bus of hid_sim between the firmware and hidraw.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include "main.h"
+
+/* the clock of the bus in us */
+#define SIM_FRAME               1000    /* a frame, a keep-alive at its start */
+#define SIM_PACKET              115     /* a packet of EP0 with its handshake */
+#define SIM_TURN                100     /* the host between two requests     */
+#define SIM_LOOP                20      /* a pass of loop() with no work     */
+#define SIM_POLL                10000   /* the interval of EP1               */
+
+extern long SimNow;                     /* us since SimInit()                */
+extern int SimDropAck;                  /* % of Input reports lost by hidraw */
+extern int SimDropSet;                  /* % of SET_FEATUREs never sent      */
+extern int SimLostSet;                  /* % sent but failed to the caller   */
+extern BYTE SimAddress;                 /* of _usbSetAddress(), 0xFF early   */
+extern BYTE SimConfig;                  /* of _usbSetConfig()                */
+
+/* the firmware from its reset on a fresh bus */
+void SimInit(void);
+
+/* 'us' go by, then loop() makes a pass and EP1 is polled if it's time */
+void SimStep(long us);
+
+/* a control transfer of the host at the next frame. 'dat' holds the DATA
+   stage of an OUT transfer and takes that of an IN transfer. the bytes of
+   the DATA stage, -1 on a STALL, -2 if the device never finishes it */
+int SimControl(const BYTE *setup, BYTE *dat);
+
+/* 1 'pct' % of the time */
+int SimLose(int pct);
+
+/* a report of EP1 the host has got, 0 if there isn't any. NULL peeks */
+int SimInput(BYTE *rpt);
+
+/* of main.c, called by sie.s on the device */
+void setup(void);
+void loop(void);
+
+#endif
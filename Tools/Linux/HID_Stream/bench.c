@@ -0,0 +1,403 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        bench.c The benchmark commands of main.c, the acceptance
+ *               test of a firmware drop.
+ *
+ *---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#include "hidstream.h"
+
+/* the opcodes of HID_Commands[] in main.c of the firmware */
+#define CMD_ECHO                0x00
+#define CMD_SINK                0x03
+#define CMD_SOURCE              0x04
+#define CMD_PING                0x05
+#define CMD_LOAD                0x06
+
+#define RETRIES                 100
+
+static const int Sizes[] = {8, 16, 32, 64};
+static const int Loads[] = {0, 1000, 5000};
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/* the bytes of SOURCE, as Pattern[] of main.c holds them */
+static unsigned char Pattern(int i)
+{
+  return (unsigned char)(i*7)^0x5A;
+}
+
+/* SET_FEATURE, again while every slot of the device holds a command */
+static int Set(hid_stream *s, unsigned char *rpt, int len)
+{
+  int retry;
+
+  rpt[0] = ECHO_REPORT_ID;
+  for (retry=0; retry<RETRIES; retry++)
+  {
+    if (ioctl(s->fd,HIDIOCSFEATURE(len),rpt) == len)
+    {
+      s->sent++;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* GET_FEATURE, again while it's short as the command isn't handled yet */
+static int Get(hid_stream *s, unsigned char *rpt, int len)
+{
+  int retry;
+
+  for (retry=0; retry<RETRIES; retry++)
+  {
+    rpt[0] = ECHO_REPORT_ID;
+    if (ioctl(s->fd,HIDIOCGFEATURE(len),rpt) >= len)
+    {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* read the responses nobody has asked for, up to a ZLP */
+static void Drain(hid_stream *s)
+{
+  unsigned char rpt[ECHO_REPORT_SIZE];
+  int i;
+
+  for (i=0; i<RETRIES; i++)
+  {
+    rpt[0] = ECHO_REPORT_ID;
+    if (ioctl(s->fd,HIDIOCGFEATURE(sizeof(rpt)),rpt) < 2)
+    {
+      break;
+    }
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** [op][req] and its response [op][rsp]. the response is written over the
+** request in the slot of the device, so the request is as long as both.
+**---------------------------------------------------------------------------*/
+static int Command(hid_stream *s, int op, const unsigned char *req, int reqlen,
+                   unsigned char *rsp, int rsplen)
+{
+  unsigned char rpt[ECHO_REPORT_SIZE];
+  int len = 2+(reqlen > rsplen? reqlen:rsplen);
+
+  memset(rpt,0,sizeof(rpt));
+  rpt[1] = (unsigned char)op;
+  memcpy(rpt+2,req,reqlen);
+  if (Set(s,rpt,len) != 0 || Get(s,rpt,2+rsplen) != 0 || rpt[1] != op)
+  {
+    return -1;
+  }
+  memcpy(rsp,rpt+2,rsplen);
+  return 0;
+}
+
+static int Load(hid_stream *s, int us)
+{
+  unsigned char req[2] = {us & 0xFF, us >> 8}, rsp[2];
+
+  return Command(s,CMD_LOAD,req,2,rsp,2);
+}
+
+static int Sunk(hid_stream *s, unsigned long *bytes)
+{
+  unsigned char rsp[4] = {0};
+
+  if (Command(s,CMD_SINK,rsp,0,rsp,4) != 0)
+  {
+    return -1;
+  }
+  *bytes = rsp[0] | (unsigned long)rsp[1]<<8 |
+           (unsigned long)rsp[2]<<16 | (unsigned long)rsp[3]<<24;
+  return 0;
+}
+
+/* n reports of len bytes to SINK, their responses are never read */
+static int Sink(hid_stream *s, int len, int n, double *t)
+{
+  unsigned char rpt[ECHO_REPORT_SIZE];
+  unsigned long b0, b1;
+  int i;
+
+  if (Sunk(s,&b0) != 0)
+  {
+    return -1;
+  }
+  memset(rpt,0,sizeof(rpt));
+  rpt[1] = CMD_SINK;
+  *t = Seconds();
+  for (i=0; i<n; i++)
+  {
+    rpt[2] = (unsigned char)i;
+    if (Set(s,rpt,len) != 0)
+    {
+      return -1;
+    }
+  }
+  *t = Seconds()-*t;
+
+  /* all the bytes and the 4 of the last Sunk() itself */
+  Drain(s);
+  if (Sunk(s,&b1) != 0)
+  {
+    return -1;
+  }
+  return b1-b0 == (unsigned long)n*(len-2)+4? 0:-2;
+}
+
+/* n responses of len bytes from SOURCE, asked for by a report of 3 */
+static int Source(hid_stream *s, int len, int n, double *t)
+{
+  unsigned char rpt[ECHO_REPORT_SIZE];
+  int i, j;
+
+  *t = Seconds();
+  for (i=0; i<n; i++)
+  {
+    rpt[1] = CMD_SOURCE;
+    rpt[2] = (unsigned char)(len-2);
+    if (Set(s,rpt,3) != 0 || Get(s,rpt,len) != 0)
+    {
+      return -1;
+    }
+    for (j=0; j<len-2; j++)
+    {
+      if (rpt[1] != CMD_SOURCE || rpt[2+j] != Pattern(j))
+      {
+        return -2;
+      }
+    }
+  }
+  *t = Seconds()-*t;
+  return 0;
+}
+
+/* n reports of len bytes to ECHO and back inverted */
+static int Echo(hid_stream *s, int len, int n, double *t)
+{
+  unsigned char rpt[ECHO_REPORT_SIZE], in[ECHO_REPORT_SIZE];
+  int i, j;
+
+  *t = Seconds();
+  for (i=0; i<n; i++)
+  {
+    rpt[1] = CMD_ECHO;
+    for (j=2; j<len; j++)
+    {
+      rpt[j] = (unsigned char)rand();
+    }
+    if (Set(s,rpt,len) != 0 || Get(s,in,len) != 0)
+    {
+      return -1;
+    }
+    for (j=2; j<len; j++)
+    {
+      if (in[1] != CMD_ECHO || (in[j]^rpt[j]) != 0xFF)
+      {
+        return -2;
+      }
+    }
+  }
+  *t = Seconds()-*t;
+  return 0;
+}
+
+static int Compare(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+
+  return x < y? -1:x > y;
+}
+
+/*-----------------------------------------------------------------------------
+** n PINGs one after the other. the round trip is timed by the host, and the
+** interval between two of them by the device too, in its frames and Timer3
+** ticks since the keep-alive. the device clock follows the keep-alives of
+** the host, so the intervals show when the commands reach the firmware.
+**---------------------------------------------------------------------------*/
+static int Ping(hid_stream *s, int n, double *rtt, double *dev)
+{
+  unsigned char req[2], rsp[8];
+  unsigned short frame, ticks, tpms, f0 = 0, t0 = 0;
+  double t;
+  int i;
+
+  for (i=0; i<n; i++)
+  {
+    req[0] = i & 0xFF;
+    req[1] = (i >> 8) & 0xFF;
+    t = Seconds();
+    if (Command(s,CMD_PING,req,2,rsp,8) != 0)
+    {
+      return -1;
+    }
+    rtt[i] = (Seconds()-t)*1000;
+    if (rsp[0] != req[0] || rsp[1] != req[1])
+    {
+      return -2;
+    }
+    frame = (unsigned short)(rsp[2] | rsp[3]<<8);
+    ticks = (unsigned short)(rsp[4] | rsp[5]<<8);
+    tpms = (unsigned short)(rsp[6] | rsp[7]<<8);
+    dev[i] = (unsigned short)(frame-f0)+((double)ticks-t0)/tpms;
+    f0 = frame;
+    t0 = ticks;
+  }
+  qsort(rtt,n,sizeof(rtt[0]),Compare);
+  qsort(dev+1,n-1,sizeof(dev[0]),Compare);
+  return 0;
+}
+
+static const char *Result(int rv)
+{
+  return rv == 0? "":rv == -1? " (no response)":" (BAD DATA)";
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = NULL;
+  int idx, n = 200, rv, fails = 0, i, k;
+  double t[3], *rtt, *dev, sum;
+  hid_stream s;
+
+  /*---------------------------------------------------------------------------
+  ** hid_bench [-d /dev/hidrawN] [-n N]
+  **   -d     the hidraw of the device instead of the first one of 096E:0100
+  **   -n N   commands a measure, 200 unless it's given
+  **-------------------------------------------------------------------------*/
+  for (idx=1; idx<argc; idx++)
+  {
+    if (strcmp(argv[idx],"-d") == 0 && idx+1 < argc)
+    {
+      path = argv[++idx];
+    }
+    else
+    if (strcmp(argv[idx],"-n") == 0 && idx+1 < argc)
+    {
+      n = atoi(argv[++idx]);
+    }
+    else
+    {
+      printf("usage: hid_bench [-d /dev/hidrawN] [-n N]\n");
+      return -1;
+    }
+  }
+  if (n < 2 || n > 100000)
+  {
+    printf("-n must be 2..100000\n");
+    return -1;
+  }
+
+  if (StreamOpen(&s,path,0x096E,0x0100) != 0)
+  {
+    printf("Device not found!\n");
+    return -1;
+  }
+  rtt = (double*)malloc(2*n*sizeof(double));
+  if (rtt == NULL)
+  {
+    return -5;
+  }
+  dev = rtt+n;
+
+  Drain(&s);
+  if (Load(&s,0) != 0)
+  {
+    printf("the firmware has no benchmark commands!\n");
+    return -3;
+  }
+
+  /* the payload is the report less its ID and opcode */
+  printf("throughput, KB/s of payload, %d commands each\n\n", n);
+  printf("| Report | SINK | SOURCE | ECHO |\n");
+  printf("| ------ | ---- | ------ | ---- |\n");
+  for (i=0; i<(int)(sizeof(Sizes)/sizeof(Sizes[0])); i++)
+  {
+    printf("| %d bytes |", Sizes[i]);
+    for (k=0; k<3; k++)
+    {
+      rv = k == 0? Sink(&s,Sizes[i],n,&t[k]):
+           k == 1? Source(&s,Sizes[i],n,&t[k]):Echo(&s,Sizes[i],n,&t[k]);
+      fails += rv != 0;
+      if (rv == 0)
+      {
+        printf(" %.2f |", n*(Sizes[i]-2)/1024.0/t[k]);
+      }
+      else
+      {
+        printf(" FAILED%s |", Result(rv));
+      }
+    }
+    printf("\n");
+  }
+
+  printf("\nlatency of PING in ms, %d commands each\n\n", n);
+  printf("| Load | Min | Avg | 99%% | Max | Device interval |\n");
+  printf("| ---- | --- | --- | --- | --- | --------------- |\n");
+  for (i=0; i<(int)(sizeof(Loads)/sizeof(Loads[0])); i++)
+  {
+    rv = Load(&s,Loads[i]) == 0? Ping(&s,n,rtt,dev):-1;
+    fails += rv != 0;
+    if (rv != 0)
+    {
+      printf("| %dus | FAILED%s |\n", Loads[i], Result(rv));
+      continue;
+    }
+    for (sum=0, k=0; k<n; k++)
+    {
+      sum += rtt[k];
+    }
+    printf("| %dus | %.2f | %.2f | %.2f | %.2f | %.2f..%.2f |\n", Loads[i],
+           rtt[0], sum/n, rtt[(n*99)/100], rtt[n-1], dev[1], dev[n-1]);
+  }
+  fails += Load(&s,0) != 0;
+
+  printf("\n%s\n", fails? "FAILED":"PASSED");
+  free(rtt);
+  StreamClose(&s);
+  return fails? -2:0;
+}
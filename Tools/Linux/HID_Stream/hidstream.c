@@ -0,0 +1,310 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        hidstream.c Windowed stream to the firmware over hidraw.
+ *
+ *---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+#include "hidstream.h"
+
+/* no progress for so long: an ack or a frame is lost, go back to the ack */
+#define STREAM_TIMEOUT_MS       100
+
+static long Millis(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1000L+ts.tv_nsec/1000000L;
+}
+
+int StreamOpen(hid_stream *s, const char *path, unsigned short vid, unsigned short pid)
+{
+  struct hidraw_devinfo info;
+  char name[32];
+  int i, fd;
+
+  memset(s,0,sizeof(*s));
+  s->fd = -1;
+  if (path != NULL)
+  {
+    s->fd = open(path,O_RDWR);
+    return s->fd < 0? -1:0;
+  }
+
+  for (i=0; i<64; i++)
+  {
+    snprintf(name,sizeof(name),"/dev/hidraw%d",i);
+    fd = open(name,O_RDWR);
+    if (fd < 0)
+    {
+      continue;
+    }
+    if (ioctl(fd,HIDIOCGRAWINFO,&info) == 0 &&
+        (unsigned short)info.vendor == vid && (unsigned short)info.product == pid)
+    {
+      s->fd = fd;
+      return 0;
+    }
+    close(fd);
+  }
+  return -1;
+}
+
+void StreamClose(hid_stream *s)
+{
+  if (s->fd >= 0)
+  {
+    close(s->fd);
+    s->fd = -1;
+  }
+}
+
+int StreamStatus(hid_stream *s, stream_status *st)
+{
+  unsigned char rpt[STREAM_REPORT_SIZE];
+
+  memset(rpt,0,sizeof(rpt));
+  rpt[0] = STREAM_REPORT_ID;
+  if (ioctl(s->fd,HIDIOCGFEATURE(sizeof(rpt)),rpt) < 9)
+  {
+    return -1;
+  }
+  st->ack = rpt[1];
+  st->credit = rpt[2];
+  st->bytes = rpt[3] | (unsigned long)rpt[4]<<8 |
+              (unsigned long)rpt[5]<<16 | (unsigned long)rpt[6]<<24;
+  st->sum = (unsigned short)(rpt[7] | rpt[8]<<8);
+  return 0;
+}
+
+unsigned short StreamSum(const void *dat, size_t siz, unsigned short sum)
+{
+  const unsigned char *p = dat;
+
+  while(siz--)
+  {
+    sum += *p++;
+  }
+  return sum;
+}
+
+/*-----------------------------------------------------------------------------
+** the frames are counted from 0 on the host, the device counts them by an
+** 8-bit seq from 'seq0'. an ack moves 'base' on by the frames it covers, and
+** 'limit' is the first frame the device has no room for yet.
+**---------------------------------------------------------------------------*/
+typedef struct _window {
+  unsigned char seq0;
+  unsigned long base, next, limit;
+} window;
+
+static void TakeAck(window *w, unsigned char ack, unsigned char credit)
+{
+  unsigned long d = (unsigned char)(ack-(unsigned char)(w->seq0+w->base));
+
+  /* an ack of a frame not sent yet is an old one, of the last round */
+  if (d <= w->next-w->base)
+  {
+    w->base += d;
+    w->limit = w->base+credit;
+  }
+}
+
+/* take the acks on the interrupt IN endpoint, wait up to 'ms' for one */
+static int TakeAcks(hid_stream *s, window *w, int ms)
+{
+  struct pollfd pfd;
+  unsigned char in[64];
+  unsigned long base = w->base, limit = w->limit;
+  int n;
+
+  pfd.fd = s->fd;
+  pfd.events = POLLIN;
+  while (poll(&pfd,1,ms) > 0 && (pfd.revents & POLLIN))
+  {
+    n = (int)read(s->fd,in,sizeof(in));
+    if (n >= 3 && in[0] == STREAM_REPORT_ID)
+    {
+      TakeAck(w,in[1],in[2]);
+      s->acks++;
+    }
+    /* the rest of the queue without waiting */
+    ms = 0;
+  }
+  return w->base != base || w->limit != limit;
+}
+
+int StreamWrite(hid_stream *s, const void *dat, size_t siz, int window_size, int packed)
+{
+  const unsigned char *p = dat;
+  unsigned char rpt[STREAM_REPORT_SIZE];
+  unsigned long frames = (siz+STREAM_DATA_SIZE-1)/STREAM_DATA_SIZE, high = 0;
+  stream_status st;
+  window w;
+  size_t off, len;
+  long last;
+
+  /* the acks of an earlier run may be waiting in the queue */
+  if (StreamStatus(s,&st) != 0)
+  {
+    return -1;
+  }
+  w.seq0 = st.ack;
+  w.base = w.next = 0;
+  w.limit = st.credit;
+  TakeAcks(s,&w,0);
+
+  last = Millis();
+  while (w.base < frames)
+  {
+    /*-------------------------------------------------------------------------
+    ** every frame the window and the credit allow goes out at once, the
+    ** acks come back on EP1 while the next SET_FEATUREs are on their way.
+    **-----------------------------------------------------------------------*/
+    while (w.next < frames && w.next < w.limit &&
+           w.next < w.base+(unsigned long)window_size)
+    {
+      off = w.next*STREAM_DATA_SIZE;
+      len = siz-off < STREAM_DATA_SIZE? siz-off:STREAM_DATA_SIZE;
+      memset(rpt,0,sizeof(rpt));
+      rpt[0] = STREAM_REPORT_ID;
+      rpt[1] = (unsigned char)(w.seq0+w.next);
+      rpt[2] = (unsigned char)len | (packed? STREAM_PACKED:0);
+      memcpy(rpt+3,p+off,len);
+      if (ioctl(s->fd,HIDIOCSFEATURE(sizeof(rpt)),rpt) < 0)
+      {
+        break;
+      }
+      s->sent++;
+      if (w.next < high)
+      {
+        s->resent++;
+      }
+      w.next++;
+      high = w.next > high? w.next:high;
+      if (TakeAcks(s,&w,0))
+      {
+        last = Millis();
+      }
+    }
+
+    if (TakeAcks(s,&w,10))
+    {
+      last = Millis();
+    }
+    else
+    if (Millis()-last > STREAM_TIMEOUT_MS)
+    {
+      /* go back to the frame the device asks for */
+      if (StreamStatus(s,&st) != 0)
+      {
+        return -1;
+      }
+      s->syncs++;
+      TakeAck(&w,st.ack,st.credit);
+      w.next = w.base;
+      last = Millis();
+    }
+  }
+  return 0;
+}
+
+int EchoWrite(hid_stream *s, const void *dat, size_t siz, int depth)
+{
+  const unsigned char *p = dat;
+  unsigned char rpt[ECHO_REPORT_SIZE], in[ECHO_REPORT_SIZE];
+  size_t set, get, num, off, len, i;
+  int n, retry;
+
+  /*---------------------------------------------------------------------------
+  ** the ECHO command, opcode 0, then GET_FEATURE of its inverted echo. the
+  ** payload is 61 bytes a report, the same as a frame of the stream. up to
+  ** 'depth' commands wait in the queue of the device (HID_QUEUE_SLOTS of
+  ** hid.h), their responses come back in the same order. 1 is the
+  ** stop-and-wait of HID_Test.
+  **-------------------------------------------------------------------------*/
+  num = (siz+STREAM_DATA_SIZE-1)/STREAM_DATA_SIZE;
+  for (set=get=0; get<num; )
+  {
+    if (set < num && set-get < (size_t)depth)
+    {
+      off = set*STREAM_DATA_SIZE;
+      len = siz-off < STREAM_DATA_SIZE? siz-off:STREAM_DATA_SIZE;
+      memset(rpt,0,sizeof(rpt));
+      rpt[0] = ECHO_REPORT_ID;
+      memcpy(rpt+3,p+off,len);
+      if (ioctl(s->fd,HIDIOCSFEATURE(sizeof(rpt)),rpt) < 0)
+      {
+        return -1;
+      }
+      s->sent++;
+      set++;
+      continue;
+    }
+
+    /* a short report until the firmware has taken the command */
+    for (retry=0; retry<100; retry++)
+    {
+      in[0] = ECHO_REPORT_ID;
+      n = ioctl(s->fd,HIDIOCGFEATURE(sizeof(in)),in);
+      if (n >= (int)sizeof(in))
+      {
+        break;
+      }
+    }
+    if (retry == 100)
+    {
+      return -1;
+    }
+    off = get*STREAM_DATA_SIZE;
+    len = siz-off < STREAM_DATA_SIZE? siz-off:STREAM_DATA_SIZE;
+    if (in[1] != 0)
+    {
+      return -2;
+    }
+    for (i=0; i<len; i++)
+    {
+      if ((in[3+i]^p[off+i]) != 0xFF)
+      {
+        return -2;
+      }
+    }
+    get++;
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        hidstream.h The stream of stream.c over hidraw on Linux.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _HIDSTREAM_H_
+#define _HIDSTREAM_H_
+
+#include <stddef.h>
+
+/* as stream.h and vusb.desc of the firmware */
+#define STREAM_REPORT_ID        5
+#define STREAM_DATA_SIZE        61
+#define STREAM_REPORT_SIZE      (1+2+STREAM_DATA_SIZE)
+#define STREAM_PACKED           0x80
+#define ECHO_REPORT_ID          4
+#define ECHO_REPORT_SIZE        64
+
+typedef struct _hid_stream {
+  int           fd;
+  unsigned long sent;       /* frames sent, the retransmitted ones too */
+  unsigned long resent;
+  unsigned long acks;       /* acks on the interrupt IN endpoint */
+  unsigned long syncs;      /* GET_FEATURE after a timeout */
+} hid_stream;
+
+typedef struct _stream_status {
+  unsigned char ack;        /* seq of the next frame the device takes */
+  unsigned char credit;     /* frames it takes without an ack */
+  unsigned long bytes;      /* bytes taken since the device started */
+  unsigned short sum;       /* and their sum */
+} stream_status;
+
+/* open the device at 'path', or the first hidraw of vid:pid if it's NULL */
+int StreamOpen(hid_stream *s, const char *path, unsigned short vid, unsigned short pid);
+
+void StreamClose(hid_stream *s);
+
+/* GET_FEATURE of the stream report */
+int StreamStatus(hid_stream *s, stream_status *st);
+
+/* send 'siz' bytes with up to 'window' frames in flight, 0 on success.
+   'packed' marks the frames of data packed by LzPack(), the device unpacks
+   them, and its bytes and sum count the packed bytes then */
+int StreamWrite(hid_stream *s, const void *dat, size_t siz, int window, int packed);
+
+/* send 'siz' bytes as HID_Test does, SET_FEATURE + GET_FEATURE a report,
+   with up to 'depth' commands in the queue of the device */
+int EchoWrite(hid_stream *s, const void *dat, size_t siz, int depth);
+
+/* the sum the device keeps of the stream */
+unsigned short StreamSum(const void *dat, size_t siz, unsigned short sum);
+
+#endif
@@ -0,0 +1,146 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        lz.c The LZ77 of lz.c of the firmware.
+ *
+ *---------------------------------------------------------------------------*/
+#include "lz.h"
+
+/*-----------------------------------------------------------------------------
+** 0x00..0x7F: n+1 literal bytes follow. 0x80..0xFF: a match of (t&0x7F)+3
+** bytes, the next byte is its distance-1 back in the output. the device
+** keeps a window of LZ_WINDOW bytes, so no match goes further back. the
+** packed data may be cut into frames anywhere, the device carries a token
+** over to the next frame.
+**---------------------------------------------------------------------------*/
+static int Literals(const unsigned char *src, size_t from, size_t to,
+                    unsigned char *dst, size_t *o, size_t room)
+{
+  size_t n;
+
+  while (from < to)
+  {
+    n = to-from < LZ_MAX_LITERAL? to-from:LZ_MAX_LITERAL;
+    if (*o+1+n > room)
+    {
+      return -1;
+    }
+    dst[(*o)++] = (unsigned char)(n-1);
+    while (n--)
+    {
+      dst[(*o)++] = src[from++];
+    }
+  }
+  return 0;
+}
+
+size_t LzPack(const void *src, size_t siz, void *dst, size_t room)
+{
+  const unsigned char *p = src;
+  unsigned char *q = dst;
+  size_t i = 0, lit = 0, o = 0, d, l, best, dist;
+
+  /* greedy, the longest match in the window at each byte, as the device */
+  while (i < siz)
+  {
+    best = dist = 0;
+    for (d=1; d<=LZ_WINDOW && d<=i; d++)
+    {
+      for (l=0; i+l<siz && l<LZ_MAX_MATCH && p[i+l-d]==p[i+l]; l++);
+      if (l > best)
+      {
+        best = l;
+        dist = d;
+      }
+    }
+    if (best >= LZ_MIN_MATCH)
+    {
+      if (Literals(p,lit,i,q,&o,room) != 0 || o+2 > room)
+      {
+        return 0;
+      }
+      q[o++] = (unsigned char)(0x80 | (best-LZ_MIN_MATCH));
+      q[o++] = (unsigned char)(dist-1);
+      i += best;
+      lit = i;
+    }
+    else
+    {
+      i++;
+    }
+  }
+  if (Literals(p,lit,siz,q,&o,room) != 0)
+  {
+    return 0;
+  }
+  return o;
+}
+
+size_t LzUnpack(const void *src, size_t siz, void *dst, size_t room)
+{
+  const unsigned char *p = src;
+  unsigned char *q = dst;
+  size_t i = 0, o = 0, n, d;
+
+  while (i < siz)
+  {
+    if (p[i] & 0x80)
+    {
+      if (i+1 >= siz)
+      {
+        return 0;
+      }
+      n = (p[i] & 0x7F)+LZ_MIN_MATCH;
+      d = p[i+1]+1u;
+      i += 2;
+      if (d > o || d > LZ_WINDOW || o+n > room)
+      {
+        return 0;
+      }
+      while (n--)
+      {
+        q[o] = q[o-d];
+        o++;
+      }
+    }
+    else
+    {
+      n = p[i++]+1u;
+      if (i+n > siz || o+n > room)
+      {
+        return 0;
+      }
+      while (n--)
+      {
+        q[o++] = p[i++];
+      }
+    }
+  }
+  return o;
+}
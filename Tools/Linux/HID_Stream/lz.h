@@ -0,0 +1,53 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        lz.h The LZ77 of lz.c of the firmware.
+ *
+ *---------------------------------------------------------------------------*/
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stddef.h>
+
+/* as lz.h of the firmware, the device keeps the last LZ_WINDOW bytes */
+#define LZ_WINDOW               64
+#define LZ_MIN_MATCH            3
+#define LZ_MAX_MATCH            130
+#define LZ_MAX_LITERAL          128
+
+/* the most bytes 'siz' bytes may take packed */
+#define LZ_BOUND(siz)           ((siz)+((siz)+LZ_MAX_LITERAL-1)/LZ_MAX_LITERAL)
+
+/* pack 'siz' bytes into 'dst', the packed bytes or 0 if they don't fit */
+size_t LzPack(const void *src, size_t siz, void *dst, size_t room);
+
+/* unpack 'siz' bytes into 'dst', the unpacked bytes or 0 on an error */
+size_t LzUnpack(const void *src, size_t siz, void *dst, size_t room);
+
+#endif
@@ -0,0 +1,231 @@
+/* ----------------------------------------------------------------------------
+ * Copyright (C) 2019-2020 Zach Lee.
+ *
+ * Licensed under the MIT License, you may not use this file except in
+ * compliance with the License.
+ *
+ * MIT License:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+ * Title:        main.c Stop-and-wait against the windowed stream.
+ *
+ *---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hidstream.h"
+#include "lz.h"
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/*-----------------------------------------------------------------------------
+** a log of a sensor node as it goes to a PC, a line every 100ms: the time,
+** a temperature and a supply voltage which wander slowly, and a state.
+**---------------------------------------------------------------------------*/
+static void Telemetry(unsigned char *dat, size_t siz)
+{
+  char line[64];
+  unsigned long ms = 0;
+  int temp = 2350, mv = 3300, n;
+  size_t i = 0;
+
+  while (i < siz)
+  {
+    temp += rand()%3-1;
+    mv += rand()%5-2;
+    n = snprintf(line,sizeof(line),"%lu,%d.%02d,%d,%s\n",ms,temp/100,
+                 temp%100,mv,rand()%50? "OK":"WARN");
+    ms += 100;
+    memcpy(dat+i,line,(size_t)n < siz-i? (size_t)n:siz-i);
+    i += n;
+  }
+}
+
+/* a stream of siz bytes, the device must have taken all of them once */
+static int Stream(hid_stream *s, const unsigned char *dat, size_t siz,
+                  int window, int packed, double *t)
+{
+  stream_status st0, st1;
+
+  if (StreamStatus(s,&st0) != 0)
+  {
+    printf("the firmware has no stream!\n");
+    return -3;
+  }
+  s->sent = s->resent = s->acks = s->syncs = 0;
+  *t = Seconds();
+  if (StreamWrite(s,dat,siz,window,packed) != 0 || StreamStatus(s,&st1) != 0)
+  {
+    printf("stream: FAILED\n");
+    return -2;
+  }
+  *t = Seconds()-*t;
+
+  /* the device sums what it has taken, nothing lost nor doubled */
+  return st1.bytes-st0.bytes == siz &&
+         st1.sum == StreamSum(dat,siz,st0.sum)? 0:-4;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = NULL;
+  int idx, window = 4, kbytes = 16, echo = 1, zip = 0, queue = 1, rv, d;
+  unsigned char *data, *packed;
+  size_t siz, n, i;
+  hid_stream s;
+  double t, t1;
+
+  /*---------------------------------------------------------------------------
+  ** hid_stream [-d /dev/hidrawN] [-k KB] [-w N] [-q N] [-s] [-z]
+  **   -d     the hidraw of the device instead of the first one of 096E:0100
+  **   -k KB  the size of the transfer, 16KB unless it's given
+  **   -w N   frames in flight, 4 unless it's given, the credit of the
+  **          device (STR_WINDOW of stream.h) bounds it as well
+  **   -q N   send the echo transfer with 1..N commands queued, one run of
+  **          each, N up to HID_QUEUE_SLOTS of hid.h. 1 unless it's given
+  **   -s     skip the stop-and-wait transfer of HID_Test
+  **   -z     send a telemetry log instead of random data, then send it
+  **          packed by lz.c as well and print the gain
+  **-------------------------------------------------------------------------*/
+  for (idx=1; idx<argc; idx++)
+  {
+    if (strcmp(argv[idx],"-d") == 0 && idx+1 < argc)
+    {
+      path = argv[++idx];
+    }
+    else
+    if (strcmp(argv[idx],"-k") == 0 && idx+1 < argc)
+    {
+      kbytes = atoi(argv[++idx]);
+    }
+    else
+    if (strcmp(argv[idx],"-w") == 0 && idx+1 < argc)
+    {
+      window = atoi(argv[++idx]);
+    }
+    else
+    if (strcmp(argv[idx],"-q") == 0 && idx+1 < argc)
+    {
+      queue = atoi(argv[++idx]);
+    }
+    else
+    if (strcmp(argv[idx],"-s") == 0)
+    {
+      echo = 0;
+    }
+    else
+    if (strcmp(argv[idx],"-z") == 0)
+    {
+      zip = 1;
+    }
+    else
+    {
+      printf("usage: hid_stream [-d /dev/hidrawN] [-k KB] [-w N] [-q N] "
+             "[-s] [-z]\n");
+      return -1;
+    }
+  }
+  if (kbytes <= 0 || window < 1 || window > 127 || queue < 1 || queue > 128)
+  {
+    printf("-k must be above 0, -w 1..127 and -q 1..128\n");
+    return -1;
+  }
+
+  if (StreamOpen(&s,path,0x096E,0x0100) != 0)
+  {
+    printf("Device not found!\n");
+    return -1;
+  }
+
+  siz = (size_t)kbytes*1024;
+  data = (unsigned char*)malloc(siz+LZ_BOUND(siz));
+  if (data == NULL)
+  {
+    return -5;
+  }
+  packed = data+siz;
+  if (zip)
+  {
+    Telemetry(data,siz);
+  }
+  else
+  {
+    for (i=0; i<siz; i++)
+    {
+      data[i] = (unsigned char)rand();
+    }
+  }
+
+  for (d=1; echo && d<=queue; d++)
+  {
+    t = Seconds();
+    rv = EchoWrite(&s,data,siz,d);
+    t = Seconds()-t;
+    if (rv != 0)
+    {
+      printf("echo, %d queued: FAILED (%d)\n", d, rv);
+      return -2;
+    }
+    printf("echo, %d queued: %zu bytes in %.2f s, %.2f KB/s\n",
+           d, siz, t, siz/1024.0/t);
+  }
+
+  rv = Stream(&s,data,siz,window,0,&t);
+  if (rv == -3 || rv == -2)
+  {
+    return rv;
+  }
+  printf("stream, %d in flight: %zu bytes in %.2f s, %.2f KB/s, %s\n",
+         window, siz, t, siz/1024.0/t, rv == 0? "sum ok":"SUM FAILED");
+  printf("%lu frames, %lu sent again, %lu acks, %lu timeouts\n",
+         s.sent-s.resent, s.resent, s.acks, s.syncs);
+
+  if (zip && rv == 0)
+  {
+    /*-------------------------------------------------------------------------
+    ** the same data packed, the device unpacks it in STR_wRead(). the rate
+    ** of the frames is the same, so the data goes faster by the ratio.
+    **-----------------------------------------------------------------------*/
+    n = LzPack(data,siz,packed,LZ_BOUND(siz));
+    rv = Stream(&s,packed,n,window,1,&t1);
+    if (rv == -3 || rv == -2)
+    {
+      return rv;
+    }
+    printf("packed, %d in flight: %zu bytes in %zu (%.0f%%) in %.2f s, "
+           "%.2f KB/s of data, %.2fx, %s\n", window, siz, n, n*100.0/siz,
+           t1, siz/1024.0/t1, t/t1, rv == 0? "sum ok":"SUM FAILED");
+  }
+
+  free(data);
+  StreamClose(&s);
+  return rv;
+}
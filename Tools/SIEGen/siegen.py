@@ -0,0 +1,1490 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright (C) 2019-2020 Zach Lee.
+#
+# Licensed under the MIT License, you may not use this file except in
+# compliance with the License.
+#
+# MIT License:
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# ----------------------------------------------------------------------------
+#
+# Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+# Title:        siegen.py Generates sie.s for a chosen instruction clock.
+#
+# The receive loop, the transmit loop and the handshake code of sie.s are
+# described below as instruction lists. Every instruction knows its cost, so
+# the generator inserts the nop padding which puts each D-/D+ sample, each
+# _LATU toggle and each branch at the right cycle of a bit, and writes the
+# cycle of every instruction into its comment. If the work of a bit doesn't
+# fit into the cycles of the bit, no file is written at all.
+#
+# usage: siegen.py --target dsPIC33 --fcy 15 [--endpoints 1] [--frc] -o sie.s
+#
+# ----------------------------------------------------------------------------
+import argparse
+import math
+import os
+import sys
+
+BIT_RATE = 1.5                      # low speed USB, Mbit/s
+TRIM_DEADBAND = 0.2                 # % of the FRC trimming, as usb.c
+TEMPLATE = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'sie.s.in')
+
+TARGETS = {
+    'dsPIC33': {
+        'device': ['.equ    __33FJ12MC201, 1', '.include "p33FJ12MC201.inc"'],
+        'name':   'dsPIC33FJ12MC201',
+        'maxfcy': 40,
+        'pll':    True,             # 8MHz crystal and PLL, see __user_init
+        'frc':    (7.37, 0.375),    # FRC in MHz, OSCTUN step in %
+        'adref':  'DS70265E-page-120',
+    },
+    'PIC24F': {
+        'device': ['.equ    __24F16KA101, 1', '.include "p24F16KA101.inc"'],
+        'name':   'PIC24F16KA101',
+        'maxfcy': 16,
+        'pll':    False,            # crystal of 2*Fcy, no PLL
+        'frc':    (8.0, 0.4),       # FRCPLL is 4*FRC, the step is about 0.4%
+        'adref':  'DS39927C-page-114',
+    },
+}
+
+
+class GenError(Exception):
+    pass
+
+
+# ----------------------------------------------------------------------------
+# items of a block
+# ----------------------------------------------------------------------------
+class I(object):
+    """an instruction. 'cmt' is the comment after the cycle number."""
+    def __init__(self, mn, ops='', cmt='', tag=None, ann=True, cont=None):
+        self.mn, self.ops, self.cmt, self.tag = mn, ops, cmt, tag
+        self.ann, self.cont = ann, cont
+
+    def is_skip(self):
+        return self.mn in ('btsc', 'btss', 'btsc.b', 'btss.b')
+
+    def is_bra(self):
+        return self.mn == 'bra'
+
+    def target(self):
+        """(condition, target) of a 'bra'."""
+        parts = [p.strip() for p in self.ops.split(',')]
+        if len(parts) == 2:
+            return parts[0], parts[1]
+        return None, parts[0]
+
+    def is_computed(self):
+        if not self.is_bra():
+            return False
+        cc, tgt = self.target()
+        return cc is None and tgt[0] == 'w' and tgt[1:].isdigit()
+
+
+class L(object):
+    """a label. '{p}' in 'cmt' is replaced by the cycle before the label,
+    that is the 2nd cycle of the branch which jumps here."""
+    def __init__(self, name, cmt='', inline=False):
+        self.name, self.cmt, self.inline = name, cmt, inline
+
+
+class C(object):
+    """a comment line."""
+    def __init__(self, text):
+        self.text = text
+
+
+class Pad(object):
+    """nop padding. the instruction tagged 'anchor' (or the end of the block
+    when anchor is 'END') is delayed until
+
+        at    - an absolute cycle. it's an error if it's already later,
+        phase - the next cycle with this phase (1..N of a bit),
+        label - the phase of a label plus 'offset',
+
+    'after' is (label, tag) or (label, tag, slack). the anchor is delayed by
+    whole bits until the response which the code at 'label' starts at 'tag'
+    is 2 bits later than the EOP. slack is the cycles from the anchor to
+    'label'."""
+    def __init__(self, anchor, at=None, phase=None, label=None, offset=0,
+                 after=None, tol=0, cmt='', why='', ann=True):
+        self.anchor, self.at, self.phase = anchor, at, phase
+        self.ann = ann
+        self.label, self.offset, self.after, self.tol = label, offset, after, tol
+        self.cmt, self.why = cmt, why
+        self.cycles = 0
+
+
+class Table(object):
+    """the branch table after a 'bra wN'."""
+    def __init__(self, label, entries, cmt=''):
+        self.label, self.entries, self.cmt = label, entries, cmt
+
+
+class Raw(object):
+    """lines copied as they are. they are not timed."""
+    def __init__(self, lines):
+        self.lines = lines
+
+
+class Block(object):
+    """a sequence of items starting at cycle 'entry'. entry=None means the
+    block is not timed (it polls the bus or it runs after the packet).
+    'length' is the cycles of the bits the block runs in, the cycle 1 is the
+    first cycle of a bit."""
+    def __init__(self, entry, items, sep=True, length=None):
+        self.entry, self.items, self.sep = entry, items, sep
+        self.length = length
+
+
+# ----------------------------------------------------------------------------
+# the time grid of the bits
+# ----------------------------------------------------------------------------
+class Grid(object):
+    def __init__(self, fcy, crc=False, eps=1):
+        self.fcy, self.crc, self.eps = fcy, crc, eps
+        self.n = fcy / BIT_RATE         # it could be a fraction
+        self.N = int(round(self.n))     # cycles of a bit out of the loops
+        self.S = self.N // 2            # cycle of a bit to sample D-/D+
+        self.fractional = abs(self.n - self.N) > 1e-9
+        # a byte takes floor(8*n) cycles, the bits of it are 1 cycle longer
+        # or shorter than each other. the long bits go to __bit7 and __bit0,
+        # they have the most work to do.
+        pat = [int(math.floor((i + 1) * self.n + 1e-9)) -
+               int(math.floor(i * self.n + 1e-9)) for i in range(8)]
+        r = max(range(8), key=lambda i: (pat[i], pat[(i + 1) % 8], -i))
+        pat = pat[r:] + pat[:r]
+        self.L = dict(zip((7, 0, 1, 2, 3, 4, 5, 6), pat))
+
+    def phase(self, t, length=None):
+        """phase of the absolute cycle t, 1..length. cycle 0 is the last
+        cycle of the previous bit."""
+        return (t - 1) % (length or self.N) + 1
+
+    def show(self, t, length=None):
+        """the cycle number written in the comments, the last cycle of a bit
+        is written as 0."""
+        return str(self.phase(t, length) % (length or self.N))
+
+    def byte(self):
+        return sum(self.L.values())
+
+    def drift(self, nbytes=11):
+        """the earliest and the latest sample of a bit against the middle of
+        the bit sent by the host, in cycles. a packet of nbytes after SYNC
+        is received with no stuff-bit and with a stuff-bit after every 6
+        bits."""
+        lo = hi = 0.0
+        for stuff in (False, True):
+            t, bit, ones = 0.0, 0, 0
+            for i in range(nbytes * 8):
+                k = (7, 0, 1, 2, 3, 4, 5, 6)[i % 8]
+                t += self.L[k]
+                bit += 1
+                ones += 1
+                if stuff and ones == 6:
+                    t += self.N
+                    bit += 1
+                    ones = 0
+                err = t - bit * self.n
+                lo, hi = min(lo, err), max(hi, err)
+        return lo, hi
+
+    def tolerance(self, nbytes=11):
+        """the clock error the samples of a packet of nbytes stand, the
+        drift of the bit loops is taken off the margin of N/4 cycles."""
+        lo, hi = self.drift(nbytes)
+        bits = nbytes * 8 * 7 / 6.0     # a stuff-bit after every 6 bits
+        return (self.N / 4.0 - max(-lo, hi)) / (bits * self.n)
+
+
+# ----------------------------------------------------------------------------
+# the interrupt service routine
+# ----------------------------------------------------------------------------
+def rx_reg(k):
+    """the register which samples D-/D+ in the slot of bit k."""
+    return 'w1' if k in (7, 1, 3, 5) else 'w0'
+
+
+def other(r):
+    return 'w0' if r == 'w1' else 'w1'
+
+
+def stuff_names(g, length):
+    """labels of the __dostuff for bits of 'length' cycles."""
+    if not g.fractional:
+        return '__dostuff', '__done'
+    return '__dostuff%d' % length, '__done%d' % length
+
+
+def crc_update():
+    """CRC16 and CRC5 of the bit in w5.0. w5.0 is the complement of the bit,
+    so the polynomial is applied if bit0 of the CRC equals to w5.0."""
+    return [
+        I('xor', 'w7, w5, w4', '(w7 =CRC16 of the bits after PID,'),
+        I('lsr', 'w7, w7', ' w4.0 =0 if the polynomial is'),
+        I('btss', 'w4, #0', ' applied, w9 =0xA001)'),
+        I('xor', 'w7, w9, w7'),
+        I('xor', 'w8, w5, w4', '(w8 =CRC5 of the same bits)'),
+        I('lsr', 'w8, w8'),
+        I('btss', 'w4, #0'),
+        I('xor', '#0x14, w8', '(0x14 is the polynomial of CRC5)'),
+    ]
+
+
+def endp_table(g, name, ep0, epn):
+    """the branch table on the ENDP field of a token. w0 is the address byte
+    and the byte after it is still in the buffer, both are complemented. the
+    index is ~ENDP[3-1]:ENDP[0], so the table is upside down. an endpoint
+    which isn't in __eptab is ignored and the host times out."""
+    entries = []
+    for i in range(16):
+        ep = ((7 - (i >> 1)) << 1) | (i & 1)
+        if ep == 0:
+            entries.append((ep0, 'ENDP = 0'))
+        elif ep <= g.eps:
+            entries.append((epn % ep, 'ENDP = %d' % ep))
+        else:
+            entries.append(('__CNIntEnd', 'ENDP = %d (no such endpoint)' % ep))
+    return [
+        I('mov.b', '[w1+1], w3', '(w3[2-0] =~ENDP[3-1])'),
+        I('and', 'w3, #0x07, w3'),
+        I('btst.c', 'w0, #7', '(SR.C =ENDP[0])'),
+        I('rlc', 'w3, w3', '(w3 =index of the endpoint)'),
+        I('bra', 'w3'),
+        Table(name, entries),
+    ]
+
+
+def isr(g):
+    N, S = g.N, g.S
+    E = S + 3                           # cycle of 'bra z, __EOPHit'
+    H = 1                               # __HandShake starts a bit
+    blocks = []
+    add = blocks.append
+
+    # ------------------------------------------------------------------ entry
+    add(Block(6, [
+        L('__CNInterrupt', 'cycle-counter (5 cycles latency ISR)'),
+        I('push.s', '', '(w0-w3 could be used now)'),
+        I('push', 'RCOUNT', '(a REPEAT broken into goes on later)'),
+        I('mov', '_PORTU, w0', 'sample D-/D+'),
+        I('and', '#DPDM, w0', '(is it a SE0?)'),
+        I('bra', 'z, __SE0', '(SE0, BUS RESET or RESUME)'),
+    ], sep=False))
+    waitk = [L('__waitK'),
+             C('step 2: capture the edge between J & K')]
+    for i in range((N + 1) // 2):
+        waitk += [I('btsc', '_PORTU, #DP', ann=False),
+                  I('bra', '__firstK', ann=False)]
+    add(Block(None, [
+        L('__waitJ'),
+        C('last 3 bits (JKK) of SYNC is important'),
+        C('step 1: make sure the current bit is a J (D-/D+ =10)'),
+        I('btss', '_PORTU, #DM', ann=False),
+        I('bra', '__waitJ', ann=False),
+    ] + waitk))
+    add(Block(None, [
+        L('__SOPError'),
+        I('bset', '__ucontr0, #15', '__ucontr0[15] =1 means SOP ERROR', ann=False),
+        I('bra', '__IRQExit', ann=False),
+    ]))
+
+    # -------------------------------------------------------- SE0 and RESET
+    add(Block(12, [
+        L('__SE0', "{p} (add 1 cycle for 'bra z, __SE0')"),
+        Pad('se0a', at=N + S, why='__SE0'),
+        I('mov', '_PORTU, w0', '(sample D-/D+)', tag='se0a'),
+        I('and', '#DPDM, w0', '(is it a SE0 yet?)'),
+        I('bra', 'nz, __IRQExit', '(no, just ignore it)'),
+        Pad('se0b', at=2 * N + S, why='__SE0',
+            cmt='(2nd SE0 detected, if a J-state is following, that would '
+                'be keep alive signal)'),
+        I('mov', '#(1<<DM), w1'),
+        I('mov', '_PORTU, w0', '(sample D-/D+)', tag='se0b'),
+        I('and', '#DPDM, w0', '(is it a SE0 yet?)'),
+        I('bra', 'z, __BUSReset', '(3rd SE0 detected, a BUS RESET)'),
+        I('cp', 'w0, w1', '(J-state?)'),
+        I('bra', 'z, __keepAlive'),
+        I('bra', '__IRQExit'),
+    ]))
+    reset = 2 * N + S + 4               # 'bra z, __BUSReset' is taken
+    add(Block(reset, [
+        L('__BUSReset'),
+        Pad('rs', at=reset + N, cmt='%d cycles for 1 bits' % N, ann=False),
+        I('mov', '_PORTU, w0', 'resample D-/D+ after %d cycles(%.1fuS)'
+          % (reset + N - 1, (reset + N - 1) / g.fcy), tag='rs', ann=False),
+        I('and', '#DPDM, w0', 'is it still a SE0?', ann=False),
+        I('bra', 'nz, __IRQExit', 'not a SE0, just exit', ann=False),
+        I('mov', '#_token, w0', 'vars reinitializing for BUS RESET', ann=False),
+        I('mov', 'w0, _packet', 'prepare for first SETUP token', ann=False),
+        I('mov', '#0, w0', 'clear some vars', ann=False),
+        I('mov.b', 'WREG, _addr', 'usb device address must be cleared', ann=False),
+        I('mov.b', 'WREG, _conf', 'so must the configuration', ann=False),
+        I('mov', 'WREG, __uendpt0', ann=False),
+        I('mov', '#0x000A, w0', '__ucontr0[1-0] =10, NAK to IN token', ann=False),
+        I('mov', 'WREG, __ucontr0', '__ucontr0[3-2] =10, NAK to OUT token', ann=False),
+        I('rcall', '__EPReset', 'NAK and DATA0 on the other endpoints', ann=False),
+        I('bset', '__uendpt0, #11', '__uendpt0[11] =1 means BUS RESET', ann=False),
+        I('bset', '__uendpt0, #10', 'REQUEST FLAG =1, inform the app', ann=False),
+        I('bra', '__IRQExit', 'a BUS RESET issued', ann=False),
+    ]))
+    add(Block(None, [
+        L('__keepAlive', 'a new frame of 1ms begins'),
+        I('mov', 'TMR3, w0', 'take the time of it, usb.c trims the', ann=False),
+        I('mov', 'w0, __frametime', 'FRC by the length of 8 frames', ann=False),
+        I('inc', '__frame', 'count it', ann=False),
+        I('bra', '__IRQExit', ann=False),
+    ]))
+
+    # ------------------------------------------------------------ SYNC field
+    add(Block(5, [
+        L('__firstK', '(4 cycles maximum latency)'),
+        Pad('k2', at=N + S, why='__firstK'),
+        I('mov', '_packet, w2', '(w2 points to the rx buffer)'),
+        I('setm.b', '[w2]', '(the SYNC byte will be 0x7F)'),
+        I('bset', 'w1, #DP', '(w1.0 =D+ =1, 1st K)'),
+        I('bset', 'w0, #DP', '(w0.0 =D+ =1, 2nd K)'),
+        I('push', 'w4', '(we need more registers)'),
+        I('push', 'w5'),
+        I('setm', 'w5', '(for bit unstuff)'),
+        I('mov', '#0x003f, w3'),
+        I('btsc', '_PORTU, #DP', '(capture the second K)', tag='k2'),
+        I('bra', '__SyncEnd', "(add 1 cycle if 'bra' is taken)"),
+        I('pop', 'w5', '(current bit is J, not 2nd K)'),
+        I('pop', 'w4'),
+        I('bra', '__waitK'),
+    ]))
+    add(Block(N + S + 3, [
+        L('__SyncEnd', "{p} (add 1 cycle for 'bra __SyncEnd')"),
+        I('push', 'w6', '(more register)'),
+    ] + ([
+        I('push', 'w7', '(CRC16 of DATA0/DATA1)'),
+        I('push', 'w8', '(CRC5 of tokens)'),
+        I('push', 'w9'),
+        I('mov', '#0xA001, w9', '(the polynomial of CRC16)'),
+        I('add', 'w2, #2, w6', '(w6 points to the byte after PID)'),
+    ] if g.crc else []) + [
+        Pad('END', at=2 * N + 1, why='__SyncEnd',
+            cmt='(maximum 12 bytes received, last bit of SYNC will be '
+                'processed)'),
+    ]))
+
+    # ------------------------------------------------------- receive loop
+    notes = {7: 'w1.DP & w0.DP capture the level of DP',
+             0: 'now w0.DP is prev sample of DP',
+             1: 'now w1.DP is prev sample of DP'}
+    for k in (7, 0, 1, 2, 3, 4, 5, 6):
+        a = rx_reg(k)
+        b = other(a)
+        nxt = (k + 1) % 8
+        full = k in (7, 0, 6)
+        Lk = g.L[k]
+        it = [
+            L('__bit%d' % k, notes.get(k, '')),
+            I('xor', 'w0, w1, %s' % a, "(if %s.DP =0, means 'no_switched')" % a),
+            I('btst.c', '%s, #DP' % a, ('(move %s.DP into SR.C. it\'s bit%d)' if full
+                                       else '(move %s.DP into SR.C)') % ((a, k) if full else a)),
+            I('rlc.b', 'w5, w5', '(then shift this bit into w5)' if full
+              else '(shift bit%d into w5)' % k),
+        ]
+        if g.crc and k != 0:
+            it += crc_update()
+        it += [
+            I('btst.c', 'w5, #0', '(move this bit into SR.C again)' if full
+              else '(gather this bit if it is not a'),
+            Pad('smp', at=S, why='__bit%d' % k),
+            I('mov', '_PORTU, %s' % a, '(bit%d or a stuff-bit is sampled)' % nxt,
+              tag='smp'),
+            I('rrc.b', '[w2], [w2++]' if k == 7 else '[w2], [w2]',
+              '(gather bit7, w2 =the next byte)' if k == 7 else
+              '(gather this bit)' if full else ' stuff-bit)'),
+        ]
+        if k in (7, 0):
+            it += [
+                Pad('eop', at=E, why='__bit%d' % k),
+                I('and.b', '%s, #DPDM, w4' % a, '(terminate the RX loop if this bit'),
+                I('bra', 'z, __EOPHit', ' is the 1st SE0 of EOP)', tag='eop'),
+            ]
+        if g.crc and k == 7:
+            it += [
+                I('cp', 'w2, w6', '(is the PID byte gathered now?)'),
+                I('btsc', '_SR, #Z', '(yes, CRC16 and CRC5 start from the'),
+                I('setm', 'w7', ' next bit, the 1st bit after PID)'),
+                I('btsc', '_SR, #Z'),
+                I('mov', '#0x1F, w8'),
+            ]
+        if g.crc and k == 0:
+            it += crc_update()          # not a bit of data if EOP is here
+        if k == 6:
+            it += [
+                Pad('stf', at=Lk - 2, why='__bit6'),
+                I('and.b', 'w3, w5, w4', '(is there a 6-b-1 in lsb of w5?)'),
+                I('bra', 'z, __unstuff7', "(add 1 cycle if 'bra z' is taken)",
+                  tag='stf'),
+                I('bra', '__bit7'),
+            ]
+        else:
+            it += [
+                Pad('stf', at=Lk, why='__bit%d' % k),
+                I('and.b', 'w3, w5, w4', '(is there a 6-b-1 in lsb of w5?)' if full
+                  else '(prev D-/D+ is in %s)' % b),
+                I('bra', 'z, __unstuff%d' % nxt, "(add 1 cycle if 'bra z' is taken)",
+                  tag='stf'),
+            ]
+        add(Block(1, it, length=Lk))
+    for u in range(8):
+        x = rx_reg((u - 1) % 8)         # it sampled the stuff-bit
+        y = other(x)
+        # a stuff-bit takes N cycles. __unstuff7 is entered at the last
+        # cycle of __bit6, the others at cycle 2 of the stuff-bit.
+        it = [L('__unstuff%d' % u, "{p} (+1 cycle for 'bra z,__unstuff%d')" % u)]
+        if u == 7:
+            it += [Pad('xor', at=1, cmt='(stuff-bit cycle ends here)')]
+        it += [
+            I('xor', 'w0, w1, %s' % y, '(%d cycles of the next-bit)' % N, tag='xor'),
+            I('btst.c', '%s, #DP' % y, '(%s.DP should be 1)' % y),
+            I('rlc.b', 'w5, w5', '(shift this 1 into w5)'),
+            I('mov', '%s, %s' % (x, y), '(discard sample of the stuff-bit)'),
+            Pad('smp', at=S, tol=1, why='__unstuff%d' % u),
+            I('mov', '_PORTU, %s' % x, '(sample the next bit)', tag='smp'),
+        ]
+        if u in (0, 1):
+            it += [
+                Pad('eop', at=E, why='__unstuff%d' % u),
+                I('and.b', '%s, #DPDM, w4' % x, '(terminate the RX loop if this bit'),
+                I('bra', 'z, __EOPHit', ' is the 1st SE0 of EOP)', tag='eop'),
+            ]
+        it += [
+            Pad('back', at=N - 1, why='__unstuff%d' % u),
+            I('bra', '__bit%d' % u, tag='back'),
+        ]
+        add(Block(0 if u == 7 else 2, it))
+
+    # ---------------------------------------------------------- EOP and PID
+    add(Block(E + 2, [
+        L('__EOPHit', "{p} (+1 cycle for 'bra    z, __EOPHit')"),
+        I('mov', '_packet, w1'),
+        I('nop', '', '(first cycle of 2nd SE0)' if E + 3 == N + 1 else ''),
+        I('com.b', '[++w1], w0', '(we need to check the PID byte)'),
+        I('and', 'w0, #0xF, w0', '(discard nPID at high nibble)'),
+        I('bra', 'w0'),
+        Table('__BranchTable0', [
+            ('__PIDError', '(undefined PID)'),
+            ('__isOut', 'PID = 0001 (OUT)'),
+            ('__isAck', 'PID = 0010 (ACK)'),
+            ('__isData0', 'PID = 0011 (DATA0)'),
+            ('__PIDError', '(undefined PID)'),
+            ('__PIDError', 'PID = 0101 (SOF) not supported'),
+            ('__PIDError', '(undefined PID)'),
+            ('__PIDError', '(undefined PID)'),
+            ('__PIDError', '(undefined PID)'),
+            ('__isIn', 'PID = 1001 (IN)'),
+            ('__isNak', 'PID = 1010 (NAK)'),
+            ('__isData1', 'PID = 1011 (DATA1)'),
+            ('__PIDError', 'PID = 1100 (PRE) not supported'),
+            ('__isSetup', 'PID = 1101 (SETUP)'),
+            ('__isStall', 'PID = 1110 (STALL)'),
+            ('__PIDError', '(undefined  PID)'),
+        ]),
+    ]))
+    pid = E + 10                        # the PID handlers start here
+    # the residuals of CRC5 and CRC16 are 0x06 and 0xB001 for a good packet
+    crc5 = [
+        I('cp', 'w8, #0x06', '(CRC5 of the token MUST be correct)'),
+        I('bra', 'nz, __CNIntEnd', '(a bad token, just ignore it)'),
+    ] if g.crc else []
+    crc16 = [
+        I('mov', '#0xB001, w0', '(CRC16 of the data MUST be correct,'),
+        I('cp', 'w7, w0', ' or no handshake is sent and the'),
+        I('bra', 'nz, __CNIntEnd', ' host will send it again)'),
+    ] if g.crc else []
+    add(Block(pid, [
+        L('__PIDError', 'continue 2nd SE0 of EOP'),
+        I('bset', '__ucontr0, #14', '(__ucontr0[14] =1 means PID ERROR)'),
+        I('bra', '__CNIntEnd'),
+    ]))
+    add(Block(pid, [
+        L('__isSetup'),
+        I('mov', '#_token, w0', "(buffer '_token' will be also used"),
+        I('mov', 'WREG, _packet', ' to gather UNRELATED packet)'),
+        I('com.b', '[++w1], w0', '(fetch the device address byte)'),
+        I('and', '#0x7F, w0'),
+        I('cp.b', '_addr', '(device address MUST be matched)'),
+        I('bra', 'nz, __CNIntEnd', '(+1 cycle if address not matched)'),
+    ] + crc5 + [
+        I('bset', '__ucontr0, #13', '(__ucontr0[13] =1, address matched)'),
+        I('clr', '_epout', '(the DATA packet is not for EPn)'),
+        I('mov', '#_datax, w0', "(buffer '_datax' will be used to "),
+        I('mov', 'WREG, _packet', ' gather SETUP packet)'),
+        I('clr.b', '__uendpt0', '(clear the length/toggle/handshake)'),
+        I('bclr', '__ucontr0, #12', '(__ucontr0[12] =0,DATA1 for IN/OUT)'),
+        I('bclr', '__ucontr0, #11', '(a SETUP clears the EP0 STALL FLAG)'),
+        I('bra', '__CNIntEnd', '(__uendpt0[1-0] is 00 now. it will',
+          cont=' be 01. means a SETUP TOKEN)'),
+    ]))
+    add(Block(pid, [
+        L('__isOut', 'continue 2nd SE0 of EOP'),
+        I('mov', '#_token, w0', "(buffer '_token' will be also used"),
+        I('mov', 'WREG, _packet', ' to gather UNRELATED packet)'),
+        I('com.b', '[++w1], w0', '(device address byte, w0.7 =ENDP[0])'),
+    ] + endp_table(g, '__EndpointTableOut', '__isOut0', '__outEP%d')))
+    add(Block(pid + 11, [
+        L('__isOut0', "{p} (+1 cycle for the entry of the table)"),
+        I('cp.b', '_addr', '(device address MUST be matched)'),
+        I('bra', 'nz, __CNIntEnd', '(+1 cycle if address not matched)'),
+    ] + crc5 + [
+        I('bset', '__ucontr0, #13', '(__ucontr0[13] =1, address matched)'),
+        I('clr', '_epout', '(the DATA packet is not for EPn)'),
+        I('mov', '#_datax, w0', "(buffer '_datax' is used for DATA0)"),
+        I('btss', '__uendpt0, #3', "(buffer '_datay' is used for DATA1)"),
+        I('mov', '#_datay, w0', '(use _datay if DATA TOGGLE is 0)'),
+        I('mov', 'w0, _packet', '(prepare to gather the DATA packet)'),
+        I('bra', '__CNIntEnd', '(__uendpt0[1-0] will be switched to',
+          cont=[' 11 when we respond an ACK to the', '  host)']),
+    ]))
+    # w3 points to the entry of the endpoint in __eptab from here on
+    for n in range(1, g.eps + 1):
+        add(Block(pid + 11, [
+            L('__outEP%d' % n, "{p} (+1 cycle for the entry of the table)"),
+            I('mov', '#__eptab+%d, w3' % (8 * (n - 1)), '(w3 points to EP%d)' % n),
+            I('bra', '__isOutEP'),
+        ]))
+    # the DATA packet goes into the OUT buffer of the endpoint only if it's
+    # armed, it can't overwrite a packet which the application hasn't read
+    add(Block(pid + 14, [
+        L('__isOutEP', "{p} (+1 cycle for 'bra __isOutEP')"),
+        I('and', '#0x7F, w0', '(discard ENDP[0])'),
+        I('cp.b', '_addr', '(device address MUST be matched)'),
+        I('bra', 'nz, __CNIntEnd', '(+1 cycle if address not matched)'),
+    ] + crc5 + [
+        I('bclr', '__ucontr0, #13', '(the DATA packet is not for EP0,'),
+        I('mov', 'w3, _epout', ' but for this endpoint)'),
+        I('mov', '[w3+2], w0', '(w0 =OUT word of the endpoint)'),
+        I('and', '#0x0C, w0', '(fetch OUT word[3-2])'),
+        I('cp.b', 'w0, #0x04', '(is it an ACK?)'),
+        I('mov', '[w3+6], w0', '(its OUT buffer is used if it is'),
+        I('btsc', '_SR, #Z', ' armed, or the packet goes to'),
+        I('mov', 'w0, _packet', " '_token')"),
+        I('bra', '__CNIntEnd'),
+    ]))
+    # the handshake must not start earlier than 2 bits after the EOP
+    hs_min = dict(label='__HandShake', offset=-2, after=('__HandShake', 'resp'))
+    add(Block(pid, [
+        L('__isData1', 'continue 2nd SE0 of EOP'),
+        I('btss', '__ucontr0, #13', '(device address MUST be matched)'),
+        I('bra', '__epData1', '(+1 cycle if it is not for EP0)'),
+    ] + crc16 + [
+        Pad('hs', **hs_min),
+        I('mov', '__ucontr0, w3', '(continue if dev addr is matched)'),
+        I('and', '#0x0C, w3', '(fetch __ucontr0[3-2])'),
+        I('mov', '#0x03, w0', '(TOKEN TYPE =11, it is OUT)'),
+        I('ior', 'w0, w3, w4', '(response and TOKEN TYPE in w4)'),
+        I('cp.b', 'w3, #0x04', '(is it an ACK?)'),
+        I('btsc', '_SR, #Z', '(not an ACK, skip toggle bit)'),
+        I('bset', '__uendpt0, #3', '(__uendpt0[3] =1, DATA1)'),
+        I('mov', '#_token+1, w6', '(w6 points to the PID byte)'),
+        I('bra', '__HandShake', '(send handshake to the host)', tag='hs'),
+    ]))
+    add(Block(pid, [
+        L('__isData0', 'data packet for SETUP or OUT ?'),
+        I('btss', '__ucontr0, #13', '(device address MUST be matched)'),
+        I('bra', '__epData0', '(+1 cycle if it is not for EP0)'),
+    ] + crc16 + [
+        Pad('END', label='__HandShake', after=('__HandShake', 'resp', 2)),
+        I('mov', '__ucontr0, w3', '(continue if dev addr is matched)'),
+        I('and', '#0x0C, w3', '(fetch __ucontr0[3-2])'),
+        I('mov', '#0x03, w0', '(TOKEN TYPE =11, it is OUT)'),
+        I('ior', 'w0, w3, w4', '(response and TOKEN TYPE in w4)'),
+        I('btss', '__uendpt0, #0', '(change response and TOKEN TYPE'),
+        I('mov', '#0x05, w4', ' if current token is SETUP)'),
+        I('cp.b', 'w3, #0x04', '(is it an ACK for OUT?)'),
+        I('btsc', '_SR, #Z', "(not ACK, skip 'bclr __uendpt0, #3)"),
+        I('bclr', '__uendpt0, #3', '(clear toggle bit)'),
+        I('mov', '#_token+1, w6', '(w6 points to the PID byte)'),
+    ]))
+
+    # ----------------------------------------------------- transmit a packet
+    add(Block(H, [
+        L('__HandShake', 'handshake according to w4[3-2]'),
+        I('sub', 'w2, w1, w2'),
+        I('mov', '#2, w1', '(w1 =2 means 2 bytes will be sent)'),
+        I('and', 'w4, #0x0C, w0', '(w4[3-2] =handshake)'),
+        I('cp.b', 'w0, #0x04', '(is it an ACK? w0[3-0] =0100?)'),
+        I('btsc', '_SR, #Z', "(not ACK, skip 'bclr w0, #2')"),
+        I('bclr', 'w0, #2', '(w0[3-0] =0000 now)'),
+        I('bset', 'w0, #1', '(this bit is always 1)'),
+        L('__SendBytes', 'now w0 =PID, w1 =bytes length'),
+        I('com', 'w0, w5', '(w5 will be the PID sent to host)'),
+        I('swap.b', 'w0', '(calclate 4 bits nPID)'),
+        I('and', '#0x0F, w5'),
+        I('ior', 'w0, w5, w5'),
+        I('mov.b', 'w5, [w6--]', '(w5 is the PID sent to the host)'),
+        I('setm.b', '[w6]', '(w6 points to the SYNC byte)'),
+        I('bclr.b', '[w6], #7', '(clear bit7 of SYNC, so SYNC =7F)'),
+        I('dec', 'w2, [w15++]', '(w2 -PID, then push into stack)'),
+        I('bclr', '_LATU, #DP', '(D- =0 and D+ =0, a SE0)'),
+        I('bclr', '_LATU, #DM', '(they are not sent, _TRISU =1 now)'),
+        I('push', '_LATU', '(push a SE0 on the top of stack)'),
+        I('bset', '_LATU, #DM', '(D- =1 and D+ =0, a J-state)'),
+        Pad('resp', phase=1, why='__SendBytes'),
+        I('mov', '#~DPDM, w0', '(set pins D-/D+ to OUTPUT mode)'),
+        L('__Sending', 'start to output all signals'),
+        I('and', '_TRISU', '(now output a J-state first)', tag='resp'),
+        I('and', 'w4, #0x0C, w0', '(is it an ACK sent to host?)'),
+        I('cp.b', 'w0, #0x04', '(yes, we need to clear the low'),
+        I('mov', '#0xFF08, w0', ' byte of __uendpt0 except bit3)'),
+        I('btsc', '_SR, #Z', '(now w6 points to the SYNC byte)'),
+        I('and', '__uendpt0', '(clear __uendpt0[7-4,2-0])'),
+        I('mov', '#0xFFFF, w5', '(w5 is initialized for bit-stuff)'),
+        I('mov', '#DPDM, w0', '(D-/D+ xor w0, make J-K flipping)'),
+        Pad('END', phase=1, why='__Sending'),
+        I('rrc.b', '[w6++], w3', '(fetch the first byte to be sent,'),
+        I('rlc.b', 'w5, w5', ' bit0 is in SR.C, shift it into w5)'),
+    ]))
+    for k in range(8):
+        s1 = '__bit%ds' % ((k + 1) % 8)
+        Lk = g.L[k]
+        ds, dn = stuff_names(g, Lk)
+        it = [L('__bit%d_' % k, inline=True),
+              I('xor', '_LATU', '(send bit0, lsb sent first)' if k == 0 else
+                '(SR.C will not be affected)' if k == 7 else
+                '(send bit%d)' % k)]
+        if k == 0:
+            it += [
+                I('mov', '#(__bit1s-%s)/2, w2' % dn, '(return here when __dostuff done)'),
+                I('and', '#0x3F, w5', '(bit-stuff checking)'),
+                I('bra', 'z, %s' % ds, '(w5[5-0] =000000, need a stuff-bit'),
+                L(s1, inline=True),
+                I('mov', '#DPDM, w0'),
+                I('btss', 'w3, #0', '(if next bit is 1, D-/D+ will not'),
+                I('mov', '#0x0000, w0', ' be switched)'),
+                I('rrc.b', 'w3, w3'),
+                I('rlc.b', 'w5, w5', '(w5[5-0] is for bit-stuff checking)'),
+                I('mov', '#(__bit2s-%s)/2, w2' % dn, '(return here when __dostuff done)'),
+                Pad('END', at=Lk + 1, why='__bit0_'),
+            ]
+        elif k < 7:
+            it += [
+                I('mov', '#DPDM, w0', ''),
+                I('and', '#0x3F, w5'),
+                I('bra', 'z, %s' % ds),
+                L(s1, inline=True),
+                I('btss', 'w3, #0'),
+                I('mov', '#0x0000, w0'),
+            ]
+            if k < 6:
+                it += [
+                    I('rrc.b', 'w3, w3'),
+                    I('rlc.b', 'w5, w5'),
+                    I('mov', '#(__bit%ds-%s)/2, w2' % (k + 2, dn),
+                      '(return here when __dostuff done)'),
+                    Pad('END', at=Lk + 1, why='__bit%d_' % k),
+                ]
+            else:
+                it += [
+                    I('rrc.b', 'w3, w3', '(shift last bit of w3 into w5.'),
+                    I('rlc.b', 'w5, w5', ' now w3 is empty. we can load next'),
+                    I('mov', '#(__bit0s-%s)/2, w2' % stuff_names(g, g.L[7])[1]),
+                    Pad('ld', at=Lk, why='__bit6_'),
+                    I('rrc.b', '[w6++], w3', ' byte into w3 and bit0 into SR.C)',
+                      tag='ld'),
+                ]
+        else:
+            it += [
+                I('mov', '#DPDM, w0', '(SR.C will not be affected)'),
+                I('and', '#0x3F, w5', '(SR.C will not be affected)'),
+                I('bra', 'z, %s' % ds, '(SR.C MUST NOT be affected when'),
+                L('__bit0s', inline=True),
+                I('btss', 'SR, #C', ' __dostuff is executed)'),
+                I('mov', '#0x0000, w0', '(SR.C will not be affected)'),
+                I('rlc.b', 'w5, w5', '(shift bit0 of next byte into w5)'),
+                Pad('nxt', at=Lk - 1, why='__bit7_'),
+                I('dec', 'w1, w1', '(are all bytes sent?)'),
+                I('bra', 'nz, __bit0_', "(+1 cycle if 'bra nz' is taken)", tag='nxt'),
+                I('and', 'w4, #0x0C, w0', '(get the HANDSHAKE to host)'),
+            ]
+        add(Block(1, it, length=Lk))
+    add(Block(1, [
+        L('__bytes', 'all bytes are sent completely'),
+        I('pop', '_LATU', '(generate first SE0 on the BUS)'),
+        I('dec2', '[--w15], w2', '(w2 -CRC, clac real bytes length)'),
+        I('sl', 'w2, #4, w2', '(w2[7-4] =real bytes length)'),
+        I('ior', 'w4, w2, w4', '(w4[1-0] =TOKEN TYPE)'),
+        I('cp.b', 'w0, #0x04', '(w0[3-2] =HANDSHAKE. is it a ACK?)'),
+        I('mov', 'w4, w0', '(w4[7-4] =real bytes length)'),
+        I('btsc', '_SR, #Z', "(not ACK, skip 'bset __uendpt0,#10)"),
+        I('bset', '__uendpt0, #10', '(set REQUEST flag)'),
+        I('btsc', '_SR, #Z', "(not ACK, skip 'ior.b __uendpt0')"),
+        I('ior.b', '__uendpt0', '(__uendpt0[7-0] has been cleared)'),
+        L('__nextSE0'),
+        I('mov', '#0xD800, w0', '(device address NOT matched now,'),
+        I('and', '__ucontr0, WREG', ' but keep the EP0 STALL FLAG)'),
+        I('ior', 'w0, #0xA, w1', '(NAK to OUT and IN)'),
+        I('btsc', 'w1, #11', '(STALL to OUT and IN instead if'),
+        I('ior', 'w1, #0xF, w1', ' the EP0 STALL FLAG is set)'),
+        I('btss', 'w4, #8', '(keep __ucontr0 if it was EPn)'),
+        I('mov', 'w1, __ucontr0'),
+        Pad('eop', at=2 * N - 1, why='__nextSE0'),
+        I('mov', '#DPDM, w0', '(the 2nd SE0 ends)'),
+        I('ior', '_TRISU', '(D-/D+ are on INPUT mode now)', tag='eop'),
+        I('mov', '#_token, w1', '(prepare to receive next TOKEN)'),
+        I('mov', 'w1, _packet'),
+        I('bra', '__CNIntEnd'),
+    ]))
+    # the stuff-bit is sent when the bit which calls __dostuff ends, so
+    # there is a __dostuff for each length of the bits
+    for Lv in sorted(set(g.L.values())):
+        ds, dn = stuff_names(g, Lv)
+        add(Block(6, [
+            L(ds, "{p} (+1 cycle for 'bra z, %s')" % ds),
+            Pad('stx', at=Lv + 1, cmt='(SR.C MUST NOT be affected)'),
+            I('bset', 'w5, #0', '(insert a 1 at w5.0, the stuff-bit)'),
+            I('mov', '#DPDM, w0', '(w0 is #DPDM, make J-K flipping)'),
+            I('xor', '_LATU', '(generate stuff-bit)', tag='stx'),
+            I('nop', ''),
+            I('bra', 'w2'),
+            L(dn, "branch to '%s + w2 * 2'" % dn),
+        ], length=Lv))
+
+    # ------------------------------------------------------------- IN token
+    add(Block(pid, [
+        L('__isIn'),
+        I('com.b', '[++w1], w0', '(device address byte, w0.7 =ENDP[0])'),
+    ] + endp_table(g, '__EndpointTableIn', '__isIn0', '__inEP%d')))
+    add(Block(pid + 9, [
+        L('__isIn0', "{p} (+1 cycle for the entry of the table)"),
+        I('cp.b', '_addr', '(device address MUST be matched)'),
+        I('bra', 'nz, __CNIntEnd', '(+1 cycle if address not matched)'),
+    ] + crc5 + [
+        I('clr', '_epsent', '(the next ACK is not for EPn)'),
+        I('mov', '__ucontr0, w0', '(check __ucontr0[1-0])'),
+        I('and', '#0x03, w0', '(w0[1-0] =PID sent to host)'),
+        I('sl', 'w0, #2, w4', '(w4[3-2] =PID on __uendpt0)'),
+        I('cp.b', 'w0, #0x01', '(is it ACK?)'),
+        I('bra', 'z, __respond', '(yes, send DATA packet to host)'),
+        Pad('hs', **hs_min),
+        I('mov', '#_token+1, w6', '(w6 points to the PID byte)'),
+        I('bra', '__HandShake', tag='hs'),
+    ]))
+    add(Block(pid + 18 + len(crc5), [
+        L('__respond', "{p} (+1 cycle for 'bra z, __respond')"),
+        I('ior.b', 'w4, #2, w4', '(w4[1-0] =TOKEN TYPE, =10, IN)'),
+        I('mov.b', '#0x03, w0', '(w0 =DATA0)'),
+        I('btss', '__ucontr0, #12', '(if __ucontr0[12]==0, then set'),
+        I('mov.b', '#0x0B, w0', ' w0 =1011, DATA1)'),
+        I('mov', '__ucontr0, w1', '(__ucontr0[7-4] =bytes length)'),
+        I('lsr', 'w1, #4, w1'),
+        I('and', 'w1, #0xF, w1', '(w1 =bytes length)'),
+        I('add', 'w1, #4, w1', '(+SYNC, +PID, +CRC16)'),
+        I('dec', 'w1, w2', "(w2 is for '__uendpt0[7-4]')"),
+        I('mov', '#_datay+1, w6', '(w6 points to the PID byte)'),
+        Pad('sb', label='__SendBytes', offset=-2,
+            after=('__SendBytes', 'resp')),
+        I('bra', '__SendBytes', tag='sb'),
+    ]))
+    for n in range(1, g.eps + 1):
+        add(Block(pid + 9, [
+            L('__inEP%d' % n, "{p} (+1 cycle for the entry of the table)"),
+            I('mov', '#__eptab+%d, w3' % (8 * (n - 1)), '(w3 points to EP%d)' % n),
+            I('bra', '__isInEP'),
+        ]))
+    # w4[8] =1 tells __nextSE0 to keep the handshakes of EP0, and w4[3-2]
+    # =00 keeps the DATA packet of the endpoint away from __uendpt0
+    add(Block(pid + 12, [
+        L('__isInEP', "{p} (+1 cycle for 'bra __isInEP')"),
+        I('and', '#0x7F, w0', '(discard ENDP[0])'),
+        I('cp.b', '_addr', '(device address MUST be matched)'),
+        I('bra', 'nz, __CNIntEnd', '(+1 cycle if address not matched)'),
+    ] + crc5 + [
+        I('mov', '[w3], w0', '(check IN word[1-0])'),
+        I('and', '#0x03, w0', '(w0[1-0] =PID sent to host)'),
+        I('sl', 'w0, #2, w4', '(w4[3-2] =NAK or STALL)'),
+        I('cp.b', 'w0, #0x01', '(is it ACK?)'),
+        I('bra', 'z, __respondEP', '(yes, send the DATA to host)'),
+        I('bset', 'w4, #8', '(w4[8] =1, not EP0)'),
+        Pad('hs', **hs_min),
+        I('mov', '#_token+1, w6', '(w6 points to the PID byte)'),
+        I('bra', '__HandShake', tag='hs'),
+    ]))
+    add(Block(pid + 21 + len(crc5), [
+        L('__respondEP', "{p} (+1 cycle for 'bra z, __respondEP')"),
+        I('mov', '#0x0100, w4', '(w4[8] =1, w4[3-0] =0000)'),
+        I('mov', 'w3, _epsent', '(the next ACK is for this endpoint)'),
+        I('mov.b', '#0x03, w0', '(w0 =DATA0)'),
+        I('btss', '[w3], #12', '(if IN word[12]==0, then set'),
+        I('mov.b', '#0x0B, w0', ' w0 =1011, DATA1)'),
+        I('mov', '[w3], w1', '(IN word[7-4] =bytes length)'),
+        I('lsr', 'w1, #4, w1'),
+        I('and', 'w1, #0xF, w1', '(w1 =bytes length)'),
+        I('add', 'w1, #4, w1', '(+SYNC, +PID, +CRC16)'),
+        I('dec', 'w1, w2'),
+        I('mov', '[w3+4], w6', '(w6 points to the IN buffer,'),
+        I('inc', 'w6, w6', ' then to the PID byte)'),
+        Pad('sb', label='__SendBytes', offset=-2,
+            after=('__SendBytes', 'resp')),
+        I('bra', '__SendBytes', tag='sb'),
+    ]))
+
+    # a packet is taken only if the endpoint is armed (ACK) and its toggle
+    # is the expected one. a packet with the other toggle was ACKed before but
+    # the host has missed the ACK, it's ACKed again and dropped. w4[3-2] =00
+    # sends an ACK without touching __uendpt0, w4[8] =1 keeps __ucontr0.
+    for d in (1, 0):
+        add(Block(pid + 3, [
+            L('__epData%d' % d, "{p} (+1 cycle for 'bra __epData%d')" % d),
+            I('mov', '_epout, w3', '(w3 points to the endpoint of the'),
+            I('cp0', 'w3', ' OUT token, or it is 0)'),
+            I('bra', 'z, __CNIntEnd', '(no, ignore it)'),
+        ] + crc16 + [
+            I('mov', '[w3+2], w0', '(w0 =OUT word of the endpoint)'),
+            I('sub', 'w2, w1, w6'),
+            I('sub', 'w6, #3, w6', '(w6 =bytes length, -PID -CRC16)'),
+            I('sl', 'w6, #4, w6'),
+            I('mov', '#0x060C, w5', '(set PACKET DONE, switch toggle,'),
+            I('xor', 'w0, w5, w5', ' ACK -> NAK)'),
+            I('ior', 'w5, w6, w5', '(w5 =OUT word if it is taken)'),
+            I('mov', '#0x040C, w6'),
+            I('and', 'w0, w6, w6', '(w6 =toggle and handshake)'),
+            I('mov', '#0x%04X, w4' % (0x0404 if d else 0x0004),
+              '(ACK and DATA%d expected?)' % d),
+            I('cp', 'w6, w4'),
+            I('btsc', '_SR, #Z', '(yes, take the packet)'),
+            I('mov', 'w5, [w3+2]'),
+            I('mov', '#0x0100, w4', '(w4[8] =1, not EP0)'),
+            I('and', 'w0, #0x0C, w6', '(send NAK or STALL if it is not'),
+            I('btsc', 'w0, #3', ' armed. w4[3-2] =00 means ACK)'),
+            I('ior', 'w4, w6, w4'),
+            I('clr', '_epout'),
+            Pad('hs', **hs_min),
+            I('mov', '#_token+1, w6', '(w6 points to the PID byte)'),
+            I('bra', '__HandShake', tag='hs'),
+        ]))
+
+    # ------------------------------------------------ handshake from host
+    ack1 = [
+        I('cp0', '_epsent', '(is it the ACK of a DATA on EPn?)'),
+        I('bra', 'nz, __isAckEP'),
+    ]
+    for name, body in (
+        ('__isStall', [I('nop', ''),
+                       I('mov', '#0x0700, w1', '(REQUEST FLAG & STALL from host)'),
+                       I('bra', '__hostHandShake', '(w1[9-8] =11, STALL. w1[10] =1, set',
+                         cont=' REQUEST flag)')]),
+        ('__isAck', [I('btg', '__ucontr0, #12', '(switch DATA TOGGLE)'),
+                     I('mov', '#0x0500, w1', '(REQUEST FLAG & ACK from host)'),
+                     I('bra', '__hostHandShake', '(w1[9-8] =01, ACK. w1[10] =1, set',
+                       cont=' REQUEST flag)')]),
+        ('__isNak', [I('nop', ''),
+                     I('bset', '__ucontr0, #0', '(set an ACK to next IN token, then'),
+                     I('bclr', '__ucontr0, #1', ' DATA packet will be resent)'),
+                     I('mov', '#0x0600, w1', '(REQUEST FLAG & NAK from host)')])):
+        add(Block(pid, [
+            L(name),
+        ] + (ack1 if name == '__isAck' else []) + [
+            I('mov', '#0x0007, w0'),
+            I('and', '__uendpt0, WREG', '(check __uendpt0[2-0])'),
+            I('cp', 'w0, #6', '(it must be 110, ACK & IN)'),
+            I('bra', 'nz, __CNIntEnd', '(no, this %s is not sent to us)'
+              % name[4:].upper()),
+        ] + body))
+    add(Block(None, [
+        L('__hostHandShake', 'the packet is over, no more timing'),
+        I('mov', '#0xF8FF, w0'),
+        I('and', '__uendpt0'),
+        I('mov', 'w1, w0'),
+        I('ior', '__uendpt0'),
+        I('bra', '__CNIntEnd'),
+    ]))
+    add(Block(None, [
+        L('__isAckEP', 'the host has got the DATA'),
+        I('mov', '_epsent, w1', 'w1 points to the endpoint', ann=False),
+        I('clr', '_epsent', ann=False),
+        I('mov', '#0x1003, w0', 'switch DATA TOGGLE', ann=False),
+        I('xor', 'w0, [w1], [w1]', 'IN word[1-0] =01 -> 10, NAK', ann=False),
+        I('bset', '[w1], #15', 'IN word[15] =1, the DATA is done', ann=False),
+    ]))
+    pops = ['        pop     w%d                      ;' % r
+            for r in ((9, 8, 7) if g.crc else ())]
+    add(Block(None, [Raw([
+        ';;-----------------------------------------------------------------------------',
+        '__CNIntEnd:                             ; %d cycles total' % (10 + len(pops)),
+    ] + pops + [
+        '        pop     w6                      ;',
+        '        pop     w5                      ;',
+        '        pop     w4                      ;',
+        '__IRQExit:                              ; 7 cycles total',
+        '        clr     TMR2                    ; the bus is alive, restart the',
+        '        bclr    _IFS1, #CNIF            ; SUSPEND timer of usb.c',
+        '        pop     RCOUNT                  ;',
+        '        pop.s                           ;',
+        '        retfie                          ;',
+    ])], sep=False))
+    return blocks
+
+
+# ----------------------------------------------------------------------------
+# timing
+# ----------------------------------------------------------------------------
+def cost(ins, prev):
+    """(cycles to the next instruction, has a fall through path). a taken
+    branch always arrives at its target 2 cycles later."""
+    if ins.is_bra():
+        cc, tgt = ins.target()
+        if cc is not None or (prev is not None and prev.is_skip()):
+            return 1, True
+        return 2, False
+    return 1, True
+
+
+def walk(g, blk):
+    """times of all items of a block. it returns (times, tags, end)."""
+    t = blk.entry
+    times, tags, prev, table = [], {}, None, None
+    for it in blk.items:
+        times.append(table if isinstance(it, Table) else t)
+        if isinstance(it, I):
+            if it.tag:
+                tags[it.tag] = t
+            if t is not None:
+                fall, alive = cost(it, prev)
+                if it.is_computed():
+                    table = t + 2       # the entries of a branch table
+                t = t + fall if alive else None
+            prev = it
+        elif isinstance(it, Pad):
+            if t is not None:
+                t += it.cycles
+        elif isinstance(it, Table):
+            prev = None
+            t = None
+    tags['END'] = t
+    return times, tags, t
+
+
+def resolve(g, blocks):
+    """settle all paddings. it raises GenError if a bit doesn't fit."""
+    for _ in range(20):
+        labels, offsets, changed = {}, {}, False
+        for b in blocks:
+            if b.entry is None:
+                continue
+            times, tags, _ = walk(g, b)
+            for it, t in zip(b.items, times):
+                if isinstance(it, L) and t is not None:
+                    labels[it.name] = g.phase(t, b.length)
+                    for k, v in tags.items():
+                        if v is not None:
+                            offsets[(it.name, k)] = v - t
+        for b in blocks:
+            if b.entry is None:
+                continue
+            for it in b.items:
+                if not isinstance(it, Pad):
+                    continue
+                times, tags, _ = walk(g, b)
+                now = tags.get(it.anchor)
+                if now is None:
+                    raise GenError('%s: padding anchor %s is not reachable'
+                                   % (it.why, it.anchor))
+                if it.at is not None:
+                    need = it.at - now
+                    if need < -it.tol:
+                        raise GenError(
+                            '%s needs %d more cycle(s) than the %d cycles of '
+                            'a bit' % (it.why, -need, g.N))
+                    need = max(need, 0)
+                else:
+                    length = b.length or g.N
+                    if it.label is not None:
+                        if it.label not in labels:
+                            continue
+                        ph = g.phase(labels[it.label] + it.offset, length)
+                    else:
+                        ph = it.phase
+                    need = (ph - g.phase(now, length)) % length
+                    if it.after is not None:
+                        lbl, tag = it.after[0], it.after[1]
+                        slack = it.after[2] if len(it.after) > 2 else 0
+                        off = offsets.get((lbl, tag))
+                        if off is None:
+                            continue
+                        # the first K of SYNC comes one bit after the
+                        # J-state output by '__Sending', it must be 2 bits
+                        # later than the SE0-to-J transition of EOP
+                        low = 3 * g.N - off - 2 + slack
+                        while now + need < low:
+                            need += g.N
+                if need != 0:
+                    it.cycles += need
+                    changed = True
+        if not changed:
+            return
+    raise GenError('the paddings don\'t settle')
+
+
+def check(g, blocks):
+    """all branches have to arrive at the cycle their targets expect."""
+    where = {}
+    for b in blocks:
+        if b.entry is None:
+            continue
+        times, _, _ = walk(g, b)
+        for it, t in zip(b.items, times):
+            if isinstance(it, L) and t is not None:
+                where[it.name] = g.show(t, b.length)
+    untimed = set(['__IRQExit', '__CNIntEnd', '__waitK', '__waitJ',
+                   '__firstK', '__SE0', '__BUSReset', '__keepAlive'])
+    back = {}                           # the cycle '__dostuff' returns at
+    for b in blocks:
+        if b.entry is None:
+            continue
+        times, _, _ = walk(g, b)
+        for i, (it, t) in enumerate(zip(b.items, times)):
+            if t is None or not isinstance(it, (I, Table)):
+                continue
+            arrive = g.show(t + 2, b.length)
+            if isinstance(it, Table):
+                for tgt, _ in it.entries:
+                    if tgt in untimed:
+                        continue
+                    if arrive != where[tgt]:
+                        raise GenError('%s starts at cycle %s, not %s' % (
+                            tgt, where[tgt], arrive))
+            elif it.is_computed() and it.ops == 'w2':
+                back[b.items[i + 1].name] = arrive
+            elif it.is_bra():
+                _, tgt = it.target()
+                if tgt in where and tgt not in untimed and arrive != where[tgt]:
+                    raise GenError('branch to %s arrives at cycle %s, %s '
+                                   'starts at cycle %s' % (
+                                       tgt, arrive, tgt, where[tgt]))
+    for b in blocks:
+        for it in b.items:
+            if isinstance(it, I) and it.mn == 'mov' and '-__done' in it.ops:
+                lbl, done = it.ops[2:].split(')')[0].split('-')
+                if where[lbl] != back[done]:
+                    raise GenError('%s returns at cycle %s, %s starts at '
+                                   'cycle %s' % (done, back[done], lbl,
+                                                 where[lbl]))
+    # falls through from one block into the next one
+    for a, b in zip(blocks, blocks[1:]):
+        if a.entry is None or b.entry is None:
+            continue
+        _, _, end = walk(g, a)
+        if end is not None and \
+                g.show(end, a.length) != g.show(b.entry, b.length):
+            raise GenError('falling into %s at cycle %s instead of %s' % (
+                b.items[0].name, g.show(end, a.length),
+                g.show(b.entry, b.length)))
+
+
+def turnaround(g, blocks):
+    """cycles from the SE0-to-J transition of EOP to the SYNC of each
+    response. the 2nd SE0 of EOP ends at cycle 2*N."""
+    where, blk, falls = {}, {}, {}
+    for a, b in zip(blocks, blocks[1:]):
+        if b.entry is not None and isinstance(b.items[0], L):
+            falls[id(a)] = b.items[0].name
+    for b in blocks:
+        if b.entry is None:
+            continue
+        times, tags, _ = walk(g, b)
+        for it, t in zip(b.items, times):
+            if isinstance(it, L):
+                where[it.name] = t
+                blk.setdefault(it.name, b)
+    res = {}
+    # the transmit loop is entered after the response has started
+    loop = ('__bit', '__unstuff', '__dostuff', '__done')
+
+    def follow(name, t0, path, depth=0):
+        b = blk[name]
+        times, tags, end = walk(g, b)
+        base = where[name]
+        for it, t in zip(b.items, times):
+            if t is None or t < base:
+                continue
+            if isinstance(it, I) and it.tag == 'resp':
+                res[' > '.join(path)] = t0 + (t - base) + g.N - 2 * g.N
+            tgts = []
+            if isinstance(it, Table):
+                tgts = sorted(set(e for e, _ in it.entries))
+            elif isinstance(it, I) and it.is_bra() and not it.is_computed():
+                tgts = [it.target()[1]]
+            for tgt in tgts:
+                if tgt in blk and not tgt.startswith(loop) and depth < 5:
+                    follow(tgt, t0 + (t - base) + 2, path + [tgt], depth + 1)
+        if end is not None and id(b) in falls and depth < 5:
+            nxt = falls[id(b)]
+            if not nxt.startswith(loop):
+                follow(nxt, t0 + (end - base), path + [nxt], depth + 1)
+
+    for start in ('__isIn', '__isData0', '__isData1'):
+        follow(start, where[start], [start])
+    return res
+
+
+# ----------------------------------------------------------------------------
+# output
+# ----------------------------------------------------------------------------
+SEP = ';;-----------------------------------------------------------------------------'
+
+
+def fmt(label, mn, ops, cmt):
+    head = (label + ':').ljust(8) if label else ' ' * 8
+    line = head + mn.ljust(8) + ops
+    if cmt is None:
+        return line.rstrip()
+    return line.ljust(39) + ' ; ' + cmt if len(line) >= 40 else \
+        line.ljust(40) + '; ' + cmt
+
+
+def fill(cmt, widths):
+    """split a long comment over lines the way sie.s does, the lines after
+    the first one start with a space. widths[i] is the room of line i."""
+    out = ['']
+    for w in cmt.split(' '):
+        room = widths[len(out) - 1] if len(out) <= len(widths) else 36
+        if out[-1].strip() and len(out[-1]) + 1 + len(w) > room:
+            out.append(' ')
+        out[-1] += (' ' if out[-1].strip() else '') + w
+    return out
+
+
+def cycles(g, t, n, length=None):
+    ph = [g.show(t + i, length) for i in range(n)]
+    return '/'.join(ph) if n < (length or g.N) else '%s..%s' % (ph[0], ph[-1])
+
+
+def pad_lines(g, t, n, cmt, ann=True, length=None):
+    """n cycles of nop. 'repeat' is used for long paddings."""
+    if n <= 0:
+        return []
+    if n <= 3:
+        rows = [('nop', '', g.phase(t + i, length), g.show(t + i, length))
+                for i in range(n)]
+    else:
+        rows = [('repeat', '#%d' % (n - 2), g.phase(t, length), g.show(t, length)),
+                ('nop', '', None, cycles(g, t + 1, n - 1, length))]
+    if not ann:
+        rows = [(mn, ops, None, '') for mn, ops, _, _ in rows]
+    text = fill(cmt, [37 - len(c) - (1 if c else 0) for _, _, _, c in rows]) \
+        if cmt else []
+    out = []
+    for i, (mn, ops, ph, c) in enumerate(rows):
+        if i < len(text):
+            c = (c + ' ' + text[i]) if c else text[i].strip()
+        out.append((ph, fmt('', mn, ops, c or None)))
+    for x in text[len(rows):]:
+        out.append((None, ' ' * 40 + '; ' + x))
+    return out
+
+
+def emit(g, blocks):
+    out = []
+    for b in blocks:
+        times, _, _ = walk(g, b)
+        if b.sep:
+            out.append(SEP)
+        first, held, prev = True, [], None
+
+        def show(t):
+            return g.show(t, b.length)
+        for it, t in zip(b.items, times):
+            timed = t is not None and b.entry is not None
+            if isinstance(it, Raw):
+                out.extend(it.lines)
+                continue
+            if isinstance(it, L):
+                held.append((it, t))
+                continue
+            if isinstance(it, C):
+                held_out(out, held, g, b.length)
+                held = []
+                out.append('        ; ' + it.text)
+                continue
+            lbl = None
+            if isinstance(it, Pad):
+                lines = pad_lines(g, t, it.cycles, it.cmt, it.ann, b.length)
+                if not lines:
+                    continue
+            elif isinstance(it, Table):
+                lines = [(None, (it.label + ':').ljust(40) + '; ' +
+                          show(t) + '/' + show(t + 1))]
+                for tgt, cmt in it.entries:
+                    lines.append((None, fmt('', 'bra', tgt, cmt)))
+            else:
+                ann = timed and it.ann
+                c = it.cmt or None
+                if ann:
+                    c = show(t)
+                    if it.is_computed():
+                        c += '/' + show(t + 1)
+                    c += (' ' + it.cmt) if it.cmt else ''
+                if held and held[-1][0].inline:
+                    lbl = held.pop()[0].name
+                lines = [(g.phase(t, b.length) if ann else None,
+                          fmt(lbl, it.mn, it.ops, c))]
+                # the 2nd cycle of an unconditional branch
+                if (ann and it.is_bra() and not it.is_computed() and
+                        it.target()[0] is None and
+                        not (prev is not None and prev.is_skip())):
+                    cont = it.cont or []
+                    if not isinstance(cont, list):
+                        cont = [cont]
+                    lines.append((None, ' ' * 40 + '; ' + show(t + 1) +
+                                  (' ' + cont[0] if cont else '')))
+                    for x in cont[1:]:
+                        lines.append((None, ' ' * 40 + '; ' + x))
+                prev = it
+            # a separator is put in front of the first cycle of a bit
+            if lines[0][0] == 1 and not first and out[-1] != SEP and lbl is None:
+                out.append(SEP)
+            held_out(out, held, g, b.length)
+            held = []
+            out.extend(l for _, l in lines)
+            first = False
+        held_out(out, held, g, b.length)
+    return out
+
+
+def held_out(out, held, g, length):
+    for lbl, t in held:
+        c = lbl.cmt
+        if '{p}' in c:
+            c = c.replace('{p}', g.show(t - 1, length) if t is not None else '')
+        out.append((lbl.name + ':').ljust(40) + '; ' + c if c else lbl.name + ':')
+
+
+# ----------------------------------------------------------------------------
+# clock settings
+# ----------------------------------------------------------------------------
+def pll(fcy, xtal=8.0):
+    """PLLPRE(N1), PLLDIV(M), PLLPOST(N2) of dsPIC33F for Fosc = 2*Fcy.
+    please refer to DS70186A-page-7-11."""
+    fosc = 2 * fcy
+    for n1 in range(2, 34):
+        fin = xtal / n1
+        if not 0.8 <= fin <= 8.0:
+            continue
+        for n2 in (2, 4, 8):
+            m = fosc * n2 / fin
+            if abs(m - round(m)) > 1e-9 or not 2 <= m <= 513:
+                continue
+            if 100.0 <= fin * m <= 200.0:
+                return n1, int(round(m)), n2
+    raise GenError('no PLL setting gives Fosc = %gMHz from a %gMHz crystal'
+                   % (fosc, xtal))
+
+
+def pll_frc(fcy, frc):
+    """PLLPRE(N1), PLLDIV(M), PLLPOST(N2) of dsPIC33F and the FRC they need
+    for Fosc = 2*Fcy, the nearest to the nominal FRC. OSCTUN moves it."""
+    fosc, best = 2 * fcy, None
+    for n1 in range(2, 34):
+        for n2 in (2, 4, 8):
+            for m in range(2, 514):
+                f = fosc * n1 * n2 / m
+                fin = f / n1
+                if not 0.8 <= fin <= 8.0 or not 100.0 <= fin * m <= 200.0:
+                    continue
+                if best is None or abs(f - frc) < abs(best[3] - frc):
+                    best = (n1, m, n2, f)
+    if best is None:
+        raise GenError('no PLL setting gives Fosc = %gMHz from the FRC' % fosc)
+    return best
+
+
+def clock(tg, fcy, frc):
+    """the lines setting the PLL, CLKDIV and OSCTUN, the NOSC line and the
+    note of the report. the lines of the PIC24F with a crystal are commented
+    out, it runs from the crystal of the configuration bits."""
+    lines = ['        ; initialize PLL, Fpllout = %gMHz, Fcy = %gMHz'
+             % (2 * fcy, fcy)]
+    note = None
+    if frc:
+        nominal, step = tg['frc']
+        if tg['pll']:
+            n1, m, n2, f = pll_frc(fcy, nominal)
+            post = {2: 0, 4: 1, 8: 3}[n2]
+            lines += [
+                fmt('', 'mov', '#%d, w0' % (m - 2),
+                    'PLLDIV=%d for %.4gMHz FRC' % (m, f)),
+                fmt('', 'mov', 'w0, PLLFBD',
+                    'please refer to DS70186A-page-7-12'),
+                fmt('', 'mov', '#0x%02X, w0' % ((post << 6) | (n1 - 2)),
+                    'PLLPRE=%d, PLLPOST=%d' % (n1, n2)),
+                fmt('', 'mov', 'w0, CLKDIV',
+                    'please refer to DS70186A-page-7-11'),
+            ]
+        else:
+            f = fcy / 2.0
+            lines = ['        ; initialize FRCPLL, Fosc = 4*FRC = %gMHz, '
+                     'Fcy = %gMHz' % (2 * fcy, fcy),
+                     fmt('', 'mov', '#0, w0', 'RCDIV=1:1, no DOZE'),
+                     fmt('', 'mov', 'w0, CLKDIV', None)]
+        tun = int(round((f / nominal - 1) * 100 / step))
+        if not -32 <= tun <= 31:
+            raise GenError('OSCTUN can\'t move the FRC from %gMHz to %.4gMHz'
+                           % (nominal, f))
+        lines += [
+            '        ; tune the FRC from %gMHz, usb.c trims it by the '
+            'keep-alives' % nominal,
+            fmt('', 'mov', '#0x%02X, w0' % (tun & 0x3F),
+                'TUN=%d, about %+.2f%%' % (tun, tun * step)),
+            fmt('', 'mov', 'w0, OSCTUN', None),
+        ]
+        note = '  FRC tuned from %gMHz to %.4gMHz (TUN=%d) and trimmed by ' \
+               'usb.c' % (nominal, f, tun)
+        nosc = 1
+    else:
+        n1, m, n2 = pll(fcy) if tg['pll'] else pll(15)
+        post = {2: 0, 4: 1, 8: 3}[n2]
+        lines += [
+            fmt('', 'mov', '#%d, w0' % (m - 2),
+                'PLLDIV=%d for 8MHz crystal' % m),
+            fmt('', 'mov', 'w0, PLLFBD', 'please refer to DS70186A-page-7-12'),
+            fmt('', 'mov', '#0x%02X, w0' % ((post << 6) | (n1 - 2)),
+                'PLLPRE=%d, PLLPOST=%d' % (n1, n2)),
+            fmt('', 'mov', 'w0, CLKDIV', 'please refer to DS70186A-page-7-11'),
+        ]
+        nosc = 3
+    return lines, fmt('', 'mov', '#%d, w2' % nosc,
+                      'set OSCCON<NOSC> to {0:03b}'.format(nosc)), note
+
+
+def generate(target, fcy, crc=False, eps=1, template=TEMPLATE, frc=False):
+    tg = TARGETS[target]
+    if fcy > tg['maxfcy']:
+        raise GenError('%s runs at %d MIPS at most' % (tg['name'], tg['maxfcy']))
+    if not 1 <= eps <= 15:
+        raise GenError('a device has EP1..EP15 besides EP0')
+    g = Grid(fcy, crc, eps)
+    blocks = isr(g)
+    resolve(g, blocks)
+    check(g, blocks)
+    tat = turnaround(g, blocks)
+    for path, t in tat.items():
+        if not 2 * g.N <= t <= 7.5 * g.N:
+            raise GenError('%s responds %.1f bits after EOP' % (path, t / g.N))
+    lo, hi = g.drift()
+    if max(-lo, hi) > g.N / 4.0:
+        raise GenError('the samples drift %.1f cycles away from the middle '
+                       'of the bits' % max(-lo, hi))
+    if frc and max(tg['frc'][1] / 2, TRIM_DEADBAND) > g.tolerance() * 100:
+        raise GenError('the samples stand %.3f%% of clock error at %g MIPS, '
+                       'the FRC trimmed by %.3g%% steps is too coarse'
+                       % (g.tolerance() * 100, fcy, tg['frc'][1]))
+    pll_lines, nosc_line, note = clock(tg, fcy, frc)
+    sub = {
+        'TARGET': tg['name'],
+        'FCY': '%g' % fcy,
+        'FOSC': '%g' % (2 * fcy),
+        'CPB': '%.4g' % g.n,
+        'ADREF': tg['adref'],
+        'EPS': '%d' % eps,
+    }
+    text = open(template).read()
+    lines = []
+    oscillator = False
+    for line in text.split('\n'):
+        if line == '@DEVICE@':
+            lines.extend(tg['device'])
+            continue
+        if line == '@ISR@':
+            lines.extend(emit(g, blocks))
+            continue
+        if line == '@CLOCK_BEGIN@':
+            oscillator = True
+            continue
+        if line == '@CLOCK_END@':
+            oscillator = False
+            continue
+        if line == '@PLL_LINES@':
+            block = pll_lines
+        elif line == '@NOSC_LINE@':
+            block = [nosc_line]
+        else:
+            for k, v in sub.items():
+                line = line.replace('@%s@' % k, v)
+            block = [line]
+        for line in block:
+            if oscillator and not tg['pll'] and not frc and \
+                    line.startswith('        ') and \
+                    not line.strip().startswith(';'):
+                line = '        ;' + line[8:]
+            lines.append(line)
+    report = ['%s @ %g MIPS: %.4g cycles per bit, D-/D+ sampled at cycle %d'
+              % (tg['name'], fcy, g.n, g.S)]
+    if g.fractional:
+        report.append('  bit0..bit7 take %s cycles, %d cycles per byte '
+                      '(%+.2f%% of 1.5Mbit/s)' % (
+                          '/'.join(str(g.L[k]) for k in range(8)), g.byte(),
+                          (8 * g.n / g.byte() - 1) * 100))
+        report.append('  samples drift %+.1f..%+.1f cycles in a packet of 11 '
+                      'bytes' % (lo, hi))
+    if crc:
+        report.append('  CRC16 and CRC5 are checked before the handshake')
+    if note:
+        report.append(note)
+    report.append('  EP1 is in __eptab besides EP0' if eps == 1 else
+                  '  EP1..EP%d are in __eptab besides EP0' % eps)
+    for path, t in sorted(tat.items()):
+        report.append('  %-40s responds %.1f bits after EOP' % (path, t / g.N))
+    return '\n'.join(lines), report
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description='generate sie.s for a clock')
+    ap.add_argument('--target', choices=sorted(TARGETS), required=True)
+    ap.add_argument('--fcy', type=float, required=True,
+                    help='instruction clock in MIPS, e.g. 15')
+    ap.add_argument('--crc', action='store_true',
+                    help='check CRC16/CRC5 while receiving, it takes 8 '
+                         'cycles of each bit')
+    ap.add_argument('--endpoints', type=int, default=1,
+                    help='the endpoints besides EP0, EP1..EPn, each of them '
+                         'takes 32 bytes of RAM')
+    ap.add_argument('--frc', action='store_true',
+                    help='run from the internal FRC instead of a crystal, '
+                         'usb.c trims OSCTUN by the keep-alives')
+    ap.add_argument('--template', default=TEMPLATE)
+    ap.add_argument('-o', '--output', default='sie.s')
+    args = ap.parse_args(argv)
+    try:
+        text, report = generate(args.target, args.fcy, args.crc,
+                                args.endpoints, args.template, args.frc)
+    except GenError as e:
+        sys.stderr.write('siegen: %s\n' % e)
+        return 1
+    with open(args.output, 'w', newline='\n') as f:
+        f.write(text)
+    for r in report:
+        sys.stderr.write(r + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+# ----------------------------------------------------------------------------
+# Copyright (C) 2019-2020 Zach Lee.
+#
+# Licensed under the MIT License, you may not use this file except in
+# compliance with the License.
+#
+# MIT License:
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+#
+# ----------------------------------------------------------------------------
+#
+# Project:      Yet Another Firmware Based USB on Microchip dsPIC33
+# Title:        trimsim.py Simulates the FRC trimming of usb.c.
+#
+# sie.s built with 'siegen.py --frc' runs from the internal FRC, and
+# USB_vTrimTask() of usb.c moves OSCTUN by the length of 8 keep-alive frames
+# measured with Timer3. This script runs the same steps against FRCs which
+# are off by up to the +-2% of the datasheets, drift with the temperature,
+# have a larger or smaller OSCTUN step and miss a keep-alive now and then.
+# Every vector must bring the clock within the error which keeps the samples
+# of an 11 byte packet inside the margin siegen.py asks for, and keep it
+# there.
+#
+# usage: trimsim.py --target dsPIC33 --fcy 15
+#
+# ----------------------------------------------------------------------------
+import argparse
+import random
+import sys
+
+import siegen
+
+# as usb.c
+TRIM_FRAMES = 8
+
+
+class Device(object):
+    """the FRC, the PLL and Timer3 at Fcy/8 of the device."""
+    def __init__(self, tg, fcy, offset, drift, step):
+        nominal, self.step = tg['frc']
+        if tg['pll']:
+            n1, m, n2, f = siegen.pll_frc(fcy, nominal)
+            self.mul = m / float(n1 * n2) / 2
+        else:
+            f, self.mul = fcy / 2.0, 2.0
+        self.nominal, self.offset, self.drift = nominal, offset, drift
+        self.real_step = step if step else self.step
+        # the TUN siegen.py writes in __user_init
+        t = int(round((f / nominal - 1) * 100 / self.step))
+        self.tun = t & 0x3F
+        self.cycles = 0.0
+
+    def fcy(self, t):
+        """the instruction clock in MHz at t seconds."""
+        tun = self.tun - 64 if self.tun & 0x20 else self.tun
+        frc = self.nominal * (1 + self.offset + self.drift * t) * \
+            (1 + tun * self.real_step / 100.0)
+        return frc * self.mul
+
+    def run(self, t, dt):
+        self.cycles += self.fcy(t) * 1e6 * dt
+
+    def timer3(self, jitter):
+        return int((self.cycles + jitter) / 8) & 0xFFFF
+
+
+def trim(dev, state, frame, time, fcy):
+    """USB_vTrimTask() of usb.c, 'state' is [TrimFrame, TrimTime]."""
+    ticks0 = int(fcy * 1e6 / 8 / 1000 * TRIM_FRAMES)
+    deadband, limit = ticks0 // 500, ticks0 // 16
+    n = (frame - state[0]) & 0xFFFF
+    if n < TRIM_FRAMES:
+        return
+    if n == TRIM_FRAMES:
+        ticks = (time - state[1]) & 0xFFFF
+        tun = dev.tun
+        if ticks0 + deadband < ticks < ticks0 + limit and tun != 0x20:
+            dev.tun = (tun - 1) & 0x3F
+        elif ticks0 - limit < ticks < ticks0 - deadband and tun != 0x1F:
+            dev.tun = (tun + 1) & 0x3F
+    state[0], state[1] = frame, time
+
+
+def simulate(tg, fcy, offset, drift, step, host, miss, seconds, seed):
+    """returns the ms it takes to get within the budget and the worst error
+    after that, None if it never gets there."""
+    rnd = random.Random(seed)
+    dev = Device(tg, fcy, offset, drift, step)
+    limit = siegen.Grid(fcy).tolerance()
+    frame, time = 0, dev.timer3(0)
+    state = [frame, time]
+    settled, worst = None, 0.0
+    period = 1e-3 * (1 + host)
+    for k in range(int(seconds * 1000)):
+        t = k * period
+        dev.run(t, period)
+        if rnd.random() >= miss:
+            # the ISR takes Timer3 a few cycles late at each keep-alive
+            frame = (frame + 1) & 0xFFFF
+            time = dev.timer3(rnd.uniform(0, 4))
+        trim(dev, state, frame, time, fcy)
+        # the bits of the host are as long as its frames
+        err = abs(dev.fcy(t) * (1 + host) / fcy - 1)
+        if settled is None:
+            if err <= limit:
+                settled = k
+        else:
+            worst = max(worst, err)
+    return settled, worst, limit
+
+
+VECTORS = [
+    # offset, drift per s, OSCTUN step (None: the nominal one), host error
+    (-0.02, 0.0, None, 0.0),
+    (-0.01, 0.0, None, 0.0),
+    (0.0, 0.0, None, 0.0),
+    (+0.01, 0.0, None, 0.0),
+    (+0.02, 0.0, None, 0.0),
+    (+0.02, -0.002, None, +500e-6),     # 2% in 10s, faster than any
+    (-0.02, +0.002, None, -500e-6),     # change of the temperature
+    (+0.015, 0.0, 0.3, 0.0),
+    (-0.015, 0.0, 0.45, 0.0),
+]
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description='simulate the FRC trimming')
+    ap.add_argument('--target', choices=sorted(siegen.TARGETS), required=True)
+    ap.add_argument('--fcy', type=float, required=True,
+                    help='instruction clock in MIPS, e.g. 15')
+    ap.add_argument('--seconds', type=float, default=10.0)
+    ap.add_argument('--miss', type=float, default=0.01,
+                    help='the part of the keep-alives the ISR misses')
+    args = ap.parse_args(argv)
+    tg = siegen.TARGETS[args.target]
+    g = siegen.Grid(args.fcy)
+    if max(tg['frc'][1] / 2, siegen.TRIM_DEADBAND) > g.tolerance() * 100:
+        print('%s @ %g MIPS: the samples stand %.3f%%, siegen.py --frc '
+              'refuses it' % (tg['name'], args.fcy, g.tolerance() * 100))
+        return 1
+    fails = 0
+    print('%s @ %g MIPS from the FRC, %d frames a measure' %
+          (tg['name'], args.fcy, TRIM_FRAMES))
+    for i, (offset, drift, step, host) in enumerate(VECTORS):
+        settled, worst, limit = simulate(tg, args.fcy, offset, drift, step,
+                                         host, args.miss, args.seconds, i)
+        ok = settled is not None and worst <= limit
+        fails += not ok
+        print('  FRC %+5.1f%% %+5.2f%%/s step %.3g%% host %+4dppm: %s' % (
+            offset * 100, drift * 100, step or tg['frc'][1], int(round(host * 1e6)),
+            'settled in %dms, then within %.3f%% (%.3f%% allowed)'
+            % (settled, worst * 100, limit * 100) if ok else
+            'FAILED, %.3f%% allowed' % (limit * 100)))
+    return 1 if fails else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())